@@ -851,7 +851,7 @@ void alert_tracker::raise_alert_endpoint(std::shared_ptr<kis_net_beast_httpd_con
 void alert_tracker::alert_dt_endpoint(std::shared_ptr<kis_net_beast_httpd_connection> con) {
     std::ostream os(&con->response_stream());
 
-    auto summary_vec = std::vector<SharedElementSummary>{};
+    auto summary_vec = summary_plan{std::make_shared<std::vector<SharedElementSummary>>()};
     auto rename_map = std::make_shared<tracker_element_serializer::rename_map>();
 
     auto search_term = std::string{};
@@ -875,17 +875,7 @@ void alert_tracker::alert_dt_endpoint(std::shared_ptr<kis_net_beast_httpd_connec
     try {
         auto fields = con->json().get("fields", Json::Value(Json::arrayValue));
 
-        for (const auto& i : fields) {
-            if (i.isString()) {
-                summary_vec.push_back(std::make_shared<tracker_element_summary>(i.asString()));
-            } else if (i.isArray()) {
-                if (i.size() != 2)
-                    throw std::runtime_error("Invalid field map, expected [field, rename]");
-
-                summary_vec.push_back(std::make_shared<tracker_element_summary>(i[0].asString(),
-                            i[1].asString()));
-            }
-        }
+        summary_vec = Globalreg::globalreg->entrytracker->get_summary_plan(fields);
     } catch (const std::exception& e) {
         con->set_status(400);
         fmt::print(os, "Invalid request: {}\n", e.what());
@@ -919,7 +909,7 @@ void alert_tracker::alert_dt_endpoint(std::shared_ptr<kis_net_beast_httpd_connec
                 search_term = search_k->second;
 
             if (search_term.length() != 0)
-                for (const auto& svi : summary_vec)
+                for (const auto& svi : *summary_vec)
                     search_paths.push_back(svi->resolved_path);
 
             auto order_k = con->http_variables().find("order[0][column]");
@@ -1034,7 +1024,7 @@ void alert_tracker::alert_dt_endpoint(std::shared_ptr<kis_net_beast_httpd_connec
 
     // Summarize into the output element
     for (auto i = si; i != ei; ++i) {
-        output_alerts_elem->push_back(summarize_tracker_element(*i, summary_vec, rename_map));
+        output_alerts_elem->push_back(summarize_tracker_element(*i, *summary_vec, rename_map));
     }
 
     // If the transmit wasn't assigned to a wrapper...
@@ -30,6 +30,10 @@ template<> void boost_like::hash_combine(xx_hash_cpp& hash, const std::string& v
     hash.update(val.data(), val.length());
 }
 
+template<> void boost_like::hash_combine(xx_hash_cpp& hash, const std::string_view& val) {
+    hash.update(val.data(), val.length());
+}
+
 template<> void boost_like::hash_combine(xx_hash_cpp& hash, const uint8_t& val) {
     hash.update(&val, sizeof(uint8_t));
 }
@@ -25,6 +25,7 @@
 #include "config.h"
 
 #include <string>
+#include <string_view>
 #include <stdint.h>
 
 #include "xxhash_cpp.h"
@@ -34,6 +35,7 @@ namespace boost_like {
 template<typename T> void hash_combine(xx_hash_cpp& hash, const T& val);
 
 template<> void hash_combine(xx_hash_cpp& hash, const std::string& val);
+template<> void hash_combine(xx_hash_cpp& hash, const std::string_view& val);
 template<> void hash_combine(xx_hash_cpp& hash, const uint8_t& val);
 template<> void hash_combine(xx_hash_cpp& hash, const int8_t& val);
 template<> void hash_combine(xx_hash_cpp& hash, const uint16_t& val);
@@ -25,6 +25,9 @@
 #include <list>
 #include <map>
 #include <vector>
+#include <unordered_set>
+#include <thread>
+#include <tuple>
 
 #include "kismet_algorithm.h"
 
@@ -49,6 +52,7 @@
 #include "packet.h"
 #include "packetchain.h"
 #include "pcapng_stream_futurebuf.h"
+#include "trackedelement_storage.h"
 #include "util.h"
 #include "zstr.hpp"
 
@@ -56,19 +60,27 @@ int Devicetracker_packethook_commontracker(CHAINCALL_PARMS) {
 	return ((device_tracker *) auxdata)->common_tracker(in_pack);
 }
 
+// Sort based on internal kismet ID
+bool devicetracker_sort_internal_id(const std::shared_ptr<tracker_element>& a,
+	const std::shared_ptr<tracker_element>& b) {
+	return static_cast<kis_tracked_device_base *>(a.get())->get_kis_internal_id() <
+        static_cast<kis_tracked_device_base *>(b.get())->get_kis_internal_id();
+}
+
 device_tracker::device_tracker() :
     lifetime_global(),
     kis_database(Globalreg::globalreg, "devicetracker"),
-    deferred_startup() {
+    deferred_startup(),
+    update_gate_waiting{0},
+    devicelist_mutex{this} {
 
     phy_mutex.set_name("device_tracker::phy_mutex");
     devicelist_mutex.set_name("devicetracker::devicelist");
+    update_gate.set_name("devicetracker::update_gate");
+    device_update_mutex.set_name("devicetracker::device_update");
 
     next_phy_id = 0;
 
-    // create a vector
-    immutable_tracked_vec = std::make_shared<tracker_element_vector>();
-
     entrytracker =
         Globalreg::fetch_mandatory_global_as<entry_tracker>();
 
@@ -171,7 +183,7 @@ device_tracker::device_tracker() :
             for (const auto& e : in_packet->process_complete_events)
                 eventbus->publish(e);
             return 1;
-        }, CHAINPOS_TRACKER, 0x7FFF'FFFF);
+        }, CHAINPOS_TRACKER, 0x7FFF'FFFF, "device_tracker::tracking_done");
 
     if (!globalreg->kismet_config->fetch_opt_bool("track_device_rrds", true)) {
         _MSG("Not tracking historical packet data to save RAM", MSGFLAG_INFO);
@@ -244,12 +256,31 @@ device_tracker::device_tracker() :
 
     last_database_logged = 0;
 
-    // Preload the vector for speed
+    // Split the device store into a power-of-two number of shards
+    unsigned int num_shards =
+        globalreg->kismet_config->fetch_opt_uint("tracker_device_shards", 16);
+
+    if (num_shards < 1)
+        num_shards = 1;
+    if (num_shards > 256)
+        num_shards = 256;
+
+    device_shard_bits = 0;
+    while ((1U << device_shard_bits) < num_shards)
+        device_shard_bits++;
+
+    num_tracked_devices = 0;
+    next_device_id = 1;
+
+    // Preload the vectors for speed
     unsigned int preload_sz = 
         globalreg->kismet_config->fetch_opt_uint("tracker_device_presize", 1000);
 
-    tracked_vec.reserve(preload_sz);
-    immutable_tracked_vec->reserve(preload_sz);
+    for (unsigned int i = 0; i < (1U << device_shard_bits); i++) {
+        auto shard = std::unique_ptr<device_shard>(new device_shard());
+        shard->vec.reserve(preload_sz >> device_shard_bits);
+        device_shards.push_back(std::move(shard));
+    }
 
     // Set up the device timeout
     device_idle_expiration =
@@ -268,6 +299,9 @@ device_tracker::device_tracker() :
 
         _MSG(ss.str(), MSGFLAG_INFO);
 
+        // Bucket devices by idle time in minute slots, matching the reaping timer
+        idle_wheel.configure(60, device_idle_expiration, time(0));
+
 		// Schedule device idle reaping every minute
         device_idle_timer =
             timetracker->register_timer(std::chrono::seconds(60), 1,
@@ -286,6 +320,11 @@ device_tracker::device_tracker() :
         _MSG_INFO("Limiting maximum number of devices to {}, older devices will be "
                 "removed from tracking when this limit is reached.", max_num_devices);
 
+        auto hysteresis = 
+            std::min(globalreg->kismet_config->fetch_opt_uint("tracker_max_devices_hysteresis", 5), 
+                    (unsigned int) 50);
+        max_devices_slack = (uint64_t) max_num_devices * hysteresis / 100;
+
 		// Schedule max device reaping every 5 seconds
 		max_devices_timer =
 			timetracker->register_timer(SERVER_TIMESLICES_SEC * 5, NULL, 1, 
@@ -295,8 +334,98 @@ device_tracker::device_tracker() :
                 });
 	} else {
 		max_devices_timer = -1;
+        max_devices_slack = 0;
 	}
 
+    num_hibernated_devices = 0;
+
+    device_hibernate_time =
+        globalreg->kismet_config->fetch_opt_int("tracker_device_hibernate", 0);
+
+    if (device_hibernate_time > 0) {
+        _MSG_INFO("Moving tracked devices which have been inactive for more than {} seconds "
+                "to the database until they are seen again.", device_hibernate_time);
+
+        hibernate_wheel.configure(60, device_hibernate_time, time(0));
+
+        device_hibernate_timer =
+            timetracker->register_timer(std::chrono::seconds(60), 1,
+                [this](int eventid) -> int {
+                    timetracker_event(eventid);
+                    return 1;
+                });
+    } else {
+        device_hibernate_time = 0;
+        device_hibernate_timer = -1;
+    }
+
+    device_snapshot_writing = false;
+    device_snapshot_enabled =
+        globalreg->kismet_config->fetch_opt_bool("tracker_snapshot", false);
+
+    if (device_snapshot_enabled) {
+        auto snapshot_path = globalreg->kismet_config->fetch_opt("tracker_snapshot_file");
+
+        if (snapshot_path.length() == 0)
+            snapshot_path = globalreg->kismet_config->fetch_opt("configdir") + "/kismet_devices.snapshot";
+
+        device_snapshot_file =
+            globalreg->kismet_config->expand_log_path(snapshot_path, "", "", 0, 1);
+
+        auto snapshot_interval =
+            globalreg->kismet_config->fetch_opt_uint("tracker_snapshot_interval", 300);
+
+        _MSG_INFO("Saving a snapshot of tracked devices to {} every {} seconds and at "
+                "shutdown, and restoring it at startup.", device_snapshot_file, snapshot_interval);
+
+        if (snapshot_interval > 0) {
+            device_snapshot_timer =
+                timetracker->register_timer(std::chrono::seconds(snapshot_interval), 1,
+                    [this](int) -> int {
+                        write_device_snapshot();
+                        return 1;
+                    });
+        } else {
+            device_snapshot_timer = -1;
+        }
+    } else {
+        device_snapshot_timer = -1;
+    }
+
+    // Fields views are allowed to keep ordered indexes on; an index is only built the
+    // first time a view is sorted by that field, and is re-keyed as devices change.
+    // Short names map to the common device fields, anything else is a field path
+    for (const auto& f : str_tokenize(globalreg->kismet_config->fetch_opt_dfl("tracker_view_sort_index",
+                    "last_time,signal,packets,channel"), ",")) {
+        if (f == "last_time")
+            view_sort_index_fields.push_back("kismet.device.base.last_time");
+        else if (f == "signal")
+            view_sort_index_fields.push_back("kismet.device.base.signal/kismet.common.signal.last_signal");
+        else if (f == "packets")
+            view_sort_index_fields.push_back("kismet.device.base.packets.total");
+        else if (f == "channel")
+            view_sort_index_fields.push_back("kismet.device.base.channel");
+        else if (f.length() != 0)
+            view_sort_index_fields.push_back(f);
+    }
+
+    // Read-only device searches (regex, string match) can be split over a pool; the
+    // thread making the request works alongside it, so the pool is one smaller
+    unsigned int worker_threads =
+        globalreg->kismet_config->fetch_opt_uint("tracker_worker_threads", 
+                std::thread::hardware_concurrency());
+
+    if (worker_threads > 64)
+        worker_threads = 64;
+
+    if (worker_threads > 1)
+        worker_pool = std::unique_ptr<device_tracker_worker_pool>(new device_tracker_worker_pool(worker_threads - 1));
+
+    // Distinct recently changed devices the monitor feed can replay before a lagging
+    // subscriber has to fall back to a full scan
+    change_log.configure(
+            globalreg->kismet_config->fetch_opt_uint("tracker_device_changelog", 65536));
+
     full_refresh_time = time(0);
 
     track_persource_history =
@@ -328,12 +457,14 @@ device_tracker::device_tracker() :
                     return multikey_endp_handler(con, true);
                 }, get_devicelist_mutex()));
 
-    httpd->register_route("/devices/all_devices", {"GET", "POST"}, httpd->RO_ROLE, {"ekjson", "itjson"},
+    httpd->register_route("/devices/all_devices", {"GET", "POST"}, httpd->RO_ROLE, {"ekjson", "itjson",
+            "msgpack", "msgpackid"},
             std::make_shared<kis_net_web_tracked_endpoint>(
                 [this](shared_con con) -> std::shared_ptr<tracker_element> {
-                    auto device_ro = std::make_shared<tracker_element_vector>();
-                    device_ro->set(immutable_tracked_vec->begin(), immutable_tracked_vec->end());
-                    return device_ro;
+                    // Shards aren't in any useful order; list devices as they were created
+                    auto devs = fetch_all_devices();
+                    std::sort(devs->begin(), devs->end(), devicetracker_sort_internal_id);
+                    return devs;
                 }, get_devicelist_mutex()));
 
     httpd->register_route("/devices/by-key/:key/device", {"GET", "POST"}, httpd->RO_ROLE, {},
@@ -364,9 +495,8 @@ device_tracker::device_tracker() :
 
                     auto devvec = std::make_shared<tracker_element_vector>();
 
-                    const auto mmp = tracked_mac_multimap.equal_range(mac);
-                    for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi)
-                        devvec->push_back(mmpi->second);
+                    for (const auto& d : fetch_devices(mac))
+                        devvec->push_back(d);
 
                     return devvec;
                 }, get_devicelist_mutex()));
@@ -656,6 +786,11 @@ device_tracker::device_tracker() :
 
                                 if (!json["format"].isNull())
                                     format_t = json["format"].asString();
+
+                                auto serializer = entrytracker->get_stream_serializer(format_t);
+
+                                if (serializer == nullptr)
+                                    throw std::runtime_error("unknown format");
                                     
                                 auto dev_r = json["monitor"].asString();
                                 auto dev_k = device_key(json["monitor"].asString());
@@ -673,50 +808,62 @@ device_tracker::device_tracker() :
 
                                 auto rename_map = std::make_shared<tracker_element_serializer::rename_map>();
 
-                                time_t last_tm = 0;
+                                // Per-request position in the change log, and the time of the
+                                // last pass for the full-scan fallback; these outlive this handler
+                                auto cursor = std::make_shared<uint64_t>(0);
+                                auto last_tm = std::make_shared<time_t>(0);
 
                                 // Generate a timer event that goes and looks for the devices and
                                 // serializes them with the fields record
                                 auto tid = 
                                     timetracker->register_timer(std::chrono::seconds(rate), true,
-                                            [this, con, dev_r, dev_k, dev_m, json, ws, &last_tm, rename_map, format_t](int) -> int {
+                                            [this, con, dev_r, dev_k, dev_m, json, ws, cursor, last_tm, rename_map, serializer](int) -> int {
+                                                std::stringstream ss;
+
+                                                auto write_dev = [&](const std::shared_ptr<kis_tracked_device_base>& dev) {
+                                                    ss.str("");
+                                                    ss.clear();
+                                                    entrytracker->serialize_with_json_summary(serializer, ss, dev, json);
+                                                    ws->write(ss.str(), !serializer->is_binary());
+                                                };
+
                                                 if (dev_r == "*") {
-                                                    auto worker = device_tracker_view_function_worker([json, last_tm, format_t, this, ws](std::shared_ptr<kis_tracked_device_base> dev) -> bool {
-                                                        if (dev->get_mod_time() > last_tm) {
-                                                            std::stringstream ss;
-                                                            entrytracker->serialize_with_json_summary(format_t, ss, dev, json);
-                                                            ws->write(ss.str(), true);
-                                                        }
+                                                    kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "ws monitor timer serialize lambda");
 
-                                                        return false;
-                                                    });
+                                                    // Only look at what changed since the last pass, unless this
+                                                    // is the first pass or we fell behind the change log
+                                                    std::vector<std::shared_ptr<kis_tracked_device_base>> changed;
 
-                                                    do_device_work(worker);
+                                                    if (change_log.since(*cursor, changed)) {
+                                                        for (const auto& d : changed)
+                                                            write_dev(d);
+                                                    } else {
+                                                        *cursor = change_log.head();
+
+                                                        for (const auto& d : *fetch_all_devices()) {
+                                                            auto dev = std::static_pointer_cast<kis_tracked_device_base>(d);
+                                                            if (dev->get_mod_time() > *last_tm)
+                                                                write_dev(dev);
+                                                        }
+                                                    }
                                                 } else if (!dev_k.get_error()) {
                                                     kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "ws monitor timer serialize lambda");
 
                                                     auto dev = fetch_device(dev_k);
                                                     if (dev != nullptr) {
-                                                        if (dev->get_mod_time() > last_tm) {
-                                                            std::stringstream ss;
-                                                            entrytracker->serialize_with_json_summary(format_t, ss, dev, json);
-                                                            ws->write(ss.str(), true);
-                                                        }
+                                                        if (dev->get_mod_time() > *last_tm)
+                                                            write_dev(dev);
                                                     }
                                                 } else if (!dev_m.error()) {
                                                     kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "ws monitor timer serialize lambda");
 
-                                                    const auto mmp = tracked_mac_multimap.equal_range(dev_m);
-                                                    for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
-                                                        if (mmpi->second->get_mod_time() > last_tm) {
-                                                            std::stringstream ss;
-                                                            entrytracker->serialize_with_json_summary(format_t, ss, mmpi->second, json);
-                                                            ws->write(ss.str(), true);
-                                                        }
+                                                    for (const auto& d : fetch_devices(dev_m)) {
+                                                        if (d->get_mod_time() > *last_tm)
+                                                            write_dev(d);
                                                     }
                                                 }
 
-                                                last_tm = time(0);
+                                                *last_tm = time(0);
 
                                                 return 1;
                                             });
@@ -776,6 +923,14 @@ device_tracker::device_tracker() :
     database_open("");
     database_upgrade_db();
 
+    // Hibernated records from a previous run can't be restored, their field ids are
+    // meaningless to this process
+    if (database_valid()) {
+        kis_lock_guard<kis_mutex> lk(ds_mutex);
+        sqlite3_exec(db, "DELETE FROM device_hibernation",
+                [] (void *, int, char **, char **) -> int { return 0; }, NULL, NULL);
+    }
+
     new_datasource_evt_id = 
         eventbus->register_listener(datasource_tracker::event_new_datasource(),
                 [this](std::shared_ptr<eventbus_event> evt) {
@@ -860,6 +1015,15 @@ void device_tracker::trigger_deferred_startup() {
                 });
     add_view(all_view);
 
+    // Packets aren't processed until the packet chain starts after every global has
+    // started up, so the restored devices are in place before any source reports
+    if (device_snapshot_enabled)
+        load_device_snapshot();
+}
+
+void device_tracker::trigger_deferred_shutdown() {
+    if (device_snapshot_enabled)
+        write_device_snapshot();
 }
 
 device_tracker::~device_tracker() {
@@ -884,6 +1048,8 @@ device_tracker::~device_tracker() {
     if (timetracker != NULL) {
         timetracker->remove_timer(device_idle_timer);
         timetracker->remove_timer(max_devices_timer);
+        timetracker->remove_timer(device_hibernate_timer);
+        timetracker->remove_timer(device_snapshot_timer);
         timetracker->remove_timer(device_storage_timer);
     }
 
@@ -896,9 +1062,7 @@ device_tracker::~device_tracker() {
     for (auto p : phy_handler_map)
         delete(p.second);
 
-    tracked_vec.clear();
-    immutable_tracked_vec->clear();
-    tracked_mac_multimap.clear();
+    device_shards.clear();
 }
 
 void device_tracker::macdevice_timer_event() {
@@ -964,9 +1128,7 @@ std::string device_tracker::fetch_phy_name(int in_phy) {
 }
 
 int device_tracker::fetch_num_devices() {
-    kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker fetch_num_devices");
-
-    return tracked_map.size();
+    return num_tracked_devices;
 }
 
 int device_tracker::fetch_num_packets() {
@@ -1026,249 +1188,1249 @@ void device_tracker::update_full_refresh() {
     full_refresh_time = time(0);
 }
 
-std::shared_ptr<kis_tracked_device_base> device_tracker::fetch_device(device_key in_key) {
-    kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker fetch_device");
+unsigned int device_tracker::shard_index_for_key(const device_key& in_key) {
+    if (device_shard_bits == 0)
+        return 0;
 
-	device_itr i = tracked_map.find(in_key);
+    // Shard on the mac alone, so that the devices every phy creates for a mac share a
+    // shard and looking up a mac only has to search that one shard
+    uint64_t h = in_key.get_dkey() * 0x9E3779B97F4A7C15ULL;
 
-	if (i != tracked_map.end())
-		return i->second;
+    return h >> (64 - device_shard_bits);
+}
 
-	return NULL;
+device_tracker::device_shard& device_tracker::shard_for_key(const device_key& in_key) {
+    return *device_shards[shard_index_for_key(in_key)];
 }
 
-std::shared_ptr<kis_tracked_device_base> device_tracker::fetch_device_nr(device_key in_key) {
-	device_itr i = tracked_map.find(in_key);
+namespace {
+    // Per-thread state of the devicelist and device update locks; there is only
+    // ever one device tracker
+    struct device_lock_state {
+        // Recursion depth of the devicelist lock
+        unsigned int devicelist_depth = 0;
+        // Nesting depth of device update locks
+        unsigned int update_depth = 0;
+        // Shard update locks held, in ascending order
+        std::vector<unsigned int> shards;
+        // Update locks given up while this thread holds the devicelist lock
+        bool suspended = false;
+    };
+
+    thread_local device_lock_state device_lock_thread;
+}
+
+void device_tracker::device_list_mutex::lock() {
+    auto& st = device_lock_thread;
 
-	if (i != tracked_map.end())
-		return i->second;
+    // Waiting for the devicelist lock while holding update locks would deadlock
+    // against the update gate, so let them go until the devicelist lock is released
+    if (st.devicelist_depth == 0 && st.update_depth > 0 && !st.suspended) {
+        tracker->release_update_locks(false);
+        st.suspended = true;
+    }
+
+    kis_mutex::lock();
 
-	return NULL;
+    if (st.devicelist_depth++ == 0) {
+        tracker->update_gate_waiting++;
+        tracker->update_gate.lock();
+        tracker->update_gate_waiting--;
+    }
 }
 
-// Fetch one or more devices by mac address or mac mask
-std::vector<std::shared_ptr<kis_tracked_device_base>> device_tracker::fetch_devices(mac_addr in_mac) {
-    kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker fetch_device mac");
-    std::vector<std::shared_ptr<kis_tracked_device_base>> ret;
-   
-    const auto mmp = tracked_mac_multimap.equal_range(in_mac);
-    for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
-        ret.push_back(mmpi->second);
+bool device_tracker::device_list_mutex::try_lock() {
+    auto& st = device_lock_thread;
+
+    // This thread's own update locks hold the gate
+    if (st.devicelist_depth == 0 && st.update_depth > 0 && !st.suspended)
+        return false;
+
+    if (!kis_mutex::try_lock())
+        return false;
+
+    if (st.devicelist_depth == 0 && !tracker->update_gate.try_lock()) {
+        kis_mutex::unlock();
+        return false;
     }
 
-    return ret;
+    st.devicelist_depth++;
+
+    return true;
 }
 
-int device_tracker::common_tracker(kis_packet *in_pack) {
-    kis_lock_guard<kis_mutex> lk(phy_mutex, "device_tracker common_tracker");
+void device_tracker::device_list_mutex::unlock() {
+    auto& st = device_lock_thread;
 
-    // All the statistics counters are atomic.
-    // Phy specific counters are atomic inside a map protected by the phy mutex
-    // RRDs have their own internal locking mechanisms to render them thread-safe
-    // We only need to protect the integrity of a phy being added/removed during this
+    if (--st.devicelist_depth == 0)
+        tracker->update_gate.unlock();
 
-	if (in_pack->error) {
-		// and bail
-		num_errorpackets++;
-		return 0;
-	}
+    kis_mutex::unlock();
 
-	kis_common_info *pack_common =
-        (kis_common_info *) in_pack->fetch(pack_comp_common);
+    if (st.devicelist_depth == 0 && st.suspended) {
+        st.suspended = false;
+        tracker->reacquire_update_locks();
+    }
+}
 
-    if (!ram_no_rrd)
-        packets_rrd->add_sample(1, time(0));
+device_tracker::device_update_lock::device_update_lock(device_tracker *in_tracker,
+        const std::vector<device_key>& in_keys, const std::string& in_op) :
+    tracker{in_tracker},
+    op{in_op},
+    active{false} {
 
-    num_packets++;
+    auto& st = device_lock_thread;
 
-	// If we can't figure it out at all (no common layer) just bail
-	if (pack_common == NULL)
-		return 0;
+    // The devicelist lock already excludes every other update
+    if (st.devicelist_depth > 0)
+        return;
 
-	if (pack_common->error) {
-		// If we couldn't get any common data consider it an error
-		// and bail
-		num_errorpackets++;
+    active = true;
 
-		if (phy_handler_map.find(pack_common->phyid) != phy_handler_map.end()) {
-			phy_errorpackets[pack_common->phyid]++;
-		}
+    if (st.update_depth++ == 0)
+        tracker->acquire_update_gate();
 
-		return 0;
-	}
+    tracker->lock_update_shards(in_keys);
+}
 
-	if (in_pack->filtered) {
-		num_filterpackets++;
-	}
+device_tracker::device_update_lock::~device_update_lock() {
+    if (!active)
+        return;
 
-	// Make sure our PHY is sane
-	if (phy_handler_map.find(pack_common->phyid) == phy_handler_map.end()) {
-		_MSG("Invalid phy id " + int_to_string(pack_common->phyid) + " in packet "
-			 "something is wrong.", MSGFLAG_ERROR);
-		return 0;
-	}
+    auto& st = device_lock_thread;
 
-	phy_packets[pack_common->phyid]++;
+    // Shards are held until the outermost update lock is done with them
+    if (--st.update_depth > 0)
+        return;
 
-	if (in_pack->error || pack_common->error) {
-		phy_errorpackets[pack_common->phyid]++;
-	}
+    if (st.suspended) {
+        // Still inside a devicelist lock taken during the update, there is
+        // nothing left to reacquire when it's released
+        st.shards.clear();
+        st.suspended = false;
+    } else {
+        tracker->release_update_locks(true);
+    }
+}
 
-	if (in_pack->filtered) {
-		phy_filterpackets[pack_common->phyid]++;
-		num_filterpackets++;
-	} else {
-		if (pack_common->type == packet_basic_data) {
-			num_datapackets++;
-			phy_datapackets[pack_common->phyid]++;
-		}
-	}
+void device_tracker::acquire_update_gate() {
+    // Let a waiting devicelist lock in first; the gate alone would let a steady
+    // stream of packets starve it
+    while (update_gate_waiting > 0)
+        std::this_thread::yield();
 
-	return 1;
+    update_gate.lock_shared();
 }
 
-// This function handles populating the base common info about a device, transforming a 
-// kis_common_info record into a full kis_tracked_device_base (or updating an existing
-// kis_tracked_device_base record); 
-//
-// Because a phy can create multiple devices from a single packet (such as WiFi creating
-// the access point, source, and destination devices), only the specific common device 
-// being passed will be updated.
-std::shared_ptr<kis_tracked_device_base> 
-    device_tracker::update_common_device(kis_common_info *pack_common, 
-            mac_addr in_mac, kis_phy_handler *in_phy, kis_packet *in_pack, 
-            unsigned int in_flags, std::string in_basic_type) {
+void device_tracker::lock_update_shards(const std::vector<device_key>& in_keys) {
+    auto& held = device_lock_thread.shards;
 
-    // Updating devices can only happen in serial because we don't know that a device is being
-    // created & we don't know how to append the data until we get to the end of processing
-    // so the entire chain is perforce locked
-    kis_lock_guard<kis_mutex> lg(get_devicelist_mutex(), "device_tracker update_common_device");
+    std::vector<unsigned int> wanted;
+    wanted.reserve(in_keys.size());
 
-    std::stringstream sstr;
+    for (const auto& k : in_keys) {
+        auto sn = shard_index_for_key(k);
 
-    bool new_device = false;
+        if (!std::binary_search(held.begin(), held.end(), sn))
+            wanted.push_back(sn);
+    }
 
-	kis_layer1_packinfo *pack_l1info =
-		(kis_layer1_packinfo *) in_pack->fetch(pack_comp_radiodata);
-	kis_gps_packinfo *pack_gpsinfo =
-		(kis_gps_packinfo *) in_pack->fetch(pack_comp_gps);
-	packetchain_comp_datasource *pack_datasrc =
-		(packetchain_comp_datasource *) in_pack->fetch(pack_comp_datasrc);
+    if (wanted.size() == 0)
+        return;
 
-    auto common_info =
-        in_pack->fetch<kis_common_info>(pack_comp_common);
+    std::sort(wanted.begin(), wanted.end());
+    wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
 
-    std::shared_ptr<kis_tracked_device_base> device = NULL;
-    device_key key;
+    // Shards above everything already held keep the lock order and can be waited
+    // on; shards below it can only be tried
+    std::vector<unsigned int> blocked;
+
+    for (auto sn : wanted) {
+        if (held.size() == 0 || sn > held.back()) {
+            device_shards[sn]->update_mutex.lock();
+            held.push_back(sn);
+        } else if (device_shards[sn]->update_mutex.try_lock()) {
+            held.insert(std::lower_bound(held.begin(), held.end(), sn), sn);
+        } else {
+            blocked.push_back(sn);
+        }
+    }
 
-    key = device_key(in_phy->fetch_phyname_hash(), in_mac);
+    if (blocked.size() == 0)
+        return;
 
-	if ((device = fetch_device_nr(key)) == NULL) {
-        if (in_flags & UCD_UPDATE_EXISTING_ONLY)
-            return NULL;
+    // Back off and retake everything in order
+    for (auto sn = held.rbegin(); sn != held.rend(); ++sn)
+        device_shards[*sn]->update_mutex.unlock();
 
-        device = std::make_shared<kis_tracked_device_base>(device_base_id);
+    held.insert(held.end(), blocked.begin(), blocked.end());
+    std::sort(held.begin(), held.end());
 
-        // Device ID is the size of the vector so a new device always gets put
-        // in it's numbered slot
-        device->set_kis_internal_id(immutable_tracked_vec->size());
+    for (auto sn : held)
+        device_shards[sn]->update_mutex.lock();
+}
 
-        device->set_key(key);
+void device_tracker::release_update_locks(bool in_forget) {
+    auto& held = device_lock_thread.shards;
 
-        device->set_macaddr(in_mac);
-        device->set_tracker_phyname(get_cached_phyname(in_phy->fetch_phy_name()));
-		device->set_phyid(in_phy->fetch_phy_id());
+    for (auto sn = held.rbegin(); sn != held.rend(); ++sn)
+        device_shards[*sn]->update_mutex.unlock();
 
-        device->set_server_uuid(globalreg->server_uuid);
+    if (in_forget)
+        held.clear();
 
-        device->set_first_time(in_pack->ts.tv_sec);
+    update_gate.unlock_shared();
+}
 
-        device->set_tracker_type_string(get_cached_devicetype(in_basic_type));
+void device_tracker::reacquire_update_locks() {
+    acquire_update_gate();
 
-        if (globalreg->manufdb != NULL) {
-            device->set_manuf(globalreg->manufdb->lookup_oui(in_mac));
-        }
+    for (auto sn : device_lock_thread.shards)
+        device_shards[sn]->update_mutex.lock();
+}
 
-        load_stored_username(device);
-        load_stored_tags(device);
+std::shared_ptr<kis_tracked_device_base> device_tracker::fetch_device(device_key in_key) {
+    {
+        auto& shard = shard_for_key(in_key);
+        kis_lock_guard<kis_mutex> lk(shard.mutex, "device_tracker fetch_device");
 
-        new_device = true;
+        auto device = shard.find(in_key);
 
+        if (device != nullptr)
+            return device;
     }
 
-    // Tag the packet with the base device
-    auto devinfo = in_pack->fetch<kis_tracked_device_info>(pack_comp_device);
+    if (num_hibernated_devices == 0)
+        return NULL;
 
-    if (devinfo == nullptr) {
-        devinfo = new kis_tracked_device_info;
-        in_pack->insert(pack_comp_device, devinfo);
-	}
+    // Only escalate to the devicelist lock, which suspends any update locks this
+    // thread holds, when the device really is hibernated
+    {
+        kis_lock_guard<kis_mutex> lk(hibernated_mutex, "device_tracker fetch_device");
 
-    devinfo->devrefs[in_mac] = device;
+        if (hibernated_devices.find(in_key) == hibernated_devices.end())
+            return NULL;
+    }
 
-    // Update the mod data
-    device->update_modtime();
+    return rehydrate_device(in_key);
+}
 
-    // Raise alerts for new devices or devices which have been
-    // idle and re-appeared
-    // Also keep them in macdevice_flagged_vec to send devicelost alerts
-    auto k = macdevice_alert_conf_map.find(device->get_macaddr());
-    if (k != macdevice_alert_conf_map.end()) {
-        if (new_device || ((device->get_last_time() < in_pack->ts.tv_sec &&
-            in_pack->ts.tv_sec - device->get_last_time() > devicefound_timeout))) {
+std::shared_ptr<kis_tracked_device_base> device_tracker::fetch_device_nr(device_key in_key) {
+    return fetch_device(in_key);
+}
 
-            if (k->second & 0x1) {
-                mac_addr dstmac, netmac, transmac;
+// Fetch one or more devices by mac address or mac mask
+std::vector<std::shared_ptr<kis_tracked_device_base>> device_tracker::fetch_devices(mac_addr in_mac) {
+    std::vector<std::shared_ptr<kis_tracked_device_base>> ret;
 
-                if (common_info != nullptr) {
-                    dstmac = common_info->dest;
-                    netmac = common_info->network;
-                    transmac = common_info->transmitter;
-                }
+    auto fetch_shard = [&ret, &in_mac](device_shard& shard) {
+        kis_lock_guard<kis_mutex> lk(shard.mutex, "device_tracker fetch_device mac");
 
-                auto alrt =
-                    fmt::format("Monitored device {} ({}) has been found.",
-                            device->get_macaddr(), device->get_commonname());
-                   alertracker->raise_alert(alert_macdevice_found_ref,
-                           in_pack, netmac, device->get_macaddr(), dstmac, transmac, 
-                           device->get_channel(), alrt);
-            }
-            if (k->second & 0x2) {
-                macdevice_flagged_vec.push_back(device);
-            }
+        const auto mmp = shard.mac_multimap.equal_range(in_mac);
+        for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
+            ret.push_back(mmpi->second);
         }
+    };
 
+    // Every device for a single mac is in the same shard; a mac mask may match
+    // devices in any of them
+    if (in_mac.maskbits >= 64) {
+        fetch_shard(shard_for_key(device_key(0, in_mac)));
+        return ret;
     }
 
-    if (device->get_last_time() < in_pack->ts.tv_sec)
-        device->set_last_time(in_pack->ts.tv_sec);
+    for (const auto& shard : device_shards)
+        fetch_shard(*shard);
 
-    if (in_flags & UCD_UPDATE_PACKETS) {
-        device->inc_packets();
+    return ret;
+}
 
-        if (!ram_no_rrd)
-            device->get_packets_rrd()->add_sample(1, time(0));
+void device_tracker::for_each_device(const std::function<void (const std::shared_ptr<kis_tracked_device_base>&)>& fn) {
+    for (const auto& shard : device_shards) {
+        kis_lock_guard<kis_mutex> lk(shard->mutex, "device_tracker for_each_device");
 
-        if (pack_common != NULL) {
-            if (pack_common->error)
-                device->inc_error_packets();
+        for (const auto& d : shard->vec)
+            fn(d);
+    }
+}
 
-            if (pack_common->type == packet_basic_data) {
-                // TODO fix directional data
-                device->inc_data_packets();
-                device->inc_datasize(pack_common->datasize);
+std::shared_ptr<tracker_element_vector> device_tracker::fetch_all_devices() {
+    auto ret = std::make_shared<tracker_element_vector>();
+    ret->reserve(num_tracked_devices);
 
-                if (!ram_no_rrd) {
-                    device->get_data_rrd()->add_sample(pack_common->datasize, time(0));
-                }
+    for_each_device([&ret](const std::shared_ptr<kis_tracked_device_base>& d) {
+            ret->push_back(d);
+            });
 
-            } else if (pack_common->type == packet_basic_mgmt ||
-                    pack_common->type == packet_basic_phy) {
-                device->inc_llc_packets();
-            }
+    return ret;
+}
 
-        }
-    }
+bool device_tracker::insert_device_shard(std::shared_ptr<kis_tracked_device_base> in_device) {
+    {
+        auto& shard = shard_for_key(in_device->get_key());
+        kis_lock_guard<kis_mutex> lk(shard.mutex, "device_tracker insert_device_shard");
+
+        if (shard.map.find(in_device->get_key()) != shard.map.end())
+            return false;
+
+        // Device IDs increase in the order devices are created, regardless of shard
+        in_device->set_kis_internal_id(next_device_id++);
+
+        shard.map[in_device->get_key()] = shard.vec.size();
+        shard.vec.push_back(in_device);
+        shard.mac_multimap.emplace(std::make_pair(in_device->get_macaddr(), in_device));
+
+        num_tracked_devices++;
+    }
+
+    kis_lock_guard<kis_mutex> lk(device_update_mutex, "device_tracker insert_device_shard");
+
+    if (device_idle_expiration != 0)
+        idle_wheel.schedule(in_device, in_device->get_last_time() + device_idle_expiration + 1);
+
+    if (device_hibernate_time != 0)
+        hibernate_wheel.schedule(in_device, in_device->get_last_time() + device_hibernate_time + 1);
+
+    return true;
+}
+
+std::vector<std::shared_ptr<kis_tracked_device_base>> 
+    device_tracker::remove_devices(const std::vector<std::shared_ptr<kis_tracked_device_base>>& in_devices) {
+    std::vector<std::shared_ptr<kis_tracked_device_base>> removed;
+
+    if (in_devices.size() == 0)
+        return removed;
+
+    std::vector<std::vector<std::shared_ptr<kis_tracked_device_base>>> shard_devices(device_shards.size());
+
+    for (const auto& d : in_devices)
+        shard_devices[shard_index_for_key(d->get_key())].push_back(d);
+
+    for (unsigned int sn = 0; sn < device_shards.size(); sn++) {
+        if (shard_devices[sn].size() == 0)
+            continue;
+
+        auto& shard = *device_shards[sn];
+        kis_lock_guard<kis_mutex> lk(shard.mutex, "device_tracker remove_devices");
+
+        for (const auto& d : shard_devices[sn]) {
+            auto mi = shard.map.find(d->get_key());
+
+            // Only remove the record we were given, not a newer device with the same key
+            if (mi == shard.map.end() || shard.vec[mi->second] != d)
+                continue;
+
+            auto pos = mi->second;
+            shard.map.erase(mi);
+
+            // Move the last device into the hole rather than shifting the vector
+            if (pos != shard.vec.size() - 1) {
+                shard.vec[pos] = std::move(shard.vec.back());
+                shard.map[shard.vec[pos]->get_key()] = pos;
+            }
+
+            shard.vec.pop_back();
+
+            auto mmp = shard.mac_multimap.equal_range(d->get_macaddr());
+
+            for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
+                if (mmpi->second->get_key() == d->get_key()) {
+                    shard.mac_multimap.erase(mmpi);
+                    break;
+                }
+            }
+
+            removed.push_back(d);
+            num_tracked_devices--;
+        }
+    }
+
+    return removed;
+}
+
+void device_tracker::hibernate_devices(time_t in_now) {
+    std::vector<std::shared_ptr<kis_tracked_device_base>> idle;
+
+    {
+        kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker hibernate_devices");
+
+        std::vector<std::shared_ptr<kis_tracked_device_base>> due;
+
+        hibernate_wheel.advance(in_now, due);
+
+        for (const auto& d : due) {
+            // Without a database to write to, keep devices in memory and look again later
+            if (in_now - d->get_last_time() > device_hibernate_time && database_valid()) {
+                idle.push_back(d);
+                continue;
+            }
+
+            hibernate_wheel.schedule(d, d->get_last_time() + device_hibernate_time + 1);
+        }
+    }
+
+    if (idle.size() == 0)
+        return;
+
+    // Devices stay live while their records are written; each is serialized under 
+    // its own shard update lock and the batch is written without any tracker lock,
+    // then devices which haven't been seen in the meantime are swapped for stubs
+    struct hibernate_record {
+        std::shared_ptr<kis_tracked_device_base> device;
+        std::string keystring;
+        time_t last_time;
+        uint64_t packets;
+        std::string record;
+    };
+
+    std::vector<hibernate_record> records;
+    records.reserve(idle.size());
+
+    for (const auto& d : idle) {
+        hibernate_record r;
+
+        r.device = d;
+        r.keystring = d->get_key().as_string();
+
+        {
+            device_update_lock ulk(this, {d->get_key()}, "device_tracker hibernate_devices");
+
+            r.last_time = d->get_last_time();
+            r.packets = d->get_packets();
+            serialize_binary_tracker_element(r.record, d);
+        }
+
+        records.push_back(std::move(r));
+    }
+
+    std::vector<const hibernate_record *> written;
+    written.reserve(records.size());
+
+    {
+        kis_lock_guard<kis_mutex> dlk(ds_mutex);
+
+        std::string sql;
+
+        int r;
+        sqlite3_stmt *stmt = NULL;
+        const char *pz = NULL;
+
+        sql = 
+            "INSERT INTO device_hibernation "
+            "(key, last_time, record) "
+            "VALUES (?, ?, ?)";
+
+        r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
+
+        if (r != SQLITE_OK) {
+            _MSG("device_tracker unable to prepare database insert for hibernated devices in " +
+                    ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+        } else {
+            // One transaction for the whole batch, otherwise every row is synced to disk
+            sqlite3_exec(db, "BEGIN TRANSACTION", 
+                    [] (void *, int, char **, char **) -> int { return 0; }, NULL, NULL);
+
+            for (const auto& rec : records) {
+                sqlite3_reset(stmt);
+
+                sqlite3_bind_text(stmt, 1, rec.keystring.c_str(), rec.keystring.length(), 0);
+                sqlite3_bind_int64(stmt, 2, rec.last_time);
+                sqlite3_bind_blob(stmt, 3, rec.record.data(), rec.record.length(), 0);
+
+                if (sqlite3_step(stmt) == SQLITE_DONE) {
+                    written.push_back(&rec);
+                } else {
+                    _MSG_ERROR("device_tracker unable to hibernate device {}: {}", rec.keystring,
+                            sqlite3_errmsg(db));
+                }
+            }
+
+            sqlite3_exec(db, "COMMIT", 
+                    [] (void *, int, char **, char **) -> int { return 0; }, NULL, NULL);
+
+            sqlite3_finalize(stmt);
+        }
+    }
+
+    // Records for devices which stay in memory have to go, or the snapshot would 
+    // restore them twice
+    std::vector<std::string> stale;
+
+    {
+        kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker hibernate_devices");
+
+        std::vector<std::shared_ptr<kis_tracked_device_base>> stored;
+        stored.reserve(written.size());
+
+        if (written.size() != records.size()) {
+            for (const auto& rec : records) {
+                if (std::find(written.begin(), written.end(), &rec) == written.end())
+                    hibernate_wheel.schedule(rec.device, in_now + device_hibernate_time + 1);
+            }
+        }
+
+        for (const auto rec : written) {
+            // Seen again while the record was written
+            if (rec->device->get_last_time() != rec->last_time || 
+                    rec->device->get_packets() != rec->packets) {
+                stale.push_back(rec->keystring);
+                hibernate_wheel.schedule(rec->device, 
+                        rec->device->get_last_time() + device_hibernate_time + 1);
+                continue;
+            }
+
+            stored.push_back(rec->device);
+        }
+
+        auto removed = remove_devices(stored);
+
+        // Devices removed by something else in the meantime don't get a stub either
+        if (removed.size() != stored.size()) {
+            std::unordered_set<device_key> removed_keys;
+
+            for (const auto& d : removed)
+                removed_keys.insert(d->get_key());
+
+            for (const auto& d : stored) {
+                if (removed_keys.find(d->get_key()) == removed_keys.end())
+                    stale.push_back(d->get_key().as_string());
+            }
+        }
+
+        {
+            kis_lock_guard<kis_mutex> hlk(hibernated_mutex, "device_tracker hibernate_devices");
+
+            for (const auto& d : removed) {
+                hibernated_device h;
+
+                // Stubs over the minimum packet count never expire and aren't indexed
+                if (device_idle_expiration != 0 && 
+                        (device_idle_min_packets == 0 || d->get_packets() < device_idle_min_packets))
+                    h.expiry = hibernated_expiry.emplace(d->get_last_time(), d->get_key());
+                else
+                    h.expiry = hibernated_expiry.end();
+
+                hibernated_devices[d->get_key()] = h;
+            }
+
+            num_hibernated_devices = hibernated_devices.size();
+        }
+
+        remove_view_devices(removed);
+
+        if (removed.size() > 0)
+            update_full_refresh();
+    }
+
+    if (stale.size() > 0)
+        delete_hibernated_records(stale);
+}
+
+void device_tracker::expire_hibernated_devices(time_t in_now) {
+    std::vector<std::string> expired;
+
+    {
+        kis_lock_guard<kis_mutex> lk(hibernated_mutex, "device_tracker expire_hibernated_devices");
+
+        // The expiry index is ordered by last time, so stop at the first stub which
+        // hasn't expired yet
+        while (hibernated_expiry.size() > 0) {
+            auto i = hibernated_expiry.begin();
+
+            if (in_now - i->first <= device_idle_expiration)
+                break;
+
+            expired.push_back(i->second.as_string());
+            hibernated_devices.erase(i->second);
+            hibernated_expiry.erase(i);
+        }
+
+        num_hibernated_devices = hibernated_devices.size();
+    }
+
+    if (expired.size() > 0)
+        delete_hibernated_records(expired);
+}
+
+void device_tracker::delete_hibernated_records(const std::vector<std::string>& in_keys) {
+    kis_lock_guard<kis_mutex> dlk(ds_mutex);
+
+    if (!database_valid())
+        return;
+
+    std::string sql;
+
+    int r;
+    sqlite3_stmt *stmt = NULL;
+    const char *pz = NULL;
+
+    sql = 
+        "DELETE FROM device_hibernation WHERE key = ?";
+
+    r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
+
+    if (r != SQLITE_OK) {
+        _MSG("device_tracker unable to prepare database delete for hibernated devices in " +
+                ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+        return;
+    }
+
+    sqlite3_exec(db, "BEGIN TRANSACTION", 
+            [] (void *, int, char **, char **) -> int { return 0; }, NULL, NULL);
+
+    for (const auto& k : in_keys) {
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, k.c_str(), k.length(), 0);
+        sqlite3_step(stmt);
+    }
+
+    sqlite3_exec(db, "COMMIT", 
+            [] (void *, int, char **, char **) -> int { return 0; }, NULL, NULL);
+
+    sqlite3_finalize(stmt);
+}
+
+std::shared_ptr<kis_tracked_device_base> device_tracker::rehydrate_device(const device_key& in_key) {
+    kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker rehydrate_device");
+
+    // The stub is only dropped once the device is back in the store, so a concurrent
+    // fetch either finds the device or waits here for it
+    auto forget_stub = [this, &in_key]() {
+        kis_lock_guard<kis_mutex> hlk(hibernated_mutex, "device_tracker rehydrate_device");
+
+        auto hi = hibernated_devices.find(in_key);
+
+        if (hi != hibernated_devices.end()) {
+            if (hi->second.expiry != hibernated_expiry.end())
+                hibernated_expiry.erase(hi->second.expiry);
+
+            hibernated_devices.erase(hi);
+        }
+
+        num_hibernated_devices = hibernated_devices.size();
+    };
+
+    bool hibernated;
+
+    {
+        kis_lock_guard<kis_mutex> hlk(hibernated_mutex, "device_tracker rehydrate_device");
+        hibernated = hibernated_devices.find(in_key) != hibernated_devices.end();
+    }
+
+    if (!hibernated) {
+        // Another thread may have restored it while we waited for the lock
+        auto& shard = shard_for_key(in_key);
+        kis_lock_guard<kis_mutex> slk(shard.mutex, "device_tracker rehydrate_device");
+
+        return shard.find(in_key);
+    }
+
+    std::string keystring = in_key.as_string();
+    std::string record;
+
+    {
+        kis_lock_guard<kis_mutex> dlk(ds_mutex);
+
+        if (!database_valid()) {
+            forget_stub();
+            return nullptr;
+        }
+
+        std::string sql;
+
+        int r;
+        sqlite3_stmt *stmt = NULL;
+        const char *pz = NULL;
+
+        sql = 
+            "SELECT record FROM device_hibernation WHERE key = ?";
+
+        r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
+
+        if (r != SQLITE_OK) {
+            _MSG("device_tracker unable to prepare database query for hibernated device in " +
+                    ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+            forget_stub();
+            return nullptr;
+        }
+
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, keystring.c_str(), keystring.length(), 0);
+
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            auto blob = (const char *) sqlite3_column_blob(stmt, 0);
+            auto blob_sz = sqlite3_column_bytes(stmt, 0);
+
+            if (blob != NULL)
+                record.assign(blob, blob_sz);
+        }
+
+        sqlite3_finalize(stmt);
+        stmt = NULL;
+
+        sql = 
+            "DELETE FROM device_hibernation WHERE key = ?";
+
+        r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
+
+        if (r == SQLITE_OK) {
+            sqlite3_reset(stmt);
+            sqlite3_bind_text(stmt, 1, keystring.c_str(), keystring.length(), 0);
+            sqlite3_step(stmt);
+            sqlite3_finalize(stmt);
+        }
+    }
+
+    std::shared_ptr<kis_tracked_device_base> device;
+
+    try {
+        size_t pos = 0;
+        device = std::dynamic_pointer_cast<kis_tracked_device_base>(
+                deserialize_binary_tracker_element(record, pos));
+    } catch (const std::exception& e) {
+        _MSG_ERROR("device_tracker unable to restore hibernated device {}: {}", keystring, e.what());
+        forget_stub();
+        return nullptr;
+    }
+
+    if (device == nullptr) {
+        _MSG_ERROR("device_tracker unable to restore hibernated device {}: no stored record",
+                keystring);
+        forget_stub();
+        return nullptr;
+    }
+
+    // Share the cached strings again instead of a restored copy per device
+    device->set_tracker_phyname(get_cached_phyname(device->get_phyname()));
+    device->set_tracker_type_string(get_cached_devicetype(device->get_type_string()));
+
+    if (!insert_device_shard(device)) {
+        forget_stub();
+        return nullptr;
+    }
+
+    new_view_device(device);
+    change_log.record(device);
+
+    forget_stub();
+
+    return device;
+}
+
+void device_tracker::write_device_snapshot() {
+    // Only one snapshot at a time; a periodic snapshot may still be running at shutdown
+    if (device_snapshot_writing.exchange(true))
+        return;
+
+    auto tmp_file = device_snapshot_file + ".tmp";
+
+    FILE *fp = fopen(tmp_file.c_str(), "wb");
+
+    if (fp == nullptr) {
+        _MSG_ERROR("device_tracker unable to open device snapshot {}: {}", tmp_file, 
+                kis_strerror_r(errno));
+        device_snapshot_writing = false;
+        return;
+    }
+
+    binary_tracker_element_writer writer(fp);
+
+    bool ok = writer.write_header();
+    size_t num_devices = 0;
+
+    // Serialize in batches under the devicelist lock and write them without it, so the
+    // packet threads are only held up for a batch at a time
+    const size_t snapshot_chunk_sz = 1024;
+
+    auto devices = fetch_all_devices();
+
+    for (auto i = devices->begin(); ok && i != devices->end(); ) {
+        {
+            kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker write_device_snapshot");
+
+            for (size_t n = 0; n < snapshot_chunk_sz && i != devices->end(); ++n, ++i) {
+                writer.add(*i);
+                num_devices++;
+            }
+        }
+
+        ok = writer.flush();
+    }
+
+    devices.reset();
+
+    // Hibernated devices are part of the tracked state too; their records use this
+    // process's field ids, so they're restored and written with the field table
+    if (ok && num_hibernated_devices > 0) {
+        kis_lock_guard<kis_mutex> dlk(ds_mutex);
+
+        sqlite3_stmt *stmt = NULL;
+        const char *pz = NULL;
+
+        std::string sql = 
+            "SELECT key, record FROM device_hibernation";
+
+        if (database_valid() && 
+                sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz) == SQLITE_OK) {
+            std::string record;
+
+            while (ok && sqlite3_step(stmt) == SQLITE_ROW) {
+                auto keystr = (const char *) sqlite3_column_text(stmt, 0);
+                auto blob = (const char *) sqlite3_column_blob(stmt, 1);
+                auto blob_sz = sqlite3_column_bytes(stmt, 1);
+
+                if (keystr == NULL || blob == NULL)
+                    continue;
+
+                // Records are written before their devices leave memory; only rows
+                // with a stub belong to a hibernated device
+                {
+                    kis_lock_guard<kis_mutex> hlk(hibernated_mutex, "device_tracker write_device_snapshot");
+
+                    if (hibernated_devices.find(device_key(std::string(keystr))) == 
+                            hibernated_devices.end())
+                        continue;
+                }
+
+                record.assign(blob, blob_sz);
+
+                try {
+                    size_t pos = 0;
+                    auto e = deserialize_binary_tracker_element(record, pos);
+
+                    if (e != nullptr) {
+                        writer.add(e);
+                        num_devices++;
+                    }
+                } catch (const std::exception& e) {
+                    continue;
+                }
+
+                if (writer.pending() > (1 << 20))
+                    ok = writer.flush();
+            }
+
+            sqlite3_finalize(stmt);
+        }
+    }
+
+    if (ok)
+        ok = writer.finish();
+
+    if (fclose(fp) != 0)
+        ok = false;
+
+    // Replace the previous snapshot only once this one is complete
+    if (ok && rename(tmp_file.c_str(), device_snapshot_file.c_str()) != 0)
+        ok = false;
+
+    if (!ok) {
+        _MSG_ERROR("device_tracker unable to write device snapshot {}: {}", device_snapshot_file,
+                kis_strerror_r(errno));
+        unlink(tmp_file.c_str());
+    } else {
+        _MSG_DEBUG("Saved {} devices to snapshot {}", num_devices, device_snapshot_file);
+    }
+
+    device_snapshot_writing = false;
+}
+
+void device_tracker::load_device_snapshot() {
+    FILE *fp = fopen(device_snapshot_file.c_str(), "rb");
+
+    if (fp == nullptr) {
+        if (errno != ENOENT)
+            _MSG_ERROR("device_tracker unable to open device snapshot {}: {}", device_snapshot_file,
+                    kis_strerror_r(errno));
+        return;
+    }
+
+    binary_tracker_element_reader reader(fp);
+
+    if (!reader.read_header()) {
+        _MSG_ERROR("device_tracker unable to restore devices from {}: not a device snapshot "
+                "from this version of Kismet", device_snapshot_file);
+        fclose(fp);
+        return;
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    size_t num_restored = 0;
+
+    // Phy IDs are assigned at runtime, devices are matched to their phy by name
+    std::unordered_map<std::string, kis_phy_handler *> phy_names;
+
+    kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker load_device_snapshot");
+
+    try {
+        shared_tracker_element e;
+
+        while (reader.next(e)) {
+            auto device = std::dynamic_pointer_cast<kis_tracked_device_base>(e);
+
+            if (device == nullptr)
+                continue;
+
+            auto phyname = device->get_phyname();
+            auto phi = phy_names.find(phyname);
+
+            if (phi == phy_names.end())
+                phi = phy_names.emplace(phyname, fetch_phy_handler_by_name(phyname)).first;
+
+            // Devices from a phy which isn't loaded this time are dropped
+            if (phi->second == nullptr)
+                continue;
+
+            device->set_phyid(phi->second->fetch_phy_id());
+            device->set_tracker_phyname(get_cached_phyname(phyname));
+            device->set_tracker_type_string(get_cached_devicetype(device->get_type_string()));
+
+            if (!insert_device_shard(device))
+                continue;
+
+            new_view_device(device);
+            phi->second->restore_phy_device(device);
+
+            num_restored++;
+        }
+    } catch (const std::exception& e) {
+        _MSG_ERROR("device_tracker stopped restoring devices from {}, the snapshot is damaged: {}",
+                device_snapshot_file, e.what());
+    }
+
+    if (!reader.is_complete())
+        _MSG_ERROR("device_tracker device snapshot {} was incomplete, some devices may not "
+                "have been restored", device_snapshot_file);
+
+    fclose(fp);
+
+    if (num_restored > 0)
+        update_full_refresh();
+
+    _MSG_INFO("Restored {} devices from {} in {:.1f} seconds", num_restored, device_snapshot_file,
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count());
+}
+
+void device_tracker::device_idle_wheel::configure(time_t in_granularity, time_t in_span, 
+        time_t in_now) {
+    granularity = std::max((time_t) 1, in_granularity);
+
+    // Anything scheduled is due no later than one span from now, so one spare slot
+    // past the span keeps every entry within a single turn of the wheel
+    slots.clear();
+    slots.resize((std::max((time_t) 0, in_span) / granularity) + 2);
+
+    cursor = in_now / granularity;
+}
+
+void device_tracker::device_idle_wheel::schedule(const std::shared_ptr<kis_tracked_device_base>& in_device,
+        time_t in_due) {
+    if (slots.size() == 0)
+        return;
+
+    uint64_t sn = std::max((uint64_t) std::max((time_t) 0, in_due) / granularity, cursor);
+
+    slots[sn % slots.size()].push_back(in_device);
+}
+
+void device_tracker::device_idle_wheel::advance(time_t in_now, 
+        std::vector<std::shared_ptr<kis_tracked_device_base>>& ret) {
+    if (slots.size() == 0)
+        return;
+
+    uint64_t now_sn = in_now / granularity;
+
+    if (now_sn < cursor)
+        return;
+
+    // After a long stall every slot is due, but each only needs to be emptied once
+    uint64_t num_due = std::min((uint64_t) slots.size(), now_sn - cursor + 1);
+
+    for (uint64_t i = 0; i < num_due; i++) {
+        std::vector<std::weak_ptr<kis_tracked_device_base>> slot;
+        slot.swap(slots[(cursor + i) % slots.size()]);
+
+        for (const auto& w : slot) {
+            auto d = w.lock();
+
+            if (d != nullptr)
+                ret.push_back(d);
+        }
+    }
+
+    // Move the cursor before anything is re-scheduled so that nothing lands in a slot
+    // we've already passed
+    cursor = now_sn + 1;
+}
+
+void device_tracker::device_change_log::configure(size_t in_capacity) {
+    ring.clear();
+    ring.resize(std::max((size_t) 1, in_capacity));
+    logged_seq.clear();
+    logged_seq.reserve(ring.size());
+}
+
+void device_tracker::device_change_log::record(const std::shared_ptr<kis_tracked_device_base>& in_device) {
+    if (ring.size() == 0)
+        return;
+
+    auto key = in_device->get_key();
+
+    // Already logged and still in the ring; clear the old slot so the device is only
+    // reported once, at its newest position
+    auto li = logged_seq.find(key);
+    if (li != logged_seq.end() && li->second + ring.size() >= next_seq) 
+        ring[li->second % ring.size()].device.reset();
+
+    auto& slot = ring[next_seq % ring.size()];
+
+    // Lapping an older entry; forget it unless that device has since moved forward
+    if (slot.seq != 0 && !(slot.key == key)) {
+        auto oi = logged_seq.find(slot.key);
+        if (oi != logged_seq.end() && oi->second == slot.seq)
+            logged_seq.erase(oi);
+    }
+
+    slot.seq = next_seq;
+    slot.key = key;
+    slot.device = in_device;
+
+    logged_seq[key] = next_seq;
+
+    next_seq++;
+}
+
+bool device_tracker::device_change_log::since(uint64_t& in_cursor, 
+        std::vector<std::shared_ptr<kis_tracked_device_base>>& ret) {
+    if (ring.size() == 0 || in_cursor == 0 || in_cursor + ring.size() < next_seq)
+        return false;
+
+    for (uint64_t seq = in_cursor; seq < next_seq; seq++) {
+        auto d = ring[seq % ring.size()].device.lock();
+
+        if (d != nullptr)
+            ret.push_back(d);
+    }
+
+    in_cursor = next_seq;
+
+    return true;
+}
+
+uint64_t device_tracker::get_device_change_head() {
+    kis_lock_guard<kis_mutex> lk(devicelist_mutex, "device_tracker get_device_change_head");
+    return change_log.head();
+}
+
+bool device_tracker::fetch_changed_devices(uint64_t& in_cursor, 
+        std::vector<std::shared_ptr<kis_tracked_device_base>>& ret) {
+    kis_lock_guard<kis_mutex> lk(devicelist_mutex, "device_tracker fetch_changed_devices");
+    return change_log.since(in_cursor, ret);
+}
+
+int device_tracker::common_tracker(kis_packet *in_pack) {
+    kis_lock_guard<kis_mutex> lk(phy_mutex, "device_tracker common_tracker");
+
+    // All the statistics counters are atomic.
+    // Phy specific counters are atomic inside a map protected by the phy mutex
+    // RRDs have their own internal locking mechanisms to render them thread-safe
+    // We only need to protect the integrity of a phy being added/removed during this
+
+	if (in_pack->error) {
+		// and bail
+		num_errorpackets++;
+		return 0;
+	}
+
+	kis_common_info *pack_common =
+        (kis_common_info *) in_pack->fetch(pack_comp_common);
+
+    if (!ram_no_rrd)
+        packets_rrd->add_sample(1, time(0));
+
+    num_packets++;
+
+	// If we can't figure it out at all (no common layer) just bail
+	if (pack_common == NULL)
+		return 0;
+
+	if (pack_common->error) {
+		// If we couldn't get any common data consider it an error
+		// and bail
+		num_errorpackets++;
+
+		if (phy_handler_map.find(pack_common->phyid) != phy_handler_map.end()) {
+			phy_errorpackets[pack_common->phyid]++;
+		}
+
+		return 0;
+	}
+
+	if (in_pack->filtered) {
+		num_filterpackets++;
+	}
+
+	// Make sure our PHY is sane
+	if (phy_handler_map.find(pack_common->phyid) == phy_handler_map.end()) {
+		_MSG("Invalid phy id " + int_to_string(pack_common->phyid) + " in packet "
+			 "something is wrong.", MSGFLAG_ERROR);
+		return 0;
+	}
+
+	phy_packets[pack_common->phyid]++;
+
+	if (in_pack->error || pack_common->error) {
+		phy_errorpackets[pack_common->phyid]++;
+	}
+
+	if (in_pack->filtered) {
+		phy_filterpackets[pack_common->phyid]++;
+		num_filterpackets++;
+	} else {
+		if (pack_common->type == packet_basic_data) {
+			num_datapackets++;
+			phy_datapackets[pack_common->phyid]++;
+		}
+	}
+
+	return 1;
+}
+
+// This function handles populating the base common info about a device, transforming a 
+// kis_common_info record into a full kis_tracked_device_base (or updating an existing
+// kis_tracked_device_base record); 
+//
+// Because a phy can create multiple devices from a single packet (such as WiFi creating
+// the access point, source, and destination devices), only the specific common device 
+// being passed will be updated.
+std::shared_ptr<kis_tracked_device_base> 
+    device_tracker::update_common_device(kis_common_info *pack_common, 
+            mac_addr in_mac, kis_phy_handler *in_phy, kis_packet *in_pack, 
+            unsigned int in_flags, std::string in_basic_type) {
+
+    auto key = device_key(in_phy->fetch_phyname_hash(), in_mac);
+
+    // Updates to devices in other shards run in parallel; a phy updating several devices
+    // from one packet usually holds this already
+    device_update_lock ulk(this, {key}, "device_tracker update_common_device");
+
+    bool new_device = false;
+
+	kis_layer1_packinfo *pack_l1info =
+		(kis_layer1_packinfo *) in_pack->fetch(pack_comp_radiodata);
+	kis_gps_packinfo *pack_gpsinfo =
+		(kis_gps_packinfo *) in_pack->fetch(pack_comp_gps);
+	packetchain_comp_datasource *pack_datasrc =
+		(packetchain_comp_datasource *) in_pack->fetch(pack_comp_datasrc);
+
+    auto common_info =
+        in_pack->fetch<kis_common_info>(pack_comp_common);
+
+    std::shared_ptr<kis_tracked_device_base> device = NULL;
+
+	if ((device = fetch_device_nr(key)) == NULL) {
+        if (in_flags & UCD_UPDATE_EXISTING_ONLY)
+            return NULL;
+
+        device = std::make_shared<kis_tracked_device_base>(device_base_id);
+
+        device->set_key(key);
+
+        device->set_macaddr(in_mac);
+        device->set_tracker_phyname(get_cached_phyname(in_phy->fetch_phy_name()));
+		device->set_phyid(in_phy->fetch_phy_id());
+
+        device->set_server_uuid(globalreg->server_uuid);
+
+        device->set_first_time(in_pack->ts.tv_sec);
+
+        device->set_tracker_type_string(get_cached_devicetype(in_basic_type));
+
+        if (globalreg->manufdb != NULL) {
+            device->set_manuf(globalreg->manufdb->lookup_oui(in_mac));
+        }
+
+        load_stored_username(device);
+        load_stored_tags(device);
+
+        new_device = true;
+
+    }
+
+    // Tag the packet with the base device
+    auto devinfo = in_pack->fetch<kis_tracked_device_info>(pack_comp_device);
+
+    if (devinfo == nullptr) {
+        devinfo = new kis_tracked_device_info;
+        in_pack->insert(pack_comp_device, devinfo);
+	}
+
+    devinfo->devrefs[in_mac] = device;
+
+    // Update the mod data
+    device->update_modtime();
+
+    // Raise alerts for new devices or devices which have been
+    // idle and re-appeared
+    // Also keep them in macdevice_flagged_vec to send devicelost alerts
+    auto k = macdevice_alert_conf_map.find(device->get_macaddr());
+    if (k != macdevice_alert_conf_map.end()) {
+        if (new_device || ((device->get_last_time() < in_pack->ts.tv_sec &&
+            in_pack->ts.tv_sec - device->get_last_time() > devicefound_timeout))) {
+
+            if (k->second & 0x1) {
+                mac_addr dstmac, netmac, transmac;
+
+                if (common_info != nullptr) {
+                    dstmac = common_info->dest;
+                    netmac = common_info->network;
+                    transmac = common_info->transmitter;
+                }
+
+                auto alrt =
+                    fmt::format("Monitored device {} ({}) has been found.",
+                            device->get_macaddr(), device->get_commonname());
+                   alertracker->raise_alert(alert_macdevice_found_ref,
+                           in_pack, netmac, device->get_macaddr(), dstmac, transmac, 
+                           device->get_channel(), alrt);
+            }
+            if (k->second & 0x2) {
+                kis_lock_guard<kis_mutex> lk(device_update_mutex, "device_tracker update_common_device");
+                macdevice_flagged_vec.push_back(device);
+            }
+        }
+
+    }
+
+    if (device->get_last_time() < in_pack->ts.tv_sec)
+        device->set_last_time(in_pack->ts.tv_sec);
+
+    if (in_flags & UCD_UPDATE_PACKETS) {
+        device->inc_packets();
+
+        if (!ram_no_rrd)
+            device->get_packets_rrd()->add_sample(1, time(0));
+
+        if (pack_common != NULL) {
+            if (pack_common->error)
+                device->inc_error_packets();
+
+            if (pack_common->type == packet_basic_data) {
+                // TODO fix directional data
+                device->inc_data_packets();
+                device->inc_datasize(pack_common->datasize);
+
+                if (!ram_no_rrd) {
+                    device->get_data_rrd()->add_sample(pack_common->datasize, time(0));
+                }
+
+            } else if (pack_common->type == packet_basic_mgmt ||
+                    pack_common->type == packet_basic_phy) {
+                device->inc_llc_packets();
+            }
+
+        }
+    }
 
 	if ((in_flags & UCD_UPDATE_FREQUENCIES)) {
         if (pack_l1info != NULL) {
@@ -1341,15 +2503,19 @@ std::shared_ptr<kis_tracked_device_base>
     if (pack_common != NULL)
         device->add_basic_crypt(pack_common->basic_crypt_set);
 
-    if (new_device) {
-        // Add the new device to the list
-        tracked_map[key] = device;
+    {
+        kis_lock_guard<kis_mutex> lk(device_update_mutex, "device_tracker update_common_device");
+        change_log.record(device);
+    }
 
-        tracked_vec.push_back(device);
-        immutable_tracked_vec->push_back(device);
+    // Times, counts, and signal have likely moved; re-key any view sort indexes
+    // the next time they're read
+    if (!new_device)
+        touch_view_device(device);
 
-        auto mm_pair = std::make_pair(in_mac, device);
-        tracked_mac_multimap.insert(mm_pair);
+    if (new_device) {
+        // Add the new device to its shard; this assigns the device ID
+        insert_device_shard(device);
 
         // If we have no packet info, add it to the device list immediately,
         // otherwise, flag the packet to trigger a new device event at the
@@ -1364,20 +2530,41 @@ std::shared_ptr<kis_tracked_device_base>
             evt->get_event_content()->insert(event_new_device(), device);
             in_pack->process_complete_events.push_back(evt);
         }
-
-#if 0
-        // Release the devicelist lock before we add it to the views
-        ul_list.unlock();
-#endif
     }
 
     return device;
 }
 
-// Sort based on internal kismet ID
-bool devicetracker_sort_internal_id(std::shared_ptr<kis_tracked_device_base> a,
-	std::shared_ptr<kis_tracked_device_base> b) {
-	return a->get_kis_internal_id() < b->get_kis_internal_id();
+void device_tracker::update_device_seenby(kis_packet *in_pack, const device_key& in_key) {
+    auto pack_datasrc = in_pack->fetch<packetchain_comp_datasource>(pack_comp_datasrc);
+
+    if (pack_datasrc == nullptr)
+        return;
+
+    device_update_lock ulk(this, {in_key}, "device_tracker update_device_seenby");
+
+    auto device = fetch_device_nr(in_key);
+
+    if (device == nullptr)
+        return;
+
+    auto pack_l1info = in_pack->fetch<kis_layer1_packinfo>(pack_comp_radiodata);
+    auto pack_gpsinfo = in_pack->fetch<kis_gps_packinfo>(pack_comp_gps);
+
+    if (track_persource_history) {
+        double f = -1;
+
+        if (pack_l1info != nullptr)
+            f = pack_l1info->freq_khz;
+
+        packinfo_sig_combo sc(pack_l1info, pack_gpsinfo);
+        device->inc_seenby_count(pack_datasrc->ref_source, in_pack->ts.tv_sec, f, &sc, !ram_no_rrd);
+    } else {
+        device->inc_seenby_count(pack_datasrc->ref_source, in_pack->ts.tv_sec, 0, 0, false);
+    }
+
+    if (map_seenby_views)
+        update_view_device(device);
 }
 
 std::shared_ptr<tracker_element_vector> device_tracker::do_readonly_device_work(device_tracker_view_worker& worker, 
@@ -1394,107 +2581,110 @@ std::shared_ptr<tracker_element_vector> device_tracker::do_readonly_device_work(
     return all_view->do_readonly_device_work(worker);
 }
 
-// Simple std::sort comparison function to order by the least frequently
-// seen devices
-bool devicetracker_sort_lastseen(std::shared_ptr<kis_tracked_device_base> a,
-	std::shared_ptr<kis_tracked_device_base> b) {
-
-	return a->get_last_time() < b->get_last_time();
-}
-
 void device_tracker::timetracker_event(int eventid) {
     if (eventid == device_idle_timer) {
-        kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker timetracker_event device_idle_timer");
-
         time_t ts_now = time(0);
-        bool purged = false;
-
-        // Find all eligible devices, remove them from the tracked vec
-        tracked_vec.erase(std::remove_if(tracked_vec.begin(), tracked_vec.end(),
-                [&](std::shared_ptr<kis_tracked_device_base> d) {
-                    if (ts_now - d->get_last_time() > device_idle_expiration &&
-                            (d->get_packets() < device_idle_min_packets || 
-                             device_idle_min_packets <= 0)) {
-                        device_itr mi = tracked_map.find(d->get_key());
-
-                        if (mi != tracked_map.end())
-                            tracked_map.erase(mi);
-
-                        // Erase it from the multimap
-                        auto mmp = tracked_mac_multimap.equal_range(d->get_macaddr());
-
-                        for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
-                            if (mmpi->second->get_key() == d->get_key()) {
-                                tracked_mac_multimap.erase(mmpi);
-                                break;
-                            }
-                        }
 
-                        // Forget it from any views
-                        remove_view_device(d);
+        {
+            kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker timetracker_event device_idle_timer");
 
-                        // Forget it from the immutable vec, but keep its 
-                        // position; we need to have vecpos = devid
-                        auto iti = immutable_tracked_vec->begin() + d->get_kis_internal_id();
-                        (*iti).reset();
+            // Only devices whose idle slot has come due are examined
+            std::vector<std::shared_ptr<kis_tracked_device_base>> due;
+            std::vector<std::shared_ptr<kis_tracked_device_base>> expired;
 
-                        purged = true;
+            idle_wheel.advance(ts_now, due);
 
-                        return true;
-                    }
+            for (const auto& d : due) {
+                // Packet counts only go up, so a device over the minimum can never be
+                // eligible again and leaves the wheel
+                if (device_idle_min_packets > 0 && d->get_packets() >= device_idle_min_packets)
+                    continue;
+
+                if (ts_now - d->get_last_time() > device_idle_expiration) {
+                    expired.push_back(d);
+                    continue;
+                }
 
-                    return false;
-         
-                    }), tracked_vec.end());
+                // Seen since it was scheduled, re-bucket by the current last time
+                idle_wheel.schedule(d, d->get_last_time() + device_idle_expiration + 1);
+            }
 
-        if (purged)
-            update_full_refresh();
+            // Remove them from the device store, then forget them from any views
+            auto removed = remove_devices(expired);
 
-    } else if (eventid == max_devices_timer) {
-        kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker timetracker_event max_devices_timer");
+            remove_view_devices(removed);
 
+            if (removed.size() > 0)
+                update_full_refresh();
+        }
+
+        // Stubs have their own lock, the database work doesn't need to hold up the tracker
+        expire_hibernated_devices(ts_now);
+
+    } else if (eventid == device_hibernate_timer) {
+        hibernate_devices(time(0));
+    } else if (eventid == max_devices_timer) {
 		// Do nothing if we don't care
 		if (max_num_devices <= 0)
             return;
 
 		// Do nothing if the number of devices is less than the max
-		if (tracked_vec.size() <= max_num_devices)
+		if (num_tracked_devices <= max_num_devices)
             return;
 
-        // Do an update since we're trimming something
-        update_full_refresh();
+        // Snapshot the last time of every device; this is the only part which needs the
+        // devicelist lock, the selection runs without blocking the packet threads
+        std::vector<std::tuple<uint64_t, uint64_t, std::shared_ptr<kis_tracked_device_base>>> candidates;
+
+        {
+            kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), 
+                    "device_tracker timetracker_event max_devices_timer");
+
+            candidates.reserve(num_tracked_devices);
+
+            for_each_device([&candidates](const std::shared_ptr<kis_tracked_device_base>& d) {
+                    candidates.emplace_back(d->get_last_time(), d->get_kis_internal_id(), d);
+                    });
+        }
 
-		// Now things start getting expensive.  Start by sorting the
-		// vector of devices - anything else that has to sort the entire list
-        // has to sort it themselves
-        std::stable_sort(tracked_vec.begin(), tracked_vec.end(), 
-                devicetracker_sort_lastseen);
+        if (candidates.size() <= max_num_devices)
+            return;
 
-        tracked_vec.erase(std::remove_if(tracked_vec.begin() + max_num_devices, tracked_vec.end(),
-                [&](std::shared_ptr<kis_tracked_device_base> d) {
-                    device_itr mi = tracked_map.find(d->get_key());
+        // Trim down to the low water mark so we don't evict again on the next pass
+        size_t num_evict = candidates.size() - (max_num_devices - max_devices_slack);
+
+        // Partition the oldest devices to the front; ties go to the older device ID.  
+        // This is linear, we don't need the devices in order, just the set.
+        auto nth = candidates.begin() + num_evict;
+        std::nth_element(candidates.begin(), nth, candidates.end(),
+                [](const std::tuple<uint64_t, uint64_t, std::shared_ptr<kis_tracked_device_base>>& a,
+                    const std::tuple<uint64_t, uint64_t, std::shared_ptr<kis_tracked_device_base>>& b) -> bool {
+                    if (std::get<0>(a) != std::get<0>(b))
+                        return std::get<0>(a) < std::get<0>(b);
+                    return std::get<1>(a) < std::get<1>(b);
+                });
 
-                    if (mi != tracked_map.end())
-                        tracked_map.erase(mi);
+        std::vector<std::shared_ptr<kis_tracked_device_base>> evict_vec;
+        evict_vec.reserve(num_evict);
 
-                    // Erase it from the multimap
-                    auto mmp = tracked_mac_multimap.equal_range(d->get_macaddr());
+        kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), 
+                "device_tracker timetracker_event max_devices_timer");
 
-                    for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
-                        if (mmpi->second->get_key() == d->get_key()) {
-                            tracked_mac_multimap.erase(mmpi);
-                            break;
-                        }
-                    }
+        // Devices seen again since the snapshot aren't the oldest any more and are kept
+        for (auto i = candidates.begin(); i != nth; ++i) {
+            if ((uint64_t) std::get<2>(*i)->get_last_time() == std::get<0>(*i))
+                evict_vec.push_back(std::get<2>(*i));
+        }
 
-                    // Forget it from the immutable vec, but keep its 
-                    // position; we need to have vecpos = devid
-                    auto iti = immutable_tracked_vec->begin() + d->get_kis_internal_id();
-                    (*iti).reset();
+        candidates.clear();
 
-                    return true;
-         
-                    }), tracked_vec.end());
+        // Devices removed since the snapshot are skipped
+        auto removed = remove_devices(evict_vec);
+
+        remove_view_devices(removed);
+
+        if (removed.size() > 0)
+            update_full_refresh();
 	}
 }
 
@@ -1585,7 +2775,29 @@ int device_tracker::database_upgrade_db() {
         }
     }
 
-    database_set_db_version(4);
+    if (dbv < 5) {
+        // Idle devices moved out of memory; records are only meaningful to the process
+        // which wrote them
+        sql = 
+            "CREATE TABLE device_hibernation ("
+            "key TEXT, "
+            "last_time INT, "
+            "record BLOB, "
+            "UNIQUE(key) ON CONFLICT REPLACE)";
+
+        r = sqlite3_exec(db, sql.c_str(),
+                [] (void *, int, char **, char **) -> int { return 0; }, NULL, &sErrMsg);
+
+        if (r != SQLITE_OK) {
+            _MSG("device_tracker unable to create device_hibernation table in " + ds_dbfile + ": " +
+                    std::string(sErrMsg), MSGFLAG_ERROR);
+            sqlite3_close(db);
+            db = NULL;
+            return -1;
+        }
+    }
+
+    database_set_db_version(5);
 
     return 0;
 }
@@ -1593,22 +2805,11 @@ int device_tracker::database_upgrade_db() {
 void device_tracker::add_device(std::shared_ptr<kis_tracked_device_base> device) {
     kis_lock_guard<kis_mutex> lk(get_devicelist_mutex(), "device_tracker add_device");
 
-    if (fetch_device_nr(device->get_key()) != NULL) {
+    if (!insert_device_shard(device)) {
         _MSG("device_tracker tried to add device " + device->get_macaddr().mac_to_string() + 
                 " which already exists", MSGFLAG_ERROR);
         return;
     }
-
-    // Device ID is the size of the vector so a new device always gets put
-    // in it's numbered slot
-    device->set_kis_internal_id(immutable_tracked_vec->size());
-
-    tracked_map[device->get_key()] = device;
-    tracked_vec.push_back(device);
-    immutable_tracked_vec->push_back(device);
-
-    auto mm_pair = std::make_pair(device->get_macaddr(), device);
-    tracked_mac_multimap.emplace(mm_pair);
 }
 
 bool device_tracker::add_view(std::shared_ptr<device_tracker_view> in_view) {
@@ -1622,7 +2823,8 @@ bool device_tracker::add_view(std::shared_ptr<device_tracker_view> in_view) {
 
     view_vec->push_back(in_view);
 
-    for (const auto& i : *immutable_tracked_vec) {
+    // Populate the view from a copy so the shard locks aren't held inside the view
+    for (const auto& i : *fetch_all_devices()) {
         auto di = std::static_pointer_cast<kis_tracked_device_base>(i);
         in_view->new_device(di);
     }
@@ -1643,7 +2845,8 @@ void device_tracker::remove_view(const std::string& in_id) {
 }
 
 void device_tracker::new_view_device(std::shared_ptr<kis_tracked_device_base> in_device) {
-    kis_lock_guard<kis_mutex> lk(devicelist_mutex);
+    device_update_lock ulk(this, {in_device->get_key()}, "device_tracker new_view_device");
+    kis_lock_guard<kis_mutex> lk(device_update_mutex, "device_tracker new_view_device");
 
     for (const auto& i : *view_vec) {
         auto vi = std::static_pointer_cast<device_tracker_view>(i);
@@ -1652,7 +2855,10 @@ void device_tracker::new_view_device(std::shared_ptr<kis_tracked_device_base> in
 }
 
 void device_tracker::update_view_device(std::shared_ptr<kis_tracked_device_base> in_device) {
-    kis_lock_guard<kis_mutex> lk(devicelist_mutex);
+    device_update_lock ulk(this, {in_device->get_key()}, "device_tracker update_view_device");
+    kis_lock_guard<kis_mutex> lk(device_update_mutex, "device_tracker update_view_device");
+
+    change_log.record(in_device);
 
     for (const auto& i : *view_vec) {
         auto vi = std::static_pointer_cast<device_tracker_view>(i);
@@ -1660,6 +2866,30 @@ void device_tracker::update_view_device(std::shared_ptr<kis_tracked_device_base>
     }
 }
 
+void device_tracker::touch_view_device(std::shared_ptr<kis_tracked_device_base> in_device) {
+    device_update_lock ulk(this, {in_device->get_key()}, "device_tracker touch_view_device");
+    kis_lock_guard<kis_mutex> lk(device_update_mutex, "device_tracker touch_view_device");
+
+    for (const auto& i : *view_vec) {
+        auto vi = std::static_pointer_cast<device_tracker_view>(i);
+        vi->touch_device(in_device);
+    }
+}
+
+std::string device_tracker::verify_view_sort_indexes() {
+    kis_lock_guard<kis_mutex> lk(devicelist_mutex);
+
+    for (const auto& i : *view_vec) {
+        auto vi = std::static_pointer_cast<device_tracker_view>(i);
+        auto err = vi->verify_sort_indexes();
+
+        if (err.length())
+            return err;
+    }
+
+    return "";
+}
+
 void device_tracker::remove_view_device(std::shared_ptr<kis_tracked_device_base> in_device) {
     kis_lock_guard<kis_mutex> lk(devicelist_mutex);
 
@@ -1669,6 +2899,18 @@ void device_tracker::remove_view_device(std::shared_ptr<kis_tracked_device_base>
     }
 }
 
+void device_tracker::remove_view_devices(const std::vector<std::shared_ptr<kis_tracked_device_base>>& in_devices) {
+    if (in_devices.size() == 0)
+        return;
+
+    kis_lock_guard<kis_mutex> lk(devicelist_mutex);
+
+    for (const auto& i : *view_vec) {
+        auto vi = std::static_pointer_cast<device_tracker_view>(i);
+        vi->remove_devices(in_devices);
+    }
+}
+
 std::shared_ptr<device_tracker_view> device_tracker::get_phy_view(int in_phyid) {
     kis_lock_guard<kis_mutex> lk(devicelist_mutex);
 
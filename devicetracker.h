@@ -29,6 +29,8 @@
 #include <unordered_map>
 #include <vector>
 #include <algorithm>
+#include <functional>
+#include <memory>
 #include <string>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -86,6 +88,7 @@ public:
 	virtual ~device_tracker();
 
     virtual void trigger_deferred_startup() override;
+    virtual void trigger_deferred_shutdown() override;
 
 	// Register a phy handler weak class, used to instantiate the strong class
 	// inside devtracker
@@ -115,16 +118,26 @@ public:
     // components due to timeouts / max device cleanup
     void update_full_refresh();
 
-	// Look for an existing device record under read-only shared lock
+	// Look for an existing device record; only the shard holding the key is locked
     std::shared_ptr<kis_tracked_device_base> fetch_device(device_key in_key);
 
-    // Fetch one or more devices by mac address or mac mask
+    // Fetch one or more devices by mac address or mac mask; hibernated devices are
+    // only restored by fetch_device
     std::vector<std::shared_ptr<kis_tracked_device_base>> fetch_devices(mac_addr in_mac);
 
-    // Look for an existing device record, without lock - must be called under some form of existing
-    // lock to be safely used
+    // Historical alias of fetch_device; the device store is protected by its own shard
+    // locks so this no longer requires the devicelist lock to be held
     std::shared_ptr<kis_tracked_device_base> fetch_device_nr(device_key in_key);
 
+    // Cross-shard iteration over every tracked device.  Shards are locked one at a time
+    // while the callback runs over the devices in that shard.  Shard locks are leaf locks:
+    // the callback must not fetch other devices, and must not take the devicelist lock
+    // unless the caller already holds it.
+    void for_each_device(const std::function<void (const std::shared_ptr<kis_tracked_device_base>&)>& fn);
+
+    // Snapshot of all tracked devices, collected shard by shard
+    std::shared_ptr<tracker_element_vector> fetch_all_devices();
+
     // Do work on all devices, this applies to the 'all' device view
     std::shared_ptr<tracker_element_vector> do_device_work(device_tracker_view_worker& worker);
     std::shared_ptr<tracker_element_vector> do_readonly_device_work(device_tracker_view_worker& worker);
@@ -191,6 +204,11 @@ public:
             mac_addr in_mac, kis_phy_handler *phy, kis_packet *in_pack, unsigned int in_flags,
             std::string in_basic_type);
 
+    // Merge the per-source seenby data of a packet into an existing device, without
+    // any of the other common updates; used when a duplicate packet from another 
+    // source is discarded before dissection.  Unknown devices are ignored.
+    void update_device_seenby(kis_packet *in_pack, const device_key& in_key);
+
     // Set the common name of a device (and log it in the database for future runs)
     void set_device_user_name(std::shared_ptr<kis_tracked_device_base> in_dev,
             std::string in_username);
@@ -221,7 +239,14 @@ public:
 
     virtual void new_view_device(std::shared_ptr<kis_tracked_device_base> in_device);
     virtual void update_view_device(std::shared_ptr<kis_tracked_device_base> in_device);
+    // Flag a device whose sortable fields changed so that view sort indexes re-key it
+    virtual void touch_view_device(std::shared_ptr<kis_tracked_device_base> in_device);
     virtual void remove_view_device(std::shared_ptr<kis_tracked_device_base> in_device);
+    virtual void remove_view_devices(const std::vector<std::shared_ptr<kis_tracked_device_base>>& in_devices);
+
+    // Check every view's sort indexes against a full sort; see
+    // device_tracker_view::verify_sort_indexes
+    std::string verify_view_sort_indexes();
 
     // Get phy views
     std::shared_ptr<device_tracker_view> get_phy_view(int in_phy);
@@ -232,11 +257,48 @@ public:
     // Get a cached phyname; use this to de-dup thousands of devices phynames
     std::shared_ptr<tracker_element_string> get_cached_phyname(const std::string& phyname);
 
+    // Monitor change feed; see device_change_log.  A cursor of 0 is unset.
+    uint64_t get_device_change_head();
+    bool fetch_changed_devices(uint64_t& in_cursor, 
+            std::vector<std::shared_ptr<kis_tracked_device_base>>& ret);
+
+    // Shared pool for parallel read-only device work; nullptr when parallel
+    // workers are disabled
+    device_tracker_worker_pool *get_worker_pool() {
+        return worker_pool.get();
+    }
+
+    // Field paths views may maintain incremental sort indexes for
+    const std::vector<std::string>& get_view_sort_index_fields() const {
+        return view_sort_index_fields;
+    }
+
     // Expose to devicelist mutex for external batch locking
     kis_mutex& get_devicelist_mutex() {
         return devicelist_mutex;
     }
 
+    // Per-packet device update lock.  Updates to devices in different shards run in
+    // parallel, and the devicelist lock excludes all of them.  Phys which update several
+    // devices from one packet pass every key they will touch up front; a nested lock
+    // which needs a shard below one this thread already holds may have to release and
+    // retake this thread's shard locks to keep them in order.  Inside the devicelist
+    // lock this does nothing.
+    class device_update_lock {
+    public:
+        device_update_lock(device_tracker *in_tracker, const std::vector<device_key>& in_keys,
+                const std::string& in_op = "UNKNOWN");
+        ~device_update_lock();
+
+        device_update_lock(const device_update_lock&) = delete;
+        device_update_lock& operator=(const device_update_lock&) = delete;
+
+    protected:
+        device_tracker *tracker;
+        std::string op;
+        bool active;
+    };
+
 protected:
     std::shared_ptr<entry_tracker> entrytracker;
     std::shared_ptr<packet_chain> packetchain;
@@ -291,10 +353,135 @@ protected:
     // being timed out
     unsigned int device_idle_min_packets;
 
-    // Maximum number of devices
+    // Hashed timing wheel of devices, bucketed by the time they would become idle, so
+    // that the idle timer only looks at devices which may actually be due.  Devices are
+    // placed in the wheel when they are created; updating a device does not touch the
+    // wheel.  When a device's slot comes due it is expired, or re-bucketed by its
+    // current last-seen time.  Protected by device_update_mutex or the
+    // devicelist lock.
+    class device_idle_wheel {
+    public:
+        device_idle_wheel() :
+            granularity{1},
+            cursor{0} { }
+
+        // Size the wheel to cover in_span seconds in slots of in_granularity seconds
+        void configure(time_t in_granularity, time_t in_span, time_t in_now);
+
+        // Place a device in the slot for in_due, or the next slot to be examined if
+        // in_due has already passed
+        void schedule(const std::shared_ptr<kis_tracked_device_base>& in_device, time_t in_due);
+
+        // Empty every slot due at or before in_now into ret, skipping devices which
+        // no longer exist
+        void advance(time_t in_now, std::vector<std::shared_ptr<kis_tracked_device_base>>& ret);
+
+    protected:
+        time_t granularity;
+        // Absolute number of the next slot to be examined
+        uint64_t cursor;
+        std::vector<std::vector<std::weak_ptr<kis_tracked_device_base>>> slots;
+    };
+
+    device_idle_wheel idle_wheel;
+
+    // Devices idle longer than the hibernation time are serialized into the
+    // database and dropped from memory, leaving only a stub; fetching the device
+    // by key restores it.  Lookups by mac address and device views only see
+    // devices in memory, a hibernated device reappears in them once it has been
+    // fetched by key (for instance when a packet from it is processed).  Records
+    // use this process's field ids and are discarded at startup.
+    int device_hibernate_time;
+    int device_hibernate_timer;
+
+    device_idle_wheel hibernate_wheel;
+
+    // Stubs are protected by their own leaf lock so that a fetch miss only escalates
+    // to the devicelist lock when the device really is hibernated.  Stubs which can
+    // expire are indexed by last time so expiration only looks at the due ones.
+    using hibernated_expiry_t = std::multimap<time_t, device_key>;
+
+    struct hibernated_device {
+        hibernated_expiry_t::iterator expiry;
+    };
+
+    kis_mutex hibernated_mutex;
+    std::unordered_map<device_key, hibernated_device> hibernated_devices;
+    hibernated_expiry_t hibernated_expiry;
+    std::atomic<size_t> num_hibernated_devices;
+
+    // Move idle devices due in the hibernation wheel to the database
+    void hibernate_devices(time_t in_now);
+    // Drop hibernated devices which have passed the idle expiration
+    void expire_hibernated_devices(time_t in_now);
+    // Delete hibernation records from the database
+    void delete_hibernated_records(const std::vector<std::string>& in_keys);
+    // Restore a hibernated device into the store and views; returns nullptr if the
+    // device isn't hibernated
+    std::shared_ptr<kis_tracked_device_base> rehydrate_device(const device_key& in_key);
+
+    // Binary snapshot of every tracked device, written periodically and at shutdown
+    // and restored at startup before packets are processed
+    bool device_snapshot_enabled;
+    std::string device_snapshot_file;
+    int device_snapshot_timer;
+    std::atomic<bool> device_snapshot_writing;
+
+    void write_device_snapshot();
+    void load_device_snapshot();
+
+    // Ring of recently modified devices, ordered by a change sequence number.  Each
+    // device holds at most one slot; logging it again moves it to the head, so the
+    // ring holds the most recently changed distinct devices.  Monitor subscribers
+    // keep their own cursor into the shared ring and only look at what changed since
+    // their last read.  Protected by device_update_mutex or the
+    // devicelist lock.
+    class device_change_log {
+    public:
+        device_change_log() :
+            next_seq{1} { }
+
+        void configure(size_t in_capacity);
+
+        void record(const std::shared_ptr<kis_tracked_device_base>& in_device);
+
+        // Sequence number the next change will get; a cursor at head is caught up
+        uint64_t head() const {
+            return next_seq;
+        }
+
+        // Append every device changed at or after in_cursor to ret and advance the
+        // cursor to the head.  Returns false without touching ret when the cursor is
+        // unset or has been lapped by the ring, in which case the caller must fall
+        // back to examining every device.
+        bool since(uint64_t& in_cursor, std::vector<std::shared_ptr<kis_tracked_device_base>>& ret);
+
+    protected:
+        struct change_entry {
+            uint64_t seq = 0;
+            device_key key;
+            std::weak_ptr<kis_tracked_device_base> device;
+        };
+
+        uint64_t next_seq;
+        std::vector<change_entry> ring;
+        std::unordered_map<device_key, uint64_t> logged_seq;
+    };
+
+    device_change_log change_log;
+
+    // Maximum number of devices, and how far below the maximum we trim when we
+    // go over it
     unsigned int max_num_devices;
+    unsigned int max_devices_slack;
     int max_devices_timer;
 
+    // Threads for parallel read-only device work
+    std::unique_ptr<device_tracker_worker_pool> worker_pool;
+
+    // Sortable fields views may index
+    std::vector<std::string> view_sort_index_fields;
+
     // Timer event for storing devices
     int device_storage_timer;
 
@@ -333,19 +520,98 @@ protected:
     // Signal threshold
     int device_location_signal_threshold;
 
-	// Tracked devices
-    device_map_t tracked_map;
-	// Vector of tracked devices so we can iterate them quickly
-    std::vector<std::shared_ptr<kis_tracked_device_base> > tracked_vec;
-    // MAC address lookups are incredibly expensive from the webui if we don't
-    // track by map; in theory multiple objects in different PHYs could have the
-    // same MAC so it's not a simple 1:1 map
-    std::multimap<mac_addr, std::shared_ptr<kis_tracked_device_base> > tracked_mac_multimap;
-
-    // Immutable vector, one entry per device; may never be sorted.  Devices
-    // which are removed are set to 'null'.  Each position corresponds to the
-    // device ID.
-    std::shared_ptr<tracker_element_vector> immutable_tracked_vec;
+    // Tracked devices are partitioned into independently locked shards by device key
+    // hash, so that lookups, insertion, and removal don't serialize on one lock.  Device
+    // contents are guarded by the shard update lock, or the devicelist lock which
+    // excludes every update.  Lock order is the devicelist lock, the shard update locks
+    // in ascending shard order, then the leaf locks (shard mutex, device_update_mutex,
+    // hibernated_mutex).
+    class device_shard {
+    public:
+        device_shard() {
+            mutex.set_name("devicetracker::shard");
+            update_mutex.set_name("devicetracker::shard_update");
+        }
+
+        // Leaf lock for the containers below
+        kis_mutex mutex;
+
+        // Held by device updates for devices in this shard; see device_update_lock
+        kis_mutex update_mutex;
+
+        // Vector of tracked devices so we can iterate them quickly; unordered, a removed
+        // device is replaced by the last device in the vector
+        std::vector<std::shared_ptr<kis_tracked_device_base>> vec;
+        // Position of each device in vec, by key
+        robin_hood::unordered_flat_map<device_key, size_t> map;
+
+        std::shared_ptr<kis_tracked_device_base> find(const device_key& in_key) const {
+            auto i = map.find(in_key);
+
+            if (i == map.end())
+                return nullptr;
+
+            return vec[i->second];
+        }
+        // MAC address lookups are incredibly expensive from the webui if we don't
+        // track by map; in theory multiple objects in different PHYs could have the
+        // same MAC so it's not a simple 1:1 map
+        std::multimap<mac_addr, std::shared_ptr<kis_tracked_device_base>> mac_multimap;
+    };
+
+    std::vector<std::unique_ptr<device_shard>> device_shards;
+    unsigned int device_shard_bits;
+    std::atomic<size_t> num_tracked_devices;
+
+    // Device IDs are assigned in creation order across all shards
+    std::atomic<uint64_t> next_device_id;
+
+    unsigned int shard_index_for_key(const device_key& in_key);
+    device_shard& shard_for_key(const device_key& in_key);
+
+    // Insert a device into its shard, assigning the device ID; returns false if a device
+    // with the same key already exists
+    bool insert_device_shard(std::shared_ptr<kis_tracked_device_base> in_device);
+
+    // The devicelist lock.  Holding it excludes every device update, so it's taken by
+    // the endpoints, the timers, and anything which changes the device store or the views
+    // as a whole.  A thread inside a device update which takes it gives up its update
+    // locks until it releases the devicelist lock again.
+    class device_list_mutex : public kis_mutex {
+    public:
+        device_list_mutex(device_tracker *in_tracker) :
+            kis_mutex(),
+            tracker{in_tracker} { }
+
+        virtual void lock() override;
+        virtual bool try_lock() override;
+        virtual void unlock() override;
+
+    protected:
+        device_tracker *tracker;
+    };
+
+    // Held shared by device updates and exclusively by the devicelist lock; new updates
+    // wait while a devicelist lock is waiting so they can't starve it
+    kis_shared_mutex update_gate;
+    std::atomic<unsigned int> update_gate_waiting;
+
+    void acquire_update_gate();
+    void lock_update_shards(const std::vector<device_key>& in_keys);
+    // Release this thread's update locks, keeping the list of shards unless in_forget
+    void release_update_locks(bool in_forget);
+    void reacquire_update_locks();
+
+    // Guards the state shared by concurrent device updates: the views, the change log,
+    // the idle and hibernation wheels, and the flagged device list.  Holders of the
+    // devicelist lock don't need it, and the devicelist lock must never be taken under it.
+    kis_mutex device_update_mutex;
+
+    // Remove a list of devices from the store, only locking and scanning the shards
+    // which hold them; returns the devices which were still tracked and were removed.
+    // Views are not updated.
+    std::vector<std::shared_ptr<kis_tracked_device_base>>
+        remove_devices(const std::vector<std::shared_ptr<kis_tracked_device_base>>& in_devices);
 
     // List of views using new API as we transition the rest to the new API
     std::shared_ptr<tracker_element_vector> view_vec;
@@ -366,7 +632,7 @@ protected:
     kis_mutex phy_mutex;
 
     // New multimutex primitive
-    kis_mutex devicelist_mutex;
+    device_list_mutex devicelist_mutex;
 
     kis_mutex storing_mutex;
     std::atomic<bool> devices_storing;
@@ -321,32 +321,32 @@ void kis_tracked_signal_data::register_fields() {
 }
 
 kis_tracked_seenby_data::kis_tracked_seenby_data() :
-    tracker_component() {
+    tracker_flat_component(),
+    flat{} {
     register_fields();
     reserve_fields(NULL);
 }
 
 kis_tracked_seenby_data::kis_tracked_seenby_data(int in_id) : 
-    tracker_component(in_id) { 
+    tracker_flat_component(in_id),
+    flat{} {
     register_fields();
     reserve_fields(NULL);
 } 
 
 kis_tracked_seenby_data::kis_tracked_seenby_data(int in_id, std::shared_ptr<tracker_element_map> e) :
-    tracker_component(in_id) {
+    tracker_flat_component(in_id),
+    flat{} {
     register_fields();
     reserve_fields(e);
 }
 
 kis_tracked_seenby_data::kis_tracked_seenby_data(const kis_tracked_seenby_data *p) :
-    tracker_component{p} {
+    tracker_flat_component{p},
+    flat{} {
     
     __ImportId(src_uuid_id, p);
 
-    __ImportField(first_time, p);
-    __ImportField(last_time, p);
-    __ImportField(num_packets, p);
-
     __ImportId(freq_khz_map, p);
     __ImportId(freq_khz_map_id, p);
     __ImportId(signal_data_id, p);
@@ -366,15 +366,17 @@ void kis_tracked_seenby_data::inc_frequency_count(int frequency) {
 }
 
 void kis_tracked_seenby_data::register_fields() {
-    tracker_component::register_fields();
+    tracker_flat_component::register_fields();
 
     src_uuid_id =
         register_dynamic_field("kismet.common.seenby.uuid", "UUID of source", &src_uuid);
 
-    register_field("kismet.common.seenby.first_time", "first time seen time_t", &first_time);
-    register_field("kismet.common.seenby.last_time", "last time seen time_t", &last_time);
-    register_field("kismet.common.seenby.num_packets", 
-            "number of packets seen by this device", &num_packets);
+    register_flat_field<tracker_element_uint64>("kismet.common.seenby.first_time", 
+            "first time seen time_t", &flat.first_time);
+    register_flat_field<tracker_element_uint64>("kismet.common.seenby.last_time", 
+            "last time seen time_t", &flat.last_time);
+    register_flat_field<tracker_element_uint64>("kismet.common.seenby.num_packets", 
+            "number of packets seen by this device", &flat.num_packets);
 
     freq_khz_map_id =
         register_dynamic_field("kismet.common.seenby.freq_khz_map", 
@@ -442,7 +444,7 @@ void kis_tracked_device_base::inc_seenby_count(kis_datasource *source,
 }
 
 void kis_tracked_device_base::register_fields() {
-    tracker_component::register_fields();
+    tracker_flat_component::register_fields();
     
     phy_id = 0;
 
@@ -455,23 +457,35 @@ void kis_tracked_device_base::register_fields() {
     register_field("kismet.device.base.commonname", 
             "common name alias of custom or device names", &commonname);
     register_field("kismet.device.base.type", "printable device type", &type_string);
-    register_field("kismet.device.base.basic_type_set", "bitset of basic type", &basic_type_set);
+    register_flat_field<tracker_element_uint64>("kismet.device.base.basic_type_set", 
+            "bitset of basic type", &flat.basic_type_set);
     register_field("kismet.device.base.crypt", "printable encryption type", &crypt_string);
-    register_field("kismet.device.base.basic_crypt_set", 
-            "bitset of basic encryption", &basic_crypt_set);
-    register_field("kismet.device.base.first_time", "first time seen time_t", &first_time);
-    register_field("kismet.device.base.last_time", "last time seen time_t", &last_time);
-    register_field("kismet.device.base.mod_time", 
-            "timestamp of last seen time (local clock)", &mod_time);
-    register_field("kismet.device.base.packets.total", "total packets seen of all types", &packets);
-    register_field("kismet.device.base.packets.rx", "observed packets sent to device", &rx_packets);
-    register_field("kismet.device.base.packets.tx", "observed packets from device", &tx_packets);
-    register_field("kismet.device.base.packets.llc", "observed protocol control packets", &llc_packets);
-    register_field("kismet.device.base.packets.error", "corrupt/error packets", &error_packets);
-    register_field("kismet.device.base.packets.data", "data packets", &data_packets);
-    register_field("kismet.device.base.packets.crypt", "data packets using encryption", &crypt_packets);
-    register_field("kismet.device.base.packets.filtered", "packets dropped by filter", &filter_packets);
-    register_field("kismet.device.base.datasize", "transmitted data in bytes", &datasize);
+    register_flat_field<tracker_element_uint64>("kismet.device.base.basic_crypt_set", 
+            "bitset of basic encryption", &flat.basic_crypt_set);
+    register_flat_field<tracker_element_uint64>("kismet.device.base.first_time", 
+            "first time seen time_t", &flat.first_time);
+    register_flat_field<tracker_element_uint64>("kismet.device.base.last_time", 
+            "last time seen time_t", &flat.last_time);
+    register_flat_field<tracker_element_uint64>("kismet.device.base.mod_time", 
+            "timestamp of last seen time (local clock)", &flat.mod_time);
+    register_flat_field<tracker_element_uint64>("kismet.device.base.packets.total", 
+            "total packets seen of all types", &flat.packets);
+    register_flat_field<tracker_element_uint64>("kismet.device.base.packets.rx", 
+            "observed packets sent to device", &flat.rx_packets);
+    register_flat_field<tracker_element_uint64>("kismet.device.base.packets.tx", 
+            "observed packets from device", &flat.tx_packets);
+    register_flat_field<tracker_element_uint64>("kismet.device.base.packets.llc", 
+            "observed protocol control packets", &flat.llc_packets);
+    register_flat_field<tracker_element_uint64>("kismet.device.base.packets.error", 
+            "corrupt/error packets", &flat.error_packets);
+    register_flat_field<tracker_element_uint64>("kismet.device.base.packets.data", 
+            "data packets", &flat.data_packets);
+    register_flat_field<tracker_element_uint64>("kismet.device.base.packets.crypt", 
+            "data packets using encryption", &flat.crypt_packets);
+    register_flat_field<tracker_element_uint64>("kismet.device.base.packets.filtered", 
+            "packets dropped by filter", &flat.filter_packets);
+    register_flat_field<tracker_element_uint64>("kismet.device.base.datasize", 
+            "transmitted data in bytes", &flat.datasize);
     
     packets_rrd_id =
         register_dynamic_field("kismet.device.base.packets.rrd", "packet rate rrd", &packets_rrd);
@@ -482,9 +496,11 @@ void kis_tracked_device_base::register_fields() {
 
     register_field("kismet.device.base.freq_khz_map", "packets seen per frequency (khz)", &freq_khz_map);
     register_field("kismet.device.base.channel", "channel (phy specific)", &channel);
-    register_field("kismet.device.base.frequency", "frequency", &frequency);
+    register_flat_field<tracker_element_double>("kismet.device.base.frequency", 
+            "frequency", &flat.frequency);
     register_field("kismet.device.base.manuf", "manufacturer name", &manuf);
-    register_field("kismet.device.base.num_alerts", "number of alerts on this device", &alert);
+    register_flat_field<tracker_element_uint32>("kismet.device.base.num_alerts", 
+            "number of alerts on this device", &flat.alert);
     
     tag_map_id =
         register_dynamic_field("kismet.device.base.tags", "set of arbitrary tags, including user notes", &tag_map);
@@ -517,7 +533,7 @@ void kis_tracked_device_base::register_fields() {
 }
 
 void kis_tracked_device_base::reserve_fields(std::shared_ptr<tracker_element_map> e) {
-    tracker_component::reserve_fields(e);
+    tracker_flat_component::reserve_fields(e);
 
     seenby_map->set_as_vector(true);
 
@@ -149,7 +149,7 @@ protected:
     int sig_type;
 };
 
-class kis_tracked_seenby_data : public tracker_component {
+class kis_tracked_seenby_data : public tracker_flat_component {
 public:
     kis_tracked_seenby_data();
     kis_tracked_seenby_data(int in_id);
@@ -163,10 +163,10 @@ public:
     }
 
     __ProxyDynamicTrackable(src_uuid, tracker_element_alias, src_uuid, src_uuid_id);
-    __Proxy(first_time, uint64_t, time_t, time_t, first_time);
-    __Proxy(last_time, uint64_t, time_t, time_t, last_time);
-    __Proxy(num_packets, uint64_t, uint64_t, uint64_t, num_packets);
-    __ProxyIncDec(num_packets, uint64_t, uint64_t, num_packets);
+    __ProxyFlat(first_time, uint64_t, time_t, time_t, flat.first_time);
+    __ProxyFlat(last_time, uint64_t, time_t, time_t, flat.last_time);
+    __ProxyFlat(num_packets, uint64_t, uint64_t, uint64_t, flat.num_packets);
+    __ProxyFlatIncDec(num_packets, uint64_t, uint64_t, flat.num_packets);
 
     __ProxyDynamicTrackable(freq_khz_map, tracker_element_double_map_double, freq_khz_map, freq_khz_map_id);
     __ProxyDynamicTrackable(signal_data, kis_tracked_signal_data, signal_data, signal_data_id);
@@ -179,9 +179,11 @@ protected:
     std::shared_ptr<tracker_element_alias> src_uuid;
     int src_uuid_id;
 
-    std::shared_ptr<tracker_element_uint64> first_time;
-    std::shared_ptr<tracker_element_uint64> last_time;
-    std::shared_ptr<tracker_element_uint64> num_packets;
+    struct {
+        uint64_t first_time;
+        uint64_t last_time;
+        uint64_t num_packets;
+    } flat;
 
     std::shared_ptr<tracker_element_double_map_double> freq_khz_map;
     int freq_khz_map_id;
@@ -325,28 +327,32 @@ protected:
 #define KIS_DEVICE_BASICCRYPT_DECRYPTED	(1 << 5)
 
 // Base of all device tracking under the new trackerentry system
-class kis_tracked_device_base : public tracker_component {
+class kis_tracked_device_base : public tracker_flat_component {
 public:
     kis_tracked_device_base() :
-        tracker_component() {
+        tracker_flat_component(),
+        flat{} {
         register_fields();
         reserve_fields(NULL);
     }
 
     kis_tracked_device_base(int in_id) :
-        tracker_component(in_id) {
+        tracker_flat_component(in_id),
+        flat{} {
         register_fields();
         reserve_fields(NULL);
     }
 
     kis_tracked_device_base(int in_id, std::shared_ptr<tracker_element_map> e) : 
-        tracker_component(in_id) {
+        tracker_flat_component(in_id),
+        flat{} {
         register_fields();
         reserve_fields(e);
     }
 
     kis_tracked_device_base(const kis_tracked_device_base *p) :
-        tracker_component{p} {
+        tracker_flat_component{p},
+        flat{} {
 
         __ImportField(key, p);
         __ImportField(macaddr, p);
@@ -357,36 +363,20 @@ public:
 
         __ImportField(commonname, p);
         __ImportField(type_string, p);
-        __ImportField(basic_type_set,p );
         __ImportField(crypt_string, p);
-        __ImportField(basic_crypt_set, p);
-        __ImportField(first_time, p);
-        __ImportField(last_time, p);
-        __ImportField(mod_time, p);
 
-        __ImportField(packets, p);
-        __ImportField(tx_packets, p);
-        __ImportField(rx_packets, p);
-        __ImportField(llc_packets, p);
-        __ImportField(error_packets, p);
-        __ImportField(data_packets, p);
-        __ImportField(crypt_packets, p);
-        __ImportField(filter_packets, p);
 
 
-        __ImportField(datasize, p);
 
         __ImportId(packets_rrd_id, p);
         __ImportId(data_rrd_id, p);
 
         __ImportField(channel, p);
-        __ImportField(frequency, p);
 
         __ImportId(signal_data_id, p);
 
         __ImportField(freq_khz_map, p);
         __ImportField(manuf, p);
-        __ImportField(alert, p);
 
         __ImportId(tag_map_id, p);
         __ImportId(tag_entry_id, p);
@@ -472,8 +462,8 @@ public:
     // __Proxy(type_string, std::string, std::string, std::string, type_string);
     __ProxySwappingTrackable(type_string, tracker_element_string, type_string);
 
-    __Proxy(basic_type_set, uint64_t, uint64_t, uint64_t, basic_type_set);
-    __ProxyBitset(basic_type_set, uint64_t, basic_type_set);
+    __ProxyFlat(basic_type_set, uint64_t, uint64_t, uint64_t, flat.basic_type_set);
+    __ProxyFlatBitset(basic_type_set, uint64_t, flat.basic_type_set);
 
     __ProxyGet(type_string, std::string, std::string, type_string);
 
@@ -499,43 +489,43 @@ public:
 
     __Proxy(crypt_string, std::string, std::string, std::string, crypt_string);
 
-    __Proxy(basic_crypt_set, uint64_t, uint64_t, uint64_t, basic_crypt_set);
-    void add_basic_crypt(uint64_t in) { (*basic_crypt_set) |= in; }
+    __ProxyFlat(basic_crypt_set, uint64_t, uint64_t, uint64_t, flat.basic_crypt_set);
+    void add_basic_crypt(uint64_t in) { flat.basic_crypt_set |= in; }
 
-    __Proxy(first_time, uint64_t, time_t, time_t, first_time);
-    __Proxy(last_time, uint64_t, time_t, time_t, last_time);
+    __ProxyFlat(first_time, uint64_t, time_t, time_t, flat.first_time);
+    __ProxyFlat(last_time, uint64_t, time_t, time_t, flat.last_time);
 
     // Simple management of last modified time
-    __Proxy(mod_time, uint64_t, time_t, time_t, mod_time);
+    __ProxyFlat(mod_time, uint64_t, time_t, time_t, flat.mod_time);
     void update_modtime() {
         set_mod_time(time(0));
     }
 
-    __Proxy(packets, uint64_t, uint64_t, uint64_t, packets);
-    __ProxyIncDec(packets, uint64_t, uint64_t, packets);
+    __ProxyFlat(packets, uint64_t, uint64_t, uint64_t, flat.packets);
+    __ProxyFlatIncDec(packets, uint64_t, uint64_t, flat.packets);
 
-    __Proxy(rx_packets, uint64_t, uint64_t, uint64_t, rx_packets);
-    __ProxyIncDec(rx_packets, uint64_t, uint64_t, rx_packets);
+    __ProxyFlat(rx_packets, uint64_t, uint64_t, uint64_t, flat.rx_packets);
+    __ProxyFlatIncDec(rx_packets, uint64_t, uint64_t, flat.rx_packets);
 
-    __Proxy(tx_packets, uint64_t, uint64_t, uint64_t, tx_packets);
-    __ProxyIncDec(tx_packets, uint64_t, uint64_t, tx_packets)
-    __Proxy(llc_packets, uint64_t, uint64_t, uint64_t, llc_packets);
-    __ProxyIncDec(llc_packets, uint64_t, uint64_t, llc_packets);
+    __ProxyFlat(tx_packets, uint64_t, uint64_t, uint64_t, flat.tx_packets);
+    __ProxyFlatIncDec(tx_packets, uint64_t, uint64_t, flat.tx_packets);
+    __ProxyFlat(llc_packets, uint64_t, uint64_t, uint64_t, flat.llc_packets);
+    __ProxyFlatIncDec(llc_packets, uint64_t, uint64_t, flat.llc_packets);
 
-    __Proxy(error_packets, uint64_t, uint64_t, uint64_t, error_packets);
-    __ProxyIncDec(error_packets, uint64_t, uint64_t, error_packets);
+    __ProxyFlat(error_packets, uint64_t, uint64_t, uint64_t, flat.error_packets);
+    __ProxyFlatIncDec(error_packets, uint64_t, uint64_t, flat.error_packets);
 
-    __Proxy(data_packets, uint64_t, uint64_t, uint64_t, data_packets);
-    __ProxyIncDec(data_packets, uint64_t, uint64_t, data_packets);
+    __ProxyFlat(data_packets, uint64_t, uint64_t, uint64_t, flat.data_packets);
+    __ProxyFlatIncDec(data_packets, uint64_t, uint64_t, flat.data_packets);
 
-    __Proxy(crypt_packets, uint64_t, uint64_t, uint64_t, crypt_packets);
-    __ProxyIncDec(crypt_packets, uint64_t, uint64_t, crypt_packets);
+    __ProxyFlat(crypt_packets, uint64_t, uint64_t, uint64_t, flat.crypt_packets);
+    __ProxyFlatIncDec(crypt_packets, uint64_t, uint64_t, flat.crypt_packets);
 
-    __Proxy(filter_packets, uint64_t, uint64_t, uint64_t, filter_packets);
-    __ProxyIncDec(filter_packets, uint64_t, uint64_t, filter_packets);
+    __ProxyFlat(filter_packets, uint64_t, uint64_t, uint64_t, flat.filter_packets);
+    __ProxyFlatIncDec(filter_packets, uint64_t, uint64_t, flat.filter_packets);
 
-    __Proxy(datasize, uint64_t, uint64_t, uint64_t, datasize);
-    __ProxyIncDec(datasize, uint64_t, uint64_t, datasize);
+    __ProxyFlat(datasize, uint64_t, uint64_t, uint64_t, flat.datasize);
+    __ProxyFlatIncDec(datasize, uint64_t, uint64_t, flat.datasize);
 
     typedef kis_tracked_rrd<> rrdt;
     __ProxyDynamicTrackable(packets_rrd, rrdt, packets_rrd, packets_rrd_id);
@@ -544,12 +534,12 @@ public:
     __ProxyDynamicTrackable(data_rrd, rrdt, data_rrd, data_rrd_id);
 
     __Proxy(channel, std::string, std::string, std::string, channel);
-    __Proxy(frequency, double, double, double, frequency);
+    __ProxyFlat(frequency, double, double, double, flat.frequency);
 
     __ProxyTrackable(manuf, tracker_element_string, manuf);
     __Proxy(manuf, std::string, std::string, std::string, manuf);
 
-    __Proxy(num_alerts, uint32_t, unsigned int, unsigned int, alert);
+    __ProxyFlat(num_alerts, uint32_t, unsigned int, unsigned int, flat.alert);
 
     __ProxyDynamicTrackable(signal_data, kis_tracked_signal_data, signal_data,
             signal_data_id);
@@ -591,6 +581,38 @@ protected:
     // up long-running queries.
     uint64_t kis_internal_id;
 
+    // Scalar fields, held flat and only built as elements for serialization
+    struct {
+        // Basic phy-neutral type for sorting and classification
+        uint64_t basic_type_set;
+
+        // Bitset of basic phy-neutral crypt options
+        uint64_t basic_crypt_set;
+
+        // First and last seen
+        uint64_t first_time;
+        uint64_t last_time;
+        uint64_t mod_time;
+
+        // Packet counts
+        uint64_t packets;
+        uint64_t tx_packets;
+        uint64_t rx_packets;
+        uint64_t llc_packets;
+        uint64_t error_packets;
+        uint64_t data_packets;
+        uint64_t crypt_packets;
+        uint64_t filter_packets;
+
+        uint64_t datasize;
+
+        // Frequency as per PHY type
+        double frequency;
+
+        // Alerts triggered on this device
+        uint32_t alert;
+    } flat;
+
     // Unique key
     std::shared_ptr<tracker_element_device_key> key;
 
@@ -616,34 +638,11 @@ protected:
     // This should be empty if the phy layer is unable to add something intelligent
     std::shared_ptr<tracker_element_string> type_string;
 
-    // Basic phy-neutral type for sorting and classification
-    std::shared_ptr<tracker_element_uint64> basic_type_set;
-
     // Printable crypt string, which is set by the phy and is the best printable
     // representation of the phy crypt options.  This should be empty if the phy
     // layer hasn't added something intelligent.
     std::shared_ptr<tracker_element_string> crypt_string;
 
-    // Bitset of basic phy-neutral crypt options
-    std::shared_ptr<tracker_element_uint64> basic_crypt_set;
-
-    // First and last seen
-    std::shared_ptr<tracker_element_uint64> first_time;
-    std::shared_ptr<tracker_element_uint64> last_time;
-    std::shared_ptr<tracker_element_uint64> mod_time;
-
-    // Packet counts
-    std::shared_ptr<tracker_element_uint64> packets;
-    std::shared_ptr<tracker_element_uint64> tx_packets;
-    std::shared_ptr<tracker_element_uint64> rx_packets;
-    std::shared_ptr<tracker_element_uint64> llc_packets;
-    std::shared_ptr<tracker_element_uint64> error_packets;
-    std::shared_ptr<tracker_element_uint64> data_packets;
-    std::shared_ptr<tracker_element_uint64> crypt_packets;
-    std::shared_ptr<tracker_element_uint64> filter_packets;
-
-    std::shared_ptr<tracker_element_uint64> datasize;
-
     // Packets and data RRDs
     int packets_rrd_id;
     std::shared_ptr<kis_tracked_rrd<>> packets_rrd;
@@ -651,9 +650,8 @@ protected:
     int data_rrd_id;
     std::shared_ptr<kis_tracked_rrd<>> data_rrd;
 
-	// Channel and frequency as per PHY type
+	// Channel as per PHY type
     std::shared_ptr<tracker_element_string> channel;
-    std::shared_ptr<tracker_element_double> frequency;
 
     // Signal data
     int signal_data_id;
@@ -666,9 +664,6 @@ protected:
     // from other data (phy-dependent)
     std::shared_ptr<tracker_element_string> manuf;
 
-    // Alerts triggered on this device
-    std::shared_ptr<tracker_element_uint32> alert;
-
     // Stringmap of tags
     std::shared_ptr<tracker_element_string_map> tag_map;
     int tag_map_id;
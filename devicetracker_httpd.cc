@@ -64,19 +64,11 @@ std::shared_ptr<tracker_element> device_tracker::multimac_endp_handler(shared_co
         macs.push_back(ma);
     }
 
-    // Duplicate the mac index so that we're 'immune' to things changing it under us; because we
-    // may have quite a number of devices in our query list, this is safest.
-    kis_unique_lock<kis_mutex> devlist_locker(get_devicelist_mutex(), std::defer_lock, "multimac_endp_handler");
-    devlist_locker.lock();
-    auto immutable_copy = 
-        std::multimap<mac_addr, std::shared_ptr<kis_tracked_device_base>>{tracked_mac_multimap};
-    devlist_locker.unlock();
-
-    // Pull all the devices out of the list
+    // Pull all the devices out of the list; each mac lookup only holds the shard locks
+    // for the duration of the lookup, so we don't block the packet path
     for (auto m : macs) {
-        const auto& mi = immutable_copy.equal_range(m);
-        for (auto msi = mi.first; msi != mi.second; ++msi)
-            ret_devices->push_back(msi->second);
+        for (const auto& d : fetch_devices(m))
+            ret_devices->push_back(d);
     }
 
     return ret_devices;
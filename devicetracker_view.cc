@@ -42,6 +42,8 @@ device_tracker_view::device_tracker_view(const std::string& in_id, const std::st
 
     device_list = std::make_shared<tracker_element_vector>();
 
+    init_sort_indexes();
+
     auto httpd = Globalreg::fetch_mandatory_global_as<kis_net_beast_httpd>();
 
     auto uri = fmt::format("/devices/views/{}/devices", in_id);
@@ -77,6 +79,8 @@ device_tracker_view::device_tracker_view(const std::string& in_id, const std::st
 
     device_list = std::make_shared<tracker_element_vector>();
 
+    init_sort_indexes();
+
     auto httpd = Globalreg::fetch_mandatory_global_as<kis_net_beast_httpd>();
 
     auto uri = fmt::format("/devices/views/{}/devices", in_id);
@@ -134,6 +138,11 @@ device_tracker_view::device_tracker_view(const std::string& in_id, const std::st
 
                                 if (!json["format"].isNull())
                                     format_t = json["format"].asString();
+
+                                auto serializer = Globalreg::globalreg->entrytracker->get_stream_serializer(format_t);
+
+                                if (serializer == nullptr)
+                                    throw std::runtime_error("unknown format");
                                     
                                 auto dev_r = json["monitor"].asString();
                                 auto dev_k = device_key(json["monitor"].asString());
@@ -151,35 +160,53 @@ device_tracker_view::device_tracker_view(const std::string& in_id, const std::st
 
                                 auto rename_map = std::make_shared<tracker_element_serializer::rename_map>();
 
-                                time_t last_tm = 0;
+                                // Per-request position in the devicetracker change log, and the
+                                // time of the last pass for the full-scan fallback
+                                auto cursor = std::make_shared<uint64_t>(0);
+                                auto last_tm = std::make_shared<time_t>(0);
 
                                 // Generate a timer event that goes and looks for the devices and
                                 // serializes them with the fields record
                                 auto tid = 
                                     timetracker->register_timer(std::chrono::seconds(rate), true,
-                                            [this, con, dev_r, dev_k, dev_m, json, ws, &last_tm, rename_map, format_t](int) -> int {
+                                            [this, con, dev_r, dev_k, dev_m, json, ws, cursor, last_tm, rename_map, serializer](int) -> int {
+                                                std::stringstream ss;
+
+                                                auto write_dev = [&](const std::shared_ptr<kis_tracked_device_base>& dev) {
+                                                    ss.str("");
+                                                    ss.clear();
+                                                    Globalreg::globalreg->entrytracker->serialize_with_json_summary(serializer, ss, dev, json);
+                                                    ws->write(ss.str(), !serializer->is_binary());
+                                                };
+
                                                 if (dev_r == "*") {
-                                                    auto worker = device_tracker_view_function_worker([json, last_tm, format_t, ws](std::shared_ptr<kis_tracked_device_base> dev) -> bool {
-                                                        if (dev->get_mod_time() > last_tm) {
-                                                            std::stringstream ss;
-                                                            Globalreg::globalreg->entrytracker->serialize_with_json_summary(format_t, ss, dev, json);
-                                                            ws->write(ss.str(), true);
-                                                        }
+                                                    kis_lock_guard<kis_mutex> lk(devicetracker->get_devicelist_mutex(), "view ws monitor timer serialize lambda");
 
-                                                        return false;
-                                                    });
+                                                    // Only look at what changed since the last pass, unless this
+                                                    // is the first pass or we fell behind the change log
+                                                    std::vector<std::shared_ptr<kis_tracked_device_base>> changed;
 
-                                                    do_device_work(worker);
+                                                    if (devicetracker->fetch_changed_devices(*cursor, changed)) {
+                                                        for (const auto& d : changed) {
+                                                            if (device_presence_map.find(d->get_key()) != device_presence_map.end())
+                                                                write_dev(d);
+                                                        }
+                                                    } else {
+                                                        *cursor = devicetracker->get_device_change_head();
+
+                                                        for (const auto& d : *device_list) {
+                                                            auto dev = std::static_pointer_cast<kis_tracked_device_base>(d);
+                                                            if (dev->get_mod_time() > *last_tm)
+                                                                write_dev(dev);
+                                                        }
+                                                    }
                                                 } else if (!dev_k.get_error()) {
                                                     kis_lock_guard<kis_mutex> lk(devicetracker->get_devicelist_mutex(), "view ws monitor timer serialize lambda");
 
                                                     auto dev = fetch_device(dev_k);
                                                     if (dev != nullptr) {
-                                                        if (dev->get_mod_time() > last_tm) {
-                                                            std::stringstream ss;
-                                                            Globalreg::globalreg->entrytracker->serialize_with_json_summary(format_t, ss, dev, json);
-                                                            ws->write(ss.str(), true);
-                                                        }
+                                                        if (dev->get_mod_time() > *last_tm)
+                                                            write_dev(dev);
                                                     }
                                                 } else if (!dev_m.error()) {
                                                     kis_lock_guard<kis_mutex> lk(devicetracker->get_devicelist_mutex(), "view ws monitor timer serialize lambda");
@@ -188,18 +215,15 @@ device_tracker_view::device_tracker_view(const std::string& in_id, const std::st
 
                                                     for (const auto& i : mvec) {
                                                         auto pk = device_presence_map.find(i->get_key());
-                                                        if (pk == device_presence_map.end() || pk->second == false)
+                                                        if (pk == device_presence_map.end())
                                                             continue;
 
-                                                        if (i->get_mod_time() > last_tm) {
-                                                            std::stringstream ss;
-                                                            Globalreg::globalreg->entrytracker->serialize_with_json_summary(format_t, ss, i, json);
-                                                            ws->write(ss.str(), true);
-                                                        }
+                                                        if (i->get_mod_time() > *last_tm)
+                                                            write_dev(i);
                                                     }
                                                 }
 
-                                                last_tm = time(0);
+                                                *last_tm = time(0);
 
                                                 return 1;
                                             });
@@ -314,39 +338,47 @@ std::shared_ptr<tracker_element_vector> device_tracker_view::do_device_work(devi
 std::shared_ptr<tracker_element_vector> device_tracker_view::do_readonly_device_work(device_tracker_view_worker& worker,
         std::shared_ptr<tracker_element_vector> devices) {
 
-    // read-only workers are currently disabled because it may not be reasonable to solve conflicts
-    // at the per-device level, use the locked worker.
+    // Workers which can't run concurrently use the locked worker
+    auto pool = devicetracker->get_worker_pool();
 
-    return do_device_work(worker, devices);
+    if (pool == nullptr || !worker.thread_safe() || devices->size() < 2 * parallel_chunk_sz)
+        return do_device_work(worker, devices);
 
-#if 0
     auto ret = std::make_shared<tracker_element_vector>();
     ret->reserve(devices->size());
 
+    // Holding the device list lock keeps writers out while the pool reads devices;
+    // the pool threads never take it themselves
     kis_lock_guard<kis_mutex> ul_devlist(devicetracker->get_devicelist_mutex(), 
             "device_tracker_view do_readonly_device_work");
 
-    std::for_each(devices->begin(), devices->end(),
-            [&](shared_tracker_element val) {
+    // Chunks are matched independently and merged in order, so the result matches
+    // the serial worker
+    size_t num_chunks = (devices->size() + parallel_chunk_sz - 1) / parallel_chunk_sz;
+    std::vector<std::vector<shared_tracker_element>> chunk_matches(num_chunks);
 
-            if (val == nullptr)
-                return;
-
-            auto dev = std::static_pointer_cast<kis_tracked_device_base>(val);
+    pool->parallel_for(num_chunks, [&](size_t c) {
+            auto si = std::next(devices->begin(), c * parallel_chunk_sz);
+            auto ei = std::next(devices->begin(), std::min(devices->size(), (c + 1) * parallel_chunk_sz));
 
-            auto m = worker.match_device(dev);
-
-            if (m) 
-                ret->push_back(dev);
+            for (auto di = si; di != ei; ++di) {
+                if (*di == nullptr)
+                    continue;
 
+                if (worker.match_device(std::static_pointer_cast<kis_tracked_device_base>(*di)))
+                    chunk_matches[c].push_back(*di);
+            }
         });
 
+    for (const auto& cm : chunk_matches)
+        for (const auto& d : cm)
+            ret->push_back(d);
+
     worker.set_matched_devices(ret);
 
     worker.finalize();
 
     return ret;
-#endif
 }
 
 std::shared_ptr<kis_tracked_device_base> device_tracker_view::fetch_device(device_key in_key) {
@@ -354,7 +386,7 @@ std::shared_ptr<kis_tracked_device_base> device_tracker_view::fetch_device(devic
 
     auto present_itr = device_presence_map.find(in_key);
 
-    if (present_itr == device_presence_map.end() || present_itr->second == false)
+    if (present_itr == device_presence_map.end())
         return nullptr;
 
     return devicetracker->fetch_device(in_key);
@@ -369,8 +401,8 @@ void device_tracker_view::new_device(std::shared_ptr<kis_tracked_device_base> de
             auto dpmi = device_presence_map.find(device->get_key());
 
             if (dpmi == device_presence_map.end()) {
-                device_presence_map[device->get_key()] = true;
-                device_list->push_back(device);
+                device_list_add(device);
+                sort_index_insert(device);
             }
 
             list_sz->set(device_list->size());
@@ -393,25 +425,23 @@ void device_tracker_view::update_device(std::shared_ptr<kis_tracked_device_base>
     // If we're adding the device (or keeping it) and we don't have it tracked,
     // add it and record it in the presence map
     if (retain && dpmi == device_presence_map.end()) {
-        device_list->push_back(device);
-        device_presence_map[device->get_key()] = true;
+        device_list_add(device);
+        sort_index_insert(device);
         list_sz->set(device_list->size());
         return;
     }
 
-    // if we're removing the device, find it in the vector and remove it, and remove
-    // it from the presence map; this is expensive
+    // if we're removing the device, remove it from the vector and the presence map
     if (!retain && dpmi != device_presence_map.end()) {
-        for (auto di = device_list->begin(); di != device_list->end(); ++di) {
-            if (*di == device) {
-                device_list->erase(di);
-                break;
-            }
-        }
-        device_presence_map.erase(dpmi);
+        device_list_remove(dpmi);
+        sort_index_remove(device);
         list_sz->set(device_list->size());
         return;
     }
+
+    // Retained device which may have changed how it sorts
+    if (retain && dpmi != device_presence_map.end())
+        touch_device(device);
 }
 
 void device_tracker_view::remove_device(std::shared_ptr<kis_tracked_device_base> device) {
@@ -421,19 +451,47 @@ void device_tracker_view::remove_device(std::shared_ptr<kis_tracked_device_base>
     auto di = device_presence_map.find(device->get_key());
 
     if (di != device_presence_map.end()) {
-        device_presence_map.erase(di);
+        device_list_remove(di);
+        sort_index_remove(device);
 
-        for (auto vi = device_list->begin(); vi != device_list->end(); ++vi) {
-            if (*vi == device) {
-                device_list->erase(vi);
-                break;
-            }
-        }
-        
         list_sz->set(device_list->size());
     }
 }
 
+void device_tracker_view::remove_devices(const std::vector<std::shared_ptr<kis_tracked_device_base>>& devices) {
+    // Only called under guard from devicetracker
+
+    for (const auto& d : devices) {
+        auto di = device_presence_map.find(d->get_key());
+
+        if (di == device_presence_map.end())
+            continue;
+
+        device_list_remove(di);
+        sort_index_remove(d);
+    }
+
+    list_sz->set(device_list->size());
+}
+
+void device_tracker_view::device_list_add(const std::shared_ptr<kis_tracked_device_base>& device) {
+    device_presence_map[device->get_key()] = device_list->size();
+    device_list->push_back(device);
+}
+
+void device_tracker_view::device_list_remove(presence_map_t::iterator present) {
+    auto& vec = device_list->get();
+    auto pos = present->second;
+
+    if (pos != vec.size() - 1) {
+        vec[pos] = std::move(vec.back());
+        device_presence_map[static_cast<kis_tracked_device_base *>(vec[pos].get())->get_key()] = pos;
+    }
+
+    vec.pop_back();
+    device_presence_map.erase(present);
+}
+
 void device_tracker_view::add_device_direct(std::shared_ptr<kis_tracked_device_base> device) {
     kis_lock_guard<kis_mutex> lk(devicetracker->get_devicelist_mutex());
 
@@ -442,27 +500,294 @@ void device_tracker_view::add_device_direct(std::shared_ptr<kis_tracked_device_b
     if (di != device_presence_map.end())
         return;
 
-    device_presence_map[device->get_key()] = true;
-    device_list->push_back(device);
+    device_list_add(device);
+    sort_index_insert(device);
 
     list_sz->set(device_list->size());
 }
 
+void device_tracker_view::touch_device(std::shared_ptr<kis_tracked_device_base> device) {
+    // Only called under guard from devicetracker
+
+    if (!sort_indexes_built)
+        return;
+
+    if (device_presence_map.find(device->get_key()) == device_presence_map.end())
+        return;
+
+    sort_index_dirty[device->get_key()] = device;
+}
+
+device_tracker_view::sort_index_key device_tracker_view::make_sort_index_key(const std::vector<int>& path,
+        std::shared_ptr<kis_tracked_device_base> device) {
+    sort_index_key k{false, 0, ""};
+
+    auto e = get_tracker_element_path(path, device);
+
+    if (e == nullptr)
+        return k;
+
+    k.valid = true;
+
+    switch (e->get_type()) {
+        case tracker_type::tracker_string:
+            k.str = std::static_pointer_cast<tracker_element_string>(e)->get();
+            break;
+        case tracker_type::tracker_int8:
+            k.num = std::static_pointer_cast<tracker_element_int8>(e)->get();
+            break;
+        case tracker_type::tracker_uint8:
+            k.num = std::static_pointer_cast<tracker_element_uint8>(e)->get();
+            break;
+        case tracker_type::tracker_int16:
+            k.num = std::static_pointer_cast<tracker_element_int16>(e)->get();
+            break;
+        case tracker_type::tracker_uint16:
+            k.num = std::static_pointer_cast<tracker_element_uint16>(e)->get();
+            break;
+        case tracker_type::tracker_int32:
+            k.num = std::static_pointer_cast<tracker_element_int32>(e)->get();
+            break;
+        case tracker_type::tracker_uint32:
+            k.num = std::static_pointer_cast<tracker_element_uint32>(e)->get();
+            break;
+        case tracker_type::tracker_int64:
+            k.num = std::static_pointer_cast<tracker_element_int64>(e)->get();
+            break;
+        case tracker_type::tracker_uint64:
+            k.num = std::static_pointer_cast<tracker_element_uint64>(e)->get();
+            break;
+        case tracker_type::tracker_float:
+            k.num = std::static_pointer_cast<tracker_element_float>(e)->get();
+            break;
+        case tracker_type::tracker_double:
+            k.num = std::static_pointer_cast<tracker_element_double>(e)->get();
+            break;
+        default:
+            // Only numeric and string fields can be indexed
+            k.valid = false;
+            break;
+    }
+
+    return k;
+}
+
+void device_tracker_view::init_sort_indexes() {
+    sort_indexes_built = false;
+
+    // Paths are resolved on first use; dynamic fields like signal may not be
+    // registered until the first device that carries them is seen
+    for (const auto& f : devicetracker->get_view_sort_index_fields()) {
+        auto si = std::unique_ptr<sort_index>(new sort_index());
+        si->field = f;
+        si->built = false;
+        sort_indexes.push_back(std::move(si));
+    }
+}
+
+device_tracker_view::sort_index *device_tracker_view::fetch_sort_index(const std::vector<int>& in_path) {
+    // Only called under guard from the endpoint
+
+    for (auto& si : sort_indexes) {
+        if (si->path.size() == 0) {
+            auto path = tracker_element_summary(si->field).resolved_path;
+
+            if (path.size() == 0 || std::find(path.begin(), path.end(), -1) != path.end())
+                continue;
+
+            si->path = path;
+        }
+
+        if (si->path != in_path)
+            continue;
+
+        if (!si->built) {
+            for (const auto& d : *device_list) {
+                auto dev = std::static_pointer_cast<kis_tracked_device_base>(d);
+                auto pi = si->entries.insert(sort_index_entry{make_sort_index_key(si->path, dev), 
+                        dev->get_key(), dev});
+                si->positions[dev->get_key()] = pi.first;
+            }
+
+            si->built = true;
+            sort_indexes_built = true;
+        }
+
+        return si.get();
+    }
+
+    return nullptr;
+}
+
+void device_tracker_view::walk_sort_index(sort_index *index, unsigned int direction,
+        size_t start, size_t len,
+        const std::function<void (const std::shared_ptr<kis_tracked_device_base>&)>& fn) {
+    auto walk = [&](auto si, auto ei) {
+        for (size_t n = 0; n < start && si != ei; ++n)
+            ++si;
+
+        for (size_t n = 0; n < len && si != ei; ++n, ++si)
+            fn(si->device);
+    };
+
+    if (direction == 0)
+        walk(index->entries.cbegin(), index->entries.cend());
+    else
+        walk(index->entries.crbegin(), index->entries.crend());
+}
+
+void device_tracker_view::sort_device_vector(std::shared_ptr<tracker_element_vector> vec,
+        const std::vector<int>& path, unsigned int direction) {
+    // Resolve the sort field once per device instead of once per comparison; flat
+    // device fields are built on demand when resolved by path
+    std::vector<std::pair<shared_tracker_element, shared_tracker_element>> keyed_vec;
+    keyed_vec.reserve(vec->size());
+
+    for (const auto& d : *vec)
+        keyed_vec.push_back(std::make_pair(get_tracker_element_path(path, d), d));
+
+    std::stable_sort(keyed_vec.begin(), keyed_vec.end(),
+            [&](const std::pair<shared_tracker_element, shared_tracker_element>& a,
+                const std::pair<shared_tracker_element, shared_tracker_element>& b) -> bool {
+            const auto& fa = a.first;
+            const auto& fb = b.first;
+
+            if (fa == nullptr)
+                return direction == 0;
+
+            if (fb == nullptr)
+                return direction != 0;
+
+            if (direction == 0)
+                return fast_sort_tracker_element_less(fa, fb);
+
+            return fast_sort_tracker_element_less(fb, fa);
+        });
+
+    auto wi = vec->begin();
+    for (const auto& k : keyed_vec)
+        *(wi++) = k.second;
+}
+
+std::string device_tracker_view::verify_sort_indexes() {
+    kis_lock_guard<kis_mutex> lk(devicetracker->get_devicelist_mutex(), "view verify_sort_indexes");
+
+    for (auto& si : sort_indexes) {
+        auto path = si->path;
+
+        if (path.size() == 0)
+            path = tracker_element_summary(si->field).resolved_path;
+
+        if (path.size() == 0 || std::find(path.begin(), path.end(), -1) != path.end())
+            continue;
+
+        auto index = fetch_sort_index(path);
+
+        if (index == nullptr)
+            continue;
+
+        sort_index_apply_dirty();
+
+        for (unsigned int direction = 0; direction < 2; direction++) {
+            auto sorted_vec = std::make_shared<tracker_element_vector>();
+            sorted_vec->set(device_list->begin(), device_list->end());
+            sort_device_vector(sorted_vec, path, direction);
+
+            std::vector<std::shared_ptr<kis_tracked_device_base>> index_vec;
+            walk_sort_index(index, direction, 0, index->entries.size(),
+                    [&](const std::shared_ptr<kis_tracked_device_base>& dev) {
+                        index_vec.push_back(dev);
+                    });
+
+            if (index_vec.size() != sorted_vec->size())
+                return fmt::format("view {} index {} has {} devices, view has {}",
+                        get_view_id(), si->field, index_vec.size(), sorted_vec->size());
+
+            // Devices with equal keys may legitimately be in a different order, so
+            // compare the keys at each position
+            for (size_t n = 0; n < index_vec.size(); n++) {
+                auto sk = make_sort_index_key(path,
+                        std::static_pointer_cast<kis_tracked_device_base>((*sorted_vec)[n]));
+                auto ik = make_sort_index_key(path, index_vec[n]);
+
+                if (sk < ik || ik < sk)
+                    return fmt::format("view {} index {} direction {} differs from the sorted "
+                            "list at position {}", get_view_id(), si->field, direction, n);
+            }
+        }
+    }
+
+    return "";
+}
+
+void device_tracker_view::sort_index_insert(std::shared_ptr<kis_tracked_device_base> device) {
+    if (!sort_indexes_built)
+        return;
+
+    for (auto& si : sort_indexes) {
+        if (!si->built || si->positions.find(device->get_key()) != si->positions.end())
+            continue;
+
+        auto pi = si->entries.insert(sort_index_entry{make_sort_index_key(si->path, device), 
+                device->get_key(), device});
+        si->positions[device->get_key()] = pi.first;
+    }
+}
+
+void device_tracker_view::sort_index_remove(std::shared_ptr<kis_tracked_device_base> device) {
+    if (!sort_indexes_built)
+        return;
+
+    sort_index_dirty.erase(device->get_key());
+
+    for (auto& si : sort_indexes) {
+        if (!si->built)
+            continue;
+
+        auto pi = si->positions.find(device->get_key());
+
+        if (pi == si->positions.end())
+            continue;
+
+        si->entries.erase(pi->second);
+        si->positions.erase(pi);
+    }
+}
+
+void device_tracker_view::sort_index_apply_dirty() {
+    for (const auto& di : sort_index_dirty) {
+        for (auto& si : sort_indexes) {
+            if (!si->built)
+                continue;
+
+            auto pi = si->positions.find(di.first);
+
+            if (pi == si->positions.end())
+                continue;
+
+            auto k = make_sort_index_key(si->path, di.second);
+
+            // Most touches don't move a device in any given index
+            if (!(k < pi->second->key) && !(pi->second->key < k))
+                continue;
+
+            si->entries.erase(pi->second);
+            pi->second = si->entries.insert(sort_index_entry{k, di.first, di.second}).first;
+        }
+    }
+
+    sort_index_dirty.clear();
+}
+
 void device_tracker_view::remove_device_direct(std::shared_ptr<kis_tracked_device_base> device) {
     kis_lock_guard<kis_mutex> lk(devicetracker->get_devicelist_mutex());
 
     auto di = device_presence_map.find(device->get_key());
 
     if (di != device_presence_map.end()) {
-        device_presence_map.erase(di);
+        device_list_remove(di);
+        sort_index_remove(device);
 
-        for (auto vi = device_list->begin(); vi != device_list->end(); ++vi) {
-            if (*vi == device) {
-                device_list->erase(vi);
-                break;
-            }
-        }
-        
         list_sz->set(device_list->size());
     }
 }
@@ -496,7 +821,7 @@ void device_tracker_view::device_endpoint_handler(std::shared_ptr<kis_net_beast_
     std::ostream os(&con->response_stream());
 
     // Summarization vector based on simplification part of shared data
-    auto summary_vec = std::vector<SharedElementSummary>{};
+    auto summary_vec = summary_plan{std::make_shared<std::vector<SharedElementSummary>>()};
 
     // Rename cache generated by summarization
     auto rename_map = std::make_shared<tracker_element_serializer::rename_map>();
@@ -516,6 +841,9 @@ void device_tracker_view::device_endpoint_handler(std::shared_ptr<kis_net_beast_
     // Regular expression terms, if any
     auto regex = con->json()["regex"];
 
+    // Filter expression, if any; see device_tracker_view_filter_worker
+    auto filter_expr = con->json().get("filter", "").asString();
+
     // Wrapper, if any, we insert under
     std::shared_ptr<tracker_element_string_map> wrapper_elem;
 
@@ -540,18 +868,7 @@ void device_tracker_view::device_endpoint_handler(std::shared_ptr<kis_net_beast_
         // If the json has a 'fields' record, derive the fields simplification
         auto fields = con->json().get("fields", Json::Value(Json::arrayValue));
 
-        for (const auto& i : fields) {
-            if (i.isString()) {
-                summary_vec.push_back(std::make_shared<tracker_element_summary>(i.asString()));
-            } else if (i.isArray()) {
-                if (i.size() != 2) 
-                    throw std::runtime_error("Invalid field map, expected [field, rename]");
-
-                summary_vec.push_back(std::make_shared<tracker_element_summary>(i[0].asString(), i[1].asString()));
-            } else {
-                throw std::runtime_error("Invalid field map, exected field or [field, rename]");
-            }
-        }
+        summary_vec = Globalreg::globalreg->entrytracker->get_summary_plan(fields);
 
         // Capture timestamp and negative-offset timestamp
         auto raw_ts = con->json().get("last_time", 0).asInt64();
@@ -596,7 +913,7 @@ void device_tracker_view::device_endpoint_handler(std::shared_ptr<kis_net_beast_
 
             // Search every field we return
             if (search_term.length() != 0) 
-                for (const auto& svi : summary_vec)
+                for (const auto& svi : *summary_vec)
                     search_paths.push_back(svi->resolved_path);
 
             // We only allow ordering by a single column, we don't do sub-ordering;
@@ -656,6 +973,44 @@ void device_tracker_view::device_endpoint_handler(std::shared_ptr<kis_net_beast_
         os << "Invalid request: " << e.what() << "\n";
     }
 
+    // Unfiltered sorts on an indexed field are answered by walking the index to the
+    // requested window, without copying or sorting the device list
+    if (in_order_column_num.length() && order_field.size() > 0 && timestamp_min == 0 &&
+            search_term.length() == 0 && regex.isNull() && filter_expr.length() == 0) {
+        auto index = fetch_sort_index(order_field);
+
+        if (index != nullptr) {
+            sort_index_apply_dirty();
+
+            total_sz_elem->set(index->entries.size());
+            filtered_sz_elem->set(index->entries.size());
+
+            if (in_window_start >= index->entries.size())
+                in_window_start = 0;
+
+            start_elem->set(in_window_start);
+
+            size_t window_len = index->entries.size() - in_window_start;
+            if (in_window_len != 0 && in_window_len < window_len)
+                window_len = in_window_len;
+
+            length_elem->set(window_len);
+
+            walk_sort_index(index, in_order_direction, in_window_start, window_len,
+                    [&](const std::shared_ptr<kis_tracked_device_base>& dev) {
+                        output_devices_elem->push_back(summarize_tracker_element(dev,
+                                    *summary_vec, rename_map));
+                    });
+
+            if (transmit == nullptr)
+                transmit = output_devices_elem;
+
+            Globalreg::globalreg->entrytracker->serialize(static_cast<std::string>(con->uri()), os, 
+                    transmit, rename_map);
+            return;
+        }
+    }
+
     // Next vector we do work on
     auto next_work_vec = std::make_shared<tracker_element_vector>();
 
@@ -700,6 +1055,19 @@ void device_tracker_view::device_endpoint_handler(std::shared_ptr<kis_net_beast_
         }
     }
 
+    // Apply a compiled filter expression
+    if (filter_expr.length() > 0) {
+        try {
+            auto worker = 
+                device_tracker_view_filter_worker(filter_expr);
+            next_work_vec = do_readonly_device_work(worker, next_work_vec);
+        } catch (const std::exception& e) {
+            con->set_status(400);
+            os << "Invalid filter: " << e.what() << "\n";
+            return;
+        }
+    }
+
     // Apply the filtered length
     filtered_sz_elem->set(next_work_vec->size());
 
@@ -721,34 +1089,15 @@ void device_tracker_view::device_endpoint_handler(std::shared_ptr<kis_net_beast_
     // Update the end
     length_elem->set(ei - si);
 
-    if (in_order_column_num.length() && order_field.size() > 0) {
-        std::stable_sort(next_work_vec->begin(), next_work_vec->end(),
-                [&](shared_tracker_element a, shared_tracker_element b) -> bool {
-                shared_tracker_element fa;
-                shared_tracker_element fb;
-
-                fa = get_tracker_element_path(order_field, a);
-                fb = get_tracker_element_path(order_field, b);
-
-                if (fa == nullptr) 
-                    return in_order_direction == 0;
-
-                if (fb == nullptr)
-                    return in_order_direction != 0;
-
-                if (in_order_direction == 0)
-                    return fast_sort_tracker_element_less(fa, fb);
-
-                return fast_sort_tracker_element_less(fb, fa);
-            });
-    }
+    if (in_order_column_num.length() && order_field.size() > 0)
+        sort_device_vector(next_work_vec, order_field, in_order_direction);
 
     // Summarize into the output element
     auto final_devices_vec = std::make_shared<tracker_element_vector>();
 
     for (auto i = si; i != ei; ++i) {
         final_devices_vec->push_back(*i);
-        output_devices_elem->push_back(summarize_tracker_element(*i, summary_vec, rename_map));
+        output_devices_elem->push_back(summarize_tracker_element(*i, *summary_vec, rename_map));
     }
 
     // If the transmit wasn't assigned to a wrapper...
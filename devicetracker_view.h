@@ -22,6 +22,8 @@
 #include "config.h"
 
 #include <functional>
+#include <memory>
+#include <set>
 #include <unordered_map>
 
 #include "uuid.h"
@@ -96,7 +98,9 @@ public:
     // must not call this on a vector which can be altered in another thread.
     virtual std::shared_ptr<tracker_element_vector> do_device_work(device_tracker_view_worker& worker,
             std::shared_ptr<tracker_element_vector> vec);
-    // Do read-only work; this MAY NOT modify devices in the worker!
+    // Do read-only work; this MAY NOT modify devices in the worker!  Workers which declare
+    // themselves thread safe are split over the devicetracker worker pool when the vector
+    // is large enough to be worth it.
     virtual std::shared_ptr<tracker_element_vector> do_readonly_device_work(device_tracker_view_worker& worker,
             std::shared_ptr<tracker_element_vector> vec);
 
@@ -111,6 +115,11 @@ public:
     virtual void add_device_direct(std::shared_ptr<kis_tracked_device_base> device);
     virtual void remove_device_direct(std::shared_ptr<kis_tracked_device_base> device);
 
+    // Compare every sort index against the copy-and-sort path in both directions,
+    // building any index which hasn't been used yet.  Returns a description of the first
+    // difference, or an empty string if every index matches.
+    std::string verify_sort_indexes();
+
 	// Look for an existing device record under read-only shared lock
     std::shared_ptr<kis_tracked_device_base> fetch_device(device_key in_key);
 
@@ -136,10 +145,89 @@ protected:
     new_device_cb new_cb;
     updated_device_cb update_cb;
 
+    // Devices per chunk of parallel read-only work
+    static const size_t parallel_chunk_sz = 4096;
+
     // Main vector of devices
     std::shared_ptr<tracker_element_vector> device_list;
-    // Map of device presence in our list for fast reference during updates
-    std::unordered_map<device_key, bool> device_presence_map;
+    // Map of device presence in our list for fast reference during updates, holding
+    // the position of each device in device_list
+    using presence_map_t = std::unordered_map<device_key, size_t>;
+    presence_map_t device_presence_map;
+
+    // Add a device to the list, or remove a present device by moving the last device
+    // into its slot, so removal doesn't shift the list; the list is unordered
+    void device_list_add(const std::shared_ptr<kis_tracked_device_base>& device);
+    void device_list_remove(presence_map_t::iterator present);
+
+    // Ordered index over a single sortable field, so that sorted, windowed requests
+    // walk the index instead of copying and sorting the whole device list.  Indexes
+    // are built the first time the view is sorted by an eligible field and kept
+    // current afterwards; devices whose fields change are queued in sort_index_dirty
+    // and re-keyed before the next read.
+    //
+    // Entries are kept in the order of an ascending datatables sort (direction 0): missing
+    // fields first, then numbers, and strings in natural order.  A descending sort
+    // (direction 1) walks the index backwards.
+    struct sort_index_key {
+        bool valid;
+        double num;
+        std::string str;
+
+        bool operator<(const sort_index_key& k) const {
+            if (valid != k.valid)
+                return !valid;
+            if (num != k.num)
+                return num < k.num;
+            return tracker_element_string::natural_less(str, k.str);
+        }
+    };
+
+    struct sort_index_entry {
+        sort_index_key key;
+        device_key dev_key;
+        std::shared_ptr<kis_tracked_device_base> device;
+
+        bool operator<(const sort_index_entry& e) const {
+            if (key < e.key)
+                return true;
+            if (e.key < key)
+                return false;
+            return dev_key < e.dev_key;
+        }
+    };
+
+    struct sort_index {
+        std::string field;
+        std::vector<int> path;
+        bool built;
+        std::set<sort_index_entry> entries;
+        std::unordered_map<device_key, std::set<sort_index_entry>::iterator> positions;
+    };
+
+    std::vector<std::unique_ptr<sort_index>> sort_indexes;
+    bool sort_indexes_built;
+    std::unordered_map<device_key, std::shared_ptr<kis_tracked_device_base>> sort_index_dirty;
+
+    void init_sort_indexes();
+
+    static sort_index_key make_sort_index_key(const std::vector<int>& path,
+            std::shared_ptr<kis_tracked_device_base> device);
+
+    // Find (and build, if needed) the index matching a resolved field path
+    sort_index *fetch_sort_index(const std::vector<int>& in_path);
+
+    // Call fn for up to len devices from position start in the sort order of direction
+    void walk_sort_index(sort_index *index, unsigned int direction, size_t start, size_t len,
+            const std::function<void (const std::shared_ptr<kis_tracked_device_base>&)>& fn);
+
+    // Copy-and-sort path used when a request can't be answered from an index
+    static void sort_device_vector(std::shared_ptr<tracker_element_vector> vec,
+            const std::vector<int>& path, unsigned int direction);
+
+    void sort_index_insert(std::shared_ptr<kis_tracked_device_base> device);
+    void sort_index_remove(std::shared_ptr<kis_tracked_device_base> device);
+    void sort_index_apply_dirty();
 
     void device_endpoint_handler(std::shared_ptr<kis_net_beast_httpd_connection> con);
     std::shared_ptr<tracker_element> device_time_endpoint(std::shared_ptr<kis_net_beast_httpd_connection> con);
@@ -155,6 +243,13 @@ protected:
     // device record.
     virtual void remove_device(std::shared_ptr<kis_tracked_device_base> device);
 
+    // Remove a batch of devices in a single pass over the device list
+    virtual void remove_devices(const std::vector<std::shared_ptr<kis_tracked_device_base>>& devices);
+
+    // A device's sortable fields have changed; re-key it in any sort indexes.  Called
+    // from devicetracker for every updated device, so this must stay cheap.
+    virtual void touch_device(std::shared_ptr<kis_tracked_device_base> device);
+
 };
 
 #endif
@@ -25,6 +25,78 @@
 #include "kis_mutex.h"
 #include "kismet_algorithm.h"
 
+device_tracker_worker_pool::device_tracker_worker_pool(unsigned int in_threads) {
+    for (unsigned int n = 0; n < in_threads; n++) {
+        threads.emplace_back(std::thread([this, n, in_threads]() {
+                    thread_set_process_name(fmt::format("devworker {}/{}", n, in_threads));
+
+                    std::function<void ()> job;
+
+                    while (true) {
+                        jobs.wait_dequeue(job);
+
+                        // Empty job is the shutdown signal
+                        if (job == nullptr)
+                            return;
+
+                        job();
+                    }
+                }));
+    }
+}
+
+device_tracker_worker_pool::~device_tracker_worker_pool() {
+    for (unsigned int n = 0; n < threads.size(); n++)
+        jobs.enqueue(std::function<void ()>{});
+
+    for (auto& t : threads)
+        t.join();
+}
+
+void device_tracker_worker_pool::parallel_for(size_t in_n, const std::function<void (size_t)>& fn) {
+    std::atomic<size_t> next{0};
+    std::exception_ptr error;
+
+    std::mutex done_m;
+    std::condition_variable done_cv;
+    size_t num_helpers = std::min(threads.size(), in_n > 0 ? in_n - 1 : 0);
+    size_t helpers_remaining = num_helpers;
+
+    auto run = [&]() {
+        size_t i;
+
+        while ((i = next++) < in_n) {
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lk(done_m);
+                if (error == nullptr)
+                    error = std::current_exception();
+            }
+        }
+    };
+
+    // Helpers may only be picked up after the caller has finished every chunk, but
+    // they reference this stack frame so they have to be waited out regardless
+    for (size_t h = 0; h < num_helpers; h++) {
+        jobs.enqueue([&]() {
+                run();
+
+                std::lock_guard<std::mutex> lk(done_m);
+                if (--helpers_remaining == 0)
+                    done_cv.notify_one();
+            });
+    }
+
+    run();
+
+    std::unique_lock<std::mutex> lk(done_m);
+    done_cv.wait(lk, [&]() { return helpers_remaining == 0; });
+
+    if (error != nullptr)
+        std::rethrow_exception(error);
+}
+
 void device_tracker_view_worker::set_matched_devices(std::shared_ptr<tracker_element_vector> devs) {
     kis_lock_guard<kis_mutex> lk(mutex);
     matched = devs;
@@ -272,3 +344,425 @@ bool device_tracker_view_icasestringmatch_worker::match_device(std::shared_ptr<k
 }
 
 
+
+namespace {
+    // Numeric value of any numeric element
+    bool filter_numeric_value(const shared_tracker_element& e, double& ret) {
+        switch (e->get_type()) {
+            case tracker_type::tracker_int8:
+                ret = std::static_pointer_cast<tracker_element_int8>(e)->get();
+                return true;
+            case tracker_type::tracker_uint8:
+                ret = std::static_pointer_cast<tracker_element_uint8>(e)->get();
+                return true;
+            case tracker_type::tracker_int16:
+                ret = std::static_pointer_cast<tracker_element_int16>(e)->get();
+                return true;
+            case tracker_type::tracker_uint16:
+                ret = std::static_pointer_cast<tracker_element_uint16>(e)->get();
+                return true;
+            case tracker_type::tracker_int32:
+                ret = std::static_pointer_cast<tracker_element_int32>(e)->get();
+                return true;
+            case tracker_type::tracker_uint32:
+                ret = std::static_pointer_cast<tracker_element_uint32>(e)->get();
+                return true;
+            case tracker_type::tracker_int64:
+                ret = std::static_pointer_cast<tracker_element_int64>(e)->get();
+                return true;
+            case tracker_type::tracker_uint64:
+                ret = std::static_pointer_cast<tracker_element_uint64>(e)->get();
+                return true;
+            case tracker_type::tracker_float:
+                ret = std::static_pointer_cast<tracker_element_float>(e)->get();
+                return true;
+            case tracker_type::tracker_double:
+                ret = std::static_pointer_cast<tracker_element_double>(e)->get();
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    enum class filter_op {
+        eq, ne, lt, le, gt, ge, regex, prefix
+    };
+
+    template<typename T>
+    bool filter_compare(filter_op op, const T& a, const T& b) {
+        switch (op) {
+            case filter_op::eq:
+                return a == b;
+            case filter_op::ne:
+                return !(a == b);
+            case filter_op::lt:
+                return a < b;
+            case filter_op::le:
+                return !(b < a);
+            case filter_op::gt:
+                return b < a;
+            case filter_op::ge:
+                return !(a < b);
+            default:
+                return false;
+        }
+    }
+
+    // A constant on the right hand side of a comparison, pre-converted to every type
+    // it can be compared against
+    struct filter_constant {
+        std::string str;
+
+        bool is_num;
+        double num;
+
+        bool is_mac;
+        mac_addr mac;
+
+        bool is_uuid;
+        uuid uuid_v;
+
+        std::shared_ptr<device_tracker_view_regex_worker::pcre_filter> re;
+    };
+
+    class filter_compiler {
+    public:
+        filter_compiler(const std::string& in_expr) :
+            expr{in_expr},
+            offt{0} {
+            next();
+        }
+
+        device_tracker_view_filter_worker::filter_fn compile() {
+            auto ret = parse_or();
+
+            if (tok != tok_end)
+                fail(fmt::format("unexpected '{}'", text));
+
+            return ret;
+        }
+
+    protected:
+        enum token_type {
+            tok_end, tok_ident, tok_number, tok_string, tok_op
+        };
+
+        const std::string& expr;
+        size_t offt;
+
+        // Current token
+        token_type tok;
+        std::string text;
+        double num;
+        size_t tok_pos;
+
+        [[noreturn]] void fail(const std::string& msg) {
+            throw std::runtime_error(fmt::format("Invalid filter expression at {}: {}", 
+                        tok_pos, msg));
+        }
+
+        bool is_op(const char *op) const {
+            return tok == tok_op && text == op;
+        }
+
+        bool is_word(const char *w) const {
+            return tok == tok_ident && text == w;
+        }
+
+        void expect_op(const char *op) {
+            if (!is_op(op))
+                fail(fmt::format("expected '{}'", op));
+            next();
+        }
+
+        void next() {
+            while (offt < expr.length() && std::isspace((unsigned char) expr[offt]))
+                offt++;
+
+            tok_pos = offt;
+            text.clear();
+
+            if (offt >= expr.length()) {
+                tok = tok_end;
+                return;
+            }
+
+            auto c = expr[offt];
+
+            if (std::isalpha((unsigned char) c) || c == '_') {
+                while (offt < expr.length() && 
+                        (std::isalnum((unsigned char) expr[offt]) || expr[offt] == '_' ||
+                         expr[offt] == '.' || expr[offt] == '/'))
+                    text += expr[offt++];
+
+                tok = tok_ident;
+                return;
+            }
+
+            if (std::isdigit((unsigned char) c) || 
+                    ((c == '-' || c == '+' || c == '.') && offt + 1 < expr.length() && 
+                     (std::isdigit((unsigned char) expr[offt + 1]) || expr[offt + 1] == '.'))) {
+                const char *start = expr.c_str() + offt;
+                char *end;
+
+                num = strtod(start, &end);
+
+                if (end == start)
+                    fail("invalid number");
+
+                text = std::string(start, end - start);
+                offt += end - start;
+                tok = tok_number;
+                return;
+            }
+
+            if (c == '"' || c == '\'') {
+                offt++;
+
+                while (offt < expr.length() && expr[offt] != c) {
+                    if (expr[offt] == '\\' && offt + 1 < expr.length())
+                        offt++;
+                    text += expr[offt++];
+                }
+
+                if (offt >= expr.length())
+                    fail("unterminated string");
+
+                offt++;
+                tok = tok_string;
+                return;
+            }
+
+            static const char *ops2[] = { "==", "!=", "<=", ">=", "&&", "||", "^=", nullptr };
+
+            for (unsigned int i = 0; ops2[i] != nullptr; i++) {
+                if (expr.compare(offt, 2, ops2[i]) == 0) {
+                    text = ops2[i];
+                    offt += 2;
+                    tok = tok_op;
+                    return;
+                }
+            }
+
+            if (std::string("<>!~()[],=").find(c) != std::string::npos) {
+                // A lone '=' is accepted as equality
+                text = c == '=' ? "==" : std::string(1, c);
+                offt++;
+                tok = tok_op;
+                return;
+            }
+
+            fail(fmt::format("unexpected '{}'", c));
+        }
+
+        device_tracker_view_filter_worker::filter_fn parse_or() {
+            auto lhs = parse_and();
+
+            while (is_op("||") || is_word("or")) {
+                next();
+                auto rhs = parse_and();
+                lhs = [lhs, rhs](const shared_tracker_element& d) { return lhs(d) || rhs(d); };
+            }
+
+            return lhs;
+        }
+
+        device_tracker_view_filter_worker::filter_fn parse_and() {
+            auto lhs = parse_not();
+
+            while (is_op("&&") || is_word("and")) {
+                next();
+                auto rhs = parse_not();
+                lhs = [lhs, rhs](const shared_tracker_element& d) { return lhs(d) && rhs(d); };
+            }
+
+            return lhs;
+        }
+
+        device_tracker_view_filter_worker::filter_fn parse_not() {
+            if (is_op("!") || is_word("not")) {
+                next();
+                auto e = parse_not();
+                return [e](const shared_tracker_element& d) { return !e(d); };
+            }
+
+            return parse_primary();
+        }
+
+        device_tracker_view_filter_worker::filter_fn parse_primary() {
+            if (is_op("(")) {
+                next();
+                auto e = parse_or();
+                expect_op(")");
+                return e;
+            }
+
+            if (tok != tok_ident)
+                fail("expected field or '('");
+
+            auto field = text;
+            auto path = tracker_element_summary(field).resolved_path;
+
+            // Unresolved path components are -1 and can never match a device
+            if (path.size() == 0 || std::find(path.begin(), path.end(), -1) != path.end())
+                fail(fmt::format("invalid field '{}'", field));
+
+            next();
+
+            if (is_word("in")) {
+                next();
+                expect_op("[");
+                auto low = parse_number();
+                expect_op(",");
+                auto high = parse_number();
+                expect_op("]");
+
+                return [path, low, high](const shared_tracker_element& d) -> bool {
+                    auto e = get_tracker_element_path(path, d);
+                    double v;
+
+                    if (e == nullptr || !filter_numeric_value(e, v))
+                        return false;
+
+                    return v >= low && v <= high;
+                };
+            }
+
+            if (tok != tok_op)
+                fail("expected comparison");
+
+            filter_op op;
+
+            if (text == "==")
+                op = filter_op::eq;
+            else if (text == "!=")
+                op = filter_op::ne;
+            else if (text == "<")
+                op = filter_op::lt;
+            else if (text == "<=")
+                op = filter_op::le;
+            else if (text == ">")
+                op = filter_op::gt;
+            else if (text == ">=")
+                op = filter_op::ge;
+            else if (text == "~")
+                op = filter_op::regex;
+            else if (text == "^=")
+                op = filter_op::prefix;
+            else
+                fail(fmt::format("unexpected '{}'", text));
+
+            next();
+
+            if (tok != tok_number && tok != tok_string)
+                fail("expected number or string");
+
+            auto c = std::make_shared<filter_constant>();
+
+            c->str = text;
+            c->is_num = tok == tok_number;
+            c->num = num;
+
+            if (op == filter_op::prefix) {
+                // Partial MACs match as a masked MAC
+                mac_addr m(text);
+                c->is_mac = !m.error() && text.length() > 0;
+                if (c->is_mac) {
+                    std::string mask;
+                    for (unsigned int b = 0; b <= m.state.len; b++)
+                        mask += b == 0 ? "FF" : ":FF";
+                    c->mac = mac_addr(fmt::format("{}/{}", text, mask));
+                }
+            } else {
+                c->mac = mac_addr(text);
+                c->is_mac = !c->mac.error() && text.length() > 0;
+            }
+
+            c->uuid_v = uuid(text);
+            c->is_uuid = !c->uuid_v.error;
+
+            if (op == filter_op::regex) {
+#ifdef HAVE_LIBPCRE
+                c->re = std::make_shared<device_tracker_view_regex_worker::pcre_filter>(field, text);
+#else
+                fail("Kismet was not compiled with PCRE support");
+#endif
+            }
+
+            next();
+
+            return [path, op, c](const shared_tracker_element& d) -> bool {
+                auto e = get_tracker_element_path(path, d);
+
+                if (e == nullptr)
+                    return false;
+
+                switch (e->get_type()) {
+                    case tracker_type::tracker_string:
+                    case tracker_type::tracker_byte_array:
+                        {
+                            const auto& v = e->get_type() == tracker_type::tracker_string ?
+                                std::static_pointer_cast<tracker_element_string>(e)->get() :
+                                std::static_pointer_cast<tracker_element_byte_array>(e)->get();
+
+                            if (op == filter_op::prefix)
+                                return v.compare(0, c->str.length(), c->str) == 0;
+
+                            if (op == filter_op::regex) {
+#ifdef HAVE_LIBPCRE
+                                int ovector[128];
+                                return pcre_exec(c->re->re, c->re->study, v.c_str(), v.length(), 
+                                        0, 0, ovector, 128) >= 0;
+#else
+                                return false;
+#endif
+                            }
+
+                            return filter_compare(op, v, c->str);
+                        }
+                    case tracker_type::tracker_mac_addr:
+                        if (!c->is_mac || (op != filter_op::eq && op != filter_op::ne &&
+                                    op != filter_op::prefix))
+                            return false;
+
+                        if (op == filter_op::ne)
+                            return !(std::static_pointer_cast<tracker_element_mac_addr>(e)->get() == c->mac);
+
+                        return std::static_pointer_cast<tracker_element_mac_addr>(e)->get() == c->mac;
+                    case tracker_type::tracker_uuid:
+                        if (!c->is_uuid || (op != filter_op::eq && op != filter_op::ne))
+                            return false;
+
+                        return filter_compare(op, std::static_pointer_cast<tracker_element_uuid>(e)->get(), 
+                                c->uuid_v);
+                    default:
+                        {
+                            double v;
+
+                            if (!c->is_num || !filter_numeric_value(e, v))
+                                return false;
+
+                            return filter_compare(op, v, c->num);
+                        }
+                }
+            };
+        }
+
+        double parse_number() {
+            if (tok != tok_number)
+                fail("expected number");
+
+            auto v = num;
+            next();
+            return v;
+        }
+    };
+}
+
+device_tracker_view_filter_worker::device_tracker_view_filter_worker(const std::string& in_expression) {
+    filter = filter_compiler(in_expression).compile();
+}
+
+bool device_tracker_view_filter_worker::match_device(std::shared_ptr<kis_tracked_device_base> device) {
+    return filter(device);
+}
@@ -21,7 +21,12 @@
 
 #include "config.h"
 
+#include <atomic>
+#include <condition_variable>
 #include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "kis_mutex.h"
 #include "uuid.h"
@@ -29,10 +34,35 @@
 #include "trackedcomponent.h"
 #include "devicetracker_component.h"
 
+#include "moodycamel/blockingconcurrentqueue.h"
+
 #ifdef HAVE_LIBPCRE
 #include <pcre.h>
 #endif
 
+// Shared pool of threads for splitting read-only device work into chunks.  The calling
+// thread works through chunks alongside the pool, so a busy (or empty) pool only
+// costs parallelism, never progress.
+class device_tracker_worker_pool {
+public:
+    device_tracker_worker_pool(unsigned int in_threads);
+    ~device_tracker_worker_pool();
+
+    // Threads available to a parallel_for, including the caller
+    size_t concurrency() const {
+        return threads.size() + 1;
+    }
+
+    // Call fn for every index in [0, in_n) across the pool and the calling thread, 
+    // returning once every call has completed.  The first exception thrown by fn is
+    // re-thrown to the caller.
+    void parallel_for(size_t in_n, const std::function<void (size_t)>& fn);
+
+protected:
+    moodycamel::BlockingConcurrentQueue<std::function<void ()>> jobs;
+    std::vector<std::thread> threads;
+};
+
 class device_tracker_view_worker {
 public:
     device_tracker_view_worker() {
@@ -41,6 +71,14 @@ public:
     virtual ~device_tracker_view_worker() { }
 
     virtual bool match_device(std::shared_ptr<kis_tracked_device_base> device) = 0;
+
+    // Workers which only read devices, and keep no mutable state of their own in
+    // match_device, may have match_device called concurrently from multiple threads
+    // over read-only work
+    virtual bool thread_safe() const {
+        return false;
+    }
+
     virtual std::shared_ptr<tracker_element_vector> getMatchedDevices() {
         return matched;
     }
@@ -109,6 +147,10 @@ public:
 
     virtual bool match_device(std::shared_ptr<kis_tracked_device_base> device) override;
 
+    virtual bool thread_safe() const override {
+        return true;
+    }
+
 protected:
     std::vector<std::shared_ptr<device_tracker_view_regex_worker::pcre_filter>> filter_vec;
 
@@ -133,6 +175,10 @@ public:
 
     virtual bool match_device(std::shared_ptr<kis_tracked_device_base> device) override;
 
+    virtual bool thread_safe() const override {
+        return true;
+    }
+
 protected:
     std::string query;
     std::vector<std::vector<int>> fieldpaths;
@@ -160,6 +206,10 @@ public:
 
     virtual bool match_device(std::shared_ptr<kis_tracked_device_base> device) override;
 
+    virtual bool thread_safe() const override {
+        return true;
+    }
+
 protected:
     std::string query;
     std::vector<std::vector<int>> fieldpaths;
@@ -168,4 +218,40 @@ protected:
     unsigned int mac_query_term_len;
 };
 
+// Compiled filter expression.  The expression is parsed once per request into a tree
+// of match functions, with every field path resolved to field ids up front, and
+// constants converted to the type they're compared against; matching a device doesn't
+// convert its fields to strings.
+//
+//   kismet.device.base.packets.total > 100 && kismet.device.base.channel == "6"
+//   kismet.device.base.macaddr ^= "AA:BB:CC" || !(kismet.device.base.name ~ "^HP-")
+//   kismet.device.base.signal/kismet.common.signal.last_signal in [-70, -40]
+//
+// Comparisons are ==, !=, <, <=, >, >=, ~ (regex), ^= (prefix, or MAC prefix against 
+// MAC fields) and 'in [low, high]' (inclusive numeric range), combined with && (and), 
+// || (or), ! (not) and parentheses.  A comparison against a field which is missing, or
+// of a type the operator doesn't apply to, doesn't match.
+class device_tracker_view_filter_worker : public device_tracker_view_worker {
+public:
+    using filter_fn = std::function<bool (const shared_tracker_element&)>;
+
+    // std::runtime_error is thrown if the expression can't be compiled
+    device_tracker_view_filter_worker(const std::string& in_expression);
+    device_tracker_view_filter_worker(const device_tracker_view_filter_worker& w) {
+        filter = w.filter;
+        matched = w.matched;
+    }
+
+    virtual ~device_tracker_view_filter_worker() { }
+
+    virtual bool match_device(std::shared_ptr<kis_tracked_device_base> device) override;
+
+    virtual bool thread_safe() const override {
+        return true;
+    }
+
+protected:
+    filter_fn filter;
+};
+
 #endif
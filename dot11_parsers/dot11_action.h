@@ -130,7 +130,7 @@ public:
             return m_dialog_token;
         }
 
-        std::string tags_data() const {
+        const std::string& tags_data() const {
             return m_tags_data;
         }
 
@@ -16,22 +16,89 @@
     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
+#include <stdexcept>
+#include <streambuf>
+
 #include "dot11_ie.h"
 
-void dot11_ie::parse(std::shared_ptr<kaitai::kstream> p_io) {
-    m_tags.reset(new shared_ie_tag_vector());
+void dot11_ie::parse(const uint8_t *data, size_t len) {
+    size_t pos = 0;
+
+    m_data = data;
+    m_len = 0;
+    m_parsed = false;
+
+    while (pos < len) {
+        if (len - pos < 2)
+            throw std::runtime_error("truncated IE tag header");
 
-    while (!p_io->is_eof()) {
-        std::shared_ptr<dot11_ie_tag> t(new dot11_ie_tag());
-        t->parse(p_io);
-        m_tags->push_back(t);
+        if (len - pos - 2 < data[pos + 1])
+            throw std::runtime_error("truncated IE tag content");
+
+        pos += 2 + data[pos + 1];
     }
+
+    m_len = len;
+    m_parsed = true;
 }
 
-void dot11_ie::dot11_ie_tag::parse(std::shared_ptr<kaitai::kstream> p_io) {
-    m_tag_num = p_io->read_u1();
-    m_tag_len = p_io->read_u1();
-    m_tag_data = p_io->read_bytes(tag_len());
-    m_tag_data_stream.reset(new kaitai::kstream(m_tag_data));
+namespace {
+    // Read-only streambuf over existing memory, with enough seek support for
+    // the kaitai stream api
+    struct dot11_ie_membuf : std::streambuf {
+        dot11_ie_membuf(const uint8_t *data, size_t len) {
+            char *begin = (char *) data;
+            setg(begin, begin, begin + len);
+        }
+
+        virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                std::ios_base::openmode which __attribute__((unused)) = std::ios_base::in) override {
+            off_type target;
+
+            if (dir == std::ios_base::cur)
+                target = (gptr() - eback()) + off;
+            else if (dir == std::ios_base::end)
+                target = (egptr() - eback()) + off;
+            else
+                target = off;
+
+            if (target < 0 || target > egptr() - eback())
+                return pos_type(off_type(-1));
+
+            setg(eback(), eback() + target, egptr());
+
+            return pos_type(target);
+        }
+
+        virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+            return seekoff(off_type(pos), std::ios_base::beg, which);
+        }
+    };
+
+    struct dot11_ie_stream_holder {
+        dot11_ie_stream_holder(const uint8_t *data, size_t len) :
+            buf{data, len},
+            istr{&buf},
+            ks{&istr} { }
+
+        dot11_ie_membuf buf;
+        std::istream istr;
+        kaitai::kstream ks;
+    };
+}
+
+std::shared_ptr<kaitai::kstream> dot11_ie_view_stream(const uint8_t *data, size_t len) {
+    auto holder = std::make_shared<dot11_ie_stream_holder>(data, len);
+    return std::shared_ptr<kaitai::kstream>(holder, &holder->ks);
 }
 
+std::shared_ptr<kaitai::kstream> dot11_ie::dot11_ie_tag::tag_data_stream() const {
+    return dot11_ie_view_stream(m_tag_data, m_tag_len);
+}
+
+std::shared_ptr<kaitai::kstream> dot11_ie::dot11_ie_tag::vendor_tag_stream() const {
+    if (m_tag_len < 3)
+        throw std::runtime_error("IE tag too short for vendor OUI");
+
+    return dot11_ie_view_stream(m_tag_data + 3, m_tag_len - 3);
+}
@@ -19,50 +19,71 @@
 #ifndef __DOT11_IE_H__
 #define __DOT11_IE_H__
 
-/* Parse a dot11 ie stream into individual objects.
+/* Walk a dot11 ie tag buffer in place.
  *
- * This uses the kaitai stream buffer from the kaitai runtime as it is a 
- * solid implementation of buffer-bounded operations and data extraction.
+ * Tags are returned as lightweight views (number, length, and a pointer into
+ * the original buffer); walking the tags does not allocate or copy the tag
+ * contents, so the buffer given to parse() must outlive the dot11_ie object
+ * and any tags taken from it.
  *
- * Much of this is modeled on how kaitai generates parsers.
+ * Parsers built on the kaitai stream API can still be used on a tag via
+ * tag_data_stream(), which reads the original buffer in place.
  *
  */
 
+#include <stdint.h>
 #include <string>
+#include <string_view>
 #include <memory>
-#include <vector>
 #include <kaitai/kaitaistream.h>
 #include "multi_constexpr.h"
 
 class dot11_ie {
 public:
     class dot11_ie_tag;
-    typedef std::vector<std::shared_ptr<dot11_ie_tag> > shared_ie_tag_vector;
+    class iterator;
 
-    dot11_ie() {
-
-    }
+    dot11_ie() :
+        m_data{nullptr},
+        m_len{0},
+        m_parsed{false} { }
 
     ~dot11_ie() {
 
     }
 
-    void parse(std::shared_ptr<kaitai::kstream> p_io);
+    // Validate and index a buffer of tags; throws std::runtime_error if the tag
+    // list is truncated
+    void parse(const uint8_t *data, size_t len);
+
+    void parse(const std::string& data) {
+        parse((const uint8_t *) data.data(), data.length());
+    }
 
-    std::shared_ptr<shared_ie_tag_vector> tags() const {
-        return m_tags;
+    bool parsed() const {
+        return m_parsed;
     }
 
+    iterator begin() const;
+    iterator end() const;
+
 protected:
-    std::shared_ptr<shared_ie_tag_vector> m_tags;
+    const uint8_t *m_data;
+    size_t m_len;
+    bool m_parsed;
 
 public:
     class dot11_ie_tag {
     public:
-        dot11_ie_tag() { } 
-        ~dot11_ie_tag() { }
+        dot11_ie_tag() :
+            m_tag_num{0},
+            m_tag_len{0},
+            m_tag_data{nullptr} { }
 
-        void parse(std::shared_ptr<kaitai::kstream> p_io);
+        dot11_ie_tag(uint8_t tag_num, uint8_t tag_len, const uint8_t *tag_data) :
+            m_tag_num{tag_num},
+            m_tag_len{tag_len},
+            m_tag_data{tag_data} { }
 
         constexpr17 uint8_t tag_num() const {
             return m_tag_num;
@@ -72,23 +93,84 @@ public:
             return m_tag_len;
         }
 
-        std::string tag_data() const {
+        const uint8_t *tag_data_ptr() const {
             return m_tag_data;
         }
 
-        std::shared_ptr<kaitai::kstream> tag_data_stream() const {
-            return m_tag_data_stream;
+        std::string_view tag_data() const {
+            return std::string_view((const char *) m_tag_data, m_tag_len);
+        }
+
+        // Vendor tags (150, 221) lead with a 3 byte OUI and usually a vendor
+        // type byte; read them directly from the tag
+        bool has_vendor_oui() const {
+            return m_tag_len >= 3;
         }
 
+        uint32_t vendor_oui_int() const {
+            if (m_tag_len < 3)
+                return 0;
+
+            return (uint32_t) ((m_tag_data[0] << 16) + (m_tag_data[1] << 8) + m_tag_data[2]);
+        }
+
+        uint8_t vendor_oui_type() const {
+            if (m_tag_len < 4)
+                return 0;
+
+            return m_tag_data[3];
+        }
+
+        // Kaitai stream over the tag contents, or over the vendor contents following
+        // the OUI; each call returns a new stream positioned at the start
+        std::shared_ptr<kaitai::kstream> tag_data_stream() const;
+        std::shared_ptr<kaitai::kstream> vendor_tag_stream() const;
+
     protected:
         uint8_t m_tag_num;
         uint8_t m_tag_len;
-        std::string m_tag_data;
-        std::shared_ptr<kaitai::kstream> m_tag_data_stream;
+        const uint8_t *m_tag_data;
+    };
+
+    class iterator {
+    public:
+        iterator(const uint8_t *pos) :
+            m_pos{pos} { }
+
+        dot11_ie_tag operator*() const {
+            return dot11_ie_tag(m_pos[0], m_pos[1], m_pos + 2);
+        }
+
+        iterator& operator++() {
+            m_pos += 2 + m_pos[1];
+            return *this;
+        }
+
+        bool operator==(const iterator& i) const {
+            return m_pos == i.m_pos;
+        }
+
+        bool operator!=(const iterator& i) const {
+            return m_pos != i.m_pos;
+        }
+
+    protected:
+        const uint8_t *m_pos;
     };
 
 };
 
+inline dot11_ie::iterator dot11_ie::begin() const {
+    return iterator(m_data);
+}
+
+inline dot11_ie::iterator dot11_ie::end() const {
+    return iterator(m_data + m_len);
+}
+
+// Kaitai stream over an existing buffer, read in place
+std::shared_ptr<kaitai::kstream> dot11_ie_view_stream(const uint8_t *data, size_t len);
+
 
 #endif
 
@@ -190,7 +190,7 @@ public:
                 return m_wpa_key_data_len;
             }
 
-            std::string wpa_key_data() const {
+            const std::string& wpa_key_data() const {
                 return m_wpa_key_data;
             }
 
@@ -22,20 +22,58 @@
 #include "util.h"
 
 #include "entrytracker.h"
+#include "json_adapter.h"
 #include "messagebus.h"
 #include "kis_net_beast_httpd.h"
 
 entry_tracker::entry_tracker() {
     entry_mutex.set_name("entry_tracker");
     serializer_mutex.set_name("entry_tracker_serializer");
+    summary_plan_mutex.set_name("entry_tracker_summary_plan");
 
     next_field_num = 1;
+
+    for (auto& c : field_table)
+        c.store(nullptr, std::memory_order_relaxed);
 }
 
 entry_tracker::~entry_tracker() {
     kis_lock_guard<kis_mutex> lk(entry_mutex, "~entrytracker");
 
     Globalreg::globalreg->remove_global("ENTRYTRACKER");
+
+    for (auto& c : field_table)
+        delete[] c.load(std::memory_order_relaxed);
+}
+
+void entry_tracker::publish_field_names(const reserved_field& in_field) {
+    // Callers hold the entry mutex
+    if (in_field.field_id < 0 || in_field.field_id >= (field_table_chunks << field_table_chunk_bits))
+        return;
+
+    auto names = std::unique_ptr<tracked_field_names>(new tracked_field_names());
+    names->field_id = in_field.field_id;
+    names->name = in_field.field_name;
+    names->description = in_field.field_description;
+    names->json_name = json_adapter::sanitize_string(in_field.field_name);
+    names->ek_json_name = json_adapter::sanitize_string(multi_replace_all(in_field.field_name, ".", "_"));
+
+    auto& chunk_slot = field_table[in_field.field_id >> field_table_chunk_bits];
+    auto chunk = chunk_slot.load(std::memory_order_relaxed);
+
+    if (chunk == nullptr) {
+        chunk = new field_table_slot[1 << field_table_chunk_bits];
+
+        for (int i = 0; i < (1 << field_table_chunk_bits); i++)
+            chunk[i].store(nullptr, std::memory_order_relaxed);
+
+        chunk_slot.store(chunk, std::memory_order_release);
+    }
+
+    // The record is complete before it's visible to readers
+    chunk[in_field.field_id & ((1 << field_table_chunk_bits) - 1)].store(names.get(), 
+            std::memory_order_release);
+    field_table_records.push_back(std::move(names));
 }
 
 void entry_tracker::trigger_deferred_startup() {
@@ -115,6 +153,8 @@ int entry_tracker::register_field(const std::string& in_name,
     field_name_map[in_name] = definition;
     field_id_map[definition->field_id] = definition;
 
+    publish_field_names(*definition);
+
     return definition->field_id;
 }
 
@@ -148,6 +188,8 @@ std::shared_ptr<tracker_element> entry_tracker::register_and_get_field(const std
     field_name_map[in_name] = definition;
     field_id_map[definition->field_id] = definition;
 
+    publish_field_names(*definition);
+
     return definition->builder->clone_type();
 }
 
@@ -165,25 +207,33 @@ int entry_tracker::get_field_id(const std::string& in_name) {
 }
 
 std::string entry_tracker::get_field_name(int in_id) {
-    kis_lock_guard<kis_mutex> lk(entry_mutex, "entry_tracker get_field_name");
+    auto names = fetch_field_names(in_id);
 
-    auto iter = field_id_map.find(in_id);
-    if (iter == field_id_map.end()) 
+    if (names == nullptr)
         return "field.unknown.not.registered";
 
-    return iter->second->field_name;
+    return names->name;
 }
 
-std::string entry_tracker::get_field_description(int in_id) {
-    kis_lock_guard<kis_mutex> lk(entry_mutex, "entry_tracker get_field_description");
+std::vector<std::pair<int, std::string>> entry_tracker::get_field_names() {
+    kis_lock_guard<kis_mutex> lk(entry_mutex, "entry_tracker get_field_names");
 
-    auto iter = field_id_map.find(in_id);
+    std::vector<std::pair<int, std::string>> ret;
+    ret.reserve(field_id_map.size());
+
+    for (const auto& i : field_id_map)
+        ret.push_back(std::make_pair(i.first, i.second->field_name));
+
+    return ret;
+}
+
+std::string entry_tracker::get_field_description(int in_id) {
+    auto names = fetch_field_names(in_id);
 
-    if (iter == field_id_map.end()) {
+    if (names == nullptr)
         return "untracked field, description not available";
-    }
 
-    return iter->second->field_description;
+    return names->description;
 }
 
 std::shared_ptr<tracker_element> entry_tracker::get_shared_instance(int in_id) {
@@ -286,6 +336,111 @@ int entry_tracker::serialize_with_json_summary(const std::string& type, std::ost
     return serialize(type, stream, sumelem, name_map);
 }
 
+std::shared_ptr<tracker_element_serializer> entry_tracker::get_stream_serializer(const std::string& in_name) {
+    kis_lock_guard<kis_mutex> lk(serializer_mutex, "entry_tracker get_stream_serializer");
+
+    auto dpos = in_name.find_last_of(".");
+    auto i = serializer_map.find(dpos == std::string::npos ? in_name : in_name.substr(dpos + 1));
+
+    if (i == serializer_map.end())
+        return nullptr;
+
+    auto stream_ser = i->second->new_stream();
+
+    if (stream_ser != nullptr)
+        return stream_ser;
+
+    return i->second;
+}
+
+int entry_tracker::serialize_with_json_summary(const std::shared_ptr<tracker_element_serializer>& serializer,
+        std::ostream& stream, shared_tracker_element elem, const Json::Value& json_summary) {
+    auto name_map = std::make_shared<tracker_element_serializer::rename_map>();
+
+    auto sumelem = 
+        summarize_tracker_element_with_json(elem, json_summary, name_map);
+
+    return serializer->serialize(sumelem, stream, name_map);
+}
+
+summary_plan entry_tracker::get_summary_plan(const Json::Value& fields) {
+    // Key the cache on the paths and renames, length-prefixed so they can't run together
+    std::string key;
+
+    for (const auto& i : fields) {
+        if (i.isString()) {
+            auto path = i.asString();
+            key += fmt::format("{}:{}", path.length(), path);
+        } else if (i.isArray()) {
+            if (i.size() != 2)
+                throw std::runtime_error("Invalid field mapping, expected [field, name]");
+
+            auto path = i[0].asString();
+            auto rename = i[1].asString();
+            key += fmt::format("{}:{}{}={}", path.length(), path, rename.length(), rename);
+        } else {
+            throw std::runtime_error("Invalid field mapping, expected field or [field,rename]");
+        }
+    }
+
+    {
+        kis_lock_guard<kis_mutex> lk(summary_plan_mutex, "entry_tracker get_summary_plan");
+
+        auto p = summary_plan_map.find(key);
+        if (p != summary_plan_map.end())
+            return p->second;
+    }
+
+    auto plan = std::make_shared<std::vector<SharedElementSummary>>();
+    bool resolved = true;
+    unsigned int fn = 0;
+
+    for (const auto& i : fields) {
+        fn++;
+
+        auto sum = i.isString() ? 
+            std::make_shared<tracker_element_summary>(i.asString()) :
+            std::make_shared<tracker_element_summary>(i[0].asString(), i[1].asString());
+
+        if (sum->resolved_path.size() == 0) {
+            plan->push_back(sum);
+            continue;
+        }
+
+        for (auto id : sum->resolved_path) {
+            if (id < 0)
+                resolved = false;
+        }
+
+        sum->json_rename = json_adapter::sanitize_string(sum->rename);
+        sum->ek_json_rename = json_adapter::sanitize_string(multi_replace_all(sum->rename, ".", "_"));
+
+        // Same placeholder summarize_tracker_element would make for a missing path
+        sum->placeholder_id = register_field(fmt::format("unknown{}", fn),
+                tracker_element_factory<tracker_element_placeholder>(), "unallocated field");
+
+        auto lastid = sum->resolved_path[sum->resolved_path.size() - 1];
+
+        if (sum->rename.length() != 0)
+            sum->placeholder_name = sum->rename;
+        else if (lastid >= 0)
+            sum->placeholder_name = get_field_name(lastid);
+
+        plan->push_back(sum);
+    }
+
+    if (resolved) {
+        kis_lock_guard<kis_mutex> lk(summary_plan_mutex, "entry_tracker get_summary_plan");
+
+        if (summary_plan_map.size() >= summary_plan_max)
+            summary_plan_map.clear();
+
+        summary_plan_map[key] = plan;
+    }
+
+    return plan;
+}
+
 void entry_tracker::register_search_xform(int in_field_id, std::function<void (std::shared_ptr<tracker_element>,
             std::string& mapped_str)> in_xform) {
 
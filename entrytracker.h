@@ -24,10 +24,12 @@
 #include <stdio.h>
 #include <stdint.h>
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "globalregistry.h"
 #include "kis_mutex.h"
@@ -36,6 +38,19 @@
 
 class kis_net_beast_httpd_connection;
 
+// Names of a registered field, in the forms the serializers need.  Records are published
+// when the field is registered and are never changed or freed while the entry tracker
+// exists, so they can be read without locking.
+struct tracked_field_names {
+    int field_id;
+    std::string name;
+    std::string description;
+    // Name escaped for use as a JSON key
+    std::string json_name;
+    // JSON key with dots replaced by underscores, for ELK-style JSON
+    std::string ek_json_name;
+};
+
 // Allocate and track named fields and give each one a custom int
 class entry_tracker : public lifetime_global, public deferred_startup {
 public:
@@ -92,6 +107,24 @@ public:
     std::string get_field_name(int in_id);
     std::string get_field_description(int in_id);
 
+    // Lock-free lookup of the names of a field, for serializers; returns nullptr if the
+    // field isn't registered
+    const tracked_field_names *fetch_field_names(int in_id) const {
+        if (in_id < 0 || in_id >= (field_table_chunks << field_table_chunk_bits))
+            return nullptr;
+
+        auto chunk = field_table[in_id >> field_table_chunk_bits].load(std::memory_order_acquire);
+
+        if (chunk == nullptr)
+            return nullptr;
+
+        return chunk[in_id & ((1 << field_table_chunk_bits) - 1)].load(std::memory_order_acquire);
+    }
+
+    // Every registered field id and name, for records which have to be mapped back to
+    // field ids by a later process
+    std::vector<std::pair<int, std::string>> get_field_names();
+
     // Generate a shared field instance, using the builder
     template<class T> std::shared_ptr<T> get_shared_instance_as(const std::string& in_name) {
         return std::static_pointer_cast<T>(get_shared_instance(in_name));
@@ -114,6 +147,20 @@ public:
     int serialize_with_json_summary(const std::string& type, std::ostream& stream, shared_tracker_element elem,
             const Json::Value& json_summary);
 
+    // Fetch a serializer by type or file extension for a stream of messages, such as a
+    // websocket, which are serialized by calling it directly; returns nullptr if the type
+    // can't be serialized
+    std::shared_ptr<tracker_element_serializer> get_stream_serializer(const std::string& type);
+
+    int serialize_with_json_summary(const std::shared_ptr<tracker_element_serializer>& serializer,
+            std::ostream& stream, shared_tracker_element elem, const Json::Value& json_summary);
+
+    // Compile a request 'fields' list of paths and [path, rename] pairs into a summary plan
+    // of resolved paths, renames, and pre-encoded keys.  Plans are cached by the text of the
+    // list, so the same list only resolves once.  Throws std::runtime_error if the list is
+    // malformed.
+    summary_plan get_summary_plan(const Json::Value& fields);
+
     // Optional per-field-id transforms for search functions, must use the search workers or be called
     // manually
     void register_search_xform(int in_field_id, std::function<void (std::shared_ptr<tracker_element>,
@@ -145,11 +192,29 @@ protected:
     robin_hood::unordered_node_map<int, std::shared_ptr<reserved_field> > field_id_map;
     robin_hood::unordered_node_map<std::string, std::shared_ptr<tracker_element_serializer> > serializer_map;
 
+    // Compiled summary plans by field list.  Lists with paths which don't resolve aren't
+    // cached, as the fields may be registered later.
+    kis_mutex summary_plan_mutex;
+    robin_hood::unordered_node_map<std::string, summary_plan> summary_plan_map;
+    static constexpr size_t summary_plan_max = 256;
+
     // Field IDs to optional search xform function
     robin_hood::unordered_node_map<int, std::function<void (std::shared_ptr<tracker_element>, 
             std::string& mapped_str)>> search_xform_map;
 
     void tracked_fields_endp_handler(std::shared_ptr<kis_net_beast_httpd_connection> con);
+
+    // Field name records indexed by id, in fixed chunks which are never moved once
+    // published, so readers don't need the entry mutex.  Appended under the entry mutex.
+    static constexpr int field_table_chunk_bits = 10;
+    static constexpr int field_table_chunks = 4096;
+
+    using field_table_slot = std::atomic<const tracked_field_names *>;
+
+    std::atomic<field_table_slot *> field_table[field_table_chunks];
+    std::vector<std::unique_ptr<tracked_field_names>> field_table_records;
+
+    void publish_field_names(const reserved_field& in_field);
 };
 
 class serializer_scope {
@@ -89,17 +89,31 @@ void event_bus::trigger_deferred_startup() {
                                     reg_map.erase(e_k);
                                 }
 
+                                std::string format_t = "json";
+
+                                if (!json["format"].isNull())
+                                    format_t = json["format"].asString();
+
+                                auto serializer = 
+                                    Globalreg::globalreg->entrytracker->get_stream_serializer(format_t);
+
+                                if (serializer == nullptr) {
+                                    _MSG_ERROR("Invalid websocket request (unknown format {}) on "
+                                            "/eventbus/events.ws", format_t);
+                                    return;
+                                }
+
                                 auto id = 
                                     register_listener(json["SUBSCRIBE"].asString(), 
-                                            [ws, json](std::shared_ptr<eventbus_event> evt) {
+                                            [ws, json, serializer](std::shared_ptr<eventbus_event> evt) {
                                             
                                             boost::asio::streambuf stream;
                                             std::ostream os(&stream);
 
-                                            Globalreg::globalreg->entrytracker->serialize_with_json_summary("json", os, 
+                                            Globalreg::globalreg->entrytracker->serialize_with_json_summary(serializer, os, 
                                                     evt->get_event_content(), json);
 
-                                            ws->write(stream.data(), true);
+                                            ws->write(stream.data(), !serializer->is_binary());
 
                                             });
                                 
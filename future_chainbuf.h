@@ -42,7 +42,8 @@
 // Once in packet mode it can not be set to stream mode
 //
 // Offers two blocking interfaces:
-// wait() - waits until data is *present in the buffer*, should be called by the consumer
+// wait() - waits until data is *present in the buffer*, should be called by the consumer;
+//  wait(min_sz) waits until at least min_sz bytes are buffered or the stream ends
 // wait_write() - waits until the buffer *has flushed data*, should be called by a producer
 //  looking to throttle size buffer size.
 class future_chainbuf : public std::stringbuf {
@@ -377,23 +378,26 @@ public:
         packet_ = true;
     }
 
-    size_t wait() {
+    size_t wait(size_t min_sz = 1) {
         if (waiting_)
             throw std::runtime_error("future_stream already blocking");
 
-        if (total_sz_ > 0 || !running()) {
-            return total_sz_;
-        }
+        while (1) {
+            mutex_.lock();
 
-        mutex_.lock();
-        waiting_ = true;
-        wait_promise_ = std::promise<void>();
-        auto ft = wait_promise_.get_future();
-        mutex_.unlock();
+            if (total_sz_ >= min_sz || !running()) {
+                size_t sz = total_sz_;
+                mutex_.unlock();
+                return sz;
+            }
 
-        ft.wait();
+            waiting_ = true;
+            wait_promise_ = std::promise<void>();
+            auto ft = wait_promise_.get_future();
+            mutex_.unlock();
 
-        return total_sz_;
+            ft.wait();
+        }
     }
 
     size_t wait_write() {
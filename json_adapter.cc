@@ -19,6 +19,7 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <list>
 #include <map>
@@ -34,6 +35,7 @@
 #include "entrytracker.h"
 #include "uuid.h"
 #include "devicetracker_component.h"
+#include "endian_magic.h"
 #include "json_adapter.h"
 
 /* sanitize_extra_space and sanitize_string taken from nlohmann's jsonhpp library,
@@ -164,8 +166,7 @@ std::string json_adapter::sanitize_string(const std::string& s) noexcept {
 
 void json_adapter::pack(std::ostream &stream, shared_tracker_element e, 
         std::shared_ptr<tracker_element_serializer::rename_map> name_map,
-        bool prettyprint, unsigned int depth,
-        std::function<std::string (const std::string&)> name_permuter) {
+        bool prettyprint, unsigned int depth, field_naming naming) {
 
     std::string indent;
     std::string ppendl;
@@ -223,7 +224,7 @@ void json_adapter::pack(std::ostream &stream, shared_tracker_element e,
                     if (prettyprint)
                         stream << indent;
 
-                    json_adapter::pack(stream, i, name_map, prettyprint, depth + 1, name_permuter);
+                    json_adapter::pack(stream, i, name_map, prettyprint, depth + 1, naming);
                 }
                 stream << ppendl << indent << "]";
                 break;
@@ -277,11 +278,12 @@ void json_adapter::pack(std::ostream &stream, shared_tracker_element e,
                     stream << ppendl << indent << "{" << ppendl;
 
                 prepend_comma = false;
-                for (auto i : *(std::static_pointer_cast<tracker_element_map>(e))) {
+                for_each_map_field(std::static_pointer_cast<tracker_element_map>(e),
+                        [&](const tracker_element_map::map_t::value_type& i) {
                     bool named = false;
 
                     if (i.second == NULL)
-                        continue;
+                        return;
 
                     if (prepend_comma) {
                         stream << "," << ppendl;
@@ -293,51 +295,67 @@ void json_adapter::pack(std::ostream &stream, shared_tracker_element e,
                     prepend_comma = true;
 
                     if (!as_vector) {
+                        // Registered field names come pre-escaped from the entry tracker,
+                        // without locking or copying
+                        const std::string *keyname = nullptr;
+                        auto fieldnames = Globalreg::globalreg->entrytracker->fetch_field_names(i.first);
+
                         if (name_map != NULL) {
                             tracker_element_serializer::rename_map::iterator nmi = name_map->find(i.second);
-                            if (nmi != name_map->end() && nmi->second->rename.length() != 0) {
-                                tname = nmi->second->rename;
+                            if (nmi != name_map->end() && nmi->second.summary->rename.length() != 0) {
+                                tname = nmi->second.summary->rename;
                                 named = true;
                             }
                         }
 
                         if (!named) {
-                            if (i.second == NULL) {
-                                tname = Globalreg::globalreg->entrytracker->get_field_name(i.first);
-                            } else {
-                                if (i.second->get_type() == tracker_type::tracker_placeholder_missing) {
-                                    tname = std::static_pointer_cast<tracker_element_placeholder>(i.second)->get_name();
-                                } else if (i.second->get_type() == tracker_type::tracker_alias) {
-                                    tname = std::static_pointer_cast<tracker_element_alias>(i.second)->get_alias_name();
-                                } else {
-                                    tname = Globalreg::globalreg->entrytracker->get_field_name(i.first);
-                                }
-
-                                // Default to the defined name if we got a blank
-                                if (tname == "")
-                                    tname = Globalreg::globalreg->entrytracker->get_field_name(i.first);
+                            if (i.second->get_type() == tracker_type::tracker_placeholder_missing) {
+                                tname = std::static_pointer_cast<tracker_element_placeholder>(i.second)->get_name();
+                                named = tname.length() != 0;
+                            } else if (i.second->get_type() == tracker_type::tracker_alias) {
+                                tname = std::static_pointer_cast<tracker_element_alias>(i.second)->get_alias_name();
+                                named = tname.length() != 0;
                             }
                         }
 
-                        tname = json_adapter::sanitize_string(name_permuter(tname));
+                        if (named) {
+                            if (naming == field_naming::elk)
+                                tname = multi_replace_all(tname, ".", "_");
+
+                            tname = json_adapter::sanitize_string(tname);
+                            keyname = &tname;
+                        } else if (fieldnames != nullptr) {
+                            if (naming == field_naming::elk)
+                                keyname = &fieldnames->ek_json_name;
+                            else
+                                keyname = &fieldnames->json_name;
+                        } else {
+                            tname = "field.unknown.not.registered";
+
+                            if (naming == field_naming::elk)
+                                tname = multi_replace_all(tname, ".", "_");
+
+                            keyname = &tname;
+                        }
 
                         if (prettyprint) {
-                            stream << indent << "\"description." << tname << "\": ";
+                            stream << indent << "\"description." << *keyname << "\": ";
                             stream << "\"";
-                            if (i.second != nullptr) {
-                                stream << sanitize_string(i.second->get_type_as_string());
-                                stream << ", ";
-                            }
-                            stream << sanitize_string(Globalreg::globalreg->entrytracker->get_field_description(i.first));
+                            stream << sanitize_string(i.second->get_type_as_string());
+                            stream << ", ";
+                            if (fieldnames != nullptr)
+                                stream << sanitize_string(fieldnames->description);
+                            else
+                                stream << "untracked field, description not available";
                             stream << "\"," << ppendl;
                         }
 
-                        stream << indent << "\"" << tname << "\": ";
+                        stream << indent << "\"" << *keyname << "\": ";
                     }
 
-                    json_adapter::pack(stream, i.second, name_map, prettyprint, depth + 1, name_permuter);
+                    json_adapter::pack(stream, i.second, name_map, prettyprint, depth + 1, naming);
 
-                }
+                });
 
                 if (as_vector || as_key_vector)
                     stream << ppendl << indent << "]";
@@ -372,7 +390,7 @@ void json_adapter::pack(std::ostream &stream, shared_tracker_element e,
                     }
 
                     if (!as_key_vector) {
-                        json_adapter::pack(stream, i.second, name_map, prettyprint, depth + 1, name_permuter);
+                        json_adapter::pack(stream, i.second, name_map, prettyprint, depth + 1, naming);
                     }
                 }
 
@@ -409,7 +427,7 @@ void json_adapter::pack(std::ostream &stream, shared_tracker_element e,
                     }
 
                     if (!as_key_vector) {
-                        json_adapter::pack(stream, i.second, name_map, prettyprint, depth + 1, name_permuter);
+                        json_adapter::pack(stream, i.second, name_map, prettyprint, depth + 1, naming);
                     }
                 }
 
@@ -446,7 +464,7 @@ void json_adapter::pack(std::ostream &stream, shared_tracker_element e,
                     }
 
                     if (!as_key_vector) {
-                        json_adapter::pack(stream, i.second, name_map, prettyprint, depth + 1, name_permuter);
+                        json_adapter::pack(stream, i.second, name_map, prettyprint, depth + 1, naming);
                     }
                 }
 
@@ -482,7 +500,7 @@ void json_adapter::pack(std::ostream &stream, shared_tracker_element e,
                     }
 
                     if (!as_key_vector) {
-                        json_adapter::pack(stream, i.second, name_map, prettyprint, depth + 1, name_permuter);
+                        json_adapter::pack(stream, i.second, name_map, prettyprint, depth + 1, naming);
                     }
                 }
 
@@ -527,7 +545,7 @@ void json_adapter::pack(std::ostream &stream, shared_tracker_element e,
                     }
 
                     if (!as_key_vector) {
-                        json_adapter::pack(stream, i.second, name_map, prettyprint, depth + 1, name_permuter);
+                        json_adapter::pack(stream, i.second, name_map, prettyprint, depth + 1, naming);
                     }
                 }
 
@@ -570,7 +588,7 @@ void json_adapter::pack(std::ostream &stream, shared_tracker_element e,
                     }
 
                     if (!as_key_vector) {
-                        json_adapter::pack(stream, i.second, name_map, prettyprint, depth + 1, name_permuter);
+                        json_adapter::pack(stream, i.second, name_map, prettyprint, depth + 1, naming);
                     }
                 }
 
@@ -654,7 +672,7 @@ void json_adapter::pack(std::ostream &stream, shared_tracker_element e,
                     }
 
                     if (!as_key_vector) {
-                        json_adapter::pack(stream,i.second, name_map, prettyprint, depth + 1, name_permuter);
+                        json_adapter::pack(stream,i.second, name_map, prettyprint, depth + 1, naming);
                     }
                 }
 
@@ -676,3 +694,473 @@ void json_adapter::pack(std::ostream &stream, shared_tracker_element e,
     }
 }
 
+
+void json_adapter::buffer_writer::flush() {
+    if (buf.size() == 0)
+        return;
+
+    stream.write(buf.data(), buf.size());
+    buf.resize(0);
+}
+
+// True if any byte of the word is a control character, quote, or backslash; bytes with
+// the high bit set are never flagged, matching sanitize_string
+static inline bool json_word_needs_escape(uint64_t w) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highs = 0x8080808080808080ULL;
+
+    const uint64_t q = w ^ (ones * '"');
+    const uint64_t b = w ^ (ones * '\\');
+
+    return (((w - ones * 0x20) & ~w) |
+            ((q - ones) & ~q) |
+            ((b - ones) & ~b)) & highs;
+}
+
+void json_adapter::buffer_writer::write_escaped(const char *data, size_t len) {
+    static const char hexdigits[] = "0123456789abcdef";
+
+    size_t start = 0;
+    size_t pos = 0;
+
+    while (pos < len) {
+        // Skip clean runs a word at a time, and copy them in one go when we hit something
+        // which needs escaping
+        if (pos + 8 <= len) {
+            uint64_t w;
+            memcpy(&w, data + pos, sizeof(w));
+
+            if (!json_word_needs_escape(w)) {
+                pos += 8;
+                continue;
+            }
+        }
+
+        const unsigned char c = data[pos];
+
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            pos++;
+            continue;
+        }
+
+        write(data + start, pos - start);
+
+        switch (c) {
+            case '"':
+                write("\\\"", 2);
+                break;
+            case '\\':
+                write("\\\\", 2);
+                break;
+            case '\b':
+                write("\\b", 2);
+                break;
+            case '\f':
+                write("\\f", 2);
+                break;
+            case '\n':
+                write("\\n", 2);
+                break;
+            case '\r':
+                write("\\r", 2);
+                break;
+            case '\t':
+                write("\\t", 2);
+                break;
+            default:
+                {
+                    const char u[] = { '\\', 'u', '0', '0', hexdigits[c >> 4], hexdigits[c & 0xF] };
+                    write(u, sizeof(u));
+                }
+                break;
+        }
+
+        start = ++pos;
+    }
+
+    write(data + start, len - start);
+}
+
+void json_adapter::buffer_writer::write_hex(uint64_t v, unsigned int width) {
+    static const char hexdigits[] = "0123456789ABCDEF";
+
+    char out[16];
+    unsigned int n = 0;
+
+    do {
+        out[sizeof(out) - ++n] = hexdigits[v & 0xF];
+        v >>= 4;
+    } while (v != 0);
+
+    while (n < width && n < sizeof(out))
+        out[sizeof(out) - ++n] = '0';
+
+    write(out + sizeof(out) - n, n);
+}
+
+void json_adapter::buffer_writer::write_mac(const mac_addr& m) {
+    static const char hexdigits[] = "0123456789ABCDEF";
+
+    // Same layout as mac_addr::mac_to_string, len is the base-0 count of bytes
+    char out[MAC_LEN_MAX * 3];
+    unsigned int nbytes = m.state.len + 1;
+    unsigned int n = 0;
+
+    for (unsigned int i = 0; i < nbytes; i++) {
+        auto b = m.index64(m.longmac, i);
+
+        if (i != 0)
+            out[n++] = ':';
+
+        out[n++] = hexdigits[(b >> 4) & 0xF];
+        out[n++] = hexdigits[b & 0xF];
+    }
+
+    write(out, n);
+}
+
+void json_adapter::buffer_writer::write_uuid(const uuid& u) {
+    write_hex(u.time_low, 8);
+    write('-');
+    write_hex(u.time_mid, 4);
+    write('-');
+    write_hex(u.time_hi, 4);
+    write('-');
+    write_hex(u.clock_seq, 4);
+    write('-');
+
+    for (unsigned int i = 0; i < 6; i++)
+        write_hex((uint8_t) (u.node >> (i * 8)), 2);
+}
+
+void json_adapter::buffer_writer::write_device_key(const device_key& k) {
+    write_hex(kis_hton64(k.get_spkey()), 2);
+    write('_');
+    write_hex(kis_hton64(k.get_dkey()), 1);
+}
+
+void json_adapter::buffer_writer::write_field_name(int id, const shared_tracker_element& e) {
+    if (name_map != nullptr) {
+        auto nmi = name_map->find(e);
+        if (nmi != name_map->end() && nmi->second.summary->rename.length() != 0) {
+            // Summary plans carry their renames pre-escaped
+            const auto& sum = nmi->second.summary;
+
+            if (naming == field_naming::elk) {
+                if (sum->ek_json_rename.length() != 0)
+                    write(sum->ek_json_rename.data(), sum->ek_json_rename.length());
+                else
+                    write_escaped(multi_replace_all(sum->rename, ".", "_"));
+            } else {
+                if (sum->json_rename.length() != 0)
+                    write(sum->json_rename.data(), sum->json_rename.length());
+                else
+                    write_escaped(sum->rename);
+            }
+
+            return;
+        }
+    }
+
+    if (e->get_type() == tracker_type::tracker_placeholder_missing ||
+            e->get_type() == tracker_type::tracker_alias) {
+        const std::string& tname = e->get_type() == tracker_type::tracker_alias ?
+            std::static_pointer_cast<tracker_element_alias>(e)->get_alias_name() :
+            std::static_pointer_cast<tracker_element_placeholder>(e)->get_name();
+
+        if (tname.length() != 0) {
+            if (naming == field_naming::elk)
+                write_escaped(multi_replace_all(tname, ".", "_"));
+            else
+                write_escaped(tname);
+            return;
+        }
+    }
+
+    auto fieldnames = Globalreg::globalreg->entrytracker->fetch_field_names(id);
+
+    if (fieldnames != nullptr) {
+        if (naming == field_naming::elk)
+            write(fieldnames->ek_json_name.data(), fieldnames->ek_json_name.length());
+        else
+            write(fieldnames->json_name.data(), fieldnames->json_name.length());
+    } else if (naming == field_naming::elk) {
+        write("field_unknown_not_registered", 28);
+    } else {
+        write("field.unknown.not.registered", 28);
+    }
+}
+
+// Keyed maps share the same layout; write_key formats the key without quotes
+template<typename M, typename K>
+static void write_keyed_map(json_adapter::buffer_writer& w, const std::shared_ptr<M>& m, K write_key) {
+    bool as_vector = m->as_vector();
+    bool as_key_vector = m->as_key_vector();
+    bool prepend_comma = false;
+
+    w.write((as_vector || as_key_vector) ? '[' : '{');
+
+    for (const auto& i : *m) {
+        if (i.second == nullptr && !as_key_vector)
+            continue;
+
+        if (prepend_comma)
+            w.write(',');
+        prepend_comma = true;
+
+        if (!as_vector) {
+            w.write('"');
+            write_key(i.first);
+            w.write('"');
+
+            if (!as_key_vector)
+                w.write(": ", 2);
+        }
+
+        if (!as_key_vector)
+            w.pack(i.second);
+    }
+
+    w.write((as_vector || as_key_vector) ? ']' : '}');
+}
+
+void json_adapter::buffer_writer::pack(shared_tracker_element e) {
+    if (e == nullptr)
+        return;
+
+    check_flush();
+
+    serializer_scope s(e, name_map);
+
+    // If we're serializing an alias, remap as the aliased element
+    if (e->get_type() == tracker_type::tracker_alias) {
+        e = std::static_pointer_cast<tracker_element_alias>(e)->get();
+
+        if (e == nullptr)
+            return;
+    }
+
+    bool prepend_comma = false;
+
+    switch (e->get_type()) {
+        case tracker_type::tracker_string:
+            write('"');
+            write_escaped(std::static_pointer_cast<tracker_element_string>(e)->get());
+            write('"');
+            break;
+        case tracker_type::tracker_int8:
+            write_int(std::static_pointer_cast<tracker_element_int8>(e)->get());
+            break;
+        case tracker_type::tracker_uint8:
+            write_int(std::static_pointer_cast<tracker_element_uint8>(e)->get());
+            break;
+        case tracker_type::tracker_int16:
+            write_int(std::static_pointer_cast<tracker_element_int16>(e)->get());
+            break;
+        case tracker_type::tracker_uint16:
+            write_int(std::static_pointer_cast<tracker_element_uint16>(e)->get());
+            break;
+        case tracker_type::tracker_int32:
+            write_int(std::static_pointer_cast<tracker_element_int32>(e)->get());
+            break;
+        case tracker_type::tracker_uint32:
+            write_int(std::static_pointer_cast<tracker_element_uint32>(e)->get());
+            break;
+        case tracker_type::tracker_int64:
+            write_int(std::static_pointer_cast<tracker_element_int64>(e)->get());
+            break;
+        case tracker_type::tracker_uint64:
+            write_int(std::static_pointer_cast<tracker_element_uint64>(e)->get());
+            break;
+        case tracker_type::tracker_float:
+            write_float(std::static_pointer_cast<tracker_element_float>(e)->get());
+            break;
+        case tracker_type::tracker_double:
+            write_float(std::static_pointer_cast<tracker_element_double>(e)->get());
+            break;
+        case tracker_type::tracker_mac_addr:
+            write('"');
+            write_mac(std::static_pointer_cast<tracker_element_mac_addr>(e)->get());
+            write('"');
+            break;
+        case tracker_type::tracker_uuid:
+            write('"');
+            write_uuid(std::static_pointer_cast<tracker_element_uuid>(e)->get());
+            write('"');
+            break;
+        case tracker_type::tracker_key:
+            write('"');
+            write_device_key(std::static_pointer_cast<tracker_element_device_key>(e)->get());
+            write('"');
+            break;
+        case tracker_type::tracker_vector:
+            write('[');
+
+            for (const auto& i : *(std::static_pointer_cast<tracker_element_vector>(e))) {
+                if (i == nullptr)
+                    continue;
+
+                if (prepend_comma)
+                    write(',');
+                prepend_comma = true;
+
+                pack(i);
+            }
+
+            write(']');
+            break;
+        case tracker_type::tracker_vector_double:
+            write('[');
+
+            for (auto i : *(std::static_pointer_cast<tracker_element_vector_double>(e))) {
+                if (prepend_comma)
+                    write(',');
+                prepend_comma = true;
+
+                // Same output as pack(), including its handling of nan
+                if (std::isnan(i) || std::isinf(i))
+                    write('0');
+
+                write_float_raw(i);
+            }
+
+            write(']');
+            break;
+        case tracker_type::tracker_vector_string:
+            write('[');
+
+            for (const auto& i : *(std::static_pointer_cast<tracker_element_vector_string>(e))) {
+                if (prepend_comma)
+                    write(',');
+                prepend_comma = true;
+
+                write(i.data(), i.length());
+            }
+
+            write(']');
+            break;
+        case tracker_type::tracker_map:
+            {
+                auto m = std::static_pointer_cast<tracker_element_map>(e);
+                bool as_vector = m->as_vector();
+                bool as_key_vector = m->as_key_vector();
+
+                write((as_vector || as_key_vector) ? '[' : '{');
+
+                for_each_map_field(m, [&](const tracker_element_map::map_t::value_type& i) {
+                    if (i.second == nullptr)
+                        return;
+
+                    if (prepend_comma)
+                        write(',');
+                    prepend_comma = true;
+
+                    if (!as_vector) {
+                        write('"');
+                        write_field_name(i.first, i.second);
+                        write("\": ", 3);
+                    }
+
+                    pack(i.second);
+                });
+
+                write((as_vector || as_key_vector) ? ']' : '}');
+            }
+            break;
+        case tracker_type::tracker_int_map:
+            write_keyed_map(*this, std::static_pointer_cast<tracker_element_int_map>(e),
+                    [this](int k) { write_int(k); });
+            break;
+        case tracker_type::tracker_mac_map:
+            write_keyed_map(*this, std::static_pointer_cast<tracker_element_mac_map>(e),
+                    [this](const mac_addr& k) { write_mac(k); });
+            break;
+        case tracker_type::tracker_uuid_map:
+            write_keyed_map(*this, std::static_pointer_cast<tracker_element_uuid_map>(e),
+                    [this](const uuid& k) { write_uuid(k); });
+            break;
+        case tracker_type::tracker_string_map:
+            write_keyed_map(*this, std::static_pointer_cast<tracker_element_string_map>(e),
+                    [this](const std::string& k) { write_escaped(k); });
+            break;
+        case tracker_type::tracker_double_map:
+            write_keyed_map(*this, std::static_pointer_cast<tracker_element_double_map>(e),
+                    [this](double k) {
+                        if (std::isnan(k) || std::isinf(k))
+                            write('0');
+                        else if (floor(k) == k)
+                            fmt::format_to(buf, "{:.0f}", k);
+                        else
+                            fmt::format_to(buf, "{:f}", k);
+                    });
+            break;
+        case tracker_type::tracker_hashkey_map:
+            write_keyed_map(*this, std::static_pointer_cast<tracker_element_hashkey_map>(e),
+                    [this](size_t k) { write_int((long) k); });
+            break;
+        case tracker_type::tracker_key_map:
+            write_keyed_map(*this, std::static_pointer_cast<tracker_element_device_key_map>(e),
+                    [this](const device_key& k) { write_device_key(k); });
+            break;
+        case tracker_type::tracker_double_map_double:
+            {
+                auto m = std::static_pointer_cast<tracker_element_double_map_double>(e);
+                bool as_vector = m->as_vector();
+                bool as_key_vector = m->as_key_vector();
+
+                write((as_vector || as_key_vector) ? '[' : '{');
+
+                for (const auto& i : *m) {
+                    if (prepend_comma)
+                        write(',');
+                    prepend_comma = true;
+
+                    if (!as_vector) {
+                        write('"');
+                        if (std::isnan(i.first) || std::isinf(i.first))
+                            write('0');
+                        else if (floor(i.first) == i.first)
+                            write_int((long) i.first);
+                        else
+                            fmt::format_to(buf, "{:f}", i.first);
+                        write('"');
+
+                        if (!as_key_vector)
+                            write(": ", 2);
+                    }
+
+                    if (!as_key_vector) {
+                        if (std::isnan(i.second) || std::isinf(i.second))
+                            write('0');
+
+                        write_float_raw(i.second);
+                    }
+                }
+
+                write((as_vector || as_key_vector) ? ']' : '}');
+            }
+            break;
+        case tracker_type::tracker_pair_double:
+            {
+                const auto& p = std::static_pointer_cast<tracker_element_pair_double>(e)->get();
+                write('[');
+                write_float(std::get<0>(p));
+                write(", ", 2);
+                write_float(std::get<1>(p));
+                write(']');
+            }
+            break;
+        default:
+            // Byte arrays, addresses, and anything else with its own string form
+            if (e->is_stringable()) {
+                if (e->needs_quotes()) {
+                    write('"');
+                    write_escaped(e->as_string());
+                    write('"');
+                } else {
+                    write_escaped(e->as_string());
+                }
+            }
+            break;
+    }
+}
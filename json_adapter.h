@@ -21,6 +21,10 @@
 
 #include "config.h"
 
+#include <math.h>
+#include <cmath>
+
+#include "fmt.h"
 #include "globalregistry.h"
 #include "trackedelement.h"
 #include "devicetracker_component.h"
@@ -30,17 +34,105 @@
 // buffer_handler_ostream_buf or similar
 namespace json_adapter {
 
+// How field names are written as object keys; elk names replace dots with underscores
+enum class field_naming {
+    kismet, elk
+};
+
 // Basic packer with some defaulted options - prettyprint and depth used for
 // recursive indenting and prettifying the output
 void pack(std::ostream &stream, shared_tracker_element e,
         std::shared_ptr<tracker_element_serializer::rename_map> name_map = nullptr,
         bool prettyprint = false, unsigned int depth = 0,
-        std::function<std::string (const std::string&)> name_permuter = 
-            [](const std::string& s) -> std::string { return s; });
+        field_naming naming = field_naming::kismet);
 
 std::string sanitize_string(const std::string& in) noexcept;
 std::size_t sanitize_extra_space(const std::string& in) noexcept;
 
+// Direct-to-buffer packer used by the standard serializers.  Output is identical to
+// pack() without prettyprinting, but scalars are formatted straight into a growable
+// buffer by type instead of through as_string() and the stream operators, strings are
+// escaped in bulk, and the buffer is handed to the stream in large blocks.
+class buffer_writer {
+public:
+    buffer_writer(std::ostream& stream,
+            std::shared_ptr<tracker_element_serializer::rename_map> name_map = nullptr,
+            field_naming naming = field_naming::kismet) :
+        stream{stream},
+        name_map{name_map},
+        naming{naming} { }
+
+    ~buffer_writer() {
+        flush();
+    }
+
+    void pack(shared_tracker_element e);
+
+    void write(const char *data, size_t len) {
+        buf.append(data, data + len);
+    }
+
+    void write(char c) {
+        buf.push_back(c);
+    }
+
+    // Hand everything buffered so far to the stream
+    void flush();
+
+protected:
+    // Buffered data is passed to the stream in blocks of about this size
+    static constexpr size_t flush_size = 16384;
+
+    void check_flush() {
+        if (buf.size() >= flush_size)
+            flush();
+    }
+
+    void write_escaped(const char *data, size_t len);
+
+    void write_escaped(const std::string& s) {
+        write_escaped(s.data(), s.length());
+    }
+
+    template<typename N>
+    void write_int(N v) {
+        fmt::format_int f(v);
+        write(f.data(), f.size());
+    }
+
+    void write_hex(uint64_t v, unsigned int width);
+
+    // Numeric formats matching float_numerical_string
+    template<typename N>
+    void write_float(N v) {
+        if (std::isnan(v) || std::isinf(v)) {
+            write('0');
+            return;
+        }
+
+        write_float_raw(v);
+    }
+
+    template<typename N>
+    void write_float_raw(N v) {
+        if (floor(v) == v)
+            write_int((long long) v);
+        else
+            fmt::format_to(buf, "{:f}", v);
+    }
+
+    void write_mac(const mac_addr& m);
+    void write_uuid(const uuid& u);
+    void write_device_key(const device_key& k);
+    void write_field_name(int id, const shared_tracker_element& e);
+
+    std::ostream& stream;
+    std::shared_ptr<tracker_element_serializer::rename_map> name_map;
+    field_naming naming;
+
+    fmt::memory_buffer buf;
+};
+
 class serializer : public tracker_element_serializer {
 public:
     serializer() :
@@ -48,7 +140,8 @@ public:
 
     virtual int serialize(shared_tracker_element in_elem, std::ostream &stream,
             std::shared_ptr<rename_map> name_map = nullptr) override {
-        pack(stream, in_elem, name_map);
+        buffer_writer w(stream, name_map);
+        w.pack(in_elem);
         return 0;
     }
 };
@@ -74,23 +167,19 @@ public:
             std::shared_ptr<rename_map> name_map = nullptr) override {
         kis_lock_guard<kis_mutex> lk(mutex, "ek_json serialize");
 
+        json_adapter::buffer_writer w(stream, name_map, json_adapter::field_naming::elk);
+
         if (in_elem->get_type() == tracker_type::tracker_vector) {
             for (auto i : *(std::static_pointer_cast<tracker_element_vector>(in_elem))) {
                 if (i == nullptr)
                     continue;
 
-                json_adapter::pack(stream, i, name_map, false, 0,
-                        [](const std::string& s) { 
-                            return multi_replace_all(s, ".", "_");
-                        });
-                stream << "\n";
+                w.pack(i);
+                w.write('\n');
             }
         } else {
-            json_adapter::pack(stream, in_elem, name_map, false, 0,
-                    [](const std::string& s) { 
-                    return multi_replace_all(s, ".", "_");
-                    });
-            stream << "\n";
+            w.pack(in_elem);
+            w.write('\n');
         }
 
         return 0;
@@ -112,14 +201,16 @@ public:
             std::shared_ptr<rename_map> name_map = nullptr) override {
         kis_lock_guard<kis_mutex> lk(mutex, "it_json serialize");
 
+        json_adapter::buffer_writer w(stream, name_map);
+
         if (in_elem->get_type() == tracker_type::tracker_vector) {
             for (auto i : *(std::static_pointer_cast<tracker_element_vector>(in_elem))) {
-                json_adapter::pack(stream, i, name_map);
-                stream << "\n";
+                w.pack(i);
+                w.write('\n');
             }
         } else {
-            json_adapter::pack(stream, in_elem, name_map);
-            stream << "\n";
+            w.pack(in_elem);
+            w.write('\n');
         }
 
         return 1;
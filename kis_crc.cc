@@ -0,0 +1,340 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <string.h>
+
+#include "kis_crc.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define KIS_CRC_X86_PCLMUL 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_FEATURE_CRC32) && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define KIS_CRC_ARMV8 1
+#include <arm_acle.h>
+#endif
+
+namespace {
+    struct crc32_slice_tables {
+        uint32_t t[8][256];
+
+        crc32_slice_tables() {
+            for (unsigned int i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (unsigned int j = 0; j < 8; j++)
+                    c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : (c >> 1);
+                t[0][i] = c;
+            }
+
+            for (unsigned int i = 0; i < 256; i++)
+                for (unsigned int k = 1; k < 8; k++)
+                    t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+        }
+    };
+
+    const crc32_slice_tables& slice_tables() {
+        static const crc32_slice_tables tables;
+        return tables;
+    }
+
+    uint32_t crc32_slice8(uint32_t crc, const uint8_t *data, size_t len) {
+        const auto& t = slice_tables().t;
+
+        while (len >= 8) {
+            uint32_t one = crc ^ ((uint32_t) data[0] | ((uint32_t) data[1] << 8) |
+                    ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24));
+            uint32_t two = (uint32_t) data[4] | ((uint32_t) data[5] << 8) |
+                ((uint32_t) data[6] << 16) | ((uint32_t) data[7] << 24);
+
+            crc = t[7][one & 0xFF] ^ t[6][(one >> 8) & 0xFF] ^
+                t[5][(one >> 16) & 0xFF] ^ t[4][one >> 24] ^
+                t[3][two & 0xFF] ^ t[2][(two >> 8) & 0xFF] ^
+                t[1][(two >> 16) & 0xFF] ^ t[0][two >> 24];
+
+            data += 8;
+            len -= 8;
+        }
+
+        while (len--)
+            crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+
+        return crc;
+    }
+
+#ifdef KIS_CRC_X86_PCLMUL
+    // Carry-less multiply folding, per Intel's "Fast CRC Computation for Generic
+    // Polynomials Using PCLMULQDQ Instruction", using the bit-reflected constants
+    // for the 802.3 polynomial.  Requires len >= 64 and a multiple of 16.
+    __attribute__((target("pclmul,sse2")))
+    uint32_t crc32_pclmul_fold(uint32_t crc, const uint8_t *buf, size_t len) {
+        const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+        const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+        const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+        const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+        const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+        __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+        x1 = _mm_loadu_si128((const __m128i *) (buf + 0x00));
+        x2 = _mm_loadu_si128((const __m128i *) (buf + 0x10));
+        x3 = _mm_loadu_si128((const __m128i *) (buf + 0x20));
+        x4 = _mm_loadu_si128((const __m128i *) (buf + 0x30));
+
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) crc));
+
+        buf += 64;
+        len -= 64;
+
+        // Fold four lanes in parallel
+        while (len >= 64) {
+            x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+            x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+            x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+            x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+            x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+            x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+            x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+            x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                    _mm_loadu_si128((const __m128i *) (buf + 0x00)));
+            x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                    _mm_loadu_si128((const __m128i *) (buf + 0x10)));
+            x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                    _mm_loadu_si128((const __m128i *) (buf + 0x20)));
+            x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                    _mm_loadu_si128((const __m128i *) (buf + 0x30)));
+
+            buf += 64;
+            len -= 64;
+        }
+
+        // Fold the four lanes into one
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+        // Remaining 16 byte blocks
+        while (len >= 16) {
+            x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *) buf)), x5);
+
+            buf += 16;
+            len -= 16;
+        }
+
+        // 128 to 64 bits
+        x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, mask32);
+        x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        // Barrett reduction to 32 bits
+        x2 = _mm_and_si128(x1, mask32);
+        x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+        x2 = _mm_and_si128(x2, mask32);
+        x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        x0 = _mm_srli_si128(x1, 4);
+        return (uint32_t) _mm_cvtsi128_si32(x0);
+    }
+
+    uint32_t crc32_pclmul(uint32_t crc, const uint8_t *data, size_t len) {
+        // Short frames (acks, control) aren't worth the setup
+        if (len < 64)
+            return crc32_slice8(crc, data, len);
+
+        size_t fold_len = len & ~((size_t) 15);
+
+        crc = crc32_pclmul_fold(crc, data, fold_len);
+
+        return crc32_slice8(crc, data + fold_len, len - fold_len);
+    }
+
+    bool cpu_has_pclmul() {
+        unsigned int eax, ebx, ecx, edx;
+
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0)
+            return false;
+
+        // PCLMULQDQ and SSE2
+        return (ecx & (1 << 1)) && (edx & (1 << 26));
+    }
+#endif
+
+#ifdef KIS_CRC_ARMV8
+    uint32_t crc32_armv8(uint32_t crc, const uint8_t *data, size_t len) {
+        while (len >= 8) {
+            uint64_t v;
+            memcpy(&v, data, 8);
+            crc = __crc32d(crc, v);
+            data += 8;
+            len -= 8;
+        }
+
+        while (len--)
+            crc = __crc32b(crc, *data++);
+
+        return crc;
+    }
+#endif
+
+    typedef uint32_t (*crc32_fn)(uint32_t, const uint8_t *, size_t);
+
+    struct crc32_impl {
+        crc32_fn fn;
+        const char *name;
+
+        crc32_impl() {
+            fn = crc32_slice8;
+            name = "slicing-by-8";
+
+#ifdef KIS_CRC_ARMV8
+            fn = crc32_armv8;
+            name = "armv8-crc32";
+#endif
+
+#ifdef KIS_CRC_X86_PCLMUL
+            if (cpu_has_pclmul()) {
+                fn = crc32_pclmul;
+                name = "pclmulqdq";
+            }
+#endif
+        }
+    };
+
+    const crc32_impl& selected_crc32() {
+        static const crc32_impl impl;
+        return impl;
+    }
+
+    // Wireshark's nibble-serial BTLE LFSR table; the byte tables below are
+    // derived from it at startup
+    const uint16_t btle_crc_next_state_flips[256] = {
+        0x0000, 0x32d8, 0x196c, 0x2bb4, 0x0cb6, 0x3e6e, 0x15da, 0x2702,
+        0x065b, 0x3483, 0x1f37, 0x2def, 0x0aed, 0x3835, 0x1381, 0x2159,
+        0x065b, 0x3483, 0x1f37, 0x2def, 0x0aed, 0x3835, 0x1381, 0x2159,
+        0x0000, 0x32d8, 0x196c, 0x2bb4, 0x0cb6, 0x3e6e, 0x15da, 0x2702,
+        0x0cb6, 0x3e6e, 0x15da, 0x2702, 0x0000, 0x32d8, 0x196c, 0x2bb4,
+        0x0aed, 0x3835, 0x1381, 0x2159, 0x065b, 0x3483, 0x1f37, 0x2def,
+        0x0aed, 0x3835, 0x1381, 0x2159, 0x065b, 0x3483, 0x1f37, 0x2def,
+        0x0cb6, 0x3e6e, 0x15da, 0x2702, 0x0000, 0x32d8, 0x196c, 0x2bb4,
+        0x196c, 0x2bb4, 0x0000, 0x32d8, 0x15da, 0x2702, 0x0cb6, 0x3e6e,
+        0x1f37, 0x2def, 0x065b, 0x3483, 0x1381, 0x2159, 0x0aed, 0x3835,
+        0x1f37, 0x2def, 0x065b, 0x3483, 0x1381, 0x2159, 0x0aed, 0x3835,
+        0x196c, 0x2bb4, 0x0000, 0x32d8, 0x15da, 0x2702, 0x0cb6, 0x3e6e,
+        0x15da, 0x2702, 0x0cb6, 0x3e6e, 0x196c, 0x2bb4, 0x0000, 0x32d8,
+        0x1381, 0x2159, 0x0aed, 0x3835, 0x1f37, 0x2def, 0x065b, 0x3483,
+        0x1381, 0x2159, 0x0aed, 0x3835, 0x1f37, 0x2def, 0x065b, 0x3483,
+        0x15da, 0x2702, 0x0cb6, 0x3e6e, 0x196c, 0x2bb4, 0x0000, 0x32d8,
+        0x32d8, 0x0000, 0x2bb4, 0x196c, 0x3e6e, 0x0cb6, 0x2702, 0x15da,
+        0x3483, 0x065b, 0x2def, 0x1f37, 0x3835, 0x0aed, 0x2159, 0x1381,
+        0x3483, 0x065b, 0x2def, 0x1f37, 0x3835, 0x0aed, 0x2159, 0x1381,
+        0x32d8, 0x0000, 0x2bb4, 0x196c, 0x3e6e, 0x0cb6, 0x2702, 0x15da,
+        0x3e6e, 0x0cb6, 0x2702, 0x15da, 0x32d8, 0x0000, 0x2bb4, 0x196c,
+        0x3835, 0x0aed, 0x2159, 0x1381, 0x3483, 0x065b, 0x2def, 0x1f37,
+        0x3835, 0x0aed, 0x2159, 0x1381, 0x3483, 0x065b, 0x2def, 0x1f37,
+        0x3e6e, 0x0cb6, 0x2702, 0x15da, 0x32d8, 0x0000, 0x2bb4, 0x196c,
+        0x2bb4, 0x196c, 0x32d8, 0x0000, 0x2702, 0x15da, 0x3e6e, 0x0cb6,
+        0x2def, 0x1f37, 0x3483, 0x065b, 0x2159, 0x1381, 0x3835, 0x0aed,
+        0x2def, 0x1f37, 0x3483, 0x065b, 0x2159, 0x1381, 0x3835, 0x0aed,
+        0x2bb4, 0x196c, 0x32d8, 0x0000, 0x2702, 0x15da, 0x3e6e, 0x0cb6,
+        0x2702, 0x15da, 0x3e6e, 0x0cb6, 0x2bb4, 0x196c, 0x32d8, 0x0000,
+        0x2159, 0x1381, 0x3835, 0x0aed, 0x2def, 0x1f37, 0x3483, 0x065b,
+        0x2159, 0x1381, 0x3835, 0x0aed, 0x2def, 0x1f37, 0x3483, 0x065b,
+        0x2702, 0x15da, 0x3e6e, 0x0cb6, 0x2bb4, 0x196c, 0x32d8, 0x0000
+    };
+
+    uint32_t btle_crc_nibble_step(uint32_t state, uint8_t byte) {
+        uint8_t index = ((state >> 16) & 0xF0) | (byte & 0x0F);
+        state = ((state << 4) ^ btle_crc_next_state_flips[index]) & 0xFFFFFF;
+
+        index = ((state >> 16) & 0xF0) | ((byte >> 4) & 0x0F);
+        state = ((state << 4) ^ btle_crc_next_state_flips[index]) & 0xFFFFFF;
+
+        return state;
+    }
+
+    // The LFSR is linear, so one byte step splits into the contribution of the
+    // top 8 bits of the state and the contribution of the input byte
+    struct btle_crc_tables {
+        uint32_t state_flips[256];
+        uint32_t byte_flips[256];
+
+        btle_crc_tables() {
+            for (unsigned int i = 0; i < 256; i++) {
+                state_flips[i] = btle_crc_nibble_step(i << 16, 0);
+                byte_flips[i] = btle_crc_nibble_step(0, (uint8_t) i);
+            }
+        }
+    };
+
+    const btle_crc_tables& btle_tables() {
+        static const btle_crc_tables tables;
+        return tables;
+    }
+}
+
+uint32_t kis_crc::crc32_update(uint32_t crc, const uint8_t *data, size_t len) {
+    static const crc32_fn fn = selected_crc32().fn;
+    return fn(crc, data, len);
+}
+
+bool kis_crc::crc32_fcs_matches(uint32_t calc_crc, const uint8_t *fcs) {
+    uint32_t le = (uint32_t) fcs[0] | ((uint32_t) fcs[1] << 8) |
+        ((uint32_t) fcs[2] << 16) | ((uint32_t) fcs[3] << 24);
+    uint32_t be = (uint32_t) fcs[3] | ((uint32_t) fcs[2] << 8) |
+        ((uint32_t) fcs[1] << 16) | ((uint32_t) fcs[0] << 24);
+
+    return calc_crc == le || calc_crc == be;
+}
+
+const char *kis_crc::crc32_engine() {
+    return selected_crc32().name;
+}
+
+uint32_t kis_crc::crc24_btle(uint32_t state, const uint8_t *data, size_t len) {
+    const auto& t = btle_tables();
+
+    state &= 0xFFFFFF;
+
+    for (size_t pos = 0; pos < len; pos++)
+        state = ((state << 8) & 0xFFFFFF) ^ t.state_flips[state >> 16] ^ t.byte_flips[data[pos]];
+
+    return state;
+}
+
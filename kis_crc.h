@@ -0,0 +1,57 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __KIS_CRC_H__
+#define __KIS_CRC_H__
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Shared CRC engine used to validate the FCS of every captured frame.
+//
+// The 802.3/802.11 CRC32 (reflected, poly 0xEDB88320) uses a carry-less
+// multiply fold on x86 cpus with PCLMULQDQ, the ARMv8 CRC32 instructions when
+// the build targets them, and a slicing-by-8 table lookup everywhere else.  The
+// implementation is picked once at startup.
+
+namespace kis_crc {
+    // Update a running reflected CRC32; no pre- or post-inversion is applied
+    uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len);
+
+    // Complete 802.11 FCS over a frame
+    inline uint32_t crc32_80211(const uint8_t *data, size_t len) {
+        return crc32_update(0xFFFFFFFF, data, len) ^ 0xFFFFFFFF;
+    }
+
+    // Compare a computed CRC against a 4-byte FCS from the capture; some
+    // drivers report the FCS byte-swapped so both orders are accepted
+    bool crc32_fcs_matches(uint32_t calc_crc, const uint8_t *fcs);
+
+    // Name of the selected CRC32 implementation, for diagnostics
+    const char *crc32_engine();
+
+    // Bluetooth LE 24-bit CRC (Vol 6, Part B, Section 3.1.1), advancing the
+    // LFSR state over len bytes of payload.  Byte-at-a-time equivalent of the
+    // nibble-serial Wireshark implementation.
+    uint32_t crc24_btle(uint32_t state, const uint8_t *data, size_t len);
+}
+
+#endif
+
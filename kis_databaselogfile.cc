@@ -407,7 +407,7 @@ bool kis_database_logfile::open_log(std::string in_path) {
         packet_handler_id = 
             packetchain->register_handler([this, this_ref](kis_packet *packet) -> int {
                     return log_packet(packet);
-                }, CHAINPOS_LOGGING, -100);
+                }, CHAINPOS_LOGGING, -100, "kis_database_logfile::log_packet");
     } else {
         packet_handler_id = -1;
         _MSG_INFO("Packets will not be saved to the Kismet database log.");
@@ -64,6 +64,7 @@ kis_datasource::kis_datasource(shared_datasource_builder in_builder) :
     pack_comp_protobuf = packetchain->register_packet_component("PROTOBUF");
 
     suppress_gps = false;
+    shed_packets = true;
 
     error_timer_id = -1;
     ping_timer_id = -1;
@@ -674,6 +675,8 @@ bool kis_datasource::parse_interface_definition(std::string in_definition) {
     clobber_timestamp = get_definition_opt_bool("timestamp", 
             datasourcetracker->get_config_defaults()->get_remote_cap_timestamp());
 
+    shed_packets = get_definition_opt_bool("shed", true);
+
     set_source_info_antenna_type(get_definition_opt("info_antenna_type"));
     set_source_info_antenna_gain(get_definition_opt_double("info_antenna_gain", 0.0f));
     set_source_info_antenna_orientation(get_definition_opt_double("info_antenna_orientation", 0.0f));
@@ -1265,7 +1268,7 @@ void kis_datasource::handle_packet_data_report(uint32_t in_seqno, const std::str
 
     // Process the data chunk
     if (report->has_packet()) {
-        kis_datachunk *datachunk = new kis_datachunk();
+        kis_datachunk *datachunk = packetchain->generate_datachunk();
 
         if (clobber_timestamp && get_source_remote()) {
             gettimeofday(&(packet->ts), NULL);
@@ -1380,7 +1383,7 @@ void kis_datasource::handle_packet_warning_report(uint32_t in_seqno, const std::
 kis_layer1_packinfo *kis_datasource::handle_sub_signal(KismetDatasource::SubSignal in_sig) {
     // Extract l1 info from a KV pair so we can add it to a packet
     
-    kis_layer1_packinfo *siginfo = new kis_layer1_packinfo();
+    kis_layer1_packinfo *siginfo = packetchain->generate_l1info();
 
     if (in_sig.has_signal_dbm()) {
         siginfo->signal_type = kis_l1_signal_type_dbm;
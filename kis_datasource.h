@@ -334,6 +334,11 @@ public:
     virtual bool get_definition_opt_bool(std::string in_opt, bool in_default);
     virtual double get_definition_opt_double(std::string in_opt, double in_default);
 
+    // Can packets from this source be shed when the packet queue is overloaded
+    bool get_source_shed_packets() const {
+        return shed_packets;
+    }
+
 
     // Kismet-only variables can be set realtime, they have no capture-binary
     // equivalents and are only used for tracking purposes in the Kismet server
@@ -739,6 +744,10 @@ protected:
     // We suppress automatically adding GPS to packets from this source
     bool suppress_gps;
 
+    // Packets from this source may be dropped by the packetchain load shedding;
+    // high-value sources can be set to shed=false to protect them
+    bool shed_packets;
+
     // packet_chain
     std::shared_ptr<packet_chain> packetchain;
 
@@ -114,7 +114,7 @@ int kis_dlt_ppi::handle_packet(kis_packet *in_pack) {
 
         if (fh_len > linkchunk->length || fh_len > ph_len) {
             if (radioheader != NULL)
-                delete radioheader;
+                packet_component::release(radioheader);
 
             _MSG("pcap PPI converter got corrupt/invalid PPI field length",
                     MSGFLAG_ERROR);
@@ -132,7 +132,7 @@ int kis_dlt_ppi::handle_packet(kis_packet *in_pack) {
             if ((tuint & PPI_80211_FLAG_INVALFCS) || (tuint & PPI_80211_FLAG_PHYERROR)) {
                 // Junk packets that are FCS or phy compromised
                 if (radioheader != NULL)
-                    delete radioheader;
+                    packet_component::release(radioheader);
 
                 return 0;
             }
@@ -147,7 +147,7 @@ int kis_dlt_ppi::handle_packet(kis_packet *in_pack) {
             }
 
             if (radioheader == NULL)
-                radioheader = new kis_layer1_packinfo;
+                radioheader = Globalreg::globalreg->packetchain->generate_l1info();
 
             // Channel flags
             tuint = kis_letoh16(ppic->chan_flags);
@@ -178,7 +178,7 @@ int kis_dlt_ppi::handle_packet(kis_packet *in_pack) {
             ppi_11n_mac *ppin = (ppi_11n_mac *) ppi_fh;
 
             if (radioheader == NULL)
-                radioheader = new kis_layer1_packinfo;
+                radioheader = Globalreg::globalreg->packetchain->generate_l1info();
 
             // Decode greenfield notation
             tuint = kis_letoh16(ppin->flags);
@@ -191,7 +191,7 @@ int kis_dlt_ppi::handle_packet(kis_packet *in_pack) {
             ppi_11n_macphy *ppinp = (ppi_11n_macphy *) ppi_fh;
 
             if (radioheader == NULL)
-                radioheader = new kis_layer1_packinfo;
+                radioheader = Globalreg::globalreg->packetchain->generate_l1info();
 
             // Decode greenfield notation
             tuint = kis_letoh16(ppinp->flags);
@@ -270,7 +270,7 @@ int kis_dlt_ppi::handle_packet(kis_packet *in_pack) {
     if (applyfcs)
         applyfcs = 4;
 
-    decapchunk = new kis_datachunk;
+    decapchunk = Globalreg::globalreg->packetchain->generate_datachunk();
 
     decapchunk->dlt = ppi_dlt;
 
@@ -300,27 +300,17 @@ int kis_dlt_ppi::handle_packet(kis_packet *in_pack) {
         in_pack->insert(pack_comp_checksum, fcschunk);
     }
 
-    // We've put the FCS in the fcschunk, so we just call the datasource FCS function
+    // Validate 802.11 FCS with the common crc engine, then give the datasource a
+    // chance to do its own checks
     if (datasrc != NULL && datasrc->ref_source != NULL && fcschunk != NULL &&
             fcschunk->checksum_valid) {
+        if (decapchunk->dlt == KDLT_IEEE802_11)
+            fcschunk->validate_80211(decapchunk);
         datasrc->ref_source->checksum_packet(in_pack);
     }
 
-#if 0
-    if (capsrc != NULL && capsrc->ref_source->FetchValidateCRC() && fcschunk != NULL) {
-        // Compare it and flag the packet
-        uint32_t calc_crc =
-            crc32_le_80211(globalreg->crc32_table, decapchunk->data, 
-                    decapchunk->length);
-
-        if (memcmp(fcschunk->checksum_ptr, &calc_crc, 4)) {
-            in_pack->error = 1;
-            fcschunk->checksum_valid = 0;
-        } else {
-            fcschunk->checksum_valid = 1;
-        }
-    }
-#endif
+    if (fcschunk != NULL && fcschunk->checksum_valid == 0)
+        in_pack->error = 1;
 
 
     return 1;
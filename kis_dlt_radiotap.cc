@@ -72,8 +72,6 @@ kis_dlt_radiotap::kis_dlt_radiotap() :
 	dlt = DLT_IEEE802_11_RADIO;
 
 	_MSG("Registering support for DLT_RADIOTAP packet header decoding", MSGFLAG_INFO);
-
-    crc32_init_table_80211(crc32_table);
 }
 
 #define ALIGN_OFFSET(offset, width) \
@@ -211,8 +209,8 @@ int kis_dlt_radiotap::handle_packet(kis_packet *in_pack) {
         return 0;
     }
 
-	decapchunk = new kis_datachunk;
-	radioheader = new kis_layer1_packinfo;
+	decapchunk = Globalreg::globalreg->packetchain->generate_datachunk();
+	radioheader = Globalreg::globalreg->packetchain->generate_l1info();
 
 	decapchunk->dlt = KDLT_IEEE802_11;
 	
@@ -416,8 +414,8 @@ int kis_dlt_radiotap::handle_packet(kis_packet *in_pack) {
 		_MSG("Pcap Radiotap converter got corrupted Radiotap frame, not "
 			 "long enough for radiotap header plus indicated FCS", MSGFLAG_ERROR);
 		*/
-		delete decapchunk;
-		delete radioheader;
+		packet_component::release(decapchunk);
+		packet_component::release(radioheader);
         return 0;
 	}
 
@@ -466,19 +464,7 @@ int kis_dlt_radiotap::handle_packet(kis_packet *in_pack) {
         // fprintf(stderr, "debug - radiotap - %d %x\n", packnum, *(fcschunk->checksum_ptr) & 0xFFFFFFFF); 
 
 		// Compare it and flag the packet
-		uint32_t calc_crc =
-			crc32_le_80211(crc32_table, decapchunk->data, decapchunk->length);
-        uint32_t flipped_crc = kis_swap32(calc_crc);
-
-        // compare both representations
-		if (memcmp(fcschunk->checksum_ptr, &calc_crc, 4) &&
-            memcmp(fcschunk->checksum_ptr, &flipped_crc, 4)) {
-            // fprintf(stderr, "debug - radiotap - %d invalid crc from %s\n", packnum, datasrc->ref_source->get_source_name().c_str());
-			fcschunk->checksum_valid = 0;
-		} else {
-            // fprintf(stderr, "debug - radiotap - crc valid\n");
-			fcschunk->checksum_valid = 1;
-		}
+        fcschunk->validate_80211(decapchunk);
 	}
 
     // If we've validated the FCS and know this packet is junk, flag it at the
@@ -497,47 +483,3 @@ int kis_dlt_radiotap::handle_packet(kis_packet *in_pack) {
 #undef BITNO_2
 #undef BIT
 
-// Taken from the BBN USRP 802.11 encoding code
-unsigned int kis_dlt_radiotap::update_crc32_80211(unsigned int crc, const unsigned char *data,
-        int len, unsigned int poly) {
-	int i, j;
-	unsigned short ch;
-
-	for ( i = 0; i < len; ++i) {
-		ch = data[i];
-		for (j = 0; j < 8; ++j) {
-			if ((crc ^ ch) & 0x0001) {
-				crc = (crc >> 1) ^ poly;
-			} else {
-				crc = (crc >> 1);
-			}
-			ch >>= 1;
-		}
-	}
-	return crc;
-}
-
-void kis_dlt_radiotap::crc32_init_table_80211(unsigned int *crc32_table) {
-	int i;
-	unsigned char c;
-
-	for (i = 0; i < 256; ++i) {
-		c = (unsigned char) i;
-		crc32_table[i] = update_crc32_80211(0, &c, 1, IEEE_802_3_CRC32_POLY);
-	}
-}
-
-unsigned int kis_dlt_radiotap::crc32_le_80211(unsigned int *crc32_table, 
-        const unsigned char *buf, int len) {
-	int i;
-	unsigned int crc = 0xFFFFFFFF;
-
-	for (i = 0; i < len; ++i) {
-		crc = (crc >> 8) ^ crc32_table[(crc ^ buf[i]) & 0xFF];
-	}
-
-	crc ^= 0xFFFFFFFF;
-
-	return crc;
-}
-
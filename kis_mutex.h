@@ -50,7 +50,7 @@ public:
     kis_mutex(const kis_mutex&) = delete;
     kis_mutex& operator=(const kis_mutex&) = delete;
 
-    ~kis_mutex() = default;
+    virtual ~kis_mutex() = default;
 
     void set_name(const std::string& name) {
         this->name = name;
@@ -60,6 +60,20 @@ public:
         return name;
     }
 
+    // Locking is virtual so that a specialized lock (such as the device list lock)
+    // behaves the same when it's taken through a plain kis_mutex reference
+    virtual void lock() {
+        std::recursive_timed_mutex::lock();
+    }
+
+    virtual bool try_lock() {
+        return std::recursive_timed_mutex::try_lock();
+    }
+
+    virtual void unlock() {
+        std::recursive_timed_mutex::unlock();
+    }
+
     // Previous workaround for gcc try_lock_for bugs here, but now we require c++14 so we don't
     // need them
 
@@ -23,6 +23,7 @@
 #include <random>
 
 #include <stdio.h>
+#include <zlib.h>
 
 #include "alertracker.h"
 #include "base64.h"
@@ -36,6 +37,66 @@ const std::string kis_net_beast_httpd::RO_ROLE{"readonly"};
 
 const std::string kis_net_beast_httpd::AUTH_COOKIE{"KISMET"};
 
+// Streaming gzip encoder for response bodies
+class kis_net_beast_gzip {
+public:
+    kis_net_beast_gzip(int level) {
+        memset(&zs, 0, sizeof(z_stream));
+
+        // Window bits over 15 select a gzip header instead of zlib
+        if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            throw std::runtime_error("could not initialize gzip compression");
+    }
+
+    ~kis_net_beast_gzip() {
+        deflateEnd(&zs);
+    }
+
+    // Compress data and append whatever the encoder produces to out; Z_SYNC_FLUSH
+    // forces out everything written so far, Z_FINISH completes the stream
+    void compress(const char *data, size_t len, int flush, std::string& out) {
+        char block[16384];
+
+        zs.next_in = (Bytef *) data;
+        zs.avail_in = len;
+
+        do {
+            zs.next_out = (Bytef *) block;
+            zs.avail_out = sizeof(block);
+
+            deflate(&zs, flush);
+
+            out.append(block, sizeof(block) - zs.avail_out);
+        } while (zs.avail_out == 0);
+    }
+
+protected:
+    z_stream zs;
+};
+
+// Content worth compressing; images, archives, packet captures, and other binary
+// formats are already compressed or are streamed as they're generated.  Parameters
+// such as the charset are ignored.
+static bool compressible_mime_type(const std::string& in_type) {
+    auto type = in_type.substr(0, in_type.find(';'));
+
+    return type.find("text/") == 0 ||
+        type == "application/javascript" ||
+        type == "application/json" ||
+        type == "application/xml" ||
+        type == "image/svg+xml";
+}
+
+static void append_vary(boost::beast::http::fields& fields, const std::string& value) {
+    auto vary = fields.find(boost::beast::http::field::vary);
+
+    if (vary == fields.end())
+        fields.set(boost::beast::http::field::vary, value);
+    else
+        fields.set(boost::beast::http::field::vary,
+                fmt::format("{}, {}", vary->value(), value));
+}
+
 std::shared_ptr<kis_net_beast_httpd> kis_net_beast_httpd::create_httpd() {
     auto httpd_interface = 
         Globalreg::globalreg->kismet_config->fetch_opt_dfl("httpd_bind_address", "0.0.0.0");
@@ -78,7 +139,10 @@ kis_net_beast_httpd::kis_net_beast_httpd(boost::asio::ip::tcp::endpoint& endpoin
     deferred_startup{},
     running{false},
     endpoint{endpoint},
-    acceptor{Globalreg::globalreg->io} {
+    acceptor{Globalreg::globalreg->io},
+    allow_compression_{false},
+    compression_level_{6},
+    compression_min_{1024} {
 
     mime_mutex.set_name("kis_net_beast_httpd MIME map");
     route_mutex.set_name("kis_net_beast_httpd route vector");
@@ -99,6 +163,8 @@ void kis_net_beast_httpd::trigger_deferred_startup() {
     register_mime_type("itjson", "application/json");
     register_mime_type("cmd", "application/json");
     register_mime_type("jcmd", "application/json");
+    register_mime_type("msgpack", "application/msgpack");
+    register_mime_type("msgpackid", "application/msgpack");
     register_mime_type("xml", "application/xml");
     register_mime_type("png", "image/png");
     register_mime_type("jpg", "image/jpeg");
@@ -192,6 +258,19 @@ void kis_net_beast_httpd::trigger_deferred_startup() {
     allowed_cors_referrer_ =
         Globalreg::globalreg->kismet_config->fetch_opt_dfl("httpd_allowed_origin", "");
 
+    allow_compression_ =
+        Globalreg::globalreg->kismet_config->fetch_opt_bool("httpd_compression", true);
+    compression_level_ =
+        Globalreg::globalreg->kismet_config->fetch_opt_as<int>("httpd_compression_level", 6);
+    compression_min_ =
+        Globalreg::globalreg->kismet_config->fetch_opt_as<size_t>("httpd_compression_min", 1024);
+
+    if (compression_level_ < 1 || compression_level_ > 9) {
+        _MSG_ERROR("Invalid httpd_compression_level {}, expected 1 to 9; using 6.",
+                compression_level_);
+        compression_level_ = 6;
+    }
+
     auto http_data_dir =
         Globalreg::globalreg->kismet_config->fetch_opt_path("httpd_home", "");
     if (http_data_dir == "") {
@@ -1021,12 +1100,59 @@ bool kis_net_beast_httpd::serve_file(std::shared_ptr<kis_net_beast_httpd_connect
             continue;
         }
 
-        boost::beast::http::file_body::value_type body;
-        body.open(modified_realpath, boost::beast::file_mode::scan, ec);
+        auto file_realpath = std::string(modified_realpath);
+        auto base_path = std::string(base_realpath);
 
         free(modified_realpath);
         free(base_realpath);
 
+        auto gzip_ok = allow_compression() && con->accepts_gzip() &&
+            con->request().method() == boost::beast::http::verb::get;
+
+        // Serve a precompressed copy of the file when there is one; it gets the same
+        // check as the file itself, so a symlink can't escape the static directory
+        std::string gz_realpath;
+
+        if (gzip_ok) {
+            char *gz_real = realpath(fmt::format("{}.gz", file_realpath).c_str(), nullptr);
+
+            if (gz_real != nullptr) {
+                if (strstr(gz_real, base_path.c_str()) == gz_real)
+                    gz_realpath = std::string(gz_real);
+
+                free(gz_real);
+            }
+        }
+
+        if (gz_realpath.length() > 0) {
+            boost::beast::http::file_body::value_type gz_body;
+            gz_body.open(gz_realpath.c_str(), boost::beast::file_mode::scan, ec);
+
+            if (!ec) {
+                auto const gz_size = gz_body.size();
+
+                boost::beast::http::response<boost::beast::http::file_body> res{std::piecewise_construct,
+                    std::make_tuple(std::move(gz_body)), std::make_tuple(boost::beast::http::status::ok, 
+                            con->request().version())};
+
+                con->append_common_headers(res, uri);
+                res.set(boost::beast::http::field::content_encoding, "gzip");
+                append_vary(res, "Accept-Encoding");
+                res.content_length(gz_size);
+
+                ec = {};
+
+                boost::beast::http::write(con->stream(), res, ec);
+
+                return true;
+            }
+
+            ec = {};
+        }
+
+        boost::beast::http::file_body::value_type body;
+        body.open(file_realpath.c_str(), boost::beast::file_mode::scan, ec);
+
         if (ec == boost::beast::errc::no_such_file_or_directory) {
             continue;
         } else if (ec) {
@@ -1036,6 +1162,47 @@ bool kis_net_beast_httpd::serve_file(std::shared_ptr<kis_net_beast_httpd_connect
 
         auto const size = body.size();
 
+        // Otherwise compress text content on the fly; if the file can't be read or
+        // compressed, fall through and serve it uncompressed from the open body
+        if (gzip_ok && size >= compression_min() && 
+                compressible_mime_type(resolve_mime_type(uri))) {
+            std::ifstream ifs(file_realpath, std::ios::binary);
+            std::string content{std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()};
+
+            bool compressed = false;
+            std::string gz_content;
+
+            if (ifs.good() || ifs.eof()) {
+                try {
+                    kis_net_beast_gzip gzip(compression_level());
+                    gzip.compress(content.data(), content.length(), Z_FINISH, gz_content);
+                    compressed = true;
+                } catch (const std::exception& e) {
+                    ;
+                }
+            }
+
+            if (compressed) {
+                body.close();
+
+                boost::beast::http::response<boost::beast::http::string_body> res{boost::beast::http::status::ok,
+                    con->request().version()};
+
+                res.body() = std::move(gz_content);
+
+                con->append_common_headers(res, uri);
+                res.set(boost::beast::http::field::content_encoding, "gzip");
+                append_vary(res, "Accept-Encoding");
+                res.content_length(res.body().length());
+
+                ec = {};
+
+                boost::beast::http::write(con->stream(), res, ec);
+
+                return true;
+            }
+        }
+
         if (con->request().method() == boost::beast::http::verb::head) {
             boost::beast::http::response<boost::beast::http::empty_body> res{boost::beast::http::status::ok, 
                 con->request().version()};
@@ -1134,6 +1301,53 @@ void kis_net_beast_httpd_connection::append_header(const std::string& header, co
     response.set(header, value);
 }
 
+bool kis_net_beast_httpd_connection::accepts_gzip() const {
+    auto accept = request_.find(boost::beast::http::field::accept_encoding);
+
+    if (accept == request_.end())
+        return false;
+
+    // Comma separated codings, each with optional parameters; a q of 0 refuses the coding
+    auto value = accept->value();
+
+    size_t start = 0;
+    while (start < value.length()) {
+        auto end = value.find(',', start);
+        if (end == value.npos)
+            end = value.length();
+
+        auto coding = value.substr(start, end - start);
+        start = end + 1;
+
+        boost::beast::string_view params;
+        auto semi = coding.find(';');
+        if (semi != coding.npos) {
+            params = coding.substr(semi);
+            coding = coding.substr(0, semi);
+        }
+
+        while (coding.length() && (coding.front() == ' ' || coding.front() == '\t'))
+            coding.remove_prefix(1);
+        while (coding.length() && (coding.back() == ' ' || coding.back() == '\t'))
+            coding.remove_suffix(1);
+
+        if (!boost::beast::iequals(coding, "gzip") && !boost::beast::iequals(coding, "x-gzip"))
+            continue;
+
+        for (auto const& p : boost::beast::http::param_list{params}) {
+            if (boost::beast::iequals(p.first, "q")) {
+                auto q = std::string(p.second);
+                if (q.find_first_not_of("0. ") == q.npos)
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
 bool kis_net_beast_httpd_connection::start() {
     // Set a default timeout
     boost::beast::get_lowest_layer(stream_).expires_after(std::chrono::seconds(30));
@@ -1484,6 +1698,10 @@ bool kis_net_beast_httpd_connection::start() {
 
     generator_ft.wait();
 
+    // Compressed response, if the client accepts one; decided when the headers are sent
+    std::unique_ptr<kis_net_beast_gzip> gzip;
+    std::string gzip_out;
+
     boost::system::error_code error;
     while (response_stream_.size() || response_stream_.running()) {
         auto sz = response_stream_.size();
@@ -1491,6 +1709,26 @@ bool kis_net_beast_httpd_connection::start() {
         if (sz) {
             // Write the headers once we have body content
             if (!first_response_write) {
+                // Only compressible content types are considered, which also keeps
+                // streaming endpoints such as the pcap streams from being held below
+                bool can_gzip = httpd->allow_compression() && accepts_gzip() &&
+                    response.find(boost::beast::http::field::content_encoding) == response.end() &&
+                    compressible_mime_type(std::string(response[boost::beast::http::field::content_type]));
+
+                // Hold the headers until the generator has produced enough to be worth
+                // compressing or has finished, so the choice depends on the size of the
+                // content and not on how quickly it was generated
+                if (can_gzip && sz < httpd->compression_min() && response_stream_.running()) {
+                    response_stream_.wait(httpd->compression_min());
+                    continue;
+                }
+
+                if (can_gzip && response_stream_.size() >= httpd->compression_min()) {
+                    gzip = std::unique_ptr<kis_net_beast_gzip>(new kis_net_beast_gzip(httpd->compression_level()));
+                    response.set(boost::beast::http::field::content_encoding, "gzip");
+                    append_vary(response, "Accept-Encoding");
+                }
+
                 boost::beast::http::write_header(stream_, sr, error);
 
                 if (error) {
@@ -1505,13 +1743,36 @@ bool kis_net_beast_httpd_connection::start() {
             char *body_data;
             auto chunk_sz = response_stream_.get(&body_data);
 
-            response.body().data = (void *) body_data;
-            response.body().size = chunk_sz;
-            response.body().more = true;
+            if (gzip != nullptr) {
+                gzip->compress(body_data, chunk_sz, Z_NO_FLUSH, gzip_out);
+                response_stream_.consume(chunk_sz);
+
+                // Flush the encoder whenever we've caught up with the generator, so
+                // streamed content isn't held back waiting for more data
+                if (response_stream_.size() == 0)
+                    gzip->compress(nullptr, 0, Z_SYNC_FLUSH, gzip_out);
+
+                if (gzip_out.length() == 0) {
+                    response_stream_.wait();
+                    continue;
+                }
+
+                response.body().data = (void *) gzip_out.data();
+                response.body().size = gzip_out.length();
+                response.body().more = true;
+
+                boost::beast::http::write(stream_, sr, error);
+
+                gzip_out.clear();
+            } else {
+                response.body().data = (void *) body_data;
+                response.body().size = chunk_sz;
+                response.body().more = true;
 
-            boost::beast::http::write(stream_, sr, error);
+                boost::beast::http::write(stream_, sr, error);
 
-            response_stream_.consume(chunk_sz);
+                response_stream_.consume(chunk_sz);
+            }
 
             // _MSG_INFO("(DEBUG) {} {} - Consumed {}/{} running {}", verb_, uri_, sz, response_stream_.size(), response_stream_.running());
 
@@ -1534,6 +1795,23 @@ bool kis_net_beast_httpd_connection::start() {
 
     // _MSG_INFO("(DEBUG) {} {} - Out of buffer poll loop, remaining {}, running {}", verb_, uri_, response_stream_.size(), response_stream_.running());
 
+    // Finish the compressed stream
+    if (gzip != nullptr) {
+        gzip->compress(nullptr, 0, Z_FINISH, gzip_out);
+
+        response.body().data = (void *) gzip_out.data();
+        response.body().size = gzip_out.length();
+        response.body().more = true;
+
+        boost::beast::http::write(stream_, sr, error);
+
+        if (error == boost::beast::http::error::need_buffer) {
+            error = {};
+        } else if (error) {
+            return do_close();
+        }
+    }
+
     // Send the completion record for the chunked response
     response.body().data = nullptr;
     response.body().size = 0;
@@ -146,6 +146,10 @@ public:
     const bool& allow_cors() { return allow_cors_; }
     const std::string& allowed_cors_referrer() { return allowed_cors_referrer_; }
 
+    const bool& allow_compression() { return allow_compression_; }
+    const int& compression_level() { return compression_level_; }
+    const size_t& compression_min() { return compression_min_; }
+
     bool serve_file(std::shared_ptr<kis_net_beast_httpd_connection> con);
 
     void strip_uri_prefix(boost::beast::string_view& uri_view);
@@ -195,6 +199,11 @@ protected:
     bool allow_cors_;
     std::string allowed_cors_referrer_;
 
+    // gzip content-encoding of responses the client accepts it for
+    bool allow_compression_;
+    int compression_level_;
+    size_t compression_min_;
+
     // Yes, these are stored in ram.  yes, I'm ok with this.
     std::string admin_username, admin_password;
     bool global_login_config;
@@ -263,6 +272,9 @@ public:
         return kis_net_beast_httpd::escape_html(html);
     }
 
+    // Does the request Accept-Encoding allow a gzip response
+    bool accepts_gzip() const;
+
 protected:
     std::shared_ptr<kis_net_beast_httpd> httpd;
 
@@ -362,22 +374,10 @@ public:
     std::shared_ptr<tracker_element> summarize_with_json(std::shared_ptr<T> in_data,
             std::shared_ptr<tracker_element_serializer::rename_map> rename_map) {
 
-        auto summary_vec = std::vector<SharedElementSummary>{};
-        auto fields = json_.get("fields", Json::Value(Json::arrayValue));
-
-        for (const auto& i : fields) {
-            if (i.isString()) {
-                summary_vec.push_back(std::make_shared<tracker_element_summary>(i.asString()));
-            } else if (i.isArray()) {
-                if (i.size() != 2)
-                    throw std::runtime_error("Invalid field mapping, expected [field, name]");
-                summary_vec.push_back(std::make_shared<tracker_element_summary>(i[0].asString(), i[1].asString()));
-            } else {
-                throw std::runtime_error("Invalid field mapping, expected field or [field,rename]");
-            }
-        }
+        auto summary_vec = 
+            Globalreg::globalreg->entrytracker->get_summary_plan(json_.get("fields", Json::Value(Json::arrayValue)));
 
-        return summarize_tracker_element(in_data, summary_vec, rename_map);
+        return summarize_tracker_element(in_data, *summary_vec, rename_map);
     }
 };
 
@@ -0,0 +1,448 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <string.h>
+#include <math.h>
+#include <cmath>
+
+#include "entrytracker.h"
+#include "msgpack_adapter.h"
+
+void msgpack_adapter::buffer_writer::flush() {
+    if (buf.size() == 0)
+        return;
+
+    stream.write(buf.data(), buf.size());
+    buf.resize(0);
+}
+
+void msgpack_adapter::buffer_writer::write_be(uint8_t type, uint64_t v, unsigned int nbytes) {
+    char out[9];
+
+    out[0] = static_cast<char>(type);
+
+    for (unsigned int i = 0; i < nbytes; i++)
+        out[nbytes - i] = static_cast<char>((v >> (i * 8)) & 0xFF);
+
+    write(out, nbytes + 1);
+}
+
+void msgpack_adapter::buffer_writer::write_nil() {
+    write(static_cast<uint8_t>(0xc0));
+}
+
+void msgpack_adapter::buffer_writer::write_uint(uint64_t v) {
+    if (v <= 0x7f)
+        write(static_cast<uint8_t>(v));
+    else if (v <= 0xff)
+        write_be(0xcc, v, 1);
+    else if (v <= 0xffff)
+        write_be(0xcd, v, 2);
+    else if (v <= 0xffffffffULL)
+        write_be(0xce, v, 4);
+    else
+        write_be(0xcf, v, 8);
+}
+
+void msgpack_adapter::buffer_writer::write_int(int64_t v) {
+    if (v >= 0) {
+        write_uint(v);
+        return;
+    }
+
+    if (v >= -32)
+        write(static_cast<uint8_t>(v));
+    else if (v >= INT8_MIN)
+        write_be(0xd0, static_cast<uint64_t>(v), 1);
+    else if (v >= INT16_MIN)
+        write_be(0xd1, static_cast<uint64_t>(v), 2);
+    else if (v >= INT32_MIN)
+        write_be(0xd2, static_cast<uint64_t>(v), 4);
+    else
+        write_be(0xd3, static_cast<uint64_t>(v), 8);
+}
+
+void msgpack_adapter::buffer_writer::write_float(float v) {
+    uint32_t u;
+    memcpy(&u, &v, sizeof(u));
+    write_be(0xca, u, 4);
+}
+
+void msgpack_adapter::buffer_writer::write_double(double v) {
+    uint64_t u;
+    memcpy(&u, &v, sizeof(u));
+    write_be(0xcb, u, 8);
+}
+
+void msgpack_adapter::buffer_writer::write_str(const char *data, size_t len) {
+    if (len < 32)
+        write(static_cast<uint8_t>(0xa0 | len));
+    else if (len <= 0xff)
+        write_be(0xd9, len, 1);
+    else if (len <= 0xffff)
+        write_be(0xda, len, 2);
+    else
+        write_be(0xdb, len, 4);
+
+    write(data, len);
+}
+
+void msgpack_adapter::buffer_writer::write_bin(const char *data, size_t len) {
+    if (len <= 0xff)
+        write_be(0xc4, len, 1);
+    else if (len <= 0xffff)
+        write_be(0xc5, len, 2);
+    else
+        write_be(0xc6, len, 4);
+
+    write(data, len);
+}
+
+void msgpack_adapter::buffer_writer::write_array_header(size_t n) {
+    if (n < 16)
+        write(static_cast<uint8_t>(0x90 | n));
+    else if (n <= 0xffff)
+        write_be(0xdc, n, 2);
+    else
+        write_be(0xdd, n, 4);
+}
+
+void msgpack_adapter::buffer_writer::write_map_header(size_t n) {
+    if (n < 16)
+        write(static_cast<uint8_t>(0x80 | n));
+    else if (n <= 0xffff)
+        write_be(0xde, n, 2);
+    else
+        write_be(0xdf, n, 4);
+}
+
+void msgpack_adapter::buffer_writer::write_string_element(const shared_tracker_element& e) {
+    auto s = e->as_string();
+    write_str(s);
+}
+
+void msgpack_adapter::buffer_writer::write_field_name(int id, const shared_tracker_element& e) {
+    if (name_map != nullptr) {
+        auto nmi = name_map->find(e);
+        if (nmi != name_map->end() && nmi->second.summary->rename.length() != 0) {
+            write_str(nmi->second.summary->rename);
+            return;
+        }
+    }
+
+    if (e->get_type() == tracker_type::tracker_placeholder_missing) {
+        auto tname = std::static_pointer_cast<tracker_element_placeholder>(e)->get_name();
+        if (tname.length() != 0) {
+            write_str(tname);
+            return;
+        }
+    } else if (e->get_type() == tracker_type::tracker_alias) {
+        auto tname = std::static_pointer_cast<tracker_element_alias>(e)->get_alias_name();
+        if (tname.length() != 0) {
+            write_str(tname);
+            return;
+        }
+    }
+
+    auto fieldnames = Globalreg::globalreg->entrytracker->fetch_field_names(id);
+
+    if (fieldnames == nullptr) {
+        write_str("field.unknown.not.registered");
+        return;
+    }
+
+    if (field_ids == nullptr) {
+        write_str(fieldnames->name);
+        return;
+    }
+
+    if (field_ids->insert(id).second)
+        new_ids.push_back(id);
+
+    write_uint(id);
+}
+
+// Keyed maps share the same layout; write_key writes the key
+template<typename M, typename K>
+static void pack_keyed_map(msgpack_adapter::buffer_writer& w, const std::shared_ptr<M>& m, K write_key) {
+    if (m->as_key_vector()) {
+        w.write_array_header(m->size());
+
+        for (const auto& i : *m)
+            write_key(i.first);
+
+        return;
+    }
+
+    size_t n = 0;
+
+    for (const auto& i : *m) {
+        if (i.second != nullptr)
+            n++;
+    }
+
+    if (m->as_vector())
+        w.write_array_header(n);
+    else
+        w.write_map_header(n);
+
+    for (const auto& i : *m) {
+        if (i.second == nullptr)
+            continue;
+
+        if (!m->as_vector())
+            write_key(i.first);
+
+        w.pack(i.second);
+    }
+}
+
+void msgpack_adapter::buffer_writer::pack(shared_tracker_element e) {
+    if (e == nullptr) {
+        write_nil();
+        return;
+    }
+
+    if (autoflush && buf.size() >= flush_size)
+        flush();
+
+    serializer_scope s(e, name_map);
+
+    // If we're serializing an alias, remap as the aliased element
+    if (e->get_type() == tracker_type::tracker_alias) {
+        e = std::static_pointer_cast<tracker_element_alias>(e)->get();
+
+        if (e == nullptr) {
+            write_nil();
+            return;
+        }
+    }
+
+    switch (e->get_type()) {
+        case tracker_type::tracker_string:
+            write_str(std::static_pointer_cast<tracker_element_string>(e)->get());
+            break;
+        case tracker_type::tracker_byte_array:
+            {
+                const auto& v = std::static_pointer_cast<tracker_element_byte_array>(e)->get();
+                write_bin(v.data(), v.length());
+            }
+            break;
+        case tracker_type::tracker_int8:
+            write_int(std::static_pointer_cast<tracker_element_int8>(e)->get());
+            break;
+        case tracker_type::tracker_uint8:
+            write_uint(std::static_pointer_cast<tracker_element_uint8>(e)->get());
+            break;
+        case tracker_type::tracker_int16:
+            write_int(std::static_pointer_cast<tracker_element_int16>(e)->get());
+            break;
+        case tracker_type::tracker_uint16:
+            write_uint(std::static_pointer_cast<tracker_element_uint16>(e)->get());
+            break;
+        case tracker_type::tracker_int32:
+            write_int(std::static_pointer_cast<tracker_element_int32>(e)->get());
+            break;
+        case tracker_type::tracker_uint32:
+            write_uint(std::static_pointer_cast<tracker_element_uint32>(e)->get());
+            break;
+        case tracker_type::tracker_int64:
+            write_int(std::static_pointer_cast<tracker_element_int64>(e)->get());
+            break;
+        case tracker_type::tracker_uint64:
+            write_uint(std::static_pointer_cast<tracker_element_uint64>(e)->get());
+            break;
+        case tracker_type::tracker_float:
+            write_number(std::static_pointer_cast<tracker_element_float>(e)->get());
+            break;
+        case tracker_type::tracker_double:
+            write_number(std::static_pointer_cast<tracker_element_double>(e)->get());
+            break;
+        case tracker_type::tracker_vector:
+            {
+                auto v = std::static_pointer_cast<tracker_element_vector>(e);
+                size_t n = 0;
+
+                for (const auto& i : *v) {
+                    if (i != nullptr)
+                        n++;
+                }
+
+                write_array_header(n);
+
+                for (const auto& i : *v) {
+                    if (i != nullptr)
+                        pack(i);
+                }
+            }
+            break;
+        case tracker_type::tracker_vector_double:
+            {
+                auto v = std::static_pointer_cast<tracker_element_vector_double>(e);
+
+                write_array_header(v->size());
+
+                for (auto i : *v)
+                    write_number(i);
+            }
+            break;
+        case tracker_type::tracker_vector_string:
+            {
+                auto v = std::static_pointer_cast<tracker_element_vector_string>(e);
+
+                write_array_header(v->size());
+
+                for (const auto& i : *v)
+                    write_str(i);
+            }
+            break;
+        case tracker_type::tracker_map:
+            {
+                auto m = std::static_pointer_cast<tracker_element_map>(e);
+                size_t n = m->num_flat_fields();
+
+                for (const auto& i : *m) {
+                    if (i.second != nullptr)
+                        n++;
+                }
+
+                if (m->as_vector() || m->as_key_vector())
+                    write_array_header(n);
+                else
+                    write_map_header(n);
+
+                for_each_map_field(m, [&](const tracker_element_map::map_t::value_type& i) {
+                    if (i.second == nullptr)
+                        return;
+
+                    if (m->as_key_vector()) {
+                        write_field_name(i.first, i.second);
+                        return;
+                    }
+
+                    if (!m->as_vector())
+                        write_field_name(i.first, i.second);
+
+                    pack(i.second);
+                });
+            }
+            break;
+        case tracker_type::tracker_int_map:
+            pack_keyed_map(*this, std::static_pointer_cast<tracker_element_int_map>(e),
+                    [this](int k) { write_int(k); });
+            break;
+        case tracker_type::tracker_mac_map:
+            pack_keyed_map(*this, std::static_pointer_cast<tracker_element_mac_map>(e),
+                    [this](const mac_addr& k) { write_str(k.as_string()); });
+            break;
+        case tracker_type::tracker_uuid_map:
+            pack_keyed_map(*this, std::static_pointer_cast<tracker_element_uuid_map>(e),
+                    [this](const uuid& k) { write_str(k.as_string()); });
+            break;
+        case tracker_type::tracker_string_map:
+            pack_keyed_map(*this, std::static_pointer_cast<tracker_element_string_map>(e),
+                    [this](const std::string& k) { write_str(k); });
+            break;
+        case tracker_type::tracker_double_map:
+            pack_keyed_map(*this, std::static_pointer_cast<tracker_element_double_map>(e),
+                    [this](double k) { write_number(k); });
+            break;
+        case tracker_type::tracker_hashkey_map:
+            pack_keyed_map(*this, std::static_pointer_cast<tracker_element_hashkey_map>(e),
+                    [this](size_t k) { write_uint(k); });
+            break;
+        case tracker_type::tracker_key_map:
+            pack_keyed_map(*this, std::static_pointer_cast<tracker_element_device_key_map>(e),
+                    [this](const device_key& k) { write_str(k.as_string()); });
+            break;
+        case tracker_type::tracker_double_map_double:
+            {
+                auto m = std::static_pointer_cast<tracker_element_double_map_double>(e);
+
+                if (m->as_vector() || m->as_key_vector())
+                    write_array_header(m->size());
+                else
+                    write_map_header(m->size());
+
+                for (const auto& i : *m) {
+                    if (!m->as_vector())
+                        write_number(i.first);
+
+                    if (!m->as_key_vector())
+                        write_number(i.second);
+                }
+            }
+            break;
+        case tracker_type::tracker_pair_double:
+            {
+                const auto& p = std::static_pointer_cast<tracker_element_pair_double>(e)->get();
+                write_array_header(2);
+                write_number(std::get<0>(p));
+                write_number(std::get<1>(p));
+            }
+            break;
+        default:
+            // Addresses, keys, and anything else with its own string form
+            if (e->is_stringable())
+                write_string_element(e);
+            else
+                write_nil();
+            break;
+    }
+}
+
+int msgpack_adapter::id_serializer::serialize(shared_tracker_element in_elem, std::ostream &stream,
+        std::shared_ptr<rename_map> name_map) {
+
+    // Responses on the shared serializer are complete on their own and carry every id they
+    // use; stream instances remember what they've already sent
+    std::unordered_set<int> response_ids;
+    kis_unique_lock<kis_mutex> lk(mutex, std::defer_lock, "msgpackid serialize");
+
+    if (stream_instance)
+        lk.lock();
+
+    auto field_ids = stream_instance ? &sent_field_ids : &response_ids;
+
+    // The dictionary has to come first, so the content is held until it's complete
+    buffer_writer content(stream, name_map, field_ids);
+    content.pack(in_elem);
+
+    buffer_writer head(stream);
+
+    head.write_array_header(2);
+    head.write_map_header(content.new_field_ids().size());
+
+    for (auto id : content.new_field_ids()) {
+        auto fieldnames = Globalreg::globalreg->entrytracker->fetch_field_names(id);
+
+        head.write_uint(id);
+
+        if (fieldnames != nullptr)
+            head.write_str(fieldnames->name);
+        else
+            head.write_str("field.unknown.not.registered");
+    }
+
+    head.flush();
+    content.flush();
+
+    return 0;
+}
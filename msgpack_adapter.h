@@ -0,0 +1,165 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __MSGPACK_ADAPTER_H__
+#define __MSGPACK_ADAPTER_H__
+
+#include "config.h"
+
+#include <unordered_set>
+#include <vector>
+
+#include "fmt.h"
+#include "globalregistry.h"
+#include "trackedelement.h"
+
+// MessagePack serialization adapter.  Objects have the same structure as the JSON
+// serializer output, but numbers are sent as native integers and floats, byte arrays as
+// binary, and nothing needs to be escaped or parsed as text.
+//
+// The 'msgpack' serializer keys objects by field name.  The 'msgpackid' serializer keys
+// registered fields by their numeric field id instead, and sends each message as a two
+// element array of a dictionary of field id to field name, followed by the content.  Over
+// REST the dictionary holds every field id used in the response; on a websocket each
+// field id is only sent the first time it is used by that monitor or subscription.
+namespace msgpack_adapter {
+
+class buffer_writer {
+public:
+    // If field_ids is provided, registered fields are keyed by id, and ids which aren't
+    // in field_ids yet are added to it and to new_field_ids()
+    buffer_writer(std::ostream& stream,
+            std::shared_ptr<tracker_element_serializer::rename_map> name_map = nullptr,
+            std::unordered_set<int> *field_ids = nullptr) :
+        stream{stream},
+        name_map{name_map},
+        field_ids{field_ids},
+        autoflush{field_ids == nullptr} { }
+
+    ~buffer_writer() {
+        flush();
+    }
+
+    void pack(shared_tracker_element e);
+
+    // Hand everything buffered so far to the stream
+    void flush();
+
+    const std::vector<int>& new_field_ids() const {
+        return new_ids;
+    }
+
+    void write_nil();
+    void write_uint(uint64_t v);
+    void write_int(int64_t v);
+    void write_float(float v);
+    void write_double(double v);
+    void write_str(const char *data, size_t len);
+    void write_bin(const char *data, size_t len);
+    void write_array_header(size_t n);
+    void write_map_header(size_t n);
+
+    void write_str(const std::string& s) {
+        write_str(s.data(), s.length());
+    }
+
+protected:
+    // Buffered data is passed to the stream in blocks of about this size
+    static constexpr size_t flush_size = 16384;
+
+    void write(const char *data, size_t len) {
+        buf.append(data, data + len);
+    }
+
+    void write(uint8_t c) {
+        buf.push_back(static_cast<char>(c));
+    }
+
+    // Type byte followed by a big-endian value of nbytes
+    void write_be(uint8_t type, uint64_t v, unsigned int nbytes);
+
+    // Floating point values follow the JSON serializer, collapsing whole numbers to
+    // integers and invalid numbers to 0
+    template<typename N>
+    void write_number(N v) {
+        if (std::isnan(v) || std::isinf(v))
+            write_uint(0);
+        else if (floor(v) == v)
+            write_int((long long) v);
+        else if (sizeof(N) == sizeof(float))
+            write_float(v);
+        else
+            write_double(v);
+    }
+
+    void write_string_element(const shared_tracker_element& e);
+    void write_field_name(int id, const shared_tracker_element& e);
+
+    std::ostream& stream;
+    std::shared_ptr<tracker_element_serializer::rename_map> name_map;
+    std::unordered_set<int> *field_ids;
+    std::vector<int> new_ids;
+    bool autoflush;
+
+    fmt::memory_buffer buf;
+};
+
+class serializer : public tracker_element_serializer {
+public:
+    serializer() :
+        tracker_element_serializer() { }
+
+    virtual int serialize(shared_tracker_element in_elem, std::ostream &stream,
+            std::shared_ptr<rename_map> name_map = nullptr) override {
+        buffer_writer w(stream, name_map);
+        w.pack(in_elem);
+        return 0;
+    }
+
+    virtual bool is_binary() const override {
+        return true;
+    }
+};
+
+class id_serializer : public tracker_element_serializer {
+public:
+    // Stream instances remember which field ids have been sent
+    id_serializer(bool stream_instance = false) :
+        tracker_element_serializer(),
+        stream_instance{stream_instance} { }
+
+    virtual int serialize(shared_tracker_element in_elem, std::ostream &stream,
+            std::shared_ptr<rename_map> name_map = nullptr) override;
+
+    virtual bool is_binary() const override {
+        return true;
+    }
+
+    virtual std::shared_ptr<tracker_element_serializer> new_stream() override {
+        return std::make_shared<id_serializer>(true);
+    }
+
+protected:
+    bool stream_instance;
+    std::unordered_set<int> sent_field_ids;
+};
+
+}
+
+#endif
+
@@ -31,6 +31,7 @@
 #include <vector>
 
 #include "globalregistry.h"
+#include "kis_crc.h"
 #include "macaddr.h"
 #include "packet.h"
 #include "packetchain.h"
@@ -43,7 +44,6 @@ kis_packet::kis_packet() {
 	filtered = 0;
     duplicate = 0;
 
-    content_vec = new packet_component *[MAX_PACKET_COMPONENTS];
     for (unsigned int x = 0; x < MAX_PACKET_COMPONENTS; x++)
         content_vec[x] = nullptr;
 }
@@ -54,10 +54,31 @@ kis_packet::~kis_packet() {
             continue;
 
         if (content_vec[x]->self_destruct)
-            delete content_vec[x];
+            packet_component::release(content_vec[x]);
+    }
+}
+
+void kis_packet::reset() {
+    for (unsigned int x = 0; x < MAX_PACKET_COMPONENTS; x++) {
+        if (content_vec[x] == nullptr)
+            continue;
+
+        if (content_vec[x]->self_destruct)
+            packet_component::release(content_vec[x]);
+
+        content_vec[x] = nullptr;
     }
 
-    delete[] content_vec;
+    ts.tv_sec = 0;
+    ts.tv_usec = 0;
+
+	error = 0;
+    crc_ok = 0;
+	filtered = 0;
+    duplicate = 0;
+
+    process_complete_events.clear();
+    tag_vec.clear();
 }
    
 void kis_packet::insert(const unsigned int index, packet_component *data) {
@@ -89,9 +110,20 @@ void kis_packet::erase(const unsigned int index) {
 	// to happen or it will be very unhappy
 	if (content_vec[index] != nullptr) {
 		if (content_vec[index]->self_destruct)
-			delete content_vec[index];
+			packet_component::release(content_vec[index]);
 
 		content_vec[index] = NULL;
 	}
 }
 
+bool kis_packet_checksum::validate_80211(const kis_datachunk *in_frame) {
+    if (in_frame == nullptr || length < 4) {
+        checksum_valid = 0;
+        return false;
+    }
+
+    checksum_valid =
+        kis_crc::crc32_fcs_matches(kis_crc::crc32_80211(in_frame->data, in_frame->length), data);
+
+    return checksum_valid;
+}
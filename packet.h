@@ -29,9 +29,11 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 
 #include "eventbus.h"
 #include "globalregistry.h"
@@ -40,6 +42,8 @@
 #include "trackedelement.h"
 #include "trackedcomponent.h"
 
+#include "moodycamel/concurrentqueue.h"
+
 // This is the main switch for how big the vector is.  If something ever starts
 // bumping up against this we'll need to increase it, but that'll slow down 
 // generating a packet (slightly) so I'm leaving it relatively low.
@@ -52,12 +56,119 @@
 // even when we don't have pcap
 #define KDLT_IEEE802_11			105
 
+class packet_component;
+
+// Anything which can take back a packet component instead of it being deleted
+// when the packet is destroyed.  Components hold a plain pointer to their recycler,
+// so a recycler must outlive every component it hands out; pools registered with
+// the packetchain are kept until the packetchain has drained all packets.
+class packet_component_recycler {
+public:
+    virtual ~packet_component_recycler() { }
+    virtual void recycle(packet_component *in_comp) = 0;
+};
+
 // High-level packet component so that we can provide our own destructors
 class packet_component {
 public:
-    packet_component() { self_destruct = 1; };
+    packet_component() { 
+        self_destruct = 1; 
+    };
     virtual ~packet_component() { }
+
+    // Return the component to a freshly constructed state; components which are
+    // allocated from a pool must implement this
+    virtual void reset() { }
+
+    // Release a component owned by a packet, either back to the pool it came from
+    // or to the allocator
+    static void release(packet_component *in_comp) {
+        if (in_comp->recycler != nullptr)
+            in_comp->recycler->recycle(in_comp);
+        else
+            delete in_comp;
+    }
+
     int self_destruct;
+
+    // Pool this component came from, if any; components without a pool are deleted
+    // when they're released
+    packet_component_recycler *recycler = nullptr;
+};
+
+// Common pool stats so that pools of different types can be reported together
+class packet_component_pool_base : public packet_component_recycler {
+public:
+    packet_component_pool_base(size_t in_max_sz) :
+        max_sz{in_max_sz},
+        hits{0},
+        misses{0},
+        discards{0} { }
+
+    virtual ~packet_component_pool_base() { }
+
+    virtual size_t size_approx() const = 0;
+
+    uint64_t get_hits() const { return hits.load(std::memory_order_relaxed); }
+    uint64_t get_misses() const { return misses.load(std::memory_order_relaxed); }
+    uint64_t get_discards() const { return discards.load(std::memory_order_relaxed); }
+    size_t get_max_size() const { return max_sz; }
+
+protected:
+    size_t max_sz;
+    std::atomic<uint64_t> hits, misses, discards;
+};
+
+// Typed freelist of packet components; components are reset and returned to the 
+// pool when the packet holding them is destroyed instead of being deleted, up to 
+// the maximum pool size.
+template<class T>
+class packet_component_pool : public packet_component_pool_base {
+public:
+    packet_component_pool(size_t in_max_sz) :
+        packet_component_pool_base{in_max_sz} { }
+
+    virtual ~packet_component_pool() {
+        T *c;
+        while (freelist.try_dequeue(c))
+            delete c;
+    }
+
+    T *acquire() {
+        T *c = nullptr;
+
+        if (freelist.try_dequeue(c)) {
+            hits.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            c = new T();
+        }
+
+        c->recycler = this;
+        return c;
+    }
+
+    virtual void recycle(packet_component *in_comp) override {
+        auto c = static_cast<T *>(in_comp);
+
+        if (freelist.size_approx() >= max_sz) {
+            discards.fetch_add(1, std::memory_order_relaxed);
+            delete c;
+            return;
+        }
+
+        // Clear the pool reference; it's set again when the component is acquired
+        c->reset();
+        c->recycler = nullptr;
+        freelist.enqueue(c);
+    }
+
+    virtual size_t size_approx() const override {
+        return freelist.size_approx();
+    }
+
+protected:
+    moodycamel::ConcurrentQueue<T *> freelist;
 };
 
 // Overall packet container that holds packet information
@@ -85,12 +196,16 @@ public:
     // a vector of device events to publish
     std::vector<std::shared_ptr<eventbus_event>> process_complete_events;
 
-    // pre-allocated vector of broken down packet components
-    packet_component **content_vec;
+    // broken down packet components
+    packet_component *content_vec[MAX_PACKET_COMPONENTS];
 
     kis_packet();
     ~kis_packet();
 
+    // Release all components and return the packet to a freshly constructed
+    // state, so it can be re-used from the packet pool
+    void reset();
+
     void insert(const unsigned int index, packet_component *data);
     void *fetch(const unsigned int index) const;
     template<class T> T* fetch(const unsigned int index) {
@@ -209,6 +324,18 @@ public:
         length = 0;
     }
 
+    virtual void reset() override {
+        if (data != NULL && self_data)
+            delete[] data;
+
+        self_destruct = 1;
+        self_data = true;
+        data = NULL;
+        length = 0;
+        dlt = 0;
+        source_id = 0;
+    }
+
     virtual void set_data(char *in_data, unsigned int in_length, bool copy = true) {
         set_data((uint8_t *) in_data, in_length, copy);
     }
@@ -268,6 +395,10 @@ public:
         kis_datachunk::set_data(in_data, in_length, copy);
         checksum_ptr = (uint32_t *) data;
     }
+
+    // Compute the 802.11 FCS over a decapsulated frame, compare it to the
+    // captured checksum, and update checksum_valid.  Returns the validity.
+    bool validate_80211(const kis_datachunk *in_frame);
 };
 
 enum kis_packet_basictype {
@@ -318,6 +449,10 @@ public:
         transmitter = mac_addr(0);
     }
 
+    virtual void reset() override {
+        *this = kis_common_info();
+    }
+
     // Source - origin of packet
     // Destination - dest of packet
     // Network - Associated network device (such as ap bssid)
@@ -446,6 +581,10 @@ public:
         channel = "0";
     }
 
+    virtual void reset() override {
+        *this = kis_layer1_packinfo();
+    }
+
     // How "accurate" are we?  Higher == better.  Nothing uses this yet
     // but we might as well track it here.
     int accuracy;
@@ -25,15 +25,91 @@
 #include <inttypes.h>
 #endif
 
+#include <cmath>
+#include <cxxabi.h>
+#include <dlfcn.h>
 #include <pthread.h>
 
 #include "alertracker.h"
 #include "configfile.h"
 #include "globalregistry.h"
+#include "kis_datasource.h"
+#include "kis_dlt_radiotap.h"
 #include "messagebus.h"
 #include "packet.h"
 #include "packetchain.h"
 
+#ifndef DLT_PPI
+#define DLT_PPI 192
+#endif
+
+static std::string chain_position_name(int in_chain) {
+    switch (in_chain) {
+        case CHAINPOS_POSTCAP:
+            return "postcap";
+        case CHAINPOS_LLCDISSECT:
+            return "llcdissect";
+        case CHAINPOS_DECRYPT:
+            return "decrypt";
+        case CHAINPOS_DATADISSECT:
+            return "datadissect";
+        case CHAINPOS_CLASSIFIER:
+            return "classifier";
+        case CHAINPOS_TRACKER:
+            return "tracker";
+        case CHAINPOS_LOGGING:
+            return "logging";
+    }
+
+    return "unknown";
+}
+
+// Resolve the symbol of a handler callback so the handler stats have a useful
+// name even when the caller doesn't provide one
+static std::string handler_symbol_name(packet_chain::pc_callback in_cb) {
+    Dl_info info;
+
+    if (in_cb == nullptr || dladdr(reinterpret_cast<void *>(in_cb), &info) == 0 || 
+            info.dli_sname == nullptr)
+        return "";
+
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+
+    if (status != 0 || demangled == nullptr)
+        return info.dli_sname;
+
+    std::string ret(demangled);
+    free(demangled);
+
+    // Trim the argument list, it's always the same CHAINCALL_PARMS
+    auto paren = ret.find('(');
+    if (paren != std::string::npos)
+        ret = ret.substr(0, paren);
+
+    return ret;
+}
+
+// Find the start of the 802.11 header in a raw linkframe, if the linkframe is
+// 802.11; radiotap and PPI both carry their header length as a le16 at offset 2
+static bool linkframe_dot11_offset(const kis_datachunk *chunk, unsigned int& offt) {
+    offt = 0;
+
+    if (chunk == nullptr || chunk->data == nullptr)
+        return false;
+
+    if (chunk->dlt == DLT_IEEE802_11_RADIO || chunk->dlt == DLT_PPI) {
+        if (chunk->length < 4)
+            return false;
+
+        offt = chunk->data[2] | (chunk->data[3] << 8);
+    } else if (chunk->dlt != KDLT_IEEE802_11) {
+        return false;
+    }
+
+    return offt < chunk->length;
+}
+
 class SortLinkPriority {
 public:
     inline bool operator() (const packet_chain::pc_link *x, 
@@ -59,6 +135,107 @@ packet_chain::packet_chain() {
     packet_queue_drop =
         Globalreg::globalreg->kismet_config->fetch_opt_uint("packet_backlog_limit", 8192);
 
+    packet_batch_size =
+        Globalreg::globalreg->kismet_config->fetch_opt_uint("packet_batch_size", 32);
+    if (packet_batch_size == 0)
+        packet_batch_size = 1;
+
+    packet_counters_mutex.set_name("packetchain packet_counters");
+    pending_queue_peak = 0;
+
+    // Work out the queue depth at which each class is shed.  Classes in the shed
+    // order start dropping at the backlog limit and at evenly spaced steps towards
+    // the hard limit; anything else is only dropped at the hard limit.  With no 
+    // shed order, everything is tail-dropped at the backlog limit.
+    auto shed_order = 
+        str_tokenize(Globalreg::globalreg->kismet_config->fetch_opt_dfl("packet_shed_order",
+                    "beacon,data,control,other"), ",");
+
+    std::vector<int> shed_classes;
+    for (const auto& sc : shed_order) {
+        auto sc_name = str_lower(sc);
+        bool found = false;
+
+        for (int c = 0; c < shed_class_max; c++) {
+            if (shed_class_name(c) == sc_name) {
+                if (std::find(shed_classes.begin(), shed_classes.end(), c) == shed_classes.end())
+                    shed_classes.push_back(c);
+                found = true;
+                break;
+            }
+        }
+
+        if (!found && sc_name.length() > 0)
+            _MSG_ERROR("Unknown packet class '{}' in packet_shed_order, expected one of "
+                    "beacon, mgmt, control, data, eapol, other", sc);
+    }
+
+    if (shed_classes.size() == 0)
+        shed_hard_limit = packet_queue_drop;
+    else
+        shed_hard_limit =
+            Globalreg::globalreg->kismet_config->fetch_opt_uint("packet_backlog_hard_limit", 
+                    packet_queue_drop * 2);
+
+    if (shed_hard_limit < packet_queue_drop)
+        shed_hard_limit = packet_queue_drop;
+
+    for (unsigned int c = 0; c < shed_class_max; c++)
+        shed_thresholds[c] = shed_hard_limit;
+
+    for (unsigned int k = 0; k < shed_classes.size(); k++)
+        shed_thresholds[shed_classes[k]] = packet_queue_drop + 
+            (k * (shed_hard_limit - packet_queue_drop)) / shed_classes.size();
+
+    shed_min_threshold = shed_hard_limit;
+    for (unsigned int c = 0; c < shed_class_max; c++)
+        shed_min_threshold = std::min(shed_min_threshold, shed_thresholds[c]);
+
+    packet_thread_count = static_cast<unsigned int>(std::thread::hardware_concurrency());
+    if (packet_thread_count == 0)
+        packet_thread_count = 1;
+
+    packet_lanes_enabled =
+        Globalreg::globalreg->kismet_config->fetch_opt_bool("packet_lanes", false);
+    packet_lane_rr = 0;
+
+    // Lanes are created up front so that packets injected before processing
+    // starts are queued to the lane which will eventually service them
+    if (packet_lanes_enabled) {
+        for (unsigned int n = 0; n < packet_thread_count; n++)
+            packet_lanes.push_back(std::unique_ptr<packet_queue_t>(new packet_queue_t()));
+
+        _MSG_INFO("Packet processing will use {} device-affine packet lanes", packet_thread_count);
+    }
+
+    pack_comp_linkframe = register_packet_component("LINKFRAME");
+    pack_comp_datasrc = register_packet_component("KISDATASRC");
+
+    handler_stats_mutex.set_name("packetchain handler_stats");
+
+    handler_stats_enabled =
+        Globalreg::globalreg->kismet_config->fetch_opt_bool("packet_handler_stats", true);
+    handler_stats_sample =
+        Globalreg::globalreg->kismet_config->fetch_opt_uint("packet_handler_stats_sample", 32);
+    if (handler_stats_sample == 0)
+        handler_stats_sample = 1;
+
+    component_pool_mutex.set_name("packetchain component_pool");
+
+    packet_pool_max =
+        Globalreg::globalreg->kismet_config->fetch_opt_uint("packet_pool_size", 4096);
+    packet_pool_hits = 0;
+    packet_pool_misses = 0;
+    packet_pool_discards = 0;
+
+    datachunk_pool = std::make_shared<packet_component_pool<kis_datachunk>>(packet_pool_max);
+    l1info_pool = std::make_shared<packet_component_pool<kis_layer1_packinfo>>(packet_pool_max);
+    common_info_pool = std::make_shared<packet_component_pool<kis_common_info>>(packet_pool_max);
+
+    register_component_pool("datachunk", datachunk_pool);
+    register_component_pool("l1info", l1info_pool);
+    register_component_pool("common", common_info_pool);
+
     auto entrytracker = 
         Globalreg::fetch_mandatory_global_as<entry_tracker>();
 
@@ -108,6 +285,18 @@ packet_chain::packet_chain() {
     packet_drop_rrd =
         std::make_shared<kis_tracked_rrd<>>(packet_drop_rrd_id);
 
+    packet_class_drop_map = std::make_shared<tracker_element_string_map>();
+
+    for (unsigned int c = 0; c < shed_class_max; c++) {
+        auto cid = 
+            entrytracker->register_field(fmt::format("kismet.packetchain.dropped_{}_packets_rrd", 
+                        shed_class_name(c)),
+                    tracker_element_factory<kis_tracked_rrd<>>(),
+                    fmt::format("{} packets shed / queue overfull rrd", shed_class_name(c)));
+        packet_class_drop_rrd[c] = std::make_shared<kis_tracked_rrd<>>(cid);
+        packet_class_drop_map->insert(shed_class_name(c), packet_class_drop_rrd[c]);
+    }
+
     packet_processed_rrd_id =
         entrytracker->register_field("kismet.packetchain.processed_packets_rrd",
                 tracker_element_factory<kis_tracked_rrd<>>(),
@@ -115,6 +304,80 @@ packet_chain::packet_chain() {
     packet_processed_rrd =
         std::make_shared<kis_tracked_rrd<>>(packet_processed_rrd_id);
 
+    pool_name_id =
+        entrytracker->register_field("kismet.packetchain.pool.name",
+                tracker_element_factory<tracker_element_string>(),
+                "pool name");
+    pool_max_id =
+        entrytracker->register_field("kismet.packetchain.pool.max_size",
+                tracker_element_factory<tracker_element_uint64>(),
+                "maximum number of pooled objects");
+    pool_size_id =
+        entrytracker->register_field("kismet.packetchain.pool.size",
+                tracker_element_factory<tracker_element_uint64>(),
+                "approximate number of objects currently in the pool");
+    pool_hits_id =
+        entrytracker->register_field("kismet.packetchain.pool.hits",
+                tracker_element_factory<tracker_element_uint64>(),
+                "allocations satisfied from the pool");
+    pool_misses_id =
+        entrytracker->register_field("kismet.packetchain.pool.misses",
+                tracker_element_factory<tracker_element_uint64>(),
+                "allocations which required a new object");
+    pool_discards_id =
+        entrytracker->register_field("kismet.packetchain.pool.discards",
+                tracker_element_factory<tracker_element_uint64>(),
+                "objects freed because the pool was full");
+
+    hstat_chains_id =
+        entrytracker->register_field("kismet.packetchain.handler_stats.chains",
+                tracker_element_factory<tracker_element_vector>(),
+                "per-chain position handler stats");
+    hstat_handlers_id =
+        entrytracker->register_field("kismet.packetchain.handler_stats.handlers",
+                tracker_element_factory<tracker_element_vector>(),
+                "per-handler stats");
+    hstat_name_id =
+        entrytracker->register_field("kismet.packetchain.handler.name",
+                tracker_element_factory<tracker_element_string>(),
+                "handler or chain name");
+    hstat_id_id =
+        entrytracker->register_field("kismet.packetchain.handler.id",
+                tracker_element_factory<tracker_element_int32>(),
+                "handler id");
+    hstat_chain_id =
+        entrytracker->register_field("kismet.packetchain.handler.chain",
+                tracker_element_factory<tracker_element_string>(),
+                "chain position");
+    hstat_priority_id =
+        entrytracker->register_field("kismet.packetchain.handler.priority",
+                tracker_element_factory<tracker_element_int32>(),
+                "handler priority within the chain position");
+    hstat_calls_id =
+        entrytracker->register_field("kismet.packetchain.handler.calls",
+                tracker_element_factory<tracker_element_uint64>(),
+                "number of calls");
+    hstat_sampled_id =
+        entrytracker->register_field("kismet.packetchain.handler.sampled",
+                tracker_element_factory<tracker_element_uint64>(),
+                "number of timed calls");
+    hstat_avg_id =
+        entrytracker->register_field("kismet.packetchain.handler.avg_ns",
+                tracker_element_factory<tracker_element_uint64>(),
+                "average time of sampled calls (ns)");
+    hstat_p50_id =
+        entrytracker->register_field("kismet.packetchain.handler.p50_ns",
+                tracker_element_factory<tracker_element_uint64>(),
+                "approximate median time of sampled calls (ns)");
+    hstat_p99_id =
+        entrytracker->register_field("kismet.packetchain.handler.p99_ns",
+                tracker_element_factory<tracker_element_uint64>(),
+                "approximate 99th percentile time of sampled calls (ns)");
+    hstat_max_id =
+        entrytracker->register_field("kismet.packetchain.handler.max_ns",
+                tracker_element_factory<tracker_element_uint64>(),
+                "maximum time of sampled calls (ns)");
+
     packet_stats_map = 
         std::make_shared<tracker_element_map>();
     packet_stats_map->insert(packet_peak_rrd);
@@ -142,8 +405,20 @@ packet_chain::packet_chain() {
             std::make_shared<kis_net_web_tracked_endpoint>(packet_dupe_rrd));
     httpd->register_route("/packetchain/packet_drop", {"GET", "POST"}, httpd->RO_ROLE, {},
             std::make_shared<kis_net_web_tracked_endpoint>(packet_drop_rrd));
+    httpd->register_route("/packetchain/packet_drop_class", {"GET", "POST"}, httpd->RO_ROLE, {},
+            std::make_shared<kis_net_web_tracked_endpoint>(packet_class_drop_map));
     httpd->register_route("/packetchain/packet_processed", {"GET", "POST"}, httpd->RO_ROLE, {},
             std::make_shared<kis_net_web_tracked_endpoint>(packet_processed_rrd));
+    httpd->register_route("/packetchain/handler_stats", {"GET", "POST"}, httpd->RO_ROLE, {},
+            std::make_shared<kis_net_web_tracked_endpoint>(
+                [this](std::shared_ptr<kis_net_beast_httpd_connection>) -> std::shared_ptr<tracker_element> {
+                    return handler_stats_endp_handler();
+                }));
+    httpd->register_route("/packetchain/packet_pool", {"GET", "POST"}, httpd->RO_ROLE, {},
+            std::make_shared<kis_net_web_tracked_endpoint>(
+                [this](std::shared_ptr<kis_net_beast_httpd_connection>) -> std::shared_ptr<tracker_element> {
+                    return pool_stats_endp_handler();
+                }));
 
     packetchain_shutdown = false;
 
@@ -154,6 +429,8 @@ packet_chain::packet_chain() {
         timetracker->register_timer(std::chrono::seconds(1), true, 
                 [this](int) -> int {
 
+                fold_packet_counters();
+
                 auto evt = eventbus->get_eventbus_event(event_packetstats());
                 evt->get_event_content()->insert(event_packetstats(), packet_stats_map);
                 eventbus->publish(evt);
@@ -166,9 +443,16 @@ packet_chain::~packet_chain() {
     timetracker->remove_timer(event_timer_id);
 
     {
-        // Tell the packet thread we're dying and unlock it
+        // Tell the packet threads we're dying and unlock them
         packetchain_shutdown = true;
-        packet_queue.enqueue(nullptr);
+
+        if (packet_lanes_enabled) {
+            for (auto& l : packet_lanes)
+                l->enqueue(nullptr);
+        } else {
+            for (unsigned int n = 0; n < packet_thread_count; n++)
+                packet_queue.enqueue(nullptr);
+        }
 
         for (auto& t: packet_threads) {
             if (t.joinable())
@@ -214,24 +498,234 @@ packet_chain::~packet_chain() {
 
     }
 
+    // Components only hold a plain pointer back to their pool, so destroy any packets
+    // still queued and the recycled packets before the component pools go away
+    kis_packet *pooled;
+
+    if (packet_lanes_enabled) {
+        for (auto& l : packet_lanes) {
+            while (l->try_dequeue(pooled))
+                delete pooled;
+        }
+    } else {
+        while (packet_queue.try_dequeue(pooled))
+            delete pooled;
+    }
+
+    while (packet_pool.try_dequeue(pooled))
+        delete pooled;
+
+    {
+        kis_lock_guard<kis_mutex> lk(component_pool_mutex, "~packet_chain");
+        component_pool_map.clear();
+    }
+
+    datachunk_pool.reset();
+    l1info_pool.reset();
+    common_info_pool.reset();
 }
 
 void packet_chain::start_processing() {
-#if 1
-    auto nt = static_cast<int>(std::thread::hardware_concurrency());
-#else
-    auto nt = int(1);
-#endif
+    auto nt = packet_thread_count;
+
+    for (unsigned int n = 0; n < nt; n++) {
+        auto queue = packet_lanes_enabled ? packet_lanes[n].get() : &packet_queue;
 
-    for (int n = 0; n < nt; n++) {
-        packet_threads.emplace_back(std::thread([this, nt, n]() {
+        packet_threads.emplace_back(std::thread([this, nt, n, queue]() {
                 thread_set_process_name(fmt::format("packethandler {}/{}", n, nt));
-                packet_queue_processor();
+                packet_queue_processor(queue);
                 }));
     }
 
 }
 
+size_t packet_chain::packet_lane(kis_packet *in_pack) {
+    auto chunk = in_pack->fetch<kis_datachunk>(pack_comp_linkframe);
+    unsigned int offt;
+
+    // Key on the transmitter (address 2) of the 802.11 header; short control
+    // frames without one fall through to the datasource
+    if (linkframe_dot11_offset(chunk, offt) && offt + 16 <= chunk->length) {
+        uint64_t key = 0;
+
+        for (unsigned int i = 0; i < 6; i++)
+            key = (key << 8) | chunk->data[offt + 10 + i];
+
+        // Mix the bits so that sequential OUIs spread over the lanes
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+
+        return key % packet_lanes.size();
+    }
+
+    auto datasrc = in_pack->fetch<packetchain_comp_datasource>(pack_comp_datasrc);
+
+    if (datasrc != nullptr && datasrc->ref_source != nullptr)
+        return std::hash<kis_datasource *>{}(datasrc->ref_source) % packet_lanes.size();
+
+    return packet_lane_rr++ % packet_lanes.size();
+}
+
+std::string packet_chain::shed_class_name(int in_class) {
+    switch (in_class) {
+        case shed_class_beacon:
+            return "beacon";
+        case shed_class_mgmt:
+            return "mgmt";
+        case shed_class_control:
+            return "control";
+        case shed_class_data:
+            return "data";
+        case shed_class_eapol:
+            return "eapol";
+    }
+
+    return "other";
+}
+
+packet_chain::packet_shed_class packet_chain::classify_packet(kis_packet *in_pack) {
+    auto chunk = in_pack->fetch<kis_datachunk>(pack_comp_linkframe);
+    unsigned int offt;
+
+    if (!linkframe_dot11_offset(chunk, offt) || offt + 2 > chunk->length)
+        return shed_class_other;
+
+    uint8_t fc0 = chunk->data[offt];
+    uint8_t fc1 = chunk->data[offt + 1];
+
+    unsigned int type = (fc0 >> 2) & 0x03;
+    unsigned int subtype = (fc0 >> 4) & 0x0F;
+
+    if (type == 0) {
+        if (subtype == 8)
+            return shed_class_beacon;
+
+        return shed_class_mgmt;
+    }
+
+    if (type == 1)
+        return shed_class_control;
+
+    if (type != 2)
+        return shed_class_other;
+
+    // Protected data can't be inspected for EAPOL
+    if (fc1 & 0x40)
+        return shed_class_data;
+
+    // Data header, plus addr4 for WDS, plus QoS control
+    unsigned int hdrlen = 24;
+    if ((fc1 & 0x03) == 0x03)
+        hdrlen += 6;
+    if (subtype & 0x08)
+        hdrlen += 2;
+
+    static const uint8_t eapol_llc[] = {0xAA, 0xAA, 0x03, 0x00, 0x00, 0x00, 0x88, 0x8E};
+
+    if (offt + hdrlen + sizeof(eapol_llc) <= chunk->length &&
+            memcmp(chunk->data + offt + hdrlen, eapol_llc, sizeof(eapol_llc)) == 0)
+        return shed_class_eapol;
+
+    return shed_class_data;
+}
+
+packet_chain::packet_counters *packet_chain::local_packet_counters() {
+    // Retires the thread's counter block when the thread exits
+    struct counter_holder {
+        packet_chain *chain = nullptr;
+        std::shared_ptr<packet_counters> counters;
+
+        ~counter_holder() {
+            if (counters != nullptr)
+                counters->retired = true;
+        }
+    };
+
+    static thread_local counter_holder holder;
+
+    if (holder.chain != this) {
+        if (holder.counters != nullptr)
+            holder.counters->retired = true;
+
+        holder.counters = std::make_shared<packet_counters>();
+        holder.chain = this;
+
+        kis_lock_guard<kis_mutex> lk(packet_counters_mutex, "local_packet_counters");
+        packet_counters_vec.push_back(holder.counters);
+    }
+
+    return holder.counters.get();
+}
+
+void packet_chain::fold_packet_counters() {
+    auto now = time(0);
+
+    uint64_t totals[counter_max] = { 0 };
+
+    {
+        kis_lock_guard<kis_mutex> lk(packet_counters_mutex, "fold_packet_counters");
+
+        for (auto ci = packet_counters_vec.begin(); ci != packet_counters_vec.end(); ) {
+            auto& pc = *ci;
+
+            // Check retirement before reading, so a retired block's final counts are
+            // always folded before it is dropped
+            bool retired = pc->retired;
+
+            for (unsigned int c = 0; c < counter_max; c++) {
+                auto count = pc->counts[c].load(std::memory_order_relaxed);
+                totals[c] += count - pc->folded[c];
+                pc->folded[c] = count;
+            }
+
+            if (retired)
+                ci = packet_counters_vec.erase(ci);
+            else
+                ++ci;
+        }
+    }
+
+    if (totals[counter_rate] > 0) {
+        packet_rate_rrd->add_sample(totals[counter_rate], now);
+        packet_peak_rrd->add_sample(totals[counter_rate], now);
+    }
+
+    if (totals[counter_error] > 0)
+        packet_error_rrd->add_sample(totals[counter_error], now);
+
+    if (totals[counter_dupe] > 0)
+        packet_dupe_rrd->add_sample(totals[counter_dupe], now);
+
+    if (totals[counter_drop] > 0)
+        packet_drop_rrd->add_sample(totals[counter_drop], now);
+
+    if (totals[counter_processed] > 0)
+        packet_processed_rrd->add_sample(totals[counter_processed], now);
+
+    for (unsigned int c = 0; c < shed_class_max; c++) {
+        if (totals[counter_class_drop + c] > 0)
+            packet_class_drop_rrd[c]->add_sample(totals[counter_class_drop + c], now);
+    }
+
+    // The queue rrd keeps the extreme, so record the deepest backlog seen this 
+    // second, or the current backlog if nothing was queued
+    auto queue_peak = pending_queue_peak.exchange(0);
+    packet_queue_rrd->add_sample(std::max(queue_peak, static_cast<uint64_t>(packet_queue_size())), now);
+}
+
+size_t packet_chain::packet_queue_size() {
+    if (!packet_lanes_enabled)
+        return packet_queue.size_approx();
+
+    size_t sz = 0;
+
+    for (const auto& l : packet_lanes)
+        sz += l->size_approx();
+
+    return sz;
+}
+
 int packet_chain::register_packet_component(std::string in_component) {
     kis_lock_guard<kis_mutex> lk(packetcomp_mutex);
 
@@ -282,26 +776,132 @@ std::string packet_chain::fetch_packet_component_name(int in_id) {
 }
 
 kis_packet *packet_chain::generate_packet() {
-    kis_packet *newpack = new kis_packet();
+    kis_packet *newpack = nullptr;
+
+    if (packet_pool.try_dequeue(newpack)) {
+        packet_pool_hits.fetch_add(1, std::memory_order_relaxed);
+        return newpack;
+    }
+
+    packet_pool_misses.fetch_add(1, std::memory_order_relaxed);
+
+    newpack = new kis_packet();
 
     return newpack;
 }
 
-void packet_chain::packet_queue_processor() {
-    kis_packet *packet = NULL;
+kis_datachunk *packet_chain::generate_datachunk() {
+    return datachunk_pool->acquire();
+}
+
+kis_layer1_packinfo *packet_chain::generate_l1info() {
+    return l1info_pool->acquire();
+}
+
+kis_common_info *packet_chain::generate_common_info() {
+    return common_info_pool->acquire();
+}
+
+void packet_chain::register_component_pool(const std::string& in_name,
+        std::shared_ptr<packet_component_pool_base> in_pool) {
+    kis_lock_guard<kis_mutex> lk(component_pool_mutex, "register_component_pool");
+    component_pool_map[in_name] = in_pool;
+}
+
+std::shared_ptr<tracker_element> packet_chain::pool_stats_endp_handler() {
+    auto ret = std::make_shared<tracker_element_string_map>();
+
+    auto make_stats = [this](const std::string& name, size_t max_sz, size_t sz, 
+            uint64_t hits, uint64_t misses, uint64_t discards) {
+        auto m = std::make_shared<tracker_element_map>();
+        m->insert(std::make_shared<tracker_element_string>(pool_name_id, name));
+        m->insert(std::make_shared<tracker_element_uint64>(pool_max_id, max_sz));
+        m->insert(std::make_shared<tracker_element_uint64>(pool_size_id, sz));
+        m->insert(std::make_shared<tracker_element_uint64>(pool_hits_id, hits));
+        m->insert(std::make_shared<tracker_element_uint64>(pool_misses_id, misses));
+        m->insert(std::make_shared<tracker_element_uint64>(pool_discards_id, discards));
+        return m;
+    };
+
+    ret->insert("packet", make_stats("packet", packet_pool_max, packet_pool.size_approx(),
+                packet_pool_hits.load(), packet_pool_misses.load(), packet_pool_discards.load()));
+
+    kis_lock_guard<kis_mutex> lk(component_pool_mutex, "pool_stats_endp_handler");
+
+    for (const auto& p : component_pool_map) 
+        ret->insert(p.first, make_stats(p.first, p.second->get_max_size(), p.second->size_approx(),
+                    p.second->get_hits(), p.second->get_misses(), p.second->get_discards()));
+
+    return ret;
+}
+
+void packet_chain::run_chain(const std::vector<pc_link *>& in_chain, int in_chainpos, 
+        kis_packet *in_pack, handler_thread_stats *tstats, bool sample) {
+
+    if (tstats == nullptr) {
+        for (const auto& pcl : in_chain) {
+            if (pcl->callback != nullptr)
+                pcl->callback(Globalreg::globalreg, pcl->auxdata, in_pack);
+            else if (pcl->l_callback != nullptr)
+                pcl->l_callback(in_pack);
+        }
+
+        return;
+    }
+
+    auto chain_start = sample ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+    for (const auto& pcl : in_chain) {
+        auto hstats = tstats->get_handler(pcl->id);
+
+        auto start = sample ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+        if (pcl->callback != nullptr)
+            pcl->callback(Globalreg::globalreg, pcl->auxdata, in_pack);
+        else if (pcl->l_callback != nullptr)
+            pcl->l_callback(in_pack);
+
+        hstats->add_call();
+
+        if (sample)
+            hstats->add_sample(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count());
+    }
+
+    tstats->chains[in_chainpos].add_call();
+
+    if (sample)
+        tstats->chains[in_chainpos].add_sample(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - chain_start).count());
+}
+
+void packet_chain::packet_queue_processor(packet_queue_t *queue) {
+    std::vector<kis_packet *> batch(packet_batch_size, nullptr);
+
+    std::shared_ptr<handler_thread_stats> tstats;
+    unsigned int sample_count = 0;
+
+    auto counters = local_packet_counters();
+
+    if (handler_stats_enabled) {
+        tstats = std::make_shared<handler_thread_stats>();
+
+        kis_lock_guard<kis_mutex> lk(handler_stats_mutex, "packet_queue_processor");
+        handler_thread_stats_vec.push_back(tstats);
+    }
 
     while (!packetchain_shutdown && 
             !Globalreg::globalreg->spindown && 
             !Globalreg::globalreg->fatal_condition &&
             !Globalreg::globalreg->complete) {
 
-        packet_queue.wait_dequeue(packet);
+        auto n_packets = queue->wait_dequeue_bulk(batch.begin(), packet_batch_size);
 
-        if (packet == nullptr)
-            break;
+        unsigned int n_shutdown = 0;
+        uint64_t n_error = 0, n_dupe = 0, n_processed = 0;
 
         {
-            // Lock the chain mutexes until we're done processing this packet
+            // Lock the chain mutexes until we're done processing this batch
             // kis_lock_guard<kis_shared_mutex> lk(packetchain_mutex, kismet::shared_lock, "packet_queue_processor");
             std::shared_lock<kis_shared_mutex> lk(packetchain_mutex);
 
@@ -309,76 +909,88 @@ void packet_chain::packet_queue_processor() {
             // the worker thread is in the sync block above, so we shouldn't
             // need to worry about the integrity of these vectors while running
 
-            for (const auto& pcl : postcap_chain) {
-                if (pcl->callback != nullptr)
-                    pcl->callback(Globalreg::globalreg, pcl->auxdata, packet);
-                else if (pcl->l_callback != nullptr)
-                    pcl->l_callback(packet);
-            }
+            for (size_t i = 0; i < n_packets; i++) {
+                auto packet = batch[i];
 
-            for (const auto& pcl : llcdissect_chain) {
-                if (pcl->callback != nullptr)
-                    pcl->callback(Globalreg::globalreg, pcl->auxdata, packet);
-                else if (pcl->l_callback != nullptr)
-                    pcl->l_callback(packet);
-            }
+                if (packet == nullptr) {
+                    n_shutdown++;
+                    continue;
+                }
 
-            for (const auto& pcl : decrypt_chain) {
-                if (pcl->callback != nullptr)
-                    pcl->callback(Globalreg::globalreg, pcl->auxdata, packet);
-                else if (pcl->l_callback != nullptr)
-                    pcl->l_callback(packet);
-            }
+                bool sample = tstats != nullptr && (sample_count++ % handler_stats_sample) == 0;
 
-            for (const auto& pcl : datadissect_chain) {
-                if (pcl->callback != nullptr)
-                    pcl->callback(Globalreg::globalreg, pcl->auxdata, packet);
-                else if (pcl->l_callback != nullptr)
-                    pcl->l_callback(packet);
+                run_chain(postcap_chain, CHAINPOS_POSTCAP, packet, tstats.get(), sample);
+                run_chain(llcdissect_chain, CHAINPOS_LLCDISSECT, packet, tstats.get(), sample);
+                run_chain(decrypt_chain, CHAINPOS_DECRYPT, packet, tstats.get(), sample);
+                run_chain(datadissect_chain, CHAINPOS_DATADISSECT, packet, tstats.get(), sample);
+                run_chain(classifier_chain, CHAINPOS_CLASSIFIER, packet, tstats.get(), sample);
+                run_chain(tracker_chain, CHAINPOS_TRACKER, packet, tstats.get(), sample);
+                run_chain(logging_chain, CHAINPOS_LOGGING, packet, tstats.get(), sample);
             }
+        }
 
-            for (const auto& pcl : classifier_chain) {
-                if (pcl->callback != nullptr)
-                    pcl->callback(Globalreg::globalreg, pcl->auxdata, packet);
-                else if (pcl->l_callback != nullptr)
-                    pcl->l_callback(packet);
-            }
+        for (size_t i = 0; i < n_packets; i++) {
+            auto packet = batch[i];
 
-            for (const auto& pcl : tracker_chain) {
-                if (pcl->callback != nullptr)
-                    pcl->callback(Globalreg::globalreg, pcl->auxdata, packet);
-                else if (pcl->l_callback != nullptr)
-                    pcl->l_callback(packet);
-            }
+            if (packet == nullptr)
+                continue;
 
-            for (const auto& pcl : logging_chain) {
-                if (pcl->callback != nullptr)
-                    pcl->callback(Globalreg::globalreg, pcl->auxdata, packet);
-                else if (pcl->l_callback != nullptr)
-                    pcl->l_callback(packet);
-            }
-        }
+            if (packet->error)
+                n_error++;
 
-        if (packet->error)
-            packet_error_rrd->add_sample(1, time(0));
+            if (packet->duplicate)
+                n_dupe++;
 
-        if (packet->duplicate)
-            packet_dupe_rrd->add_sample(1, time(0));
+            n_processed++;
 
-        packet_processed_rrd->add_sample(1, time(0));
+            destroy_packet(packet);
+        }
+
+        if (n_error)
+            counters->add(counter_error, n_error);
+        if (n_dupe)
+            counters->add(counter_dupe, n_dupe);
+        if (n_processed)
+            counters->add(counter_processed, n_processed);
 
-        destroy_packet(packet);
+        if (n_shutdown > 0) {
+            // Hand back any extra shutdown markers we grabbed in this batch so that
+            // the other threads sharing this queue wake up too
+            for (unsigned int s = 1; s < n_shutdown; s++)
+                queue->enqueue(nullptr);
 
-        continue;
+            break;
+        }
     }
 }
 
 int packet_chain::process_packet(kis_packet *in_pack) {
+    auto counters = local_packet_counters();
+
     // Total packet rate always gets added, even when we drop, so we can compare
-    packet_rate_rrd->add_sample(1, time(0));
-    packet_peak_rrd->add_sample(1, time(0));
+    counters->add(counter_rate, 1);
+
+    auto queue_sz = packet_queue_size();
+
+    // Only classify once we're into the shedding range; below that everything
+    // is queued and the classification isn't needed
+    bool shed = false;
+    int shed_class = shed_class_other;
+
+    if (packet_queue_drop != 0 && queue_sz > shed_min_threshold) {
+        shed_class = classify_packet(in_pack);
+
+        auto threshold = shed_thresholds[shed_class];
+
+        auto datasrc = in_pack->fetch<packetchain_comp_datasource>(pack_comp_datasrc);
+        if (datasrc != nullptr && datasrc->ref_source != nullptr && 
+                !datasrc->ref_source->get_source_shed_packets())
+            threshold = shed_hard_limit;
 
-    if (packet_queue_drop != 0 && packet_queue.size_approx() > packet_queue_drop) {
+        shed = queue_sz > threshold;
+    }
+
+    if (shed) {
         time_t offt = time(0) - last_packet_drop_user_warning;
 
         if (offt > 30) {
@@ -397,12 +1009,13 @@ int packet_chain::process_packet(kis_packet *in_pack) {
 
         destroy_packet(in_pack);
 
-        packet_drop_rrd->add_sample(1, time(0));
+        counters->add(counter_drop, 1);
+        counters->add(counter_class_drop + shed_class, 1);
 
         return 1;
     }
 
-    if (packet_queue.size_approx() > packet_queue_warning && packet_queue_warning != 0) {
+    if (queue_sz > packet_queue_warning && packet_queue_warning != 0) {
         time_t offt = time(0) - last_packet_queue_user_warning;
 
         if (offt > 30) {
@@ -421,21 +1034,33 @@ int packet_chain::process_packet(kis_packet *in_pack) {
 
 
     // Queue the packet
-    packet_queue.enqueue(in_pack);
+    if (packet_lanes_enabled)
+        packet_lanes[packet_lane(in_pack)]->enqueue(in_pack);
+    else
+        packet_queue.enqueue(in_pack);
 
-    packet_queue_rrd->add_sample(packet_queue.size_approx(), time(0));
+    // Racy, but we only need an approximate peak
+    if (queue_sz + 1 > pending_queue_peak.load(std::memory_order_relaxed))
+        pending_queue_peak.store(queue_sz + 1, std::memory_order_relaxed);
 
     return 1;
 }
 
 void packet_chain::destroy_packet(kis_packet *in_pack) {
+    if (packet_pool.size_approx() >= packet_pool_max) {
+        packet_pool_discards.fetch_add(1, std::memory_order_relaxed);
+        delete in_pack;
+        return;
+    }
 
-	delete in_pack;
+    // Return the components to their pools and keep the packet
+    in_pack->reset();
+    packet_pool.enqueue(in_pack);
 }
 
 int packet_chain::register_int_handler(pc_callback in_cb, void *in_aux,
         std::function<int (kis_packet *)> in_l_cb, 
-        int in_chain, int in_prio) {
+        int in_chain, int in_prio, const std::string& in_name) {
 
     kis_lock_guard<kis_shared_mutex> lk(packetchain_mutex, "register_int_handler");
 
@@ -448,6 +1073,14 @@ int packet_chain::register_int_handler(pc_callback in_cb, void *in_aux,
     link->l_callback = in_l_cb;
     link->auxdata = in_aux;
     link->id = next_handlerid++;
+    link->chain = in_chain;
+    link->name = in_name;
+
+    if (link->name.length() == 0)
+        link->name = handler_symbol_name(in_cb);
+
+    if (link->name.length() == 0)
+        link->name = fmt::format("{} handler {}", chain_position_name(in_chain), link->id);
 
     switch (in_chain) {
         case CHAINPOS_POSTCAP:
@@ -501,12 +1134,124 @@ int packet_chain::register_int_handler(pc_callback in_cb, void *in_aux,
     return link->id;
 }
 
-int packet_chain::register_handler(pc_callback in_cb, void *in_aux, int in_chain, int in_prio) {
-    return register_int_handler(in_cb, in_aux, NULL, in_chain, in_prio);
+int packet_chain::register_handler(pc_callback in_cb, void *in_aux, int in_chain, int in_prio,
+        const std::string& in_name) {
+    return register_int_handler(in_cb, in_aux, NULL, in_chain, in_prio, in_name);
+}
+
+int packet_chain::register_handler(std::function<int (kis_packet *)> in_cb, int in_chain, int in_prio,
+        const std::string& in_name) {
+    return register_int_handler(NULL, NULL, in_cb, in_chain, in_prio, in_name);
 }
 
-int packet_chain::register_handler(std::function<int (kis_packet *)> in_cb, int in_chain, int in_prio) {
-    return register_int_handler(NULL, NULL, in_cb, in_chain, in_prio);
+std::shared_ptr<tracker_element> packet_chain::handler_stats_endp_handler() {
+    // Merged view of a handler across all the packet threads
+    struct merged_stats {
+        merged_stats() : calls{0}, sampled{0}, sampled_ns{0}, max_ns{0} {
+            for (unsigned int b = 0; b < handler_hist_buckets; b++)
+                histogram[b] = 0;
+        }
+
+        void merge(const handler_stats& s) {
+            calls += s.calls.load(std::memory_order_relaxed);
+            sampled += s.sampled.load(std::memory_order_relaxed);
+            sampled_ns += s.sampled_ns.load(std::memory_order_relaxed);
+            max_ns = std::max(max_ns, s.max_ns.load(std::memory_order_relaxed));
+
+            for (unsigned int b = 0; b < handler_hist_buckets; b++)
+                histogram[b] += s.histogram[b].load(std::memory_order_relaxed);
+        }
+
+        // Percentiles are approximated as the upper bound of the log2 bucket (bucket b
+        // holds [2^b, 2^(b+1))), clamped to the largest sample seen
+        uint64_t percentile(double pct) const {
+            uint64_t total = 0;
+            for (unsigned int b = 0; b < handler_hist_buckets; b++)
+                total += histogram[b];
+
+            if (total == 0)
+                return 0;
+
+            uint64_t target = static_cast<uint64_t>(std::ceil(total * pct));
+            uint64_t count = 0;
+
+            for (unsigned int b = 0; b < handler_hist_buckets; b++) {
+                count += histogram[b];
+                if (count >= target)
+                    return std::min(max_ns, (static_cast<uint64_t>(2) << b) - 1);
+            }
+
+            return max_ns;
+        }
+
+        uint64_t calls, sampled, sampled_ns, max_ns;
+        uint64_t histogram[handler_hist_buckets];
+    };
+
+    std::map<int, merged_stats> handler_merged;
+    merged_stats chain_merged[CHAINPOS_LOGGING + 1];
+
+    {
+        kis_lock_guard<kis_mutex> lk(handler_stats_mutex, "handler_stats_endp_handler");
+
+        for (const auto& t : handler_thread_stats_vec) {
+            kis_lock_guard<kis_mutex> tlk(t->mutex, "handler_stats_endp_handler");
+
+            for (size_t i = 0; i < t->handlers.size(); i++) 
+                handler_merged[i].merge(*t->handlers[i]);
+
+            for (unsigned int c = 0; c <= CHAINPOS_LOGGING; c++)
+                chain_merged[c].merge(t->chains[c]);
+        }
+    }
+
+    auto fill_stats = [this](std::shared_ptr<tracker_element_map> m, const merged_stats& s) {
+        m->insert(std::make_shared<tracker_element_uint64>(hstat_calls_id, s.calls));
+        m->insert(std::make_shared<tracker_element_uint64>(hstat_sampled_id, s.sampled));
+        m->insert(std::make_shared<tracker_element_uint64>(hstat_avg_id, 
+                    s.sampled == 0 ? 0 : s.sampled_ns / s.sampled));
+        m->insert(std::make_shared<tracker_element_uint64>(hstat_p50_id, s.percentile(0.50)));
+        m->insert(std::make_shared<tracker_element_uint64>(hstat_p99_id, s.percentile(0.99)));
+        m->insert(std::make_shared<tracker_element_uint64>(hstat_max_id, s.max_ns));
+    };
+
+    auto ret = std::make_shared<tracker_element_map>();
+    auto chains = std::make_shared<tracker_element_vector>(hstat_chains_id);
+    auto handlers = std::make_shared<tracker_element_vector>(hstat_handlers_id);
+    ret->insert(chains);
+    ret->insert(handlers);
+
+    std::shared_lock<kis_shared_mutex> lk(packetchain_mutex);
+
+    for (auto chain : {&postcap_chain, &llcdissect_chain, &decrypt_chain, &datadissect_chain,
+            &classifier_chain, &tracker_chain, &logging_chain}) {
+        for (const auto& pcl : *chain) {
+            auto m = std::make_shared<tracker_element_map>();
+
+            m->insert(std::make_shared<tracker_element_string>(hstat_name_id, pcl->name));
+            m->insert(std::make_shared<tracker_element_int32>(hstat_id_id, pcl->id));
+            m->insert(std::make_shared<tracker_element_string>(hstat_chain_id, 
+                        chain_position_name(pcl->chain)));
+            m->insert(std::make_shared<tracker_element_int32>(hstat_priority_id, pcl->priority));
+
+            auto hm = handler_merged.find(pcl->id);
+            fill_stats(m, hm != handler_merged.end() ? hm->second : merged_stats());
+
+            handlers->push_back(m);
+        }
+    }
+
+    for (int c = CHAINPOS_POSTCAP; c <= CHAINPOS_LOGGING; c++) {
+        auto m = std::make_shared<tracker_element_map>();
+
+        m->insert(std::make_shared<tracker_element_string>(hstat_name_id, chain_position_name(c)));
+        m->insert(std::make_shared<tracker_element_string>(hstat_chain_id, chain_position_name(c)));
+        fill_stats(m, chain_merged[c]);
+
+        chains->push_back(m);
+    }
+
+    return ret;
 }
 
 int packet_chain::remove_handler(int in_id, int in_chain) {
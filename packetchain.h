@@ -29,6 +29,7 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <map>
@@ -90,6 +91,11 @@
     kis_packet *in_pack
 
 class kis_packet;
+class kis_datachunk;
+class kis_layer1_packinfo;
+class kis_common_info;
+class packet_component_pool_base;
+template<class T> class packet_component_pool;
 
 class packet_chain : public lifetime_global {
 public:
@@ -121,6 +127,18 @@ public:
     int process_packet(kis_packet *in_pack);
     // Destroy a packet at the end of its life
     void destroy_packet(kis_packet *in_pack);
+
+    // Generate common packet components from the component pools; components 
+    // are returned to the pool when the packet they are inserted into is destroyed
+    kis_datachunk *generate_datachunk();
+    kis_layer1_packinfo *generate_l1info();
+    kis_common_info *generate_common_info();
+
+    // Register a phy- or plugin-specific component pool so that it is reported
+    // with the packet pool stats; the packetchain holds the pool until every packet
+    // has been destroyed, so any pool handing out components must be registered
+    void register_component_pool(const std::string& in_name, 
+            std::shared_ptr<packet_component_pool_base> in_pool);
  
     // Callback and information 
     typedef int (*pc_callback)(CHAINCALL_PARMS);
@@ -130,23 +148,145 @@ public:
         std::function<int (kis_packet *)> l_callback;
         void *auxdata;
 		int id;
+        int chain;
+        // Name reported in the handler stats
+        std::string name;
     } pc_link;
 
-    // Register a callback, aux data, a chain to put it in, and the priority 
-    int register_handler(pc_callback in_cb, void *in_aux, int in_chain, int in_prio);
-    int register_handler(std::function<int (kis_packet *)> in_cb, int in_chain, int in_prio);
+    // Register a callback, aux data, a chain to put it in, and the priority.  The
+    // optional name is used to report the handler in the handler stats; function 
+    // callbacks are named after their symbol when possible.
+    int register_handler(pc_callback in_cb, void *in_aux, int in_chain, int in_prio,
+            const std::string& in_name = "");
+    int register_handler(std::function<int (kis_packet *)> in_cb, int in_chain, int in_prio,
+            const std::string& in_name = "");
     int remove_handler(pc_callback in_cb, int in_chain);
 	int remove_handler(int in_id, int in_chain);
 
     static std::string event_packetstats() { return "PACKETCHAIN_STATS"; }
 
+    // Merged per-handler and per-chain timing, as served by /packetchain/handler_stats
+    std::shared_ptr<tracker_element> fetch_handler_stats() {
+        return handler_stats_endp_handler();
+    }
+
 protected:
-    void packet_queue_processor();
+    typedef moodycamel::BlockingConcurrentQueue<kis_packet *> packet_queue_t;
+
+    // Log2 histogram of handler run times in nanoseconds
+    static const unsigned int handler_hist_buckets = 40;
+
+    // Timing for a single handler or chain position; only ever written by the
+    // packet thread which owns it, and read with relaxed loads when stats are
+    // requested, so no locking or atomic RMW is needed on the packet path
+    class handler_stats {
+    public:
+        handler_stats() :
+            calls{0},
+            sampled{0},
+            sampled_ns{0},
+            max_ns{0} {
+            for (unsigned int b = 0; b < handler_hist_buckets; b++)
+                histogram[b] = 0;
+        }
+
+        void add_call() {
+            calls.store(calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        void add_sample(uint64_t ns) {
+            sampled.store(sampled.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            sampled_ns.store(sampled_ns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+
+            if (ns > max_ns.load(std::memory_order_relaxed))
+                max_ns.store(ns, std::memory_order_relaxed);
+
+            unsigned int b = 0;
+            while (ns > 1 && b < handler_hist_buckets - 1) {
+                ns >>= 1;
+                b++;
+            }
+
+            histogram[b].store(histogram[b].load(std::memory_order_relaxed) + 1, 
+                    std::memory_order_relaxed);
+        }
+
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> sampled;
+        std::atomic<uint64_t> sampled_ns;
+        std::atomic<uint64_t> max_ns;
+        std::atomic<uint64_t> histogram[handler_hist_buckets];
+    };
+
+    // Per-thread accumulators, merged when the stats are read
+    class handler_thread_stats {
+    public:
+        handler_thread_stats() {
+            mutex.set_name("packetchain handler_thread_stats");
+        }
+
+        // Only called from the owning thread; the mutex protects readers from the
+        // vector growing underneath them
+        handler_stats *get_handler(int in_id) {
+            if (static_cast<size_t>(in_id) >= handlers.size()) {
+                kis_lock_guard<kis_mutex> lk(mutex, "handler_thread_stats get_handler");
+                while (handlers.size() <= static_cast<size_t>(in_id))
+                    handlers.push_back(std::unique_ptr<handler_stats>(new handler_stats()));
+            }
+
+            return handlers[in_id].get();
+        }
+
+        kis_mutex mutex;
+        std::vector<std::unique_ptr<handler_stats>> handlers;
+        handler_stats chains[CHAINPOS_LOGGING + 1];
+    };
+
+    // Run all handlers in a chain position, optionally timing them
+    void run_chain(const std::vector<pc_link *>& in_chain, int in_chainpos, kis_packet *in_pack,
+            handler_thread_stats *tstats, bool sample);
+
+    void packet_queue_processor(packet_queue_t *queue);
+
+    // Pick the lane for a packet when running device-affine lanes; packets are
+    // keyed on the transmitter of the raw 802.11 frame when we can find it, then
+    // on the datasource, and are round-robined otherwise
+    size_t packet_lane(kis_packet *in_pack);
+
+    // Total approximate backlog over all queues
+    size_t packet_queue_size();
+
+    // Fold the per-thread packet counters into the RRDs; called once a second so
+    // that the per-packet cost is a thread-local add instead of an RRD lock
+    void fold_packet_counters();
+
+    // Load shedding classes; when the backlog grows past the limit, classes are
+    // dropped in the configured shed order, and protected classes (those not in
+    // the shed order, or any packet from a source configured with shed=false)
+    // are only dropped at the hard backlog limit
+    enum packet_shed_class {
+        shed_class_other = 0,
+        shed_class_beacon = 1,
+        shed_class_mgmt = 2,
+        shed_class_control = 3,
+        shed_class_data = 4,
+        shed_class_eapol = 5,
+        shed_class_max = 6
+    };
+
+    static std::string shed_class_name(int in_class);
+
+    // Classify a packet from the raw linkframe before any dissection
+    packet_shed_class classify_packet(kis_packet *in_pack);
+
+    // Queue depth at which each class starts to be dropped
+    size_t shed_thresholds[shed_class_max];
+    size_t shed_min_threshold, shed_hard_limit;
 
     // Common function for both insertion methods
     int register_int_handler(pc_callback in_cb, void *in_aux, 
             std::function<int (kis_packet *)> in_l_cb, 
-            int in_chain, int in_prio);
+            int in_chain, int in_prio, const std::string& in_name);
 
     int next_componentid, next_handlerid;
 
@@ -171,9 +311,104 @@ protected:
     // std::thread packet_thread;
     std::list<std::thread> packet_threads;
 
-    moodycamel::BlockingConcurrentQueue<kis_packet *> packet_queue;
+    // Number of packet processing threads
+    unsigned int packet_thread_count;
+
+    // Shared packet queue, used by every processing thread unless lanes are enabled
+    packet_queue_t packet_queue;
+
+    // Per-thread queues when device-affine lanes are enabled; a given key always
+    // maps to the same lane, so a device is only ever handled by one thread
+    bool packet_lanes_enabled;
+    std::vector<std::unique_ptr<packet_queue_t>> packet_lanes;
+    std::atomic<unsigned int> packet_lane_rr;
+
+    int pack_comp_linkframe, pack_comp_datasrc;
+
+    // Recycled packets; packets are reset and re-used instead of being freed, up to
+    // the maximum pool size
+    moodycamel::ConcurrentQueue<kis_packet *> packet_pool;
+    size_t packet_pool_max;
+    std::atomic<uint64_t> packet_pool_hits, packet_pool_misses, packet_pool_discards;
+
+    std::shared_ptr<packet_component_pool<kis_datachunk>> datachunk_pool;
+    std::shared_ptr<packet_component_pool<kis_layer1_packinfo>> l1info_pool;
+    std::shared_ptr<packet_component_pool<kis_common_info>> common_info_pool;
+
+    kis_mutex component_pool_mutex;
+    std::map<std::string, std::shared_ptr<packet_component_pool_base>> component_pool_map;
+
+    int pool_name_id, pool_max_id, pool_size_id, pool_hits_id, pool_misses_id, pool_discards_id;
+    std::shared_ptr<tracker_element> pool_stats_endp_handler();
+
+    // Per-handler timing; every handler call is counted, and one in every 
+    // handler_stats_sample packets is timed
+    bool handler_stats_enabled;
+    unsigned int handler_stats_sample;
+
+    kis_mutex handler_stats_mutex;
+    std::vector<std::shared_ptr<handler_thread_stats>> handler_thread_stats_vec;
+
+    int hstat_chains_id, hstat_handlers_id, hstat_name_id, hstat_id_id, hstat_chain_id, 
+        hstat_priority_id, hstat_calls_id, hstat_sampled_id, hstat_avg_id, hstat_p50_id, 
+        hstat_p99_id, hstat_max_id;
+    std::shared_ptr<tracker_element> handler_stats_endp_handler();
+
     bool packetchain_shutdown;
 
+    // Maximum number of packets a processing thread dequeues at once
+    unsigned int packet_batch_size;
+
+    // Counters accumulated per batch by the processing threads and per packet by
+    // the injecting threads.  Each thread counts into its own block, so capture and
+    // processing threads never contend on a shared counter; fold_packet_counters()
+    // sums the change in every block since the previous fold.
+    enum packet_counter {
+        counter_rate = 0,
+        counter_error = 1,
+        counter_dupe = 2,
+        counter_drop = 3,
+        counter_processed = 4,
+        counter_class_drop = 5,
+        counter_max = counter_class_drop + shed_class_max
+    };
+
+    class packet_counters {
+    public:
+        packet_counters() :
+            retired{false} {
+            for (unsigned int c = 0; c < counter_max; c++) {
+                counts[c] = 0;
+                folded[c] = 0;
+            }
+        }
+
+        // Only called from the owning thread, so no atomic read-modify-write is needed;
+        // the counts are atomic so the fold can read them
+        void add(int in_counter, uint64_t in_n) {
+            counts[in_counter].store(counts[in_counter].load(std::memory_order_relaxed) + in_n,
+                    std::memory_order_relaxed);
+        }
+
+        std::atomic<uint64_t> counts[counter_max];
+
+        // Counts at the previous fold, only used by fold_packet_counters()
+        uint64_t folded[counter_max];
+
+        // Set when the owning thread exits; the block is dropped after its last fold
+        std::atomic<bool> retired;
+    };
+
+    // Counter block for the calling thread, registered on first use
+    packet_counters *local_packet_counters();
+
+    kis_mutex packet_counters_mutex;
+    std::vector<std::shared_ptr<packet_counters>> packet_counters_vec;
+
+    // Deepest backlog seen since the last fold; only written when a new peak is seen,
+    // so it stays shared
+    std::atomic<uint64_t> pending_queue_peak;
+
     // Warning and discard levels for packet queue being full
     unsigned int packet_queue_warning, packet_queue_drop;
     time_t last_packet_queue_user_warning, last_packet_drop_user_warning;
@@ -198,6 +433,10 @@ protected:
     std::shared_ptr<kis_tracked_rrd<>> packet_drop_rrd;
     int packet_drop_rrd_id;
 
+    // Drops broken down by shedding class
+    std::shared_ptr<tracker_element_string_map> packet_class_drop_map;
+    std::shared_ptr<kis_tracked_rrd<>> packet_class_drop_rrd[shed_class_max];
+
     std::shared_ptr<kis_tracked_rrd<>> packet_processed_rrd;
     int packet_processed_rrd_id;
 
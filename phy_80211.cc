@@ -54,6 +54,7 @@
 #include "kis_httpd_registry.h"
 
 #include "boost_like_hash.h"
+#include "xxhash.h"
 
 #include "pcapng_stream_futurebuf.h"
 
@@ -76,6 +77,10 @@ int phydot11_packethook_wep(CHAINCALL_PARMS) {
     return ((kis_80211_phy *) auxdata)->packet_wep_decryptor(in_pack);
 }
 
+int phydot11_packethook_dedupe(CHAINCALL_PARMS) {
+    return ((kis_80211_phy *) auxdata)->packet_dot11_dedupe(in_pack);
+}
+
 int phydot11_packethook_dot11(CHAINCALL_PARMS) {
     return ((kis_80211_phy *) auxdata)->packet_dot11_dissector(in_pack);
 }
@@ -91,9 +96,6 @@ kis_80211_phy::kis_80211_phy(global_registry *in_globalreg, int in_phyid) :
     entrytracker = Globalreg::fetch_mandatory_global_as<entry_tracker>();
     streamtracker = Globalreg::fetch_mandatory_global_as<stream_tracker>();
 
-    // Initialize the crc tables
-    crc32_init_table_80211(Globalreg::globalreg->crc32_table);
-
     set_phy_name("IEEE802.11");
 
     dot11_device_entry_id =
@@ -104,6 +106,9 @@ kis_80211_phy::kis_80211_phy(global_registry *in_globalreg, int in_phyid) :
     // Packet classifier - makes basic records plus dot11 data
     packetchain->register_handler(&packet_dot11_common_classifier, this, CHAINPOS_CLASSIFIER, -100);
     packetchain->register_handler(&packet_dot11_scan_json_classifier, this, CHAINPOS_CLASSIFIER, -99);
+    // Duplicate filtering runs after the DLT handlers have produced the decapsulated
+    // frame and signal data, but before any dissection work is done
+    packetchain->register_handler(&phydot11_packethook_dedupe, this, CHAINPOS_POSTCAP, 1000);
     packetchain->register_handler(&phydot11_packethook_wep, this, CHAINPOS_DECRYPT, -100);
     packetchain->register_handler(&phydot11_packethook_dot11, this, CHAINPOS_LLCDISSECT, -100);
 
@@ -561,14 +566,30 @@ kis_80211_phy::kis_80211_phy(global_registry *in_globalreg, int in_phyid) :
 
     ssidtracker = phy_80211_ssid_tracker::create_dot11_ssidtracker();
 
-    // Set up the de-duplication list
-    recent_packet_checksums_sz = 
+    packinfo_pool = std::make_shared<packet_component_pool<dot11_packinfo>>(
+            Globalreg::globalreg->kismet_config->fetch_opt_uint("packet_pool_size", 4096));
+    packetchain->register_component_pool("dot11", packinfo_pool);
+
+    // Set up the de-duplication table; slots are indexed by hash bits so the
+    // size is rounded up to a power of two
+    auto dedup_sz = 
         Globalreg::globalreg->kismet_config->fetch_opt_uint("packet_dedup_size", 2048);
-    recent_packet_checksums = new std::atomic<uint32_t>[recent_packet_checksums_sz];
-    for (unsigned int x = 0; x < recent_packet_checksums_sz; x++) {
-        recent_packet_checksums[x] = 0;
+    recent_packet_hashes_sz = 0;
+    recent_packet_hashes = nullptr;
+
+    if (dedup_sz > 0) {
+        recent_packet_hashes_sz = 1;
+        while (recent_packet_hashes_sz < dedup_sz)
+            recent_packet_hashes_sz <<= 1;
+
+        recent_packet_hashes = new std::atomic<uint64_t>[recent_packet_hashes_sz];
+        for (unsigned int x = 0; x < recent_packet_hashes_sz; x++) {
+            recent_packet_hashes[x] = 0;
+        }
     }
-    recent_packet_checksum_pos = 0;
+
+    packet_dedup_window_ms =
+        Globalreg::globalreg->kismet_config->fetch_opt_uint("packet_dedup_window", 100);
 
     // Parse the ssid regex options
     auto apspoof_lines = Globalreg::globalreg->kismet_config->fetch_opt_vec("apspoof");
@@ -912,13 +933,14 @@ kis_80211_phy::kis_80211_phy(global_registry *in_globalreg, int in_phyid) :
 }
 
 kis_80211_phy::~kis_80211_phy() {
+	packetchain->remove_handler(&phydot11_packethook_dedupe, CHAINPOS_POSTCAP);
 	packetchain->remove_handler(&phydot11_packethook_wep, CHAINPOS_DECRYPT);
 	packetchain->remove_handler(&phydot11_packethook_dot11, CHAINPOS_LLCDISSECT);
 	packetchain->remove_handler(&packet_dot11_common_classifier, CHAINPOS_CLASSIFIER);
 
     timetracker->remove_timer(device_idle_timer);
 
-    delete[] recent_packet_checksums;
+    delete[] recent_packet_hashes;
 }
 
 const std::string kis_80211_phy::khz_to_channel(const double in_khz) {
@@ -1081,7 +1103,18 @@ int kis_80211_phy::packet_dot11_common_classifier(CHAINCALL_PARMS) {
     std::shared_ptr<dot11_tracked_device> receive_dot11;
     std::shared_ptr<dot11_tracked_device> transmit_dot11;
 
-    kis_unique_lock<kis_mutex> list_locker(d11phy->devicetracker->get_devicelist_mutex(),
+    // Lock every device this packet can create or update up front, so that packets for
+    // devices in other shards are classified in parallel
+    std::vector<device_key> update_keys;
+    update_keys.reserve(6);
+
+    for (const auto& m : {dot11info->bssid_mac, dot11info->source_mac, dot11info->dest_mac,
+            dot11info->transmit_mac, dot11info->receive_mac, dot11info->other_mac}) {
+        if (m != globalreg->empty_mac)
+            update_keys.push_back(device_key(d11phy->fetch_phyname_hash(), m));
+    }
+
+    device_tracker::device_update_lock update_locker(d11phy->devicetracker.get(), update_keys,
             "phy80211 common_classifier");
 
     if (dot11info->type == packet_management) {
@@ -1432,8 +1465,11 @@ int kis_80211_phy::packet_dot11_common_classifier(CHAINCALL_PARMS) {
                         return diff < d11phy->bss_ts_group_usec;
                 });
 
-            // We have to do write work because we're still holding the device list 
-            // write state 
+            // Comparing against every AP and linking the matches touches devices outside
+            // of this packet, so it needs the whole device list
+            kis_lock_guard<kis_mutex> list_locker(d11phy->devicetracker->get_devicelist_mutex(),
+                    "phy80211 common_classifier bssts");
+
             d11phy->ap_view->do_device_work(bss_worker);
 
             for (const auto& ri : *(bss_worker.getMatchedDevices())) {
@@ -2083,16 +2119,21 @@ int kis_80211_phy::packet_dot11_scan_json_classifier(CHAINCALL_PARMS) {
             return 0;
         }
 
-        // Either calculate the actual checksums from the ietags or fake one from the capabilities
-        uint32_t ietag_csum = 0;
+        // Either hash the actual ietags or fake one from the capabilities, with the same
+        // hash and checksum folding as the packet dissector
+        uint64_t ietag_hash = 0;
 
-        if (!ietags_j.isNull()) 
-            ietag_csum = adler32_checksum(ietags_j.asString());
-        else if (!capabilities_j.isNull())
-            ietag_csum = adler32_checksum(ssid_str + capabilities_j.asString());
+        if (!ietags_j.isNull()) {
+            auto ietags_str = ietags_j.asString();
+            ietag_hash = XXH64(ietags_str.data(), ietags_str.length(), 0);
+        } else if (!capabilities_j.isNull()) {
+            auto caps_str = ssid_str + capabilities_j.asString();
+            ietag_hash = XXH64(caps_str.data(), caps_str.length(), 0);
+        }
 
+        uint32_t ietag_csum = (uint32_t) (ietag_hash ^ (ietag_hash >> 32));
 
-        if (bssid_dot11->get_last_adv_ie_csum() == ietag_csum) {
+        if (bssid_dot11->get_last_adv_ie_hash() == ietag_hash) {
             ssid = bssid_dot11->get_last_adv_ssid();
 
             if (ssid != nullptr) {
@@ -2103,7 +2144,7 @@ int kis_80211_phy::packet_dot11_scan_json_classifier(CHAINCALL_PARMS) {
             return 1;
         }
 
-        bssid_dot11->set_last_adv_ie_csum(ietag_csum);
+        bssid_dot11->set_last_adv_ie_hash(ietag_hash);
 
         // We can only report advertised SSIDs from a scan report, so we only have to look
         // in the advertised map.
@@ -2291,6 +2332,19 @@ void kis_80211_phy::add_wep_key(mac_addr bssid, uint8_t *key, unsigned int len,
     wepkeys.insert(std::make_pair(winfo->bssid, winfo));
 }
 
+// BSS load is left out of the IE hash, so a cached ssid record takes it from the packinfo
+static void update_cached_ssid_qbss(std::shared_ptr<dot11_advertised_ssid> ssid,
+        dot11_packinfo *dot11info) {
+    if (!dot11info->ietag_qbss)
+        return;
+
+    ssid->set_dot11e_qbss(true);
+    ssid->set_dot11e_qbss_stations(dot11info->ietag_qbss_stations);
+
+    // Percentage is value / max (1 byte, 255)
+    ssid->set_dot11e_qbss_channel_load(((double) dot11info->ietag_qbss_load / 255.0f) * 100.0f);
+}
+
 void kis_80211_phy::handle_ssid(std::shared_ptr<kis_tracked_device_base> basedev,
         std::shared_ptr<dot11_tracked_device> dot11dev,
         kis_packet *in_pack,
@@ -2305,30 +2359,6 @@ void kis_80211_phy::handle_ssid(std::shared_ptr<kis_tracked_device_base> basedev
         return;
     }
 
-    // If we've processed an identical ssid, don't waste time parsing again, just tweak
-    // the few fields we need to update
-    if (dot11dev->get_last_adv_ie_csum() == dot11info->ietag_csum) {
-        ssid = dot11dev->get_last_adv_ssid();
-
-        if (ssid != nullptr) {
-            if (ssid->get_last_time() < in_pack->ts.tv_sec)
-                ssid->set_last_time(in_pack->ts.tv_sec);
-
-            if (dot11info->subtype == packet_sub_beacon) {
-                ssid->inc_beacons_sec();
-            }
-        }
-
-        return;
-    }
-
-    dot11dev->set_last_adv_ie_csum(dot11info->ietag_csum);
-
-    // If we fail parsing...
-    if (packet_dot11_ie_dissector(in_pack, dot11info) < 0) {
-        return;
-    }
-
     // If we're looking for the beacon, snapshot it
     if (dot11info->subtype == packet_sub_beacon &&
             dot11dev->get_snap_next_beacon()) {
@@ -2353,6 +2383,43 @@ void kis_80211_phy::handle_ssid(std::shared_ptr<kis_tracked_device_base> basedev
 
     }
 
+    // If we've processed an identical IE body from this device, don't waste time 
+    // parsing again, just tweak the few fields we need to update; signal, packet 
+    // counts, and rrds have already been handled by the common device update.  Beacons
+    // and probe responses are cached separately since an AP interleaves both.
+    if (dot11info->subtype == packet_sub_beacon) {
+        ssid = dot11dev->get_last_beacon_ssid();
+
+        if (ssid != nullptr && dot11dev->get_last_beacon_ie_hash() == dot11info->ietag_hash) {
+            if (ssid->get_last_time() < in_pack->ts.tv_sec)
+                ssid->set_last_time(in_pack->ts.tv_sec);
+
+            ssid->inc_beacons_sec();
+
+            update_cached_ssid_qbss(ssid, dot11info);
+
+            return;
+        }
+    } else {
+        ssid = dot11dev->get_last_resp_ssid();
+
+        if (ssid != nullptr && dot11dev->get_last_resp_ie_hash() == dot11info->ietag_hash) {
+            if (ssid->get_last_time() < in_pack->ts.tv_sec)
+                ssid->set_last_time(in_pack->ts.tv_sec);
+
+            update_cached_ssid_qbss(ssid, dot11info);
+
+            return;
+        }
+    }
+
+    ssid = nullptr;
+
+    // If we fail parsing...
+    if (packet_dot11_ie_dissector(in_pack, dot11info) < 0) {
+        return;
+    }
+
     if (dot11info->channel != "0" && dot11info->channel != "") {
         basedev->set_channel(dot11info->channel);
     }
@@ -2559,7 +2626,10 @@ void kis_80211_phy::handle_ssid(std::shared_ptr<kis_tracked_device_base> basedev
             ssid->set_last_time(in_pack->ts.tv_sec);
     }
 
-    dot11dev->set_last_adv_ssid(ssid);
+    if (dot11info->subtype == packet_sub_beacon)
+        dot11dev->set_last_beacon_ssid(dot11info->ietag_hash, ssid);
+    else
+        dot11dev->set_last_resp_ssid(dot11info->ietag_hash, ssid);
 
     ssid->set_ietag_checksum(dot11info->ietag_csum);
 
@@ -2914,7 +2984,7 @@ void kis_80211_phy::handle_probed_ssid(std::shared_ptr<kis_tracked_device_base>
         dot11_packinfo *dot11info,
         kis_gps_packinfo *pack_gpsinfo) {
 
-    // We're called under device list lock so we only lock the device we're interacting with
+    // We're called under the update lock for the device we're interacting with
 
     if (dot11info == nullptr)
         throw std::runtime_error("handle_probed_ssid with null dot11dev");
@@ -2936,7 +3006,7 @@ void kis_80211_phy::handle_probed_ssid(std::shared_ptr<kis_tracked_device_base>
             dot11info->subtype == packet_sub_association_req ||
             dot11info->subtype == packet_sub_reassociation_req) {
 
-        kis_unique_lock<kis_mutex> list_locker(devicetracker->get_devicelist_mutex(),
+        device_tracker::device_update_lock update_locker(devicetracker.get(), {basedev->get_key()},
                 "phy80211 handle_probed_ssid");
 
         auto probemap(dot11dev->get_probed_ssid_map());
@@ -3036,7 +3106,9 @@ void kis_80211_phy::handle_probed_ssid(std::shared_ptr<kis_tracked_device_base>
 
         if (dot11info->wps_uuid_e != "") {
             if (probessid->get_wps_uuid_e() != dot11info->wps_uuid_e) {
-                // lk.unlock();
+                // Searching and linking other devices needs the whole device list
+                kis_lock_guard<kis_mutex> list_locker(devicetracker->get_devicelist_mutex(),
+                        "phy80211 handle_probed_ssid uuid");
 
                 device_tracker_view_function_worker dev_worker(
                         [this, dot11info, basedev, dot11dev](std::shared_ptr<kis_tracked_device_base> dev) -> bool {
@@ -3763,10 +3835,7 @@ public:
                 ssid = std::static_pointer_cast<dot11_advertised_ssid>(itr->second);
 
                 if (time(0) - ssid->get_last_time() > timeout && device->get_packets() < packets) {
-                    if (dot11dev->get_last_adv_ssid() == ssid) {
-                        dot11dev->set_last_adv_ssid(NULL);
-                        dot11dev->set_last_adv_ie_csum(0);
-                    }
+                    dot11dev->clear_cached_ssid(ssid);
 
                     adv_ssid_map->erase(itr);
                     itr = adv_ssid_map->begin();
@@ -3787,10 +3856,7 @@ public:
                 ssid = std::static_pointer_cast<dot11_advertised_ssid>(itr->second);
 
                 if (time(0) - ssid->get_last_time() > timeout && device->get_packets() < packets) {
-                    if (dot11dev->get_last_adv_ssid() == ssid) {
-                        dot11dev->set_last_adv_ssid(NULL);
-                        dot11dev->set_last_adv_ie_csum(0);
-                    }
+                    dot11dev->clear_cached_ssid(ssid);
 
                     resp_ssid_map->erase(itr);
                     itr = resp_ssid_map->begin();
@@ -3860,6 +3926,37 @@ int kis_80211_phy::timetracker_event(int eventid) {
     return 1;
 }
 
+void kis_80211_phy::restore_phy_device(std::shared_ptr<kis_tracked_device_base> in_device) {
+    auto dot11dev = in_device->get_sub_as<dot11_tracked_device>(dot11_device_entry_id);
+
+    if (dot11dev == nullptr)
+        return;
+
+    if (dot11dev->has_advertised_ssid_map()) {
+        for (const auto& s : *dot11dev->get_advertised_ssid_map()) {
+            auto ssid = std::static_pointer_cast<dot11_advertised_ssid>(s.second);
+            ssidtracker->handle_broadcast_ssid(ssid->get_ssid(), ssid->get_ssid_len(),
+                    ssid->get_crypt_set(), in_device);
+        }
+    }
+
+    if (dot11dev->has_responded_ssid_map()) {
+        for (const auto& s : *dot11dev->get_responded_ssid_map()) {
+            auto ssid = std::static_pointer_cast<dot11_advertised_ssid>(s.second);
+            ssidtracker->handle_response_ssid(ssid->get_ssid(), ssid->get_ssid_len(),
+                    ssid->get_crypt_set(), in_device);
+        }
+    }
+
+    if (dot11dev->has_probed_ssid_map()) {
+        for (const auto& s : *dot11dev->get_probed_ssid_map()) {
+            auto ssid = std::static_pointer_cast<dot11_probed_ssid>(s.second);
+            ssidtracker->handle_probe_ssid(ssid->get_ssid(), ssid->get_ssid_len(),
+                    ssid->get_crypt_set(), in_device);
+        }
+    }
+}
+
 void kis_80211_phy::load_phy_storage(shared_tracker_element in_storage, shared_tracker_element in_device) {
     if (in_storage == NULL || in_device == NULL)
         return;
@@ -142,6 +142,10 @@ class dot11_packinfo : public packet_component {
 
             // Many of these will not be available until the IE tags are parsed
             ietag_csum = 0;
+            ietag_hash = 0;
+            ietag_qbss = false;
+            ietag_qbss_stations = 0;
+            ietag_qbss_load = 0;
 
             dot11d_country = "";
 
@@ -170,6 +174,10 @@ class dot11_packinfo : public packet_component {
             new_adv_ssid = false;
         }
 
+        virtual void reset() override {
+            *this = dot11_packinfo();
+        }
+
         // Corrupt 802.11 frame
         int corrupt;
 
@@ -231,12 +239,20 @@ class dot11_packinfo : public packet_component {
 
         uint32_t ssid_csum;
         uint32_t ietag_csum;
+        // Hash of the IE tags of ssid-carrying management frames, used to skip
+        // re-dissecting unchanged beacons and probe responses.  TIM and BSS load
+        // change from one beacon to the next and are left out; the BSS load values
+        // are kept separately so they can be updated without a full dissection.
+        uint64_t ietag_hash;
+        bool ietag_qbss;
+        uint16_t ietag_qbss_stations;
+        uint8_t ietag_qbss_load;
 
         // Tupled hash map
         std::multimap<std::tuple<uint8_t, uint32_t, uint8_t>, size_t> ietag_hash_map;
 
-        // Parsed IE tags, if we've parsed them
-        std::shared_ptr<dot11_ie> ie_tags;
+        // IE tag views over the decapsulated frame, if we've parsed them
+        dot11_ie ie_tags;
 
         std::string dot11d_country;
         std::vector<dot11_packinfo_dot11d_entry> dot11d_vec;
@@ -328,6 +344,9 @@ public:
 
     // Dot11 decoders, wep decryptors, etc
     int packet_wep_decryptor(kis_packet *in_pack);
+    // Post-capture duplicate filter; flags frames seen by another source (or
+    // retransmitted) within the dedup window before they are dissected
+    int packet_dot11_dedupe(kis_packet *in_pack);
     // Top-level dissector; decodes basic type and populates the dot11 packet
     int packet_dot11_dissector(kis_packet *in_pack);
     // Expects an existing dot11 packet with the basic type intact, interprets
@@ -380,6 +399,9 @@ public:
     virtual void load_phy_storage(shared_tracker_element in_storage,
             shared_tracker_element in_device) override;
 
+    // Re-enter restored devices in the SSID tracker
+    virtual void restore_phy_device(std::shared_ptr<kis_tracked_device_base> in_device) override;
+
     // Convert a frequency in KHz to an IEEE 80211 channel name; MAY THROW AN EXCEPTION
     // if this cannot be converted or is an invalid frequency
     static const std::string khz_to_channel(const double in_khz);
@@ -388,7 +410,7 @@ public:
     const std::string dot11_wpa_handshake_event_base = "DOT11_WPA_HANDSHAKE_BASEDEV";
     const std::string dot11_wpa_handshake_event_dot11 = "DOT11_WPA_HANDSHAKE_DOT11";
 
-    static size_t ssid_hash(const std::string& ssid, unsigned int ssid_len) {
+    static size_t ssid_hash(std::string_view ssid, unsigned int ssid_len) {
         auto hash = xx_hash_cpp{};
 
         boost_like::hash_combine(hash, ssid);
@@ -406,10 +428,16 @@ protected:
     std::shared_ptr<entry_tracker> entrytracker;
     std::shared_ptr<stream_tracker> streamtracker;
 
-    // Checksum of recent packets for duplication filtering
-    std::atomic<uint32_t> *recent_packet_checksums;
-    size_t recent_packet_checksums_sz;
-    std::atomic<unsigned int> recent_packet_checksum_pos;
+    // Recycled dot11 packinfo records
+    std::shared_ptr<packet_component_pool<dot11_packinfo>> packinfo_pool;
+
+    // Recent frame hashes for cross-source duplicate filtering.  Each slot is
+    // direct-mapped by the low bits of the frame hash and holds the upper bits
+    // of the hash combined with the time (in ms) the frame was last seen, so
+    // a slot can be checked and replaced without any locking.
+    std::atomic<uint64_t> *recent_packet_hashes;
+    size_t recent_packet_hashes_sz;
+    uint64_t packet_dedup_window_ms;
 
     // Handle advertised SSIDs
     void handle_ssid(std::shared_ptr<kis_tracked_device_base> basedev, 
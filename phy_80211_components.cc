@@ -314,15 +314,15 @@ void dot11_advertised_ssid::register_fields() {
                 "802.11 IE tag content");
 }
 
-void dot11_advertised_ssid::set_ietag_content_from_packet(std::shared_ptr<dot11_ie> tags) {
+void dot11_advertised_ssid::set_ietag_content_from_packet(const dot11_ie& tags) {
     auto tagmap = get_ie_tag_content();
 
     tagmap->clear();
 
-    if (tags == nullptr)
+    if (!tags.parsed())
         return;
 
-    for (auto t : *(tags->tags())) {
+    for (const auto& t : tags) {
         auto tag =
             Globalreg::globalreg->entrytracker->get_shared_instance_as<dot11_tracked_ietag>(ie_tag_content_element_id);
         tag->set_from_tag(t);
@@ -364,62 +364,31 @@ void dot11_tracked_ietag::register_fields() {
         "Complete IE tag data", &complete_tag_data);
 }
 
-void dot11_tracked_ietag::set_from_tag(std::shared_ptr<dot11_ie::dot11_ie_tag> tag) {
-    set_tag_number(tag->tag_num());
-    set_complete_tag_data(tag->tag_data());
+void dot11_tracked_ietag::set_from_tag(const dot11_ie::dot11_ie_tag& tag) {
+    set_tag_number(tag.tag_num());
+    set_complete_tag_data(std::string(tag.tag_data()));
 
-    if (tag->tag_num() == 150) {
-        try {
-            tag->tag_data_stream()->seek(0);
-
-            dot11_ie_150_vendor tag150;
-            tag150.parse(tag->tag_data_stream());
-
-            set_tag_oui(tag150.vendor_oui_int());
+    if (tag.tag_num() == 150 || tag.tag_num() == 221) {
+        if (tag.has_vendor_oui()) {
+            set_tag_oui(tag.vendor_oui_int());
 
-            auto resolved_manuf = Globalreg::globalreg->manufdb->lookup_oui(tag150.vendor_oui_int());
+            auto resolved_manuf = Globalreg::globalreg->manufdb->lookup_oui(tag.vendor_oui_int());
             set_tag_oui_manuf(resolved_manuf->get());
 
-            set_tag_vendor_or_sub(tag150.vendor_oui_type());
+            set_tag_vendor_or_sub(tag.vendor_oui_type());
 
-            set_unique_tag_id(adler32_checksum(fmt::format("{}{}{}", tag->tag_num(), tag150.vendor_oui_int(), tag150.vendor_oui_type())));
+            set_unique_tag_id(adler32_checksum(fmt::format("{}{}{}", tag.tag_num(), tag.vendor_oui_int(), tag.vendor_oui_type())));
 
             return;
-        } catch (const std::exception& e) {
-            // Do nothing; fall through to setting the tag num
-            ;
         }
-    } else if (tag->tag_num() == 221) {
+    } else if (tag.tag_num() == 255) {
         try {
-            tag->tag_data_stream()->seek(0);
-
-            dot11_ie_221_vendor tag221;
-            tag221.parse(tag->tag_data_stream());
-
-            set_tag_oui(tag221.vendor_oui_int());
-
-            auto resolved_manuf = Globalreg::globalreg->manufdb->lookup_oui(tag221.vendor_oui_int());
-            set_tag_oui_manuf(resolved_manuf->get());
-
-            set_tag_vendor_or_sub(tag221.vendor_oui_type());
-
-            set_unique_tag_id(adler32_checksum(fmt::format("{}{}{}", tag->tag_num(), tag221.vendor_oui_int(), tag221.vendor_oui_type())));
-
-            return; 
-        } catch (const std::exception& e) {
-            // Do nothing; fall through to setting the tag num
-            ;
-        }
-    } else if (tag->tag_num() == 255) {
-        try {
-            tag->tag_data_stream()->seek(0);
-
             dot11_ie_255_ext tag255;
-            tag255.parse(tag->tag_data_stream());
+            tag255.parse(tag.tag_data_stream());
 
             set_tag_vendor_or_sub(tag255.subtag_num());
             
-            set_unique_tag_id(adler32_checksum(fmt::format("{}{}", tag->tag_num(), tag255.subtag_num())));
+            set_unique_tag_id(adler32_checksum(fmt::format("{}{}", tag.tag_num(), tag255.subtag_num())));
             return;
         } catch (const std::exception& e) {
             // Do nothing; fall through to setting the tag num
@@ -429,6 +398,6 @@ void dot11_tracked_ietag::set_from_tag(std::shared_ptr<dot11_ie::dot11_ie_tag> t
         set_tag_vendor_or_sub(-1);
     }
 
-    set_unique_tag_id(tag->tag_num());
+    set_unique_tag_id(tag.tag_num());
 }
 
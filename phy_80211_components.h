@@ -388,7 +388,7 @@ public:
     __Proxy(tag_vendor_or_sub, int16_t, int16_t, int16_t, tag_vendor_or_sub);
     __Proxy(complete_tag_data, std::string, std::string, std::string, complete_tag_data);
 
-    void set_from_tag(std::shared_ptr<dot11_ie::dot11_ie_tag> ie);
+    void set_from_tag(const dot11_ie::dot11_ie_tag& ie);
 
 protected:
     virtual void register_fields() override;
@@ -728,7 +728,7 @@ public:
 
     __ProxyDynamicTrackable(ie_tag_content, tracker_element_int_map, ie_tag_content, ie_tag_content_id);
 
-    void set_ietag_content_from_packet(std::shared_ptr<dot11_ie> tags);
+    void set_ietag_content_from_packet(const dot11_ie& tags);
 
 protected:
     virtual void register_fields() override;
@@ -1065,7 +1065,9 @@ public:
     dot11_tracked_device() :
         tracker_component() {
 
-        last_adv_ie_csum = 0;
+        last_adv_ie_hash = 0;
+        last_beacon_ie_hash = 0;
+        last_resp_ie_hash = 0;
         last_bss_invalid = 0;
         bss_invalid_count = 0;
         snapshot_next_beacon = false;
@@ -1077,7 +1079,9 @@ public:
     dot11_tracked_device(int in_id) :
         tracker_component(in_id) { 
 
-        last_adv_ie_csum = 0;
+        last_adv_ie_hash = 0;
+        last_beacon_ie_hash = 0;
+        last_resp_ie_hash = 0;
         last_bss_invalid = 0;
         bss_invalid_count = 0;
         snapshot_next_beacon = false;
@@ -1089,7 +1093,9 @@ public:
     dot11_tracked_device(int in_id, std::shared_ptr<tracker_element_map> e) :
         tracker_component(in_id) {
 
-        last_adv_ie_csum = 0;
+        last_adv_ie_hash = 0;
+        last_beacon_ie_hash = 0;
+        last_resp_ie_hash = 0;
         last_bss_invalid = 0;
         bss_invalid_count = 0;
         snapshot_next_beacon = false;
@@ -1101,7 +1107,9 @@ public:
     dot11_tracked_device(const dot11_tracked_device *p) :
         tracker_component{p} {
 
-        last_adv_ie_csum = 0;
+        last_adv_ie_hash = 0;
+        last_beacon_ie_hash = 0;
+        last_resp_ie_hash = 0;
         last_bss_invalid = 0;
         bss_invalid_count = 0;
         snapshot_next_beacon = false;
@@ -1282,8 +1290,8 @@ public:
         return std::make_shared<dot11_tracked_nonce>(wpa_nonce_entry_id);
     }
 
-    uint32_t get_last_adv_ie_csum() { return last_adv_ie_csum; }
-    void set_last_adv_ie_csum(uint32_t csum) { last_adv_ie_csum = csum; }
+    uint64_t get_last_adv_ie_hash() { return last_adv_ie_hash; }
+    void set_last_adv_ie_hash(uint64_t ie_hash) { last_adv_ie_hash = ie_hash; }
     std::shared_ptr<dot11_advertised_ssid> get_last_adv_ssid() {
         return last_adv_ssid;
     }
@@ -1291,6 +1299,40 @@ public:
         last_adv_ssid = adv_ssid;
     }
 
+    // IE hash and ssid record of the last fully dissected beacon and probe response;
+    // frames with an identical IE body skip dissection entirely
+    uint64_t get_last_beacon_ie_hash() { return last_beacon_ie_hash; }
+    std::shared_ptr<dot11_advertised_ssid> get_last_beacon_ssid() { return last_beacon_ssid; }
+    void set_last_beacon_ssid(uint64_t ie_hash, std::shared_ptr<dot11_advertised_ssid> adv_ssid) {
+        last_beacon_ie_hash = ie_hash;
+        last_beacon_ssid = adv_ssid;
+    }
+
+    uint64_t get_last_resp_ie_hash() { return last_resp_ie_hash; }
+    std::shared_ptr<dot11_advertised_ssid> get_last_resp_ssid() { return last_resp_ssid; }
+    void set_last_resp_ssid(uint64_t ie_hash, std::shared_ptr<dot11_advertised_ssid> adv_ssid) {
+        last_resp_ie_hash = ie_hash;
+        last_resp_ssid = adv_ssid;
+    }
+
+    // Forget any cached ssid record which matches a ssid being removed
+    void clear_cached_ssid(std::shared_ptr<dot11_advertised_ssid> adv_ssid) {
+        if (last_adv_ssid == adv_ssid) {
+            last_adv_ssid = nullptr;
+            last_adv_ie_hash = 0;
+        }
+
+        if (last_beacon_ssid == adv_ssid) {
+            last_beacon_ssid = nullptr;
+            last_beacon_ie_hash = 0;
+        }
+
+        if (last_resp_ssid == adv_ssid) {
+            last_resp_ssid = nullptr;
+            last_resp_ie_hash = 0;
+        }
+    }
+
     virtual void pre_serialize() override {
         if (client_map != nullptr)
             set_num_client_aps(client_map->size());
@@ -1626,8 +1668,12 @@ protected:
     int pmkid_packet_id;
 
     // Un-exposed internal tracking options
-    uint32_t last_adv_ie_csum;
+    uint64_t last_adv_ie_hash;
     std::shared_ptr<dot11_advertised_ssid> last_adv_ssid;
+    uint64_t last_beacon_ie_hash;
+    std::shared_ptr<dot11_advertised_ssid> last_beacon_ssid;
+    uint64_t last_resp_ie_hash;
+    std::shared_ptr<dot11_advertised_ssid> last_resp_ssid;
 
     // Advertised in association requests but device-centric
     std::shared_ptr<tracker_element_uint8> min_tx_power;
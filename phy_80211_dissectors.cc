@@ -38,6 +38,7 @@
 #include "packetchain.h"
 #include "alertracker.h"
 #include "configfile.h"
+#include "xxhash.h"
 
 #include "kaitai/kaitaistream.h"
 #include "dot11_parsers/dot11_wpa_eap.h"
@@ -280,6 +281,92 @@ int kis_80211_phy::wpa_key_mgt_conv(uint8_t mgt_index) {
     return ret;
 }
 
+int kis_80211_phy::packet_dot11_dedupe(kis_packet *in_pack) {
+    if (in_pack->error || recent_packet_hashes_sz == 0)
+        return 0;
+
+    kis_datachunk *chunk = in_pack->fetch<kis_datachunk>(pack_comp_decap);
+
+    if (chunk == nullptr) {
+        chunk = in_pack->fetch<kis_datachunk>(pack_comp_linkframe);
+        if (chunk == nullptr)
+            return 0;
+    }
+
+    if (chunk->dlt != KDLT_IEEE802_11 || chunk->length < 10)
+        return 0;
+
+    // Hash the 802.11 frame (radiotap/ppi have already been stripped by the DLT
+    // handlers, so per-source signal data doesn't change the hash).  The frame 
+    // control is folded into the seed with the retry bit masked so that retransmits
+    // and the same frame seen by multiple sources collapse to the same hash.
+    const uint64_t fc = chunk->data[0] | ((uint64_t) (chunk->data[1] & ~0x08) << 8);
+    const uint64_t hash = XXH64(chunk->data + 2, chunk->length - 2, fc);
+
+    // Slots hold the upper 40 bits of the hash and the lower 24 bits of a ms
+    // timestamp; 24 bits of ms wraps every ~4.6 hours which is far beyond any
+    // sane dedup window, and the wrap is handled by the masked subtraction
+    constexpr uint64_t time_mask = (1ULL << 24) - 1;
+
+    const uint64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    auto& slot = recent_packet_hashes[hash & (recent_packet_hashes_sz - 1)];
+    const uint64_t prev = slot.load(std::memory_order_relaxed);
+
+    if ((prev & ~time_mask) == (hash & ~time_mask) &&
+            ((now_ms - prev) & time_mask) <= packet_dedup_window_ms) {
+        in_pack->filtered = 1;
+        in_pack->duplicate = 1;
+
+        // Credit the other source with seeing the transmitter, without doing
+        // any of the dissection or device work a second time
+        if (chunk->length >= 16)
+            devicetracker->update_device_seenby(in_pack, 
+                    device_key(phyname_hash, mac_addr(&(chunk->data[10]), PHY80211_MAC_LEN)));
+
+        return 0;
+    }
+
+    slot.store((hash & ~time_mask) | (now_ms & time_mask), std::memory_order_relaxed);
+
+    return 0;
+}
+
+// Hash the IE tags, except TIM (5) and BSS load (11) which change with every beacon;
+// the BSS load values are recorded in the packinfo instead.  Each tag is chained into
+// the hash by seeding it with the hash so far.  Anything which doesn't walk as complete
+// tags is hashed as-is.
+static uint64_t ietag_stable_hash(const uint8_t *data, size_t len, dot11_packinfo *packinfo) {
+    uint64_t hash = 0;
+    size_t pos = 0;
+
+    while (pos + 2 <= len) {
+        auto tag_num = data[pos];
+        size_t tag_len = data[pos + 1] + 2;
+
+        if (pos + tag_len > len)
+            break;
+
+        if (tag_num == 11) {
+            if (tag_len >= 5) {
+                packinfo->ietag_qbss = true;
+                packinfo->ietag_qbss_stations = data[pos + 2] | (data[pos + 3] << 8);
+                packinfo->ietag_qbss_load = data[pos + 4];
+            }
+        } else if (tag_num != 5) {
+            hash = XXH64(data + pos, tag_len, hash);
+        }
+
+        pos += tag_len;
+    }
+
+    if (pos < len)
+        hash = XXH64(data + pos, len - pos, hash);
+
+    return hash;
+}
+
 // This needs to be optimized and it needs to not use casting to do its magic
 int kis_80211_phy::packet_dot11_dissector(kis_packet *in_pack) {
     if (in_pack->error) {
@@ -310,23 +397,9 @@ int kis_80211_phy::packet_dot11_dissector(kis_packet *in_pack) {
         return 0;
     }
 
-    // Compare the checksum and see if we've recently seen this exact packet
-    uint32_t chunk_csum = adler32_checksum((const char *) chunk->data, chunk->length);
-
-    for (unsigned int c = 0; c < recent_packet_checksums_sz; c++) {
-        if (recent_packet_checksums[c] == 0)
-            break;
-
-        if (recent_packet_checksums[c] == chunk_csum) {
-            in_pack->filtered = 1;
-            in_pack->duplicate = 1;
-            return 0;
-        }
-    }
-
-    if (recent_packet_checksums_sz > 0) 
-        recent_packet_checksums[(recent_packet_checksum_pos++ % recent_packet_checksums_sz)] = 
-            chunk_csum;
+    // Duplicates have already been flagged by the postcap dedupe handler
+    if (in_pack->duplicate)
+        return 0;
 
     kis_layer1_packinfo *pack_l1info =
         (kis_layer1_packinfo *) in_pack->fetch(pack_comp_l1info);
@@ -335,7 +408,7 @@ int kis_80211_phy::packet_dot11_dissector(kis_packet *in_pack) {
         (kis_common_info *) in_pack->fetch(pack_comp_common);
 
     if (common == NULL) {
-        common = new kis_common_info;
+        common = packetchain->generate_common_info();
         in_pack->insert(pack_comp_common, common);
     }
 
@@ -344,7 +417,7 @@ int kis_80211_phy::packet_dot11_dissector(kis_packet *in_pack) {
     if (pack_l1info != NULL)
         common->freq_khz = pack_l1info->freq_khz;
 
-    packinfo = new dot11_packinfo;
+    packinfo = packinfo_pool->acquire();
 
     frame_control *fc = (frame_control *) chunk->data;
 
@@ -724,10 +797,10 @@ int kis_80211_phy::packet_dot11_dissector(kis_packet *in_pack) {
                 if (action->category_code() == dot11_action::category_code_radio_measurement &&
                         (action_rmm = action->action_frame_rmm()) != NULL) {
                     // Scan the action IE tags
-                    std::shared_ptr<dot11_ie> rmm_tags(new dot11_ie());
+                    dot11_ie rmm_tags;
 
                     try {
-                        rmm_tags->parse(action_rmm->tags_data_stream());
+                        rmm_tags.parse(action_rmm->tags_data());
                     } catch (const std::exception& e) {
                         // fprintf(stderr, "debug - invalid ie rmm tags: %s\n", e.what());
                         packinfo->corrupt = 1;
@@ -735,11 +808,11 @@ int kis_80211_phy::packet_dot11_dissector(kis_packet *in_pack) {
                         return 0;
                     }
 
-                    for (auto t : *(rmm_tags->tags())) {
-                        if (t->tag_num() == 52) {
+                    for (const auto& t : rmm_tags) {
+                        if (t.tag_num() == 52) {
                             try {
                                 dot11_ie_52_rmm ie_rmm;
-                                ie_rmm.parse(t->tag_data_stream());
+                                ie_rmm.parse(t.tag_data_stream());
 
                                 if (ie_rmm.channel_number() > 0xE0) {
                                     std::stringstream ss;
@@ -834,9 +907,9 @@ int kis_80211_phy::packet_dot11_dissector(kis_packet *in_pack) {
             if (fc->subtype == packet_sub_beacon)
                 packinfo->beacon_interval = kis_letoh16(fixparm->beacon);
 
-            packinfo->ietag_csum = 
-                adler32_checksum((const char *) (chunk->data + packinfo->header_offset),
-                                chunk->length - packinfo->header_offset);
+            packinfo->ietag_hash = ietag_stable_hash(chunk->data + packinfo->header_offset,
+                    chunk->length - packinfo->header_offset, packinfo);
+            packinfo->ietag_csum = (uint32_t) (packinfo->ietag_hash ^ (packinfo->ietag_hash >> 32));
 
         } else if (fc->subtype == packet_sub_deauthentication) {
             if ((packinfo->mgt_reason_code >= 25 && packinfo->mgt_reason_code <= 31) ||
@@ -1200,7 +1273,7 @@ std::vector<kis_80211_phy::ie_tag_tuple> kis_80211_phy::PacketDot11IElist(kis_pa
         dot11_packinfo *packinfo) {
     auto ret = std::vector<ie_tag_tuple>{};
 
-    if (packinfo->ie_tags == nullptr) {
+    if (!packinfo->ie_tags.parsed()) {
         // If we can't have IE tags at all
         if (packinfo->type != packet_management || !(
                     packinfo->subtype == packet_sub_beacon ||
@@ -1225,45 +1298,25 @@ std::vector<kis_80211_phy::ie_tag_tuple> kis_80211_phy::PacketDot11IElist(kis_pa
         if (chunk->dlt != KDLT_IEEE802_11)
             return ret;
 
-        membuf tags_membuf((char *) &(chunk->data[packinfo->header_offset]), 
-                (char *) &(chunk->data[chunk->length]));
-        std::istream istream_ietags(&tags_membuf);
-
-        packinfo->ie_tags = std::make_shared<dot11_ie>();
+        if (packinfo->header_offset > chunk->length)
+            return ret;
 
         try {
-            std::shared_ptr<kaitai::kstream> stream_ietags(new kaitai::kstream(&istream_ietags));
-            packinfo->ie_tags->parse(stream_ietags);
+            packinfo->ie_tags.parse(&(chunk->data[packinfo->header_offset]),
+                    chunk->length - packinfo->header_offset);
         } catch (const std::exception& e) {
             return ret;
         }
     }
 
-    for (auto ie_tag : *(packinfo->ie_tags->tags())) {
-        if (ie_tag->tag_num() == 150) {
-            try {
-                ie_tag->tag_data_stream()->seek(0);
-
-                std::shared_ptr<dot11_ie_150_vendor> vendor(new dot11_ie_150_vendor());
-                vendor->parse(ie_tag->tag_data_stream());
-
-                ret.push_back(ie_tag_tuple{150, vendor->vendor_oui_int(), vendor->vendor_oui_type()});
-            } catch (const std::exception &e) {
+    for (const auto& ie_tag : packinfo->ie_tags) {
+        if (ie_tag.tag_num() == 150 || ie_tag.tag_num() == 221) {
+            if (!ie_tag.has_vendor_oui())
                 return ret;
-            }
-        } else if (ie_tag->tag_num() == 221) {
-            try {
-                ie_tag->tag_data_stream()->seek(0);
 
-                std::shared_ptr<dot11_ie_221_vendor> vendor(new dot11_ie_221_vendor());
-                vendor->parse(ie_tag->tag_data_stream());
-
-                ret.push_back(ie_tag_tuple{221, vendor->vendor_oui_int(), vendor->vendor_oui_type()});
-            } catch (const std::exception &e) {
-                return ret;
-            }
+            ret.push_back(ie_tag_tuple{ie_tag.tag_num(), ie_tag.vendor_oui_int(), ie_tag.vendor_oui_type()});
         } else {
-            ret.push_back(ie_tag_tuple{ie_tag->tag_num(), 0, 0});
+            ret.push_back(ie_tag_tuple{ie_tag.tag_num(), 0, 0});
         }
     }
 
@@ -1295,16 +1348,15 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
     if (chunk->dlt != KDLT_IEEE802_11)
         return 0;
 
-    if (packinfo->ie_tags == nullptr) {
-        membuf tags_membuf((char *) &(chunk->data[packinfo->header_offset]), 
-                (char *) &(chunk->data[chunk->length]));
-        std::istream istream_ietags(&tags_membuf);
-
-        packinfo->ie_tags = std::make_shared<dot11_ie>();
+    if (!packinfo->ie_tags.parsed()) {
+        if (packinfo->header_offset > chunk->length) {
+            packinfo->corrupt = 1;
+            return -1;
+        }
 
         try {
-            std::shared_ptr<kaitai::kstream> stream_ietags(new kaitai::kstream(&istream_ietags));
-            packinfo->ie_tags->parse(stream_ietags);
+            packinfo->ie_tags.parse(&(chunk->data[packinfo->header_offset]),
+                    chunk->length - packinfo->header_offset);
         } catch (const std::exception& e) {
             // fmt::print(stderr, "debug - IE tag structure corrupt\n");
             packinfo->corrupt = 1;
@@ -1322,35 +1374,23 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
     // bool seen_mcsrates = false;
     unsigned int wmmtspec_responses = 0;
 
-    for (auto ie_tag : *(packinfo->ie_tags->tags())) {
-        auto hash = std::hash<std::string>{};
-
-        if (ie_tag->tag_num() == 150) {
-            try {
-                auto vendor = std::make_shared<dot11_ie_150_vendor>();
-                vendor->parse(ie_tag->tag_data_stream());
+    for (const auto& ie_tag : packinfo->ie_tags) {
+        auto tag_hash = XXH64(ie_tag.tag_data_ptr(), ie_tag.tag_len(), 0);
 
-                packinfo->ietag_hash_map.insert(std::make_pair(ie_tag_tuple{150, vendor->vendor_oui_int(), vendor->vendor_oui_type()}, hash(ie_tag->tag_data())));
-            } catch (const std::exception& e) {
+        if (ie_tag.tag_num() == 150 || ie_tag.tag_num() == 221) {
+            if (!ie_tag.has_vendor_oui()) {
                 packinfo->corrupt = 1;
                 return -1;
             }
-        } else if (ie_tag->tag_num() == 221) {
-            try {
-                auto vendor = std::make_shared<dot11_ie_221_vendor>();
-                vendor->parse(ie_tag->tag_data_stream());
 
-                packinfo->ietag_hash_map.insert(std::make_pair(ie_tag_tuple{221, vendor->vendor_oui_int(), vendor->vendor_oui_type()}, hash(ie_tag->tag_data())));
-            } catch (const std::exception& e) {
-                packinfo->corrupt = 1;
-                return -1;
-            }
+            packinfo->ietag_hash_map.insert(std::make_pair(ie_tag_tuple{ie_tag.tag_num(), 
+                        ie_tag.vendor_oui_int(), ie_tag.vendor_oui_type()}, tag_hash));
         } else {
-            packinfo->ietag_hash_map.insert(std::make_pair(ie_tag_tuple{ie_tag->tag_num(), 0, 0}, hash(ie_tag->tag_data())));
+            packinfo->ietag_hash_map.insert(std::make_pair(ie_tag_tuple{ie_tag.tag_num(), 0, 0}, tag_hash));
         }
 
         // IE 0 SSID
-        if (ie_tag->tag_num() == 0) {
+        if (ie_tag.tag_num() == 0) {
             /*
             if (seen_ssid) {
                 fprintf(stderr, "debug - multiple SSID ie tags?\n");
@@ -1359,9 +1399,11 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
             seen_ssid = true;
             */
 
-            packinfo->ssid_len = ie_tag->tag_data().length();
-            packinfo->ssid_csum = kis_80211_phy::ssid_hash(ie_tag->tag_data().data(), 
-                    ie_tag->tag_data().length());
+            packinfo->ssid_len = ie_tag.tag_len();
+            // The ssid hash has always covered the ssid up to the first nul
+            packinfo->ssid_csum = 
+                kis_80211_phy::ssid_hash(ie_tag.tag_data().substr(0, ie_tag.tag_data().find('\0')), 
+                        ie_tag.tag_len());
 
             if (packinfo->ssid_len == 0) {
                 packinfo->ssid_blank = true;
@@ -1369,10 +1411,11 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
             }
 
             if (packinfo->ssid_len <= DOT11_PROTO_SSID_LEN) {
-                if (ie_tag->tag_data().find_first_not_of('\0') == std::string::npos) {
+                if (ie_tag.tag_data().find_first_not_of('\0') == std::string_view::npos) {
                     packinfo->ssid_blank = true;
                 } else {
-                    packinfo->ssid = munge_to_printable(ie_tag->tag_data().data());
+                    packinfo->ssid = munge_to_printable((const char *) ie_tag.tag_data_ptr(), 
+                            ie_tag.tag_len(), 1);
                 }
             } else { 
                 _ALERT(alert_longssid_ref, in_pack, packinfo,
@@ -1389,8 +1432,8 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
 
         // IE 1 Basic Rates
         // IE 50 Extended Rates
-        if (ie_tag->tag_num() == 1 || ie_tag->tag_num() == 50) {
-            if (ie_tag->tag_num() == 1) {
+        if (ie_tag.tag_num() == 1 || ie_tag.tag_num() == 50) {
+            if (ie_tag.tag_num() == 1) {
                 /*
                 if (seen_basicrates) {
                     fprintf(stderr, "debug - seen multiple basicrates?\n");
@@ -1401,7 +1444,7 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
 
             }
 
-            if (ie_tag->tag_num() == 50) {
+            if (ie_tag.tag_num() == 50) {
                 /*
                 if (seen_extendedrates) {
                     fprintf(stderr, "debug - seen multiple extendedrates?\n");
@@ -1411,7 +1454,7 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
                 */
             }
 
-            if (ie_tag->tag_data().find("\x75\xEB\x49") != std::string::npos) {
+            if (ie_tag.tag_data().find("\x75\xEB\x49") != std::string_view::npos) {
                 _ALERT(alert_msfdlinkrate_ref, in_pack, packinfo,
                         "MSF-style poisoned rate field in beacon for network " +
                         packinfo->bssid_mac.mac_to_string() + ", exploit attempt "
@@ -1422,7 +1465,7 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
             }
 
             std::vector<std::string> basicrates;
-            for (uint8_t r : ie_tag->tag_data()) {
+            for (uint8_t r : ie_tag.tag_data()) {
                 std::string rate;
 
                 switch (r) {
@@ -1568,14 +1611,14 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
         }
 
         // IE 3 channel
-        if (ie_tag->tag_num() == 3) {
-            if (ie_tag->tag_len() > 1) {
+        if (ie_tag.tag_num() == 3) {
+            if (ie_tag.tag_len() > 1) {
                 std::string al = fmt::format("IEEE80211 packet from {0} to {1} BSSID {2} included an IE "
                         "tag {3} entry with an invalid length; IE {3} should be {4} bytes, but was {5}. "
                         "This may be indicative of an as-yet-unknown buffer overflow attempt against "
                         "the Wi-Fi drivers or firmware, but could also be caused by a misconfigured device.",
                         packinfo->source_mac, packinfo->dest_mac, packinfo->bssid_mac, 
-                        3, 1, ie_tag->tag_len());
+                        3, 1, ie_tag.tag_len());
 
                 alertracker->raise_alert(alert_bad_fixlen_ie, in_pack, 
                         packinfo->bssid_mac, packinfo->source_mac, 
@@ -1585,17 +1628,17 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
                 return -1;
             }
                 
-            packinfo->channel = fmt::format("{}", (uint8_t) (ie_tag->tag_data()[0]));
+            packinfo->channel = fmt::format("{}", (uint8_t) (ie_tag.tag_data()[0]));
             continue;
         }
 
         // IE 7 802.11d
-        if (ie_tag->tag_num() == 7) {
+        if (ie_tag.tag_num() == 7) {
             try {
                 dot11_ie_7_country dot11d;
                 // Allow fragmented 11d, take what we can parse
                 dot11d.set_allow_fragments(true);
-                dot11d.parse(ie_tag->tag_data_stream());
+                dot11d.parse(ie_tag.tag_data_stream());
 
                 packinfo->dot11d_country = munge_to_printable(dot11d.country_code());
 
@@ -1618,11 +1661,10 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
         }
 
         // IE 11 QBSS
-        if (ie_tag->tag_num() == 11) {
+        if (ie_tag.tag_num() == 11) {
             try {
                 std::shared_ptr<dot11_ie_11_qbss> qbss(new dot11_ie_11_qbss());
-                ie_tag->tag_data_stream()->seek(0);
-                qbss->parse(ie_tag->tag_data_stream());
+                qbss->parse(ie_tag.tag_data_stream());
                 packinfo->qbss = qbss;
             } catch (const std::exception& e) {
                 // fprintf(stderr, "debug - corrupt QBSS %s\n", e.what());
@@ -1634,10 +1676,10 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
         }
 
         // IE 33 advertised txpower in probe req
-        if (ie_tag->tag_num() == 33) {
+        if (ie_tag.tag_num() == 33) {
             try {
                 packinfo->tx_power = std::make_shared<dot11_ie_33_power>();
-                packinfo->tx_power->parse(ie_tag->tag_data_stream());
+                packinfo->tx_power->parse(ie_tag.tag_data_stream());
             } catch (const std::exception& e) {
                 // fmt::print(stderr, "debug - corrupt IE33 power: {}\n", e.what());
             }
@@ -1645,16 +1687,16 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
         }
 
         // IE 36, advertised supported channels in probe req
-        if (ie_tag->tag_num() == 36) {
+        if (ie_tag.tag_num() == 36) {
             try {
                 packinfo->supported_channels = std::make_shared<dot11_ie_36_supported_channels>();
-                packinfo->supported_channels->parse(ie_tag->tag_data_stream());
+                packinfo->supported_channels->parse(ie_tag.tag_data_stream());
             } catch (const std::exception& e) {
                 // fmt::print(stderr, "debug  corrupt ie36 supported channels: {}\n", e.what());
             }
         }
 
-        if (ie_tag->tag_num() == 45) {
+        if (ie_tag.tag_num() == 45) {
             /*
             if (seen_mcsrates) {
                 fprintf(stderr, "debug - duplicate ie45 mcs rates\n");
@@ -1667,7 +1709,7 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
 
             try {
                 std::shared_ptr<dot11_ie_45_ht_cap> ht(new dot11_ie_45_ht_cap());
-                ht->parse(ie_tag->tag_data_stream());
+                ht->parse(ie_tag.tag_data_stream());
 
                 std::stringstream mcsstream;
 
@@ -1735,12 +1777,12 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
         }
 
         // IE 48, RSN
-        if (ie_tag->tag_num() == 48) {
+        if (ie_tag.tag_num() == 48) {
             bool rsn_invalid = false;
 
             try {
                 std::shared_ptr<dot11_ie_48_rsn> rsn(new dot11_ie_48_rsn());
-                rsn->parse(ie_tag->tag_data_stream());
+                rsn->parse(ie_tag.tag_data_stream());
 
                 // TODO - don't aggregate these in the future
 
@@ -1781,8 +1823,7 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
             if (rsn_invalid) {
                 try {
                     std::shared_ptr<dot11_ie_48_rsn_partial> rsn(new dot11_ie_48_rsn_partial());
-                    ie_tag->tag_data_stream()->seek(0);
-                    rsn->parse(ie_tag->tag_data_stream());
+                    rsn->parse(ie_tag.tag_data_stream());
 
                     if (rsn->pairwise_count() > 1024) {
                         alertracker->raise_alert(alert_atheros_rsnloop_ref, 
@@ -1806,10 +1847,10 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
         }
 
         // IE 54 Mobility
-        if (ie_tag->tag_num() == 54) {
+        if (ie_tag.tag_num() == 54) {
             try {
                 std::shared_ptr<dot11_ie_54_mobility> mobility(new dot11_ie_54_mobility());
-                mobility->parse(ie_tag->tag_data_stream());
+                mobility->parse(ie_tag.tag_data_stream());
                 packinfo->dot11r_mobility = mobility;
             } catch (const std::exception& e) {
                 packinfo->corrupt = 1;
@@ -1819,10 +1860,10 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
         }
 
         // IE 61 HT
-        if (ie_tag->tag_num() == 61) {
+        if (ie_tag.tag_num() == 61) {
             try {
                 std::shared_ptr<dot11_ie_61_ht_op> ht(new dot11_ie_61_ht_op());
-                ht->parse(ie_tag->tag_data_stream());
+                ht->parse(ie_tag.tag_data_stream());
                 packinfo->dot11ht = ht;
             } catch (const std::exception& e) {
                 // fprintf(stderr, "debug - unparsable HT\n");
@@ -1834,10 +1875,10 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
         }
 
         // IE 133 CISCO CCX
-        if (ie_tag->tag_num() == 133) {
+        if (ie_tag.tag_num() == 133) {
             try {
                 std::shared_ptr<dot11_ie_133_cisco_ccx> ccx1(new dot11_ie_133_cisco_ccx());
-                ccx1->parse(ie_tag->tag_data_stream());
+                ccx1->parse(ie_tag.tag_data_stream());
                 packinfo->beacon_info = munge_to_printable(ccx1->ap_name());
             } catch (const std::exception& e) {
                 // fprintf(stderr, "debug - ccx error %s\n", e.what());
@@ -1847,13 +1888,13 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
             continue;
         }
 
-        if (ie_tag->tag_num() == 127) {
-            if (ie_tag->tag_len() > 11) {
+        if (ie_tag.tag_num() == 127) {
+            if (ie_tag.tag_len() > 11) {
                 std::string al = fmt::format("IEEE80211 Access Point BSSID {} sent a beacon with "
                     "an invalid IE 127 Extended Capabilities tag; this may indicate attempts to "
                     "exploit Qualcomm drivers using the CVE-2019-10539 vulnerability.  Extended "
                     "capability tags should typically have 10-11 bytes, but saw {}.",
-                    packinfo->bssid_mac, ie_tag->tag_len());
+                    packinfo->bssid_mac, ie_tag.tag_len());
 
                 alertracker->raise_alert(alert_qcom_extended_ref, in_pack, 
                         packinfo->bssid_mac, packinfo->source_mac, 
@@ -1865,10 +1906,10 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
 
         // IE 191 VHT Capabilities TODO compbine with VHT OP to derive actual usable
         // rate
-        if (ie_tag->tag_num() == 191) {
+        if (ie_tag.tag_num() == 191) {
             try {
                 std::shared_ptr<dot11_ie_191_vht_cap> vht(new dot11_ie_191_vht_cap());
-                vht->parse(ie_tag->tag_data_stream());
+                vht->parse(ie_tag.tag_data_stream());
 
                 bool gi80 = vht->vht_cap_80mhz_shortgi();
                 bool gi160 = vht->vht_cap_160mhz_shortgi();
@@ -1943,15 +1984,11 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
 
 
         // Vendor 150 collection
-        if (ie_tag->tag_num() == 150) {
+        if (ie_tag.tag_num() == 150) {
             try {
-                auto vendor = std::make_shared<dot11_ie_150_vendor>();
-                ie_tag->tag_data_stream()->seek(0);
-                vendor->parse(ie_tag->tag_data_stream());
-
-                if (vendor->vendor_oui_int() == dot11_ie_150_cisco_powerlevel::cisco_oui()) {
+                if (ie_tag.vendor_oui_int() == dot11_ie_150_cisco_powerlevel::cisco_oui()) {
                     auto ccx_power = std::make_shared<dot11_ie_150_cisco_powerlevel>();
-                    ccx_power->parse(vendor->vendor_tag_stream());
+                    ccx_power->parse(ie_tag.vendor_tag_stream());
 
                     packinfo->ccx_txpower = ccx_power->cisco_ccx_txpower();
                 }
@@ -1962,10 +1999,10 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
         }
 
         // IE 192 VHT Operation
-        if (ie_tag->tag_num() == 192) {
+        if (ie_tag.tag_num() == 192) {
             try {
                 auto vht = std::make_shared<dot11_ie_192_vht_op>();
-                vht->parse(ie_tag->tag_data_stream());
+                vht->parse(ie_tag.tag_data_stream());
                 packinfo->dot11vht = vht;
 
             } catch (const std::exception& e) {
@@ -1976,17 +2013,13 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
             continue;
         }
 
-        if (ie_tag->tag_num() == 221) {
+        if (ie_tag.tag_num() == 221) {
             try {
-                auto vendor = std::make_shared<dot11_ie_221_vendor>();
-                ie_tag->tag_data_stream()->seek(0);
-                vendor->parse(ie_tag->tag_data_stream());
-
                 // Match mis-sized WMM
                 if (packinfo->subtype == packet_sub_beacon &&
-                        vendor->vendor_oui_int() == 0x0050f2 &&
-                        vendor->vendor_oui_type() == 2 &&
-                        ie_tag->tag_data().length() > 24) {
+                        ie_tag.vendor_oui_int() == 0x0050f2 &&
+                        ie_tag.vendor_oui_type() == 2 &&
+                        ie_tag.tag_data().length() > 24) {
 
                     std::string al = "IEEE80211 Access Point BSSID " + 
                         packinfo->bssid_mac.mac_to_string() + " sent association "
@@ -2004,11 +2037,10 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
                 // CVE-2017-11013 
                 // https://pleasestopnamingvulnerabilities.com/
                 if (packinfo->subtype == packet_sub_association_resp &&
-                        vendor->vendor_oui_int() == 0x0050f2 &&
-                        vendor->vendor_oui_type() == 2) {
+                        ie_tag.vendor_oui_int() == 0x0050f2 &&
+                        ie_tag.vendor_oui_type() == 2) {
                     dot11_ie_221_ms_wmm wmm;
-                    vendor->vendor_tag_stream()->seek(0);
-                    wmm.parse(vendor->vendor_tag_stream());
+                    wmm.parse(ie_tag.vendor_tag_stream());
 
                     if (wmm.wme_subtype() == 0x02) {
                         wmmtspec_responses++;
@@ -2031,20 +2063,18 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
                 }
 
                 // Look for DJI DroneID OUIs
-                if (vendor->vendor_oui_int() == dot11_ie_221_dji_droneid::vendor_oui()) {
+                if (ie_tag.vendor_oui_int() == dot11_ie_221_dji_droneid::vendor_oui()) {
                     std::shared_ptr<dot11_ie_221_dji_droneid> droneid(new dot11_ie_221_dji_droneid());
-                    vendor->vendor_tag_stream()->seek(0);
-                    droneid->parse(vendor->vendor_tag_stream());
+                    droneid->parse(ie_tag.vendor_tag_stream());
 
                     packinfo->droneid = droneid;
                 }
 
                 // Look for MS/WFA WPA
-                if (vendor->vendor_oui_int() == dot11_ie_221_wfa_wpa::ms_wps_oui() && 
-                        vendor->vendor_oui_type() == dot11_ie_221_wfa_wpa::wfa_wpa_subtype()) {
+                if (ie_tag.vendor_oui_int() == dot11_ie_221_wfa_wpa::ms_wps_oui() && 
+                        ie_tag.vendor_oui_type() == dot11_ie_221_wfa_wpa::wfa_wpa_subtype()) {
                     std::shared_ptr<dot11_ie_221_wfa_wpa> wpa(new dot11_ie_221_wfa_wpa());
-                    vendor->vendor_tag_stream()->seek(0);
-                    wpa->parse(vendor->vendor_tag_stream());
+                    wpa->parse(ie_tag.vendor_tag_stream());
 
                     // Merge the group cipher
                     packinfo->cryptset |= 
@@ -2071,43 +2101,40 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
                 }
 
                 // Look for cisco client MFP
-                if (vendor->vendor_oui_int() == dot11_ie_221_cisco_client_mfp::cisco_oui() &&
-                        vendor->vendor_oui_type() == dot11_ie_221_cisco_client_mfp::client_mfp_subtype()) {
+                if (ie_tag.vendor_oui_int() == dot11_ie_221_cisco_client_mfp::cisco_oui() &&
+                        ie_tag.vendor_oui_type() == dot11_ie_221_cisco_client_mfp::client_mfp_subtype()) {
                     auto mfp = std::make_shared<dot11_ie_221_cisco_client_mfp>();
-                    vendor->vendor_tag_stream()->seek(0);
-                    mfp->parse(vendor->vendor_tag_stream());
+                    mfp->parse(ie_tag.vendor_tag_stream());
 
                     packinfo->cisco_client_mfp = mfp->client_mfp();
                 }
 
                 // Look for wpa owe transitional tags
-                if (vendor->vendor_oui_int() == dot11_ie_221_owe_transition::vendor_oui()) {
-                    if (vendor->vendor_oui_type() == dot11_ie_221_owe_transition::owe_transition_subtype()) {
+                if (ie_tag.vendor_oui_int() == dot11_ie_221_owe_transition::vendor_oui()) {
+                    if (ie_tag.vendor_oui_type() == dot11_ie_221_owe_transition::owe_transition_subtype()) {
                         auto owe_trans = std::make_shared<dot11_ie_221_owe_transition>();
-                        vendor->vendor_tag_stream()->seek(0);
-                        owe_trans->parse(vendor->vendor_tag_stream());
+                        owe_trans->parse(ie_tag.vendor_tag_stream());
                         packinfo->owe_transition = owe_trans;
                         packinfo->cryptset |= crypt_wpa_owe;
                     }
                 }
 
                 // Look for WFA p2p to check the rtlwifi exploit
-                if (vendor->vendor_oui_int() == dot11_ie_221_wfa::wfa_oui()) {
+                if (ie_tag.vendor_oui_int() == dot11_ie_221_wfa::wfa_oui()) {
                     auto wfa = std::make_shared<dot11_ie_221_wfa>();
-                    vendor->vendor_tag_stream()->seek(0);
-                    wfa->parse(vendor->vendor_tag_stream());
+                    wfa->parse(ie_tag.vendor_tag_stream());
 
                     if (wfa->wfa_subtype() == dot11_ie_221_wfa::wfa_sub_p2p()) {
                         std::shared_ptr<dot11_wfa_p2p_ie> ietags(new dot11_wfa_p2p_ie());
                         ietags->parse(wfa->wfa_content_stream());
 
-                        for (auto ie_tag : *(ietags->tags())) {
-                            if (ie_tag->tag_num() == 12) {
+                        for (auto p2p_tag : *(ietags->tags())) {
+                            if (p2p_tag->tag_num() == 12) {
                                 // Affected code in rtlwifi:
                                 // noa_num = (noa_len - 2) / 13;
                                 // if (noa_num > P2P_MAX_NOA_NUM) 
                                 // and P2P_MAX_NOA_NUM is 2, therefor:
-                                if (ie_tag->tag_len() > 28) {
+                                if (p2p_tag->tag_len() > 28) {
                                     alertracker->raise_alert(alert_rtlwifi_p2p_ref, in_pack,
                                             packinfo->bssid_mac, packinfo->source_mac, 
                                             packinfo->dest_mac, packinfo->other_mac,
@@ -2122,11 +2149,10 @@ int kis_80211_phy::packet_dot11_ie_dissector(kis_packet *in_pack, dot11_packinfo
                 }
 
                 // Look for WPS MS
-                if (vendor->vendor_oui_int() == dot11_ie_221_ms_wps::ms_wps_oui() && 
-                        vendor->vendor_oui_type() == dot11_ie_221_ms_wps::ms_wps_subtype()) {
+                if (ie_tag.vendor_oui_int() == dot11_ie_221_ms_wps::ms_wps_oui() && 
+                        ie_tag.vendor_oui_type() == dot11_ie_221_ms_wps::ms_wps_subtype()) {
                     auto wps = std::make_shared<dot11_ie_221_ms_wps>();
-                    vendor->vendor_tag_stream()->seek(0);
-                    wps->parse(vendor->vendor_tag_stream());
+                    wps->parse(ie_tag.vendor_tag_stream());
 
                     for (auto wpselem : *(wps->wps_elements())) {
                         auto version = wpselem->sub_element_version();
@@ -2795,19 +2821,15 @@ std::shared_ptr<dot11_tracked_eapol>
                     }
                 }
 
-                std::shared_ptr<dot11_ie> ietags(new dot11_ie());
-                ietags->parse(rsnkey->wpa_key_data_stream());
-
-                for (auto ie_tag : *(ietags->tags())) {
-                    if (ie_tag->tag_num() == 221) {
-                        auto vendor = std::make_shared<dot11_ie_221_vendor>();
-                        ie_tag->tag_data_stream()->seek(0);
-                        vendor->parse(ie_tag->tag_data_stream());
+                dot11_ie ietags;
+                ietags.parse(rsnkey->wpa_key_data());
 
-                        if (vendor->vendor_oui_int() == dot11_ie_221_rsn_pmkid::vendor_oui() &&
-                                vendor->vendor_oui_type() == dot11_ie_221_rsn_pmkid::rsnpmkid_subtype()) {
+                for (const auto& ie_tag : ietags) {
+                    if (ie_tag.tag_num() == 221 && ie_tag.has_vendor_oui()) {
+                        if (ie_tag.vendor_oui_int() == dot11_ie_221_rsn_pmkid::vendor_oui() &&
+                                ie_tag.vendor_oui_type() == dot11_ie_221_rsn_pmkid::rsnpmkid_subtype()) {
                             dot11_ie_221_rsn_pmkid pmkid;
-                            pmkid.parse(vendor->vendor_tag_stream());
+                            pmkid.parse(ie_tag.vendor_tag_stream());
 
                             // Log the pmkid for the decoders
                             eapol->set_rsnpmkid_bytes(pmkid.pmkid());
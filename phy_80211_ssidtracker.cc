@@ -153,7 +153,7 @@ phy_80211_ssid_tracker::~phy_80211_ssid_tracker() {
 void phy_80211_ssid_tracker::ssid_endpoint_handler(std::shared_ptr<kis_net_beast_httpd_connection> con) {
     std::ostream stream(&con->response_stream());
 
-    auto summary_vec = std::vector<SharedElementSummary>{};
+    auto summary_vec = summary_plan{std::make_shared<std::vector<SharedElementSummary>>()};
     auto rename_map = std::make_shared<tracker_element_serializer::rename_map>();
 
     time_t timestamp_min = 0;
@@ -182,21 +182,10 @@ void phy_80211_ssid_tracker::ssid_endpoint_handler(std::shared_ptr<kis_net_beast
 
     try {
         // If the structured component has a 'fields' record, derive the fields simplification; we need this to
-        // compute the search path so we have to implement our own copy of the code
+        // compute the search path so we fetch the plan ourselves instead of using summarize_with_json
         auto fields = con->json().get("fields", Json::Value(Json::arrayValue));
 
-        for (const auto& i : fields) {
-            if (i.isString()) {
-                summary_vec.push_back(std::make_shared<tracker_element_summary>(i.asString()));
-            } else if (i.isArray()) {
-                if (i.size() != 2) 
-                    throw std::runtime_error("Invalid field map, expected [field, rename]");
-
-                summary_vec.push_back(std::make_shared<tracker_element_summary>(i[0].asString(), i[1].asString()));
-            } else {
-                throw std::runtime_error("Invalid field map, exected field or [field, rename]");
-            }
-        }
+        summary_vec = Globalreg::globalreg->entrytracker->get_summary_plan(fields);
 
         // Capture timestamp and negative-offset timestamp
         auto raw_ts = con->json().get("last_time", 0).asInt64();
@@ -236,7 +225,7 @@ void phy_80211_ssid_tracker::ssid_endpoint_handler(std::shared_ptr<kis_net_beast
 
         // Search every field we return
         if (search_term.length() != 0) 
-            for (const auto& svi : summary_vec)
+            for (const auto& svi : *summary_vec)
                 search_paths.push_back(svi->resolved_path);
 
         // We only allow ordering by a single column, we don't do sub-ordering;
@@ -381,7 +370,7 @@ void phy_80211_ssid_tracker::ssid_endpoint_handler(std::shared_ptr<kis_net_beast
 
     // Summarize into the output element
     for (auto i = si; i != ei; ++i) {
-        output_ssids_elem->push_back(summarize_tracker_element(*i, summary_vec, rename_map));
+        output_ssids_elem->push_back(summarize_tracker_element(*i, *summary_vec, rename_map));
     }
 
     // If the transmit wasn't assigned to a wrapper...
@@ -39,6 +39,7 @@
 #include "alertracker.h"
 
 #include "phy_btle.h"
+#include "kis_crc.h"
 
 #include "kaitai/kaitaistream.h"
 #include "bluetooth_parsers/btle.h"
@@ -77,62 +78,17 @@ public:
  *           payload_len is the Length field from the BTLE PDU header
  *           crc_init as defined in the specifications
  *
- * This implementation operates on nibbles and is therefore
- * endian-neutral.
- *
- * Taken from the Wireshark implementation
+ * The LFSR is advanced a byte at a time by the shared crc engine, which is
+ * derived from the nibble-serial Wireshark implementation.
  */
 uint32_t kis_btle_phy::calc_btle_crc(uint32_t crc_init, uint8_t *payload, size_t len) {
-    static const uint16_t btle_crc_next_state_flips[256] = {
-        0x0000, 0x32d8, 0x196c, 0x2bb4, 0x0cb6, 0x3e6e, 0x15da, 0x2702,
-        0x065b, 0x3483, 0x1f37, 0x2def, 0x0aed, 0x3835, 0x1381, 0x2159,
-        0x065b, 0x3483, 0x1f37, 0x2def, 0x0aed, 0x3835, 0x1381, 0x2159,
-        0x0000, 0x32d8, 0x196c, 0x2bb4, 0x0cb6, 0x3e6e, 0x15da, 0x2702,
-        0x0cb6, 0x3e6e, 0x15da, 0x2702, 0x0000, 0x32d8, 0x196c, 0x2bb4,
-        0x0aed, 0x3835, 0x1381, 0x2159, 0x065b, 0x3483, 0x1f37, 0x2def,
-        0x0aed, 0x3835, 0x1381, 0x2159, 0x065b, 0x3483, 0x1f37, 0x2def,
-        0x0cb6, 0x3e6e, 0x15da, 0x2702, 0x0000, 0x32d8, 0x196c, 0x2bb4,
-        0x196c, 0x2bb4, 0x0000, 0x32d8, 0x15da, 0x2702, 0x0cb6, 0x3e6e,
-        0x1f37, 0x2def, 0x065b, 0x3483, 0x1381, 0x2159, 0x0aed, 0x3835,
-        0x1f37, 0x2def, 0x065b, 0x3483, 0x1381, 0x2159, 0x0aed, 0x3835,
-        0x196c, 0x2bb4, 0x0000, 0x32d8, 0x15da, 0x2702, 0x0cb6, 0x3e6e,
-        0x15da, 0x2702, 0x0cb6, 0x3e6e, 0x196c, 0x2bb4, 0x0000, 0x32d8,
-        0x1381, 0x2159, 0x0aed, 0x3835, 0x1f37, 0x2def, 0x065b, 0x3483,
-        0x1381, 0x2159, 0x0aed, 0x3835, 0x1f37, 0x2def, 0x065b, 0x3483,
-        0x15da, 0x2702, 0x0cb6, 0x3e6e, 0x196c, 0x2bb4, 0x0000, 0x32d8,
-        0x32d8, 0x0000, 0x2bb4, 0x196c, 0x3e6e, 0x0cb6, 0x2702, 0x15da,
-        0x3483, 0x065b, 0x2def, 0x1f37, 0x3835, 0x0aed, 0x2159, 0x1381,
-        0x3483, 0x065b, 0x2def, 0x1f37, 0x3835, 0x0aed, 0x2159, 0x1381,
-        0x32d8, 0x0000, 0x2bb4, 0x196c, 0x3e6e, 0x0cb6, 0x2702, 0x15da,
-        0x3e6e, 0x0cb6, 0x2702, 0x15da, 0x32d8, 0x0000, 0x2bb4, 0x196c,
-        0x3835, 0x0aed, 0x2159, 0x1381, 0x3483, 0x065b, 0x2def, 0x1f37,
-        0x3835, 0x0aed, 0x2159, 0x1381, 0x3483, 0x065b, 0x2def, 0x1f37,
-        0x3e6e, 0x0cb6, 0x2702, 0x15da, 0x32d8, 0x0000, 0x2bb4, 0x196c,
-        0x2bb4, 0x196c, 0x32d8, 0x0000, 0x2702, 0x15da, 0x3e6e, 0x0cb6,
-        0x2def, 0x1f37, 0x3483, 0x065b, 0x2159, 0x1381, 0x3835, 0x0aed,
-        0x2def, 0x1f37, 0x3483, 0x065b, 0x2159, 0x1381, 0x3835, 0x0aed,
-        0x2bb4, 0x196c, 0x32d8, 0x0000, 0x2702, 0x15da, 0x3e6e, 0x0cb6,
-        0x2702, 0x15da, 0x3e6e, 0x0cb6, 0x2bb4, 0x196c, 0x32d8, 0x0000,
-        0x2159, 0x1381, 0x3835, 0x0aed, 0x2def, 0x1f37, 0x3483, 0x065b,
-        0x2159, 0x1381, 0x3835, 0x0aed, 0x2def, 0x1f37, 0x3483, 0x065b,
-        0x2702, 0x15da, 0x3e6e, 0x0cb6, 0x2bb4, 0x196c, 0x32d8, 0x0000
-    };
+    // Skip the access address
+    const size_t offset = 4;
 
-    uint8_t offset = 4;
-    uint32_t state = crc_init;
-
-    for (size_t pos = offset; pos < len; pos++) {
-        uint8_t byte = payload[pos];
-        uint8_t nibble = (byte & 0xF);
-        uint8_t byte_index = ((state >> 16) & 0xF0) | nibble;
-
-        state = ((state << 4) ^ btle_crc_next_state_flips[byte_index]) & 0xFFFFFF;
-        nibble = ((byte >> 4) & 0xF);
-        byte_index = ((state >> 16) & 0xF0) | nibble;
-        state = ((state << 4) ^ btle_crc_next_state_flips[byte_index]) & 0xFFFFFF;
-    }
+    if (len <= offset)
+        return crc_init & 0xFFFFFF;
 
-    return state;
+    return kis_crc::crc24_btle(crc_init, payload + offset, len - offset);
 }
 
 /*
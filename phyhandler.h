@@ -57,6 +57,11 @@ public:
     virtual void load_phy_storage(shared_tracker_element in_storage __attribute__((unused)), 
             shared_tracker_element in_device __attribute__((unused))) { }
 
+    // Called for the phy of a device which has been restored with its phy records
+    // intact, such as from a snapshot; phys should rebuild any state they keep
+    // outside of the device record
+    virtual void restore_phy_device(std::shared_ptr<kis_tracked_device_base> in_device __attribute__((unused))) { }
+
 protected:
     void set_phy_name(std::string in_phyname) {
         phyname = in_phyname;
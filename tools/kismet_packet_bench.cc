@@ -0,0 +1,783 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Offline packet chain benchmark
+ *
+ * Builds the core Kismet server globals headlessly (no webserver, no capture
+ * helpers, no plugins), loads an entire pcap or kismetdb file into memory, and
+ * pushes it through the packet chain as fast as the chain will take it.
+ *
+ * Reports the packet rate, the per-chain-stage and per-handler timing collected
+ * by the packet chain, the peak RSS, and the number of devices created, so that
+ * the packet path can be compared between builds with the same input.
+ */
+
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#ifdef HAVE_LIBPCAP
+#include <pcap.h>
+#endif
+
+#include <sqlite3.h>
+
+#include "getopt.h"
+#include "globalregistry.h"
+#include "configfile.h"
+#include "messagebus.h"
+#include "eventbus.h"
+#include "entrytracker.h"
+#include "timetracker.h"
+#include "kis_net_beast_httpd.h"
+#include "kis_httpd_registry.h"
+#include "messagebus_restclient.h"
+#include "streamtracker.h"
+#include "ipctracker_v2.h"
+#include "packetchain.h"
+#include "dlttracker.h"
+#include "antennatracker.h"
+#include "datasourcetracker.h"
+#include "datasource_virtual.h"
+#include "alertracker.h"
+#include "devicetracker.h"
+#include "channeltracker2.h"
+#include "gpstracker.h"
+#include "logtracker.h"
+#include "kis_databaselogfile.h"
+#include "kis_dlt_ppi.h"
+#include "kis_dlt_radiotap.h"
+#include "kis_dlt_btle_ll_radio.h"
+#include "kis_dissector_ipdata.h"
+#include "manuf.h"
+#include "json_adapter.h"
+#include "phy_80211.h"
+#include "phy_rtl433.h"
+#include "phy_rtlamr.h"
+#include "phy_rtladsb.h"
+#include "phy_zwave.h"
+#include "phy_bluetooth.h"
+#include "phy_uav_drone.h"
+#include "phy_nrf_mousejack.h"
+#include "phy_btle.h"
+#include "phy_802154.h"
+#include "sqlite3_cpp11.h"
+#include "trackedelement_storage.h"
+#include "version.h"
+
+#ifndef exec_name
+char *exec_name;
+#endif
+
+struct bench_packet {
+    struct timeval ts;
+    unsigned int dlt;
+    std::string data;
+};
+
+void print_help(char *argv) {
+    printf("Kismet packet chain benchmark\n");
+    printf("Load a pcap or kismetdb file into memory and push it through the Kismet packet\n"
+           "chain as fast as possible, reporting throughput and per-stage timing\n");
+    printf("usage: %s [OPTION]\n", argv);
+    printf(" -r, --pcap [filename]          Input pcap or pcapng file\n"
+           " -k, --kismetdb [filename]      Input kismetdb file\n"
+           " -f, --config-file [filename]   Kismet config file (defaults to the installed\n"
+           "                                kismet.conf)\n"
+           " -l, --log-kismetdb [filename]  Also log to a kismetdb file while processing\n"
+           " -n, --repeat [count]           Push the input through the chain [count] times\n"
+           " -w, --window [count]           Maximum packets in flight in the chain (default 4096)\n"
+           " -t, --timeout [seconds]        Give up when no packets complete the chain for\n"
+           "                                [seconds] (default 10)\n"
+           " -H, --handlers                 Report per-handler timing as well as per-stage\n"
+           " -V, --verify                   After processing, check the device view sort\n"
+           "                                indexes against a full sort, and round-trip every\n"
+           "                                device through the hibernation and snapshot formats,\n"
+           "                                and compare the buffered JSON writer with pack()\n"
+           " -v, --verbose                  Show Kismet informational messages\n"
+           "\n"
+           "Repeated passes are subject to the normal duplicate packet filtering; small\n"
+           "inputs repeated faster than the packet_dedup_window will be counted as duplicates.\n"
+          );
+}
+
+bool load_pcap(const std::string& in_fname, std::vector<bench_packet>& packets) {
+#ifdef HAVE_LIBPCAP
+    char errbuf[PCAP_ERRBUF_SIZE];
+
+    auto pd = pcap_open_offline(in_fname.c_str(), errbuf);
+
+    if (pd == nullptr) {
+        fmt::print(stderr, "ERROR: Could not open pcap file '{}': {}\n", in_fname, errbuf);
+        return false;
+    }
+
+    auto dlt = pcap_datalink(pd);
+
+    struct pcap_pkthdr *hdr;
+    const u_char *data;
+    int r;
+
+    while ((r = pcap_next_ex(pd, &hdr, &data)) >= 0) {
+        if (r == 0)
+            continue;
+
+        bench_packet p;
+        p.ts = hdr->ts;
+        p.dlt = dlt;
+        p.data = std::string((const char *) data, hdr->caplen);
+
+        packets.push_back(std::move(p));
+    }
+
+    if (r == -1)
+        fmt::print(stderr, "WARNING: Error reading pcap file '{}': {}\n", in_fname, pcap_geterr(pd));
+
+    pcap_close(pd);
+
+    return true;
+#else
+    fmt::print(stderr, "ERROR: Kismet was compiled without libpcap, only kismetdb input is "
+            "available\n");
+    return false;
+#endif
+}
+
+bool load_kismetdb(const std::string& in_fname, std::vector<bench_packet>& packets) {
+    using namespace kissqlite3;
+
+    sqlite3 *db;
+
+    if (sqlite3_open_v2(in_fname.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        fmt::print(stderr, "ERROR: Could not open kismetdb file '{}': {}\n",
+                in_fname, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return false;
+    }
+
+    try {
+        auto packets_q = _SELECT(db, "packets", {"ts_sec", "ts_usec", "dlt", "packet"});
+
+        for (auto p : packets_q) {
+            bench_packet bp;
+
+            bp.ts.tv_sec = sqlite3_column_as<unsigned long>(p, 0);
+            bp.ts.tv_usec = sqlite3_column_as<unsigned long>(p, 1);
+            bp.dlt = sqlite3_column_as<unsigned int>(p, 2);
+            bp.data = sqlite3_column_as<std::string>(p, 3);
+
+            packets.push_back(std::move(bp));
+        }
+    } catch (const std::exception& e) {
+        fmt::print(stderr, "ERROR: Could not read packets from kismetdb file '{}': {}\n",
+                in_fname, e.what());
+        sqlite3_close(db);
+        return false;
+    }
+
+    sqlite3_close(db);
+
+    return true;
+}
+
+// Peak resident size in bytes
+uint64_t peak_rss() {
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) < 0)
+        return 0;
+
+#ifdef SYS_DARWIN
+    return ru.ru_maxrss;
+#else
+    return (uint64_t) ru.ru_maxrss * 1024;
+#endif
+}
+
+void print_timing(const std::string& in_title, std::shared_ptr<tracker_element_vector> in_vec,
+        std::shared_ptr<entry_tracker> entrytracker) {
+    auto name_id = entrytracker->get_field_id("kismet.packetchain.handler.name");
+    auto chain_id = entrytracker->get_field_id("kismet.packetchain.handler.chain");
+    auto calls_id = entrytracker->get_field_id("kismet.packetchain.handler.calls");
+    auto avg_id = entrytracker->get_field_id("kismet.packetchain.handler.avg_ns");
+    auto p50_id = entrytracker->get_field_id("kismet.packetchain.handler.p50_ns");
+    auto p99_id = entrytracker->get_field_id("kismet.packetchain.handler.p99_ns");
+    auto max_id = entrytracker->get_field_id("kismet.packetchain.handler.max_ns");
+
+    if (in_vec == nullptr)
+        return;
+
+    fmt::print("\n{}\n", in_title);
+    fmt::print("  {:<52} {:>12} {:>10} {:>10} {:>10} {:>12}\n",
+            "name", "calls", "avg ns", "p50 ns", "p99 ns", "max ns");
+
+    for (const auto& e : *in_vec) {
+        auto m = std::static_pointer_cast<tracker_element_map>(e);
+
+        auto name = m->get_sub_as<tracker_element_string>(name_id)->get();
+        auto chain = m->get_sub_as<tracker_element_string>(chain_id)->get();
+
+        if (name != chain)
+            name = fmt::format("{} [{}]", name, chain);
+
+        fmt::print("  {:<52} {:>12} {:>10} {:>10} {:>10} {:>12}\n",
+                name.substr(0, 52),
+                m->get_sub_as<tracker_element_uint64>(calls_id)->get(),
+                m->get_sub_as<tracker_element_uint64>(avg_id)->get(),
+                m->get_sub_as<tracker_element_uint64>(p50_id)->get(),
+                m->get_sub_as<tracker_element_uint64>(p99_id)->get(),
+                m->get_sub_as<tracker_element_uint64>(max_id)->get());
+    }
+}
+
+// Round-trip every device through a hibernation record and through a snapshot file, and
+// compare the JSON of the restored devices with the originals.  Returns a description of
+// the first difference, or an empty string.
+std::string verify_device_storage(std::shared_ptr<device_tracker> devicetracker) {
+    kis_lock_guard<kis_mutex> lk(devicetracker->get_devicelist_mutex(), "packet_bench verify_device_storage");
+
+    auto devices = devicetracker->fetch_all_devices();
+
+    auto to_json = [](const shared_tracker_element& e) -> std::string {
+        std::stringstream ss;
+        json_adapter::serializer().serialize(e, ss);
+        return ss.str();
+    };
+
+    FILE *fp = tmpfile();
+
+    if (fp == nullptr)
+        return fmt::format("could not open a temporary snapshot file: {}", kis_strerror_r(errno));
+
+    binary_tracker_element_writer writer(fp);
+
+    if (!writer.write_header()) {
+        fclose(fp);
+        return "could not write the snapshot header";
+    }
+
+    std::vector<std::string> device_json;
+    std::string record;
+
+    for (const auto& d : *devices) {
+        auto key = std::static_pointer_cast<kis_tracked_device_base>(d)->get_key();
+
+        device_json.push_back(to_json(d));
+
+        record.clear();
+        serialize_binary_tracker_element(record, d);
+
+        try {
+            size_t pos = 0;
+            auto restored = deserialize_binary_tracker_element(record, pos);
+
+            if (restored == nullptr || to_json(restored) != device_json.back()) {
+                fclose(fp);
+                return fmt::format("device {} differs after restoring its hibernation record", key);
+            }
+        } catch (const std::exception& e) {
+            fclose(fp);
+            return fmt::format("device {} hibernation record could not be restored: {}", key, e.what());
+        }
+
+        writer.add(d);
+    }
+
+    if (!writer.finish()) {
+        fclose(fp);
+        return "could not write the snapshot";
+    }
+
+    rewind(fp);
+
+    binary_tracker_element_reader reader(fp);
+
+    if (!reader.read_header()) {
+        fclose(fp);
+        return "could not read the snapshot header";
+    }
+
+    try {
+        shared_tracker_element e;
+
+        for (size_t n = 0; n < device_json.size(); n++) {
+            if (!reader.next(e)) {
+                fclose(fp);
+                return fmt::format("snapshot ended after {} of {} devices", n, device_json.size());
+            }
+
+            if (e == nullptr || to_json(e) != device_json[n]) {
+                fclose(fp);
+                return fmt::format("device {} differs after restoring it from the snapshot",
+                        std::static_pointer_cast<kis_tracked_device_base>((*devices)[n])->get_key());
+            }
+        }
+
+        if (reader.next(e) || !reader.is_complete()) {
+            fclose(fp);
+            return "snapshot has trailing records or no end marker";
+        }
+    } catch (const std::exception& e) {
+        fclose(fp);
+        return fmt::format("snapshot could not be restored: {}", e.what());
+    }
+
+    fclose(fp);
+
+    return "";
+}
+
+// Serialize every device with the buffered JSON writer and with the reference packer, 
+// using both the kismet and elk field names, and compare the output byte for byte.
+// Returns a description of the first difference, or an empty string.
+std::string verify_json_writer(std::shared_ptr<device_tracker> devicetracker) {
+    kis_lock_guard<kis_mutex> lk(devicetracker->get_devicelist_mutex(), "packet_bench verify_json_writer");
+
+    auto devices = devicetracker->fetch_all_devices();
+
+    for (auto naming : {json_adapter::field_naming::kismet, json_adapter::field_naming::elk}) {
+        for (const auto& d : *devices) {
+            std::stringstream written, packed;
+
+            {
+                json_adapter::buffer_writer w(written, nullptr, naming);
+                w.pack(d);
+            }
+
+            json_adapter::pack(packed, d, nullptr, false, 0, naming);
+
+            auto w_str = written.str();
+            auto p_str = packed.str();
+
+            if (w_str == p_str)
+                continue;
+
+            auto mismatch = std::mismatch(w_str.begin(), w_str.end(), p_str.begin(), p_str.end());
+
+            return fmt::format("device {} {} JSON differs at byte {} of {}",
+                    std::static_pointer_cast<kis_tracked_device_base>(d)->get_key(),
+                    naming == json_adapter::field_naming::elk ? "elk" : "kismet",
+                    mismatch.first - w_str.begin(), p_str.length());
+        }
+    }
+
+    return "";
+}
+
+int main(int argc, char *argv[], char *envp[]) {
+    exec_name = argv[0];
+
+    static struct option longopt[] = {
+        { "pcap", required_argument, 0, 'r' },
+        { "kismetdb", required_argument, 0, 'k' },
+        { "config-file", required_argument, 0, 'f' },
+        { "log-kismetdb", required_argument, 0, 'l' },
+        { "repeat", required_argument, 0, 'n' },
+        { "window", required_argument, 0, 'w' },
+        { "timeout", required_argument, 0, 't' },
+        { "handlers", no_argument, 0, 'H' },
+        { "verify", no_argument, 0, 'V' },
+        { "verbose", no_argument, 0, 'v' },
+        { "help", no_argument, 0, 'h' },
+        { 0, 0, 0, 0 }
+    };
+
+    int option_idx = 0;
+
+    std::string pcap_fname, kismetdb_fname, config_fname, log_fname;
+    unsigned int repeat = 1;
+    unsigned int window = 4096;
+    unsigned int stall_timeout = 10;
+    bool show_handlers = false;
+    bool verify = false;
+    bool verbose = false;
+
+    while (1) {
+        int r = getopt_long(argc, argv, "r:k:f:l:n:w:t:HVvh", longopt, &option_idx);
+
+        if (r < 0)
+            break;
+
+        if (r == 'h') {
+            print_help(argv[0]);
+            exit(1);
+        } else if (r == 'r') {
+            pcap_fname = std::string(optarg);
+        } else if (r == 'k') {
+            kismetdb_fname = std::string(optarg);
+        } else if (r == 'f') {
+            config_fname = std::string(optarg);
+        } else if (r == 'l') {
+            log_fname = std::string(optarg);
+        } else if (r == 'n') {
+            if (sscanf(optarg, "%u", &repeat) != 1 || repeat == 0) {
+                fmt::print(stderr, "ERROR: Expected --repeat [count]\n");
+                exit(1);
+            }
+        } else if (r == 'w') {
+            if (sscanf(optarg, "%u", &window) != 1 || window == 0) {
+                fmt::print(stderr, "ERROR: Expected --window [count]\n");
+                exit(1);
+            }
+        } else if (r == 't') {
+            if (sscanf(optarg, "%u", &stall_timeout) != 1 || stall_timeout == 0) {
+                fmt::print(stderr, "ERROR: Expected --timeout [seconds]\n");
+                exit(1);
+            }
+        } else if (r == 'H') {
+            show_handlers = true;
+        } else if (r == 'V') {
+            verify = true;
+        } else if (r == 'v') {
+            verbose = true;
+        }
+    }
+
+    if ((pcap_fname.length() == 0) == (kismetdb_fname.length() == 0)) {
+        fmt::print(stderr, "ERROR: Expected one of --pcap or --kismetdb\n");
+        print_help(argv[0]);
+        exit(1);
+    }
+
+    std::vector<bench_packet> packets;
+
+    if (pcap_fname.length() && !load_pcap(pcap_fname, packets))
+        exit(1);
+
+    if (kismetdb_fname.length() && !load_kismetdb(kismetdb_fname, packets))
+        exit(1);
+
+    if (packets.size() == 0) {
+        fmt::print(stderr, "ERROR: No packets found in input\n");
+        exit(1);
+    }
+
+    uint64_t input_bytes = 0;
+    for (const auto& p : packets)
+        input_bytes += p.data.length();
+
+    fmt::print("Loaded {} packets ({} bytes)\n", packets.size(), input_bytes);
+
+    auto load_rss = peak_rss();
+
+    // Build the globalregistry; the remaining arguments are not intended for the
+    // Kismet components which parse argv themselves
+    Globalreg::globalreg = new global_registry;
+    auto globalreg = Globalreg::globalreg;
+
+    Globalreg::n_tracked_fields = 0;
+    Globalreg::n_tracked_components = 0;
+
+    globalreg->version_major = VERSION_MAJOR;
+    globalreg->version_minor = VERSION_MINOR;
+    globalreg->version_tiny = VERSION_TINY;
+    globalreg->version_git_rev = VERSION_GIT_COMMIT;
+    globalreg->build_date = VERSION_BUILD_TIME;
+
+    globalreg->argc = 1;
+    globalreg->argv = argv;
+    globalreg->envp = envp;
+
+    auto entrytracker = entry_tracker::create_entrytracker();
+
+    globalreg->server_uuid =
+        entrytracker->register_and_get_field_as<tracker_element_uuid>("kismet.server.uuid",
+                tracker_element_factory<tracker_element_uuid>(),
+                "unique server UUID");
+    uuid server_uuid;
+    server_uuid.generate_random_time_uuid();
+    globalreg->server_uuid->set(server_uuid);
+    globalreg->server_uuid_hash = server_uuid.hash;
+
+    auto eventbus = event_bus::create_eventbus();
+
+    auto messagebus = message_bus::create_messagebus();
+    globalreg->messagebus = messagebus;
+
+    eventbus->register_listener(message_bus::event_message(),
+            [verbose](std::shared_ptr<eventbus_event> evt) {
+                auto msg_k = evt->get_event_content()->find(message_bus::event_message());
+                if (msg_k == evt->get_event_content()->end())
+                    return;
+
+                auto msg = std::static_pointer_cast<tracked_message>(msg_k->second);
+
+                if (msg->get_flags() & (MSGFLAG_ERROR | MSGFLAG_FATAL))
+                    fmt::print(stderr, "ERROR: {}\n", msg->get_message());
+                else if (verbose)
+                    fmt::print(stderr, "INFO: {}\n", msg->get_message());
+            });
+
+    if (config_fname.length() == 0)
+        config_fname = fmt::format("{}/kismet.conf",
+                getenv("KISMET_CONF") != NULL ? getenv("KISMET_CONF") : SYSCONF_LOC);
+
+    auto conf = new config_file(globalreg);
+
+    if (conf->parse_config(config_fname) < 0) {
+        fmt::print(stderr, "ERROR: Could not load Kismet config file '{}'\n", config_fname);
+        exit(1);
+    }
+
+    globalreg->kismet_config = conf;
+
+    // Never shed load; the benchmark limits the packets in flight itself, and
+    // every packet has to make it through the chain for the counts to be valid
+    conf->set_opt("packet_backlog_limit", "0", false);
+
+    // Only log what we were asked to log
+    if (log_fname.length()) {
+        conf->set_opt("enable_logging", "true", false);
+        conf->set_opt("log_types", "kismet", false);
+        conf->set_opt("log_template", log_fname, false);
+    } else {
+        conf->set_opt("enable_logging", "false", false);
+    }
+
+    auto timetracker = time_tracker::create_timetracker();
+
+    // The webserver is never started, but most components register endpoints
+    kis_net_beast_httpd::create_httpd();
+
+    globalreg->manufdb = new kis_manuf();
+
+    entrytracker->register_serializer("json", std::make_shared<json_adapter::serializer>());
+
+    ipc_tracker_v2::create_ipctracker();
+    stream_tracker::create_streamtracker();
+    rest_message_client::create_messageclient();
+    kis_httpd_registry::create_http_registry();
+
+    auto packetchain = packet_chain::create_packetchain();
+
+    dlt_tracker::create_dltt();
+    antenna_tracker::create_at();
+
+    auto datasourcetracker = datasource_tracker::create_dst();
+
+    alert_tracker::create_alertracker();
+
+    auto devicetracker = device_tracker::create_device_tracker();
+
+    channel_tracker_v2::create_channeltracker(globalreg);
+
+    kis_dlt_ppi::create_dlt();
+    kis_dlt_radiotap::create_dlt();
+    kis_dlt_btle_ll_radio::create_dlt();
+
+    new kis_dissector_ip_data(globalreg);
+
+    devicetracker->register_phy_handler(new kis_80211_phy(globalreg));
+    devicetracker->register_phy_handler(new Kis_RTL433_Phy(globalreg));
+    devicetracker->register_phy_handler(new Kis_Zwave_Phy(globalreg));
+    devicetracker->register_phy_handler(new kis_bluetooth_phy(globalreg));
+    devicetracker->register_phy_handler(new Kis_UAV_Phy(globalreg));
+    devicetracker->register_phy_handler(new Kis_Mousejack_Phy(globalreg));
+    devicetracker->register_phy_handler(new kis_btle_phy(globalreg));
+    devicetracker->register_phy_handler(new kis_rtlamr_phy(globalreg));
+    devicetracker->register_phy_handler(new kis_rtladsb_phy(globalreg));
+    devicetracker->register_phy_handler(new kis_802154_phy(globalreg));
+
+    datasource_virtual_builder::create_virtualbuilder();
+
+    kis_database_logfile::create_kisdatabaselog();
+
+    auto logtracker = log_tracker::create_logtracker();
+    logtracker->register_log(shared_log_builder(new kis_database_logfile_builder()));
+
+    gps_tracker::create_gpsmanager();
+
+    globalreg->start_deferred();
+
+    if (globalreg->fatal_condition) {
+        fmt::print(stderr, "ERROR: Failed to initialize the Kismet components\n");
+        exit(1);
+    }
+
+    // All packets come from a single virtual source
+    auto virtual_builder = Globalreg::fetch_mandatory_global_as<datasource_virtual_builder>();
+    auto source = virtual_builder->build_datasource(virtual_builder);
+    auto virtual_source = std::static_pointer_cast<kis_datasource_virtual>(source);
+
+    uuid src_uuid;
+    src_uuid.generate_random_time_uuid();
+
+    virtual_source->set_virtual_hardware("benchmark");
+    source->set_source_uuid(src_uuid);
+    source->set_source_key(adler32_checksum(src_uuid.uuid_to_string()));
+    source->set_source_name(pcap_fname.length() ? pcap_fname : kismetdb_fname);
+    datasourcetracker->merge_source(source);
+    virtual_source->open_virtual_interface();
+
+    // Count packets as they leave the end of the chain
+    std::atomic<uint64_t> completed{0};
+
+    packetchain->register_handler([&completed](kis_packet *) -> int {
+                completed.fetch_add(1, std::memory_order_relaxed);
+                return 1;
+            }, CHAINPOS_LOGGING, 1000000, "packet_bench::complete");
+
+    auto pack_comp_linkframe = packetchain->register_packet_component("LINKFRAME");
+
+    timetracker->spawn_timetracker_thread();
+    packetchain->start_processing();
+
+    uint64_t total = (uint64_t) packets.size() * repeat;
+    uint64_t pushed = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Packets dropped before the logging stage never complete; rather than spinning
+    // forever, give up once the completed count stops moving for the stall timeout
+    uint64_t last_completed = 0;
+    auto last_progress = start;
+    bool stalled = false;
+
+    auto wait_completed = [&](uint64_t target) -> bool {
+        uint64_t c;
+
+        while ((c = completed.load(std::memory_order_relaxed)) < target) {
+            auto now = std::chrono::steady_clock::now();
+
+            if (c != last_completed) {
+                last_completed = c;
+                last_progress = now;
+            } else if (now - last_progress >= std::chrono::seconds(stall_timeout)) {
+                return false;
+            }
+
+            std::this_thread::yield();
+        }
+
+        return true;
+    };
+
+    for (unsigned int n = 0; n < repeat && !stalled; n++) {
+        for (const auto& p : packets) {
+            if (pushed >= window && !wait_completed(pushed - window + 1)) {
+                stalled = true;
+                break;
+            }
+
+            auto packet = packetchain->generate_packet();
+            packet->ts = p.ts;
+
+            auto chunk = packetchain->generate_datachunk();
+            chunk->dlt = p.dlt;
+            chunk->set_data(const_cast<char *>(p.data.data()), p.data.length(), false);
+            packet->insert(pack_comp_linkframe, chunk);
+
+            source->handle_rx_packet(packet);
+
+            pushed++;
+        }
+    }
+
+    if (!stalled && !wait_completed(total))
+        stalled = true;
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(
+            std::chrono::steady_clock::now() - start).count();
+
+    int ret = 0;
+    double total_bytes = (double) input_bytes * repeat;
+
+    if (stalled) {
+        fmt::print(stderr, "\nERROR: No packets completed the chain for {} seconds; {} of {} "
+                "packets completed ({} pushed)\n", stall_timeout,
+                completed.load(std::memory_order_relaxed), total, pushed);
+        total_bytes = total_bytes * completed.load(std::memory_order_relaxed) / total;
+        total = completed.load(std::memory_order_relaxed);
+        ret = 1;
+    }
+
+    fmt::print("\nProcessed {} packets in {:.3f} seconds\n", total, elapsed);
+    fmt::print("  {:.0f} packets/sec\n", elapsed > 0 ? total / elapsed : 0);
+    fmt::print("  {:.2f} MB/sec\n", elapsed > 0 ? total_bytes / elapsed / (1024 * 1024) : 0);
+    fmt::print("  {} devices\n", devicetracker->fetch_num_devices());
+    fmt::print("  {:.1f} MB peak RSS ({:.1f} MB after loading input)\n",
+            peak_rss() / (1024.0f * 1024.0f), load_rss / (1024.0f * 1024.0f));
+
+    auto stats = std::static_pointer_cast<tracker_element_map>(packetchain->fetch_handler_stats());
+
+    print_timing("Per-stage timing (sampled)",
+            stats->get_sub_as<tracker_element_vector>(entrytracker->get_field_id("kismet.packetchain.handler_stats.chains")),
+            entrytracker);
+
+    if (show_handlers)
+        print_timing("Per-handler timing (sampled)",
+                stats->get_sub_as<tracker_element_vector>(entrytracker->get_field_id("kismet.packetchain.handler_stats.handlers")),
+                entrytracker);
+
+    if (verify) {
+        fmt::print("\nVerifying\n");
+
+        auto err = devicetracker->verify_view_sort_indexes();
+
+        if (err.length()) {
+            fmt::print("  View sort indexes: FAILED, {}\n", err);
+            ret = 1;
+        } else {
+            fmt::print("  View sort indexes: ok\n");
+        }
+
+        err = verify_device_storage(devicetracker);
+
+        if (err.length()) {
+            fmt::print("  Device storage round trip: FAILED, {}\n", err);
+            ret = 1;
+        } else {
+            fmt::print("  Device storage round trip: ok\n");
+        }
+
+        err = verify_json_writer(devicetracker);
+
+        if (err.length()) {
+            fmt::print("  Buffered JSON writer: FAILED, {}\n", err);
+            ret = 1;
+        } else {
+            fmt::print("  Buffered JSON writer: ok\n");
+        }
+    }
+
+    if (log_fname.length())
+        devicetracker->databaselog_write_devices();
+
+    globalreg->shutdown_deferred();
+    globalreg->spindown = 1;
+
+    globalreg->delete_lifetime_globals();
+
+    globalreg->complete = true;
+
+    return ret;
+}
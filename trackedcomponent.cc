@@ -18,8 +18,26 @@
 
 #include "config.h"
 
+#include <mutex>
+#include <typeindex>
+#include <unordered_map>
+
 #include "trackedcomponent.h"
 
+namespace {
+    // Offsets of dynamic field members, per component class.  Dynamic members are only
+    // bound when their accessor builds them, so an element restored from storage has to
+    // be bound to its member by offset; see restore_field().  The offsets are the same
+    // for every instance, so each class is recorded once, by the first instance built
+    struct dynamic_binding {
+        int id;
+        ptrdiff_t offset;
+    };
+
+    kis_shared_mutex dynamic_binding_mutex;
+    std::unordered_map<std::type_index, std::vector<dynamic_binding>> dynamic_binding_map;
+}
+
 std::string tracker_component::get_name() {
     return Globalreg::globalreg->entrytracker->get_field_name(get_id());
 }
@@ -50,6 +68,15 @@ void tracker_component::reserve_fields(std::shared_ptr<tracker_element_map> e) {
     if (registered_fields == nullptr)
         return;
 
+    std::vector<dynamic_binding> bindings;
+    bool bound;
+
+    {
+        kis_lock_guard<kis_shared_mutex> lk(dynamic_binding_mutex, kismet::shared_lock,
+                "tracker_component reserve_fields");
+        bound = dynamic_binding_map.find(std::type_index(typeid(*this))) != dynamic_binding_map.end();
+    }
+
     for (auto& rf : *registered_fields) {
         if (rf->assign != nullptr) {
             // We use negative IDs to indicate dynamic to eke out 4 more bytes
@@ -58,6 +85,10 @@ void tracker_component::reserve_fields(std::shared_ptr<tracker_element_map> e) {
                 // proxydynamictrackable can fill it in;
                 *(rf->assign) = nullptr;
                 insert(abs(rf->id), std::shared_ptr<tracker_element>());
+
+                if (!bound)
+                    bindings.push_back(dynamic_binding{abs(rf->id), 
+                            reinterpret_cast<char *>(rf->assign) - reinterpret_cast<char *>(this)});
             } else {
                 // otherwise generate a variable for the destination
                 *(rf->assign) = import_or_new(e, rf->id);
@@ -65,11 +96,36 @@ void tracker_component::reserve_fields(std::shared_ptr<tracker_element_map> e) {
         }
     }
 
+    // The most derived class reserves last, with the complete set of fields
+    if (bindings.size() != 0) {
+        kis_lock_guard<kis_shared_mutex> lk(dynamic_binding_mutex, "tracker_component reserve_fields");
+        dynamic_binding_map.emplace(std::type_index(typeid(*this)), std::move(bindings));
+    }
+
     // Remove all the registration records we've allocated
     delete registered_fields;
     registered_fields = nullptr;
 }
 
+void tracker_component::restore_field(shared_tracker_element e) {
+    insert(e);
+
+    kis_lock_guard<kis_shared_mutex> lk(dynamic_binding_mutex, kismet::shared_lock,
+            "tracker_component restore_field");
+
+    auto bi = dynamic_binding_map.find(std::type_index(typeid(*this)));
+
+    if (bi == dynamic_binding_map.end())
+        return;
+
+    for (const auto& b : bi->second) {
+        if (b.id == e->get_id()) {
+            *reinterpret_cast<shared_tracker_element *>(reinterpret_cast<char *>(this) + b.offset) = e;
+            return;
+        }
+    }
+}
+
 shared_tracker_element tracker_component::import_or_new(std::shared_ptr<tracker_element_map> e, int i) {
     shared_tracker_element r;
 
@@ -143,3 +199,60 @@ shared_tracker_element tracker_component::get_child_path(const std::vector<std::
     return next_elem;
 }
 
+
+shared_tracker_element tracker_flat_component::materialize_sub(int id) {
+    if (flat_fields == nullptr)
+        return nullptr;
+
+    for (const auto& ff : *flat_fields) {
+        if (ff.id == id)
+            return ff.make(ff.id, reinterpret_cast<const char *>(this) + ff.offset);
+    }
+
+    return nullptr;
+}
+
+size_t tracker_flat_component::num_flat_fields() const {
+    if (flat_fields == nullptr)
+        return 0;
+
+    return flat_fields->size();
+}
+
+void tracker_flat_component::for_each_flat_field(const std::function<void (const shared_tracker_element&)>& fn) const {
+    if (flat_fields == nullptr)
+        return;
+
+    for (const auto& ff : *flat_fields)
+        fn(ff.make(ff.id, reinterpret_cast<const char *>(this) + ff.offset));
+}
+
+void tracker_flat_component::reserve_fields(std::shared_ptr<tracker_element_map> e) {
+    tracker_component::reserve_fields(e);
+
+    if (e == nullptr || e->get_type() != tracker_type::tracker_map || flat_fields == nullptr)
+        return;
+
+    // Absorb the values of any flat fields present in the imported element
+    for (const auto& ff : *flat_fields) {
+        auto v = e->find(ff.id);
+
+        if (v == e->end() || v->second == nullptr)
+            continue;
+
+        ff.load(v->second, reinterpret_cast<char *>(this) + ff.offset);
+    }
+}
+
+void tracker_flat_component::restore_field(shared_tracker_element e) {
+    if (flat_fields != nullptr) {
+        for (const auto& ff : *flat_fields) {
+            if (ff.id == e->get_id()) {
+                ff.load(e, reinterpret_cast<char *>(this) + ff.offset);
+                return;
+            }
+        }
+    }
+
+    tracker_component::restore_field(e);
+}
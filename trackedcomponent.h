@@ -687,6 +687,57 @@ class tracker_component : public tracker_element_map {
         return (dtype) (get_tracker_value<dtype>(cvar) & bs); \
     }
 
+// Proxy a flat field held in plain storage in a tracker_flat_component.  There
+// is no element to hand out, so there is no get_tracker_<name> function.
+// Same arguments as __Proxy, but <cvar> is the plain variable, not an element
+#define __ProxyFlat(name, ptype, itype, rtype, cvar) \
+    virtual rtype get_##name() const { \
+        return (rtype) cvar; \
+    } \
+    virtual void set_##name(const itype& in) { \
+        cvar = static_cast<ptype>(in); \
+    }
+
+// Flat proxy which calls <lambda> after setting, as __ProxyL
+#define __ProxyFlatL(name, ptype, itype, rtype, cvar, lambda) \
+    virtual rtype get_##name() const { \
+        return (rtype) cvar; \
+    } \
+    virtual bool set_##name(const itype& in) { \
+        cvar = static_cast<ptype>(in); \
+        return lambda(in); \
+    } \
+    virtual void set_only_##name(const itype& in) { \
+        cvar = static_cast<ptype>(in); \
+    }
+
+// Flat increment and decrement functions
+#define __ProxyFlatIncDec(name, ptype, rtype, cvar) \
+    virtual void inc_##name() { \
+        cvar += 1; \
+    } \
+    virtual void inc_##name(rtype i) { \
+        cvar += (ptype) i; \
+    } \
+    virtual void dec_##name() { \
+        cvar -= 1; \
+    } \
+    virtual void dec_##name(rtype i) { \
+        cvar -= (ptype) i; \
+    }
+
+// Flat bitset functions
+#define __ProxyFlatBitset(name, dtype, cvar) \
+    virtual void bitset_##name(dtype bs) { \
+        cvar |= bs; \
+    } \
+    virtual void bitclear_##name(dtype bs) { \
+        cvar &= ~(bs); \
+    } \
+    virtual dtype bitcheck_##name(dtype bs) { \
+        return (dtype) (cvar & bs); \
+    }
+
 // Import from a builder instance and insert into our map
 #define __ImportField(f, b) \
     f = tracker_element_clone_adaptor(b->f); \
@@ -777,6 +828,10 @@ public:
     shared_tracker_element get_child_path(const std::string& in_path);
     shared_tracker_element get_child_path(const std::vector<std::string>& in_path);
 
+    // Adopt an element restored from storage as a field of this component, binding it
+    // to the member of a dynamic field when it is one
+    virtual void restore_field(shared_tracker_element e);
+
 protected:
     // Register a field via the entrytracker, using standard entrytracker build methods.
     // This field will be automatically assigned or created during the reservefields 
@@ -845,6 +900,97 @@ protected:
     std::vector<std::unique_ptr<registered_field>> *registered_fields;
 };
 
+// Tracker component with flat storage for scalar fields.
+//
+// Every field of a normal tracker_component is its own tracker_element, with its own
+// allocation, vtable, and map entry.  For records we hold hundreds of thousands of
+// (devices, per-source records) that adds up quickly, so a flat component keeps its
+// numeric fields as plain variables (typically in a POD struct member) instead.
+//
+// Flat fields are registered with register_flat_field(), which records the field id and
+// the offset of the variable in the object; the layout is shared with every clone of
+// the builder.  Flat fields are never in the map, so reading or serializing a component
+// never modifies it.  Serializers write them from for_each_flat_field() after the map
+// contents, and path lookups via get_sub() return a detached element holding the
+// current value, so summaries, sorting, and filters see the same field ids as before.
+//
+// Flat fields are accessed with the __ProxyFlat* macros.  Callers still need whatever
+// lock guards the component against writers, as for any other component.
+class tracker_flat_component : public tracker_component {
+protected:
+    class flat_field {
+    public:
+        int id;
+        ptrdiff_t offset;
+        shared_tracker_element (*make)(int id, const void *src);
+        void (*load)(const shared_tracker_element& e, void *dst);
+    };
+
+    using flat_field_vec = std::vector<flat_field>;
+
+    template<typename TE, typename V>
+    static shared_tracker_element flat_make(int id, const void *src) {
+        auto e = std::make_shared<TE>(id);
+        e->set(*reinterpret_cast<const V *>(src));
+        return e;
+    }
+
+    template<typename TE, typename V>
+    static void flat_load(const shared_tracker_element& e, void *dst) {
+        *reinterpret_cast<V *>(dst) = get_tracker_value<V>(e);
+    }
+
+public:
+    tracker_flat_component() :
+        tracker_component() { }
+
+    tracker_flat_component(int in_id) :
+        tracker_component(in_id) { }
+
+    tracker_flat_component(int in_id, std::shared_ptr<tracker_element_map> e) :
+        tracker_component(in_id, e) { }
+
+    tracker_flat_component(const tracker_flat_component *p) :
+        tracker_component(p),
+        flat_fields{p->flat_fields} { }
+
+    virtual ~tracker_flat_component() { }
+
+    virtual shared_tracker_element materialize_sub(int id) override;
+
+    virtual size_t num_flat_fields() const override;
+    virtual void for_each_flat_field(const std::function<void (const shared_tracker_element&)>& fn) const override;
+
+    // Restored flat fields are loaded into their variables instead of the map
+    virtual void restore_field(shared_tracker_element e) override;
+
+protected:
+    // Register a flat field of element type TE, backed by the plain variable in_dest,
+    // which must be a member of this object of the element's value type.
+    template<typename TE, typename V>
+    int register_flat_field(const std::string& in_name, const std::string& in_desc, V *in_dest) {
+        static_assert(std::is_same<V, typename std::remove_reference<decltype(std::declval<TE>().get())>::type>::value,
+                "flat field storage must match the element value type");
+
+        int id =
+            Globalreg::globalreg->entrytracker->register_field(in_name,
+                    tracker_element_factory<TE>(), in_desc);
+
+        if (flat_fields == nullptr)
+            flat_fields = std::make_shared<flat_field_vec>();
+
+        flat_fields->push_back(flat_field{id,
+                reinterpret_cast<char *>(in_dest) - reinterpret_cast<char *>(this),
+                &flat_make<TE, V>, &flat_load<TE, V>});
+
+        return id;
+    }
+
+    virtual void reserve_fields(std::shared_ptr<tracker_element_map> e) override;
+
+    std::shared_ptr<flat_field_vec> flat_fields;
+};
+
 
 
 #endif
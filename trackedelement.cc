@@ -143,6 +143,10 @@ bool tracker_element_string::less_than(const tracker_element_string& rhs) const
     return doj::alphanum_comp(value, rhs.value) < 0;
 }
 
+bool tracker_element_string::natural_less(const std::string& lhs, const std::string& rhs) {
+    return doj::alphanum_comp(lhs, rhs) < 0;
+}
+
 void tracker_element_uuid::coercive_set(const std::string& in_str) {
     uuid u(in_str);
 
@@ -616,12 +620,12 @@ template<> void set_tracker_value(const shared_tracker_element& e, const device_
     std::static_pointer_cast<tracker_element_device_key>(e)->set(v);
 }
 
-void tracker_element_serializer::pre_serialize_path(const SharedElementSummary& in_summary) {
+void tracker_element_serializer::pre_serialize_path(const rename_entry& in_rename) {
 
     // Iterate through the path on this object, calling pre-serialize as
     // necessary on each object in the summary path
 
-    shared_tracker_element inter = in_summary->parent_element;
+    shared_tracker_element inter = in_rename.parent;
 
     if (inter == nullptr)
         return;
@@ -631,7 +635,7 @@ void tracker_element_serializer::pre_serialize_path(const SharedElementSummary&
         inter = std::static_pointer_cast<tracker_element_alias>(inter)->get();
 
     try {
-        for (const auto& p : in_summary->resolved_path) {
+        for (const auto& p : in_rename.summary->resolved_path) {
 #if TE_TYPE_SAFETY == 1
             inter->enforce_type(tracker_type::tracker_map);
 #endif
@@ -653,12 +657,12 @@ void tracker_element_serializer::pre_serialize_path(const SharedElementSummary&
     }
 }
 
-void tracker_element_serializer::post_serialize_path(const SharedElementSummary& in_summary) {
+void tracker_element_serializer::post_serialize_path(const rename_entry& in_rename) {
 
     // Iterate through the path on this object, calling pre-serialize as
     // necessary on each object in the summary path
 
-    shared_tracker_element inter = in_summary->parent_element;
+    shared_tracker_element inter = in_rename.parent;
 
     if (inter == nullptr)
         return;
@@ -668,7 +672,7 @@ void tracker_element_serializer::post_serialize_path(const SharedElementSummary&
         inter = std::static_pointer_cast<tracker_element_alias>(inter)->get();
 
     try {
-        for (const auto& p : in_summary->resolved_path) {
+        for (const auto& p : in_rename.summary->resolved_path) {
 #if TE_TYPE_SAFETY == 1
             inter->enforce_type(tracker_type::tracker_map);
 #endif
@@ -691,9 +695,12 @@ void tracker_element_serializer::post_serialize_path(const SharedElementSummary&
 }
 
 tracker_element_summary::tracker_element_summary(const SharedElementSummary& in_c) {
-    parent_element = in_c->parent_element;
     resolved_path = in_c->resolved_path;
     rename = in_c->rename;
+    json_rename = in_c->json_rename;
+    ek_json_rename = in_c->ek_json_rename;
+    placeholder_id = in_c->placeholder_id;
+    placeholder_name = in_c->placeholder_name;
 }
 
 tracker_element_summary::tracker_element_summary(const std::string& in_path, 
@@ -1295,7 +1302,10 @@ std::shared_ptr<tracker_element> summarize_tracker_element(std::shared_ptr<track
 
         shared_tracker_element f = get_tracker_element_path(si->resolved_path, in);
 
-        if (f == nullptr) {
+        if (f == nullptr && si->placeholder_id >= 0) {
+            // Compiled summaries carry their placeholder field
+            f = std::make_shared<tracker_element_placeholder>(si->placeholder_id, si->placeholder_name);
+        } else if (f == nullptr) {
             f = Globalreg::globalreg->entrytracker->register_and_get_field(fmt::format("unknown{}", fn),
                     tracker_element_factory<tracker_element_placeholder>(),
                     "unallocated field");
@@ -1317,15 +1327,11 @@ std::shared_ptr<tracker_element> summarize_tracker_element(std::shared_ptr<track
         } 
 
        
-        // If we're renaming it or we're a path, we put the record in.  We need
-        // to duplicate the summary object and make a reference to our parent
-        // object so that when we serialize we can descend the path calling
-        // the proper pre-serialization methods
-        if (si->rename.length() != 0 || si->resolved_path.size() > 1) {
-            auto sum = std::make_shared<tracker_element_summary>(*si);
-            sum->parent_element = in;
-            (*rename_map)[f] = sum;
-        }
+        // If we're renaming it or we're a path, we put the record in.  We refer
+        // to the shared summary and to our parent object so that when we serialize
+        // we can descend the path calling the proper pre-serialization methods
+        if (si->rename.length() != 0 || si->resolved_path.size() > 1) 
+            (*rename_map)[f] = tracker_element_serializer::rename_entry{si, in};
 
         std::static_pointer_cast<tracker_element_map>(ret_elem)->insert(f);
     }
@@ -1338,22 +1344,10 @@ std::shared_ptr<tracker_element> summarize_tracker_element(std::shared_ptr<track
 std::shared_ptr<tracker_element> summarize_tracker_element_with_json(std::shared_ptr<tracker_element> data, 
         const Json::Value& json, std::shared_ptr<tracker_element_serializer::rename_map> rename_map) {
 
-    auto summary_vec = std::vector<SharedElementSummary>{};
-    auto fields = json.get("fields", Json::Value(Json::arrayValue));
-
-    for (const auto& i : fields) {
-        if (i.isString()) {
-            summary_vec.push_back(std::make_shared<tracker_element_summary>(i.asString()));
-        } else if (i.isArray()) {
-            if (i.size() != 2)
-                throw std::runtime_error("Invalid field mapping, expected [field, name]");
-            summary_vec.push_back(std::make_shared<tracker_element_summary>(i[0].asString(), i[1].asString()));
-        } else {
-            throw std::runtime_error("Invalid field mapping, expected field or [field,rename]");
-        }
-    }
+    auto summary_vec = 
+        Globalreg::globalreg->entrytracker->get_summary_plan(json.get("fields", Json::Value(Json::arrayValue)));
 
-    return summarize_tracker_element(data, summary_vec, rename_map);
+    return summarize_tracker_element(data, *summary_vec, rename_map);
 
 }
 
@@ -531,6 +531,9 @@ public:
     using tracker_element_core_scalar<std::string>::less_than;
     inline bool less_than(const tracker_element_string& rhs) const;
 
+    // Natural ("alphanum") ordering used when sorting string fields
+    static bool natural_less(const std::string& lhs, const std::string& rhs);
+
     size_t length() {
         return value.length();
     }
@@ -1305,7 +1308,7 @@ public:
         auto v = map.find(id);
 
         if (v == map.end())
-            return NULL;
+            return materialize_sub(id);
 
         return v->second;
     }
@@ -1315,11 +1318,25 @@ public:
         auto v = map.find(id);
 
         if (v == map.end())
-            return NULL;
+            return std::static_pointer_cast<T>(materialize_sub(id));
 
         return std::static_pointer_cast<T>(v->second);
     }
 
+    // Build a field which is not held in the map; components which keep some of their
+    // fields in flat storage return a detached copy of the current value here
+    virtual shared_tracker_element materialize_sub(int id) {
+        return nullptr;
+    }
+
+    // Fields held outside of the map are serialized from here, after the map contents,
+    // without modifying the map; fn is called with a detached copy of each field
+    virtual size_t num_flat_fields() const {
+        return 0;
+    }
+
+    virtual void for_each_flat_field(const std::function<void (const shared_tracker_element&)>& fn) const { }
+
     std::pair<iterator, bool> insert(shared_tracker_element e) {
         if (e == NULL) 
             throw std::runtime_error("Attempted to insert null tracker_element with no ID");
@@ -1378,6 +1395,17 @@ public:
     }
 };
 
+// Call fn with every field of a map, including fields kept outside of the map storage
+template<typename F>
+void for_each_map_field(const std::shared_ptr<tracker_element_map>& m, F fn) {
+    for (const auto& i : *m)
+        fn(i);
+
+    m->for_each_flat_field([&fn](const shared_tracker_element& e) {
+            fn(tracker_element_map::map_t::value_type{e->get_id(), e});
+            });
+}
+
 // int::element
 using tracker_element_int_map = tracker_element_core_map<std::unordered_map<int, std::shared_ptr<tracker_element>>, int, std::shared_ptr<tracker_element>, tracker_type::tracker_int_map>;
 
@@ -1734,31 +1762,60 @@ public:
     // copy constructor
     tracker_element_summary(const SharedElementSummary& in_c);
 
-    shared_tracker_element parent_element;
     std::vector<int> resolved_path;
     std::string rename;
 
+    // Filled in when compiled into a summary plan:  the rename pre-escaped as JSON keys,
+    // and the placeholder used when the path is missing from a record
+    std::string json_rename;
+    std::string ek_json_rename;
+    int placeholder_id = -1;
+    std::string placeholder_name;
+
 protected:
     void parse_path(const std::vector<std::string>& in_path, const std::string& in_rename);
 };
 
+// Compiled, immutable list of summaries for a request field list; see
+// entry_tracker::get_summary_plan
+using summary_plan = std::shared_ptr<const std::vector<SharedElementSummary>>;
+
 // Generic serializer class to allow easy swapping of serializers
 class tracker_element_serializer {
 public:
     tracker_element_serializer() { }
 
-    using rename_map = std::map<shared_tracker_element, SharedElementSummary>;
+    // Summarized fields which are renamed or extracted from a path refer to the
+    // summary they came from, which is shared and never modified, and to the record
+    // they were extracted from so the path can be pre-serialized
+    struct rename_entry {
+        SharedElementSummary summary;
+        shared_tracker_element parent;
+    };
+
+    using rename_map = std::map<shared_tracker_element, rename_entry>;
 
     virtual ~tracker_element_serializer() { }
 
     virtual int serialize(shared_tracker_element in_elem, 
             std::ostream &stream, std::shared_ptr<rename_map> name_map) = 0;
 
+    // Binary output has to be sent as binary websocket messages
+    virtual bool is_binary() const {
+        return false;
+    }
+
+    // Serializers which keep state over a stream of messages, such as a websocket, return
+    // a new instance for each stream; stateless serializers return nullptr and are shared
+    virtual std::shared_ptr<tracker_element_serializer> new_stream() {
+        return nullptr;
+    }
+
     // Fields extracted from a summary path need to preserialize their parent
     // paths or updates may not happen in the expected fashion, serializers should
     // call this when necessary
-    static void pre_serialize_path(const SharedElementSummary& in_summary);
-    static void post_serialize_path(const SharedElementSummary& in_summary);
+    static void pre_serialize_path(const rename_entry& in_rename);
+    static void post_serialize_path(const rename_entry& in_rename);
 protected:
     kis_mutex mutex;
 };
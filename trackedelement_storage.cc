@@ -0,0 +1,965 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <string.h>
+
+#include <unordered_map>
+
+#include "trackedelement_storage.h"
+#include "trackedcomponent.h"
+#include "entrytracker.h"
+#include "globalregistry.h"
+
+namespace {
+    // Null children, and elements which can't be stored (placeholders, empty aliases)
+    const uint8_t storage_null_type = 0xFF;
+
+    void put_varint(std::string& out, uint64_t v) {
+        while (v >= 0x80) {
+            out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+            v >>= 7;
+        }
+
+        out.push_back(static_cast<char>(v));
+    }
+
+    void put_svarint(std::string& out, int64_t v) {
+        put_varint(out, (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+    }
+
+    template<typename T>
+    void put_raw(std::string& out, T v) {
+        out.append(reinterpret_cast<const char *>(&v), sizeof(T));
+    }
+
+    void put_string(std::string& out, const std::string& s) {
+        put_varint(out, s.length());
+        out.append(s);
+    }
+
+    void put_mac(std::string& out, const mac_addr& m) {
+        put_varint(out, m.longmac);
+        out.push_back(static_cast<char>(m.maskbits));
+        out.push_back(static_cast<char>((m.state.len & 0x7) | (m.state.error ? 0x80 : 0)));
+    }
+
+    class storage_reader {
+    public:
+        storage_reader(const std::string& in_data, size_t& in_pos) :
+            data{in_data},
+            pos{in_pos} {
+            if (pos > data.length())
+                throw std::runtime_error("binary tracked element offset past end of data");
+        }
+
+        uint8_t get_byte() {
+            need(1);
+            return static_cast<uint8_t>(data[pos++]);
+        }
+
+        uint64_t get_varint() {
+            uint64_t v = 0;
+
+            for (unsigned int shift = 0; shift < 64; shift += 7) {
+                auto b = get_byte();
+
+                v |= static_cast<uint64_t>(b & 0x7F) << shift;
+
+                if ((b & 0x80) == 0)
+                    return v;
+            }
+
+            throw std::runtime_error("invalid varint in binary tracked element");
+        }
+
+        int64_t get_svarint() {
+            auto v = get_varint();
+            return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+        }
+
+        template<typename T>
+        T get_raw() {
+            T v;
+            need(sizeof(T));
+            memcpy(&v, data.data() + pos, sizeof(T));
+            pos += sizeof(T);
+            return v;
+        }
+
+        std::string get_string() {
+            auto len = get_varint();
+            need(len);
+            auto s = data.substr(pos, len);
+            pos += len;
+            return s;
+        }
+
+        mac_addr get_mac() {
+            mac_addr m;
+            m.longmac = get_varint();
+            m.maskbits = get_byte();
+            auto st = get_byte();
+            m.state.len = st & 0x7;
+            m.state.error = (st & 0x80) != 0;
+            return m;
+        }
+
+    protected:
+        void need(uint64_t n) {
+            if (n > data.length() - pos)
+                throw std::runtime_error("truncated binary tracked element");
+        }
+
+        const std::string& data;
+        size_t& pos;
+    };
+
+    // Bracket writing an element with its serialization hooks, even if writing throws
+    class storage_serialize_scope {
+    public:
+        storage_serialize_scope(const shared_tracker_element& in_e) :
+            e{in_e} {
+            e->pre_serialize();
+        }
+
+        ~storage_serialize_scope() {
+            e->post_serialize();
+        }
+
+    protected:
+        const shared_tracker_element& e;
+    };
+
+    // Elements written so far in a record, by position, and the targets of the aliases
+    // in it.  Aliases are written as an index into the alias table at the end of the
+    // record, which refers back to the target's position, or holds a copy of targets
+    // from outside the record.
+    struct storage_write_state {
+        uint64_t num_elements = 0;
+        std::unordered_map<const tracker_element *, uint64_t> positions;
+        std::vector<shared_tracker_element> alias_targets;
+    };
+
+    void write_element(std::string& out, const shared_tracker_element& e, storage_write_state& st);
+
+    // Maps remember if they're presented as vectors, which is normally set up by whatever
+    // created them
+    template<typename M>
+    void put_map_flags(std::string& out, const std::shared_ptr<M>& m) {
+        out.push_back(static_cast<char>((m->as_vector() ? 0x01 : 0) | (m->as_key_vector() ? 0x02 : 0)));
+    }
+
+    template<typename M>
+    void set_map_flags(const std::shared_ptr<M>& m, uint8_t flags) {
+        m->set_as_vector(flags & 0x01);
+        m->set_as_key_vector(flags & 0x02);
+    }
+
+    template<typename M, typename KW>
+    void write_keyed_map(std::string& out, const shared_tracker_element& e, storage_write_state& st,
+            KW key_writer) {
+        auto m = std::static_pointer_cast<M>(e);
+
+        put_map_flags(out, m);
+        put_varint(out, m->size());
+
+        for (const auto& i : *m) {
+            key_writer(i.first);
+            write_element(out, i.second, st);
+        }
+    }
+
+    void write_element(std::string& out, const shared_tracker_element& e, storage_write_state& st) {
+        if (e == nullptr || e->get_type() == tracker_type::tracker_placeholder_missing) {
+            out.push_back(static_cast<char>(storage_null_type));
+            return;
+        }
+
+        if (e->get_type() == tracker_type::tracker_alias) {
+            auto target = std::static_pointer_cast<tracker_element_alias>(e)->get();
+
+            if (target == nullptr) {
+                out.push_back(static_cast<char>(storage_null_type));
+                return;
+            }
+
+            out.push_back(static_cast<char>(e->get_type()));
+            put_svarint(out, e->get_id());
+            st.positions.emplace(e.get(), st.num_elements++);
+
+            put_varint(out, st.alias_targets.size());
+            st.alias_targets.push_back(target);
+            return;
+        }
+
+        storage_serialize_scope scope(e);
+
+        out.push_back(static_cast<char>(e->get_type()));
+        put_svarint(out, e->get_id());
+        st.positions.emplace(e.get(), st.num_elements++);
+
+        switch (e->get_type()) {
+            case tracker_type::tracker_string:
+            case tracker_type::tracker_byte_array:
+                put_string(out, std::static_pointer_cast<tracker_element_string>(e)->get());
+                break;
+            case tracker_type::tracker_int8:
+                put_svarint(out, std::static_pointer_cast<tracker_element_int8>(e)->get());
+                break;
+            case tracker_type::tracker_uint8:
+                put_varint(out, std::static_pointer_cast<tracker_element_uint8>(e)->get());
+                break;
+            case tracker_type::tracker_int16:
+                put_svarint(out, std::static_pointer_cast<tracker_element_int16>(e)->get());
+                break;
+            case tracker_type::tracker_uint16:
+                put_varint(out, std::static_pointer_cast<tracker_element_uint16>(e)->get());
+                break;
+            case tracker_type::tracker_int32:
+                put_svarint(out, std::static_pointer_cast<tracker_element_int32>(e)->get());
+                break;
+            case tracker_type::tracker_uint32:
+                put_varint(out, std::static_pointer_cast<tracker_element_uint32>(e)->get());
+                break;
+            case tracker_type::tracker_int64:
+                put_svarint(out, std::static_pointer_cast<tracker_element_int64>(e)->get());
+                break;
+            case tracker_type::tracker_uint64:
+                put_varint(out, std::static_pointer_cast<tracker_element_uint64>(e)->get());
+                break;
+            case tracker_type::tracker_float:
+                put_raw<float>(out, std::static_pointer_cast<tracker_element_float>(e)->get());
+                break;
+            case tracker_type::tracker_double:
+                put_raw<double>(out, std::static_pointer_cast<tracker_element_double>(e)->get());
+                break;
+            case tracker_type::tracker_mac_addr:
+                put_mac(out, std::static_pointer_cast<tracker_element_mac_addr>(e)->get());
+                break;
+            case tracker_type::tracker_uuid:
+                put_string(out, std::static_pointer_cast<tracker_element_uuid>(e)->get().uuid_to_string());
+                break;
+            case tracker_type::tracker_key:
+                put_string(out, std::static_pointer_cast<tracker_element_device_key>(e)->get().as_string());
+                break;
+            case tracker_type::tracker_ipv4_addr:
+                put_varint(out, std::static_pointer_cast<tracker_element_ipv4_addr>(e)->get());
+                break;
+            case tracker_type::tracker_map:
+                {
+                    auto m = std::static_pointer_cast<tracker_element_map>(e);
+
+                    put_map_flags(out, m);
+                    put_varint(out, m->size() + m->num_flat_fields());
+
+                    for_each_map_field(m, [&](const tracker_element_map::map_t::value_type& i) {
+                            write_element(out, i.second, st);
+                            });
+                }
+                break;
+            case tracker_type::tracker_int_map:
+                write_keyed_map<tracker_element_int_map>(out, e, st,
+                        [&out](int k) { put_svarint(out, k); });
+                break;
+            case tracker_type::tracker_hashkey_map:
+                write_keyed_map<tracker_element_hashkey_map>(out, e, st,
+                        [&out](size_t k) { put_varint(out, k); });
+                break;
+            case tracker_type::tracker_double_map:
+                write_keyed_map<tracker_element_double_map>(out, e, st,
+                        [&out](double k) { put_raw<double>(out, k); });
+                break;
+            case tracker_type::tracker_mac_map:
+                write_keyed_map<tracker_element_mac_map>(out, e, st,
+                        [&out](const mac_addr& k) { put_mac(out, k); });
+                break;
+            case tracker_type::tracker_string_map:
+                write_keyed_map<tracker_element_string_map>(out, e, st,
+                        [&out](const std::string& k) { put_string(out, k); });
+                break;
+            case tracker_type::tracker_key_map:
+                write_keyed_map<tracker_element_device_key_map>(out, e, st,
+                        [&out](const device_key& k) { put_string(out, k.as_string()); });
+                break;
+            case tracker_type::tracker_uuid_map:
+                write_keyed_map<tracker_element_uuid_map>(out, e, st,
+                        [&out](const uuid& k) { put_string(out, k.uuid_to_string()); });
+                break;
+            case tracker_type::tracker_double_map_double:
+                {
+                    auto m = std::static_pointer_cast<tracker_element_double_map_double>(e);
+
+                    put_map_flags(out, m);
+                    put_varint(out, m->size());
+
+                    for (const auto& i : *m) {
+                        put_raw<double>(out, i.first);
+                        put_raw<double>(out, i.second);
+                    }
+                }
+                break;
+            case tracker_type::tracker_vector:
+                {
+                    auto v = std::static_pointer_cast<tracker_element_vector>(e);
+
+                    put_varint(out, v->size());
+
+                    for (const auto& i : *v)
+                        write_element(out, i, st);
+                }
+                break;
+            case tracker_type::tracker_vector_double:
+                {
+                    auto v = std::static_pointer_cast<tracker_element_vector_double>(e);
+
+                    put_varint(out, v->size());
+
+                    for (const auto& i : *v)
+                        put_raw<double>(out, i);
+                }
+                break;
+            case tracker_type::tracker_vector_string:
+                {
+                    auto v = std::static_pointer_cast<tracker_element_vector_string>(e);
+
+                    put_varint(out, v->size());
+
+                    for (const auto& i : *v)
+                        put_string(out, i);
+                }
+                break;
+            case tracker_type::tracker_pair_double:
+                {
+                    auto p = std::static_pointer_cast<tracker_element_pair_double>(e);
+                    put_raw<double>(out, p->get().first);
+                    put_raw<double>(out, p->get().second);
+                }
+                break;
+            case tracker_type::tracker_alias:
+            case tracker_type::tracker_placeholder_missing:
+                break;
+        }
+    }
+
+    // Alias table entries
+    const uint8_t storage_alias_end = 0;
+    const uint8_t storage_alias_ref = 1;
+    const uint8_t storage_alias_copy = 2;
+
+    // Write a complete record; the alias table follows the element, once the position of
+    // every element it may refer to is known
+    void write_record(std::string& out, const shared_tracker_element& e) {
+        storage_write_state st;
+
+        write_element(out, e, st);
+
+        // Copies of outside targets can hold aliases of their own, growing the table
+        for (size_t i = 0; i < st.alias_targets.size(); i++) {
+            auto target = st.alias_targets[i];
+            auto pi = st.positions.find(target.get());
+
+            if (pi != st.positions.end()) {
+                out.push_back(static_cast<char>(storage_alias_ref));
+                put_varint(out, pi->second);
+            } else {
+                out.push_back(static_cast<char>(storage_alias_copy));
+                write_element(out, target, st);
+            }
+        }
+
+        out.push_back(static_cast<char>(storage_alias_end));
+    }
+
+    // Build a plain element of a stored type, for fields without a builder of that type
+    shared_tracker_element make_storage_element(tracker_type t, int id) {
+        switch (t) {
+            case tracker_type::tracker_string:
+                return std::make_shared<tracker_element_string>(id);
+            case tracker_type::tracker_byte_array:
+                return std::make_shared<tracker_element_byte_array>(id);
+            case tracker_type::tracker_int8:
+                return std::make_shared<tracker_element_int8>(id);
+            case tracker_type::tracker_uint8:
+                return std::make_shared<tracker_element_uint8>(id);
+            case tracker_type::tracker_int16:
+                return std::make_shared<tracker_element_int16>(id);
+            case tracker_type::tracker_uint16:
+                return std::make_shared<tracker_element_uint16>(id);
+            case tracker_type::tracker_int32:
+                return std::make_shared<tracker_element_int32>(id);
+            case tracker_type::tracker_uint32:
+                return std::make_shared<tracker_element_uint32>(id);
+            case tracker_type::tracker_int64:
+                return std::make_shared<tracker_element_int64>(id);
+            case tracker_type::tracker_uint64:
+                return std::make_shared<tracker_element_uint64>(id);
+            case tracker_type::tracker_float:
+                return std::make_shared<tracker_element_float>(id);
+            case tracker_type::tracker_double:
+                return std::make_shared<tracker_element_double>(id);
+            case tracker_type::tracker_mac_addr:
+                return std::make_shared<tracker_element_mac_addr>(id);
+            case tracker_type::tracker_uuid:
+                return std::make_shared<tracker_element_uuid>(id);
+            case tracker_type::tracker_key:
+                return std::make_shared<tracker_element_device_key>(id);
+            case tracker_type::tracker_ipv4_addr:
+                return std::make_shared<tracker_element_ipv4_addr>(id);
+            case tracker_type::tracker_map:
+                return std::make_shared<tracker_element_map>(id);
+            case tracker_type::tracker_int_map:
+                return std::make_shared<tracker_element_int_map>(id);
+            case tracker_type::tracker_hashkey_map:
+                return std::make_shared<tracker_element_hashkey_map>(id);
+            case tracker_type::tracker_double_map:
+                return std::make_shared<tracker_element_double_map>(id);
+            case tracker_type::tracker_mac_map:
+                return std::make_shared<tracker_element_mac_map>(id);
+            case tracker_type::tracker_string_map:
+                return std::make_shared<tracker_element_string_map>(id);
+            case tracker_type::tracker_key_map:
+                return std::make_shared<tracker_element_device_key_map>(id);
+            case tracker_type::tracker_uuid_map:
+                return std::make_shared<tracker_element_uuid_map>(id);
+            case tracker_type::tracker_double_map_double:
+                return std::make_shared<tracker_element_double_map_double>(id);
+            case tracker_type::tracker_vector:
+                return std::make_shared<tracker_element_vector>(id);
+            case tracker_type::tracker_vector_double:
+                return std::make_shared<tracker_element_vector_double>(id);
+            case tracker_type::tracker_vector_string:
+                return std::make_shared<tracker_element_vector_string>(id);
+            case tracker_type::tracker_pair_double:
+                return std::make_shared<tracker_element_pair_double>(id);
+            case tracker_type::tracker_alias:
+                return std::make_shared<tracker_element_alias>(id);
+            case tracker_type::tracker_placeholder_missing:
+                break;
+        }
+
+        throw std::runtime_error(fmt::format("unexpected type {} in binary tracked element",
+                    static_cast<int>(t)));
+    }
+
+    // Elements read so far in a record, by position, and the aliases waiting to be bound
+    // to them once the alias table has been read
+    struct storage_read_state {
+        storage_read_state(const std::vector<int> *in_id_map) :
+            id_map{in_id_map} { }
+
+        const std::vector<int> *id_map;
+        std::vector<shared_tracker_element> elements;
+        std::vector<std::pair<std::shared_ptr<tracker_element_alias>, uint64_t>> aliases;
+    };
+
+    // Read the type and id of the next element.  Returns false for a null element;
+    // in_use is false when the field no longer exists and the element should be
+    // read and discarded.  position is the element's slot in st.elements, which the
+    // caller fills in with the element it reads into.
+    bool read_header(storage_reader& r, storage_read_state& st,
+            tracker_type& t, int& id, bool& in_use, size_t& position) {
+        auto tb = r.get_byte();
+
+        if (tb == storage_null_type)
+            return false;
+
+        if (tb > static_cast<uint8_t>(tracker_type::tracker_uuid_map))
+            throw std::runtime_error(fmt::format("unknown type {} in binary tracked element", tb));
+
+        t = static_cast<tracker_type>(tb);
+        id = static_cast<int>(r.get_svarint());
+        in_use = true;
+
+        if (st.id_map != nullptr && id >= 0) {
+            if (static_cast<size_t>(id) < st.id_map->size())
+                id = (*st.id_map)[id];
+            else
+                id = -1;
+
+            in_use = id >= 0;
+        }
+
+        position = st.elements.size();
+        st.elements.push_back(nullptr);
+
+        return true;
+    }
+
+    // Build the element for a field from its builder, so that components are restored as
+    // their own classes.  Returns nullptr if the field has changed type since it was stored.
+    shared_tracker_element build_storage_element(tracker_type t, int id) {
+        if (id >= 0) {
+            auto e = Globalreg::globalreg->entrytracker->get_shared_instance(id);
+
+            if (e != nullptr) {
+                if (e->get_type() != t)
+                    return nullptr;
+
+                return e;
+            }
+        }
+
+        return make_storage_element(t, id);
+    }
+
+    void read_payload(storage_reader& r, const shared_tracker_element& e,
+            storage_read_state& st);
+
+    // Read an element, returning nullptr if it was stored as null or has been dropped;
+    // stored_null tells the two apart for containers which hold null values
+    shared_tracker_element read_element(storage_reader& r, storage_read_state& st,
+            bool *stored_null = nullptr) {
+        tracker_type t;
+        int id;
+        bool in_use;
+        size_t position;
+
+        if (stored_null != nullptr)
+            *stored_null = false;
+
+        if (!read_header(r, st, t, id, in_use, position)) {
+            if (stored_null != nullptr)
+                *stored_null = true;
+            return nullptr;
+        }
+
+        auto e = in_use ? build_storage_element(t, id) : nullptr;
+
+        if (e == nullptr) {
+            read_payload(r, make_storage_element(t, -1), st);
+            return nullptr;
+        }
+
+        st.elements[position] = e;
+        read_payload(r, e, st);
+        return e;
+    }
+
+    template<typename M, typename KR>
+    void read_keyed_map(storage_reader& r, const shared_tracker_element& e,
+            storage_read_state& st, KR key_reader) {
+        auto m = std::static_pointer_cast<M>(e);
+
+        m->clear();
+        set_map_flags(m, r.get_byte());
+
+        auto n = r.get_varint();
+
+        for (uint64_t i = 0; i < n; i++) {
+            bool stored_null;
+
+            auto k = key_reader();
+            auto c = read_element(r, st, &stored_null);
+
+            // Some maps are only a set of keys and hold null values
+            if (c != nullptr || stored_null)
+                m->replace(k, c);
+        }
+    }
+
+    void read_payload(storage_reader& r, const shared_tracker_element& e,
+            storage_read_state& st) {
+        switch (e->get_type()) {
+            case tracker_type::tracker_string:
+            case tracker_type::tracker_byte_array:
+                std::static_pointer_cast<tracker_element_string>(e)->set(r.get_string());
+                break;
+            case tracker_type::tracker_int8:
+                std::static_pointer_cast<tracker_element_int8>(e)->set(r.get_svarint());
+                break;
+            case tracker_type::tracker_uint8:
+                std::static_pointer_cast<tracker_element_uint8>(e)->set(r.get_varint());
+                break;
+            case tracker_type::tracker_int16:
+                std::static_pointer_cast<tracker_element_int16>(e)->set(r.get_svarint());
+                break;
+            case tracker_type::tracker_uint16:
+                std::static_pointer_cast<tracker_element_uint16>(e)->set(r.get_varint());
+                break;
+            case tracker_type::tracker_int32:
+                std::static_pointer_cast<tracker_element_int32>(e)->set(r.get_svarint());
+                break;
+            case tracker_type::tracker_uint32:
+                std::static_pointer_cast<tracker_element_uint32>(e)->set(r.get_varint());
+                break;
+            case tracker_type::tracker_int64:
+                std::static_pointer_cast<tracker_element_int64>(e)->set(r.get_svarint());
+                break;
+            case tracker_type::tracker_uint64:
+                std::static_pointer_cast<tracker_element_uint64>(e)->set(r.get_varint());
+                break;
+            case tracker_type::tracker_float:
+                std::static_pointer_cast<tracker_element_float>(e)->set(r.get_raw<float>());
+                break;
+            case tracker_type::tracker_double:
+                std::static_pointer_cast<tracker_element_double>(e)->set(r.get_raw<double>());
+                break;
+            case tracker_type::tracker_mac_addr:
+                std::static_pointer_cast<tracker_element_mac_addr>(e)->set(r.get_mac());
+                break;
+            case tracker_type::tracker_uuid:
+                std::static_pointer_cast<tracker_element_uuid>(e)->set(uuid(r.get_string()));
+                break;
+            case tracker_type::tracker_key:
+                std::static_pointer_cast<tracker_element_device_key>(e)->set(device_key(r.get_string()));
+                break;
+            case tracker_type::tracker_ipv4_addr:
+                std::static_pointer_cast<tracker_element_ipv4_addr>(e)->set(r.get_varint());
+                break;
+            case tracker_type::tracker_map:
+                {
+                    auto m = std::static_pointer_cast<tracker_element_map>(e);
+                    auto comp = dynamic_cast<tracker_component *>(e.get());
+
+                    set_map_flags(m, r.get_byte());
+
+                    auto n = r.get_varint();
+
+                    for (uint64_t i = 0; i < n; i++) {
+                        tracker_type ct;
+                        int cid;
+                        bool in_use;
+                        size_t position;
+
+                        if (!read_header(r, st, ct, cid, in_use, position))
+                            continue;
+
+                        if (!in_use) {
+                            read_payload(r, make_storage_element(ct, -1), st);
+                            continue;
+                        }
+
+                        // Fields the record was built with are loaded in place, so that
+                        // component members keep pointing at them
+                        auto ci = m->find(cid);
+
+                        if (ci != m->end() && ci->second != nullptr) {
+                            if (ci->second->get_type() == ct) {
+                                st.elements[position] = ci->second;
+                                read_payload(r, ci->second, st);
+                            } else {
+                                read_payload(r, make_storage_element(ct, -1), st);
+                            }
+
+                            continue;
+                        }
+
+                        auto c = build_storage_element(ct, cid);
+
+                        if (c == nullptr) {
+                            read_payload(r, make_storage_element(ct, -1), st);
+                            continue;
+                        }
+
+                        st.elements[position] = c;
+                        read_payload(r, c, st);
+
+                        if (comp != nullptr)
+                            comp->restore_field(c);
+                        else
+                            m->insert(c);
+                    }
+                }
+                break;
+            case tracker_type::tracker_int_map:
+                read_keyed_map<tracker_element_int_map>(r, e, st,
+                        [&r]() { return static_cast<int>(r.get_svarint()); });
+                break;
+            case tracker_type::tracker_hashkey_map:
+                read_keyed_map<tracker_element_hashkey_map>(r, e, st,
+                        [&r]() { return static_cast<size_t>(r.get_varint()); });
+                break;
+            case tracker_type::tracker_double_map:
+                read_keyed_map<tracker_element_double_map>(r, e, st,
+                        [&r]() { return r.get_raw<double>(); });
+                break;
+            case tracker_type::tracker_mac_map:
+                read_keyed_map<tracker_element_mac_map>(r, e, st,
+                        [&r]() { return r.get_mac(); });
+                break;
+            case tracker_type::tracker_string_map:
+                read_keyed_map<tracker_element_string_map>(r, e, st,
+                        [&r]() { return r.get_string(); });
+                break;
+            case tracker_type::tracker_key_map:
+                read_keyed_map<tracker_element_device_key_map>(r, e, st,
+                        [&r]() { return device_key(r.get_string()); });
+                break;
+            case tracker_type::tracker_uuid_map:
+                read_keyed_map<tracker_element_uuid_map>(r, e, st,
+                        [&r]() { return uuid(r.get_string()); });
+                break;
+            case tracker_type::tracker_double_map_double:
+                {
+                    auto m = std::static_pointer_cast<tracker_element_double_map_double>(e);
+
+                    m->clear();
+                    set_map_flags(m, r.get_byte());
+
+                    auto n = r.get_varint();
+
+                    for (uint64_t i = 0; i < n; i++) {
+                        auto k = r.get_raw<double>();
+                        m->replace(k, r.get_raw<double>());
+                    }
+                }
+                break;
+            case tracker_type::tracker_vector:
+                {
+                    auto v = std::static_pointer_cast<tracker_element_vector>(e);
+
+                    v->clear();
+
+                    auto n = r.get_varint();
+
+                    for (uint64_t i = 0; i < n; i++) {
+                        bool stored_null;
+
+                        auto c = read_element(r, st, &stored_null);
+
+                        if (c != nullptr || stored_null)
+                            v->push_back(c);
+                    }
+                }
+                break;
+            case tracker_type::tracker_vector_double:
+                {
+                    auto v = std::static_pointer_cast<tracker_element_vector_double>(e);
+
+                    v->clear();
+
+                    auto n = r.get_varint();
+
+                    for (uint64_t i = 0; i < n; i++)
+                        v->push_back(r.get_raw<double>());
+                }
+                break;
+            case tracker_type::tracker_vector_string:
+                {
+                    auto v = std::static_pointer_cast<tracker_element_vector_string>(e);
+
+                    v->clear();
+
+                    auto n = r.get_varint();
+
+                    for (uint64_t i = 0; i < n; i++)
+                        v->push_back(r.get_string());
+                }
+                break;
+            case tracker_type::tracker_pair_double:
+                {
+                    auto first = r.get_raw<double>();
+                    auto second = r.get_raw<double>();
+                    std::static_pointer_cast<tracker_element_pair_double>(e)->set(first, second);
+                }
+                break;
+            case tracker_type::tracker_alias:
+                st.aliases.push_back(std::make_pair(std::static_pointer_cast<tracker_element_alias>(e),
+                            r.get_varint()));
+                break;
+            case tracker_type::tracker_placeholder_missing:
+                break;
+        }
+    }
+
+    // Read a complete record and bind its aliases
+    shared_tracker_element read_record(storage_reader& r, const std::vector<int> *id_map) {
+        storage_read_state st(id_map);
+
+        auto e = read_element(r, st);
+
+        // Targets which were dropped while reading leave their aliases empty
+        std::vector<shared_tracker_element> targets;
+
+        while (true) {
+            auto tag = r.get_byte();
+
+            if (tag == storage_alias_end) {
+                break;
+            } else if (tag == storage_alias_ref) {
+                auto position = r.get_varint();
+
+                if (position >= st.elements.size())
+                    throw std::runtime_error("invalid alias in binary tracked element");
+
+                targets.push_back(st.elements[position]);
+            } else if (tag == storage_alias_copy) {
+                targets.push_back(read_element(r, st));
+            } else {
+                throw std::runtime_error("invalid alias table in binary tracked element");
+            }
+        }
+
+        for (const auto& al : st.aliases) {
+            if (al.second < targets.size())
+                al.first->set(targets[al.second]);
+        }
+
+        return e;
+    }
+}
+
+void serialize_binary_tracker_element(std::string& out, const shared_tracker_element& e) {
+    write_record(out, e);
+}
+
+shared_tracker_element deserialize_binary_tracker_element(const std::string& in, size_t& pos,
+        const std::vector<int> *id_map) {
+    storage_reader r(in, pos);
+    return read_record(r, id_map);
+}
+
+namespace {
+    const char binary_snapshot_magic[] = "KISBSNAP";
+    const uint8_t binary_snapshot_version = 2;
+}
+
+bool binary_tracker_element_writer::write_header() {
+    buffer.append(binary_snapshot_magic, sizeof(binary_snapshot_magic) - 1);
+    buffer.push_back(static_cast<char>(binary_snapshot_version));
+
+    auto fields = Globalreg::globalreg->entrytracker->get_field_names();
+
+    put_varint(buffer, fields.size());
+
+    for (const auto& f : fields) {
+        put_varint(buffer, f.first);
+        put_string(buffer, f.second);
+    }
+
+    return flush();
+}
+
+void binary_tracker_element_writer::add(const shared_tracker_element& e) {
+    record.clear();
+    write_record(record, e);
+
+    put_varint(buffer, record.length());
+    buffer.append(record);
+}
+
+bool binary_tracker_element_writer::flush() {
+    if (buffer.length() == 0)
+        return true;
+
+    auto r = fwrite(buffer.data(), buffer.length(), 1, fp);
+    buffer.clear();
+
+    return r == 1;
+}
+
+bool binary_tracker_element_writer::finish() {
+    put_varint(buffer, 0);
+
+    if (!flush())
+        return false;
+
+    return fflush(fp) == 0;
+}
+
+bool binary_tracker_element_reader::read_varint(uint64_t& v) {
+    v = 0;
+
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        auto c = getc(fp);
+
+        if (c == EOF)
+            return false;
+
+        v |= static_cast<uint64_t>(c & 0x7F) << shift;
+
+        if ((c & 0x80) == 0)
+            return true;
+    }
+
+    throw std::runtime_error("invalid varint in binary tracked element file");
+}
+
+bool binary_tracker_element_reader::read_header() {
+    char magic[sizeof(binary_snapshot_magic)];
+
+    if (fread(magic, sizeof(binary_snapshot_magic), 1, fp) != 1)
+        return false;
+
+    if (memcmp(magic, binary_snapshot_magic, sizeof(binary_snapshot_magic) - 1) != 0 ||
+            static_cast<uint8_t>(magic[sizeof(binary_snapshot_magic) - 1]) != binary_snapshot_version)
+        return false;
+
+    uint64_t num_fields;
+
+    if (!read_varint(num_fields))
+        return false;
+
+    id_map.clear();
+
+    for (uint64_t i = 0; i < num_fields; i++) {
+        uint64_t id, len;
+
+        if (!read_varint(id) || !read_varint(len))
+            return false;
+
+        // Field ids are allocated densely from 0, anything else is garbage
+        if (id > num_fields * 2 || len > 4096)
+            return false;
+
+        record.resize(len);
+
+        if (len > 0 && fread(&record[0], len, 1, fp) != 1)
+            return false;
+
+        if (id >= id_map.size())
+            id_map.resize(id + 1, -1);
+
+        id_map[id] = Globalreg::globalreg->entrytracker->get_field_id(record);
+    }
+
+    return true;
+}
+
+bool binary_tracker_element_reader::next(shared_tracker_element& ret) {
+    uint64_t len;
+
+    ret.reset();
+
+    if (complete || !read_varint(len))
+        return false;
+
+    if (len == 0) {
+        complete = true;
+        return false;
+    }
+
+    if (len > (1 << 28))
+        throw std::runtime_error("oversized record in binary tracked element file");
+
+    record.resize(len);
+
+    if (fread(&record[0], len, 1, fp) != 1)
+        return false;
+
+    size_t pos = 0;
+    storage_reader r(record, pos);
+    ret = read_record(r, &id_map);
+
+    if (pos != record.length())
+        throw std::runtime_error("trailing data in binary tracked element record");
+
+    return true;
+}
@@ -0,0 +1,124 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __TRACKEDELEMENT_STORAGE_H__
+#define __TRACKEDELEMENT_STORAGE_H__
+
+#include "config.h"
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "trackedelement.h"
+
+// Compact binary storage of tracked element trees, used to move records (such as idle
+// devices) out of memory and back again.
+//
+// Elements are written as their type, field id, and value; containers are followed by
+// their contents.  Components are pre_serialize()'d while they're written, and flat
+// fields are written along with the map contents, so generated content and flat fields
+// are stored like any other field.
+//
+// Restoring builds each element from the entrytracker builder for its field id, so
+// components come back as their proper classes with all of their fields, and stored
+// values are loaded over them; dynamic and flat component fields are adopted through
+// tracker_component::restore_field().  Fields which are stored but no longer exist, or
+// which no longer match the stored type, are skipped.
+//
+// Aliases are stored as a reference to their target.  Targets inside the same record
+// are rebound to the restored element; targets outside of it (such as the datasource
+// UUID a seen-by record aliases) are stored with the record and restored as a copy.
+//
+// Field ids are only valid for the process which wrote them and numbers are stored in
+// host order.  Storage which outlives the process has to save the field names along with
+// the records and pass a map of stored id to current id when restoring, as the binary
+// record files below do.
+
+// Append the binary form of an element to out
+void serialize_binary_tracker_element(std::string& out, const shared_tracker_element& e);
+
+// Restore an element from the binary form at in[pos], advancing pos past it.  id_map, if
+// provided, maps stored field ids to current field ids, with -1 for fields which no longer
+// exist.  Throws std::runtime_error if the data is malformed.
+shared_tracker_element deserialize_binary_tracker_element(const std::string& in, size_t& pos,
+        const std::vector<int> *id_map = nullptr);
+
+// Streaming file of binary records which can be restored by a later process.  The file
+// starts with the name of every registered field, followed by length-prefixed records
+// and an empty record marking a complete file.
+class binary_tracker_element_writer {
+public:
+    binary_tracker_element_writer(FILE *in_fp) :
+        fp{in_fp} { }
+
+    // Write the file header and field name table
+    bool write_header();
+
+    // Append a record to the pending buffer; nothing is written until flush(), so records
+    // can be generated under a lock and written without it
+    void add(const shared_tracker_element& e);
+
+    // Write any pending records
+    bool flush();
+
+    // Flush, then mark the file complete
+    bool finish();
+
+    size_t pending() const {
+        return buffer.length();
+    }
+
+protected:
+    FILE *fp;
+    std::string buffer;
+    std::string record;
+};
+
+class binary_tracker_element_reader {
+public:
+    binary_tracker_element_reader(FILE *in_fp) :
+        fp{in_fp},
+        complete{false} { }
+
+    // Read the file header and map the stored field names to current field ids; returns
+    // false if this isn't a file we can read
+    bool read_header();
+
+    // Read the next record into ret; returns false after the last record.  Records whose
+    // field no longer exists are returned as nullptr.  Throws std::runtime_error if the
+    // file is damaged.
+    bool next(shared_tracker_element& ret);
+
+    // True once the end marker has been read; a file which ends without it was cut short
+    bool is_complete() const {
+        return complete;
+    }
+
+protected:
+    bool read_varint(uint64_t& v);
+
+    FILE *fp;
+    bool complete;
+    std::string record;
+    std::vector<int> id_map;
+};
+
+#endif
+
@@ -69,6 +69,7 @@
 #include <stdexcept>
 
 #include "packet.h"
+#include "kis_crc.h"
 
 #include <pthread.h>
 
@@ -752,28 +753,11 @@ unsigned int update_crc32_80211(unsigned int crc, const unsigned char *data,
 	return crc;
 }
 
-void crc32_init_table_80211(unsigned int *crc32_table) {
-	int i;
-	unsigned char c;
-
-	for (i = 0; i < 256; ++i) {
-		c = (unsigned char) i;
-		crc32_table[i] = update_crc32_80211(0, &c, 1, IEEE_802_3_CRC32_POLY);
-	}
-}
-
-unsigned int crc32_le_80211(unsigned int *crc32_table, const unsigned char *buf, 
-							int len) {
-	int i;
-	unsigned int crc = 0xFFFFFFFF;
-
-	for (i = 0; i < len; ++i) {
-		crc = (crc >> 8) ^ crc32_table[(crc ^ buf[i]) & 0xFF];
-	}
-
-	crc ^= 0xFFFFFFFF;
-
-	return crc;
+// Retained for existing callers; the table is no longer consulted and the
+// common crc engine is used instead
+unsigned int crc32_le_80211(unsigned int *crc32_table __attribute__((unused)), 
+							const unsigned char *buf, int len) {
+	return kis_crc::crc32_80211(buf, len);
 }
 
 void subtract_timeval(struct timeval *in_tv1, struct timeval *in_tv2,
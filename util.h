@@ -226,7 +226,6 @@ uint32_t adler32_incremental_checksum(const void *buf1, size_t len,
 #define IEEE_802_3_CRC32_POLY	0xEDB88320
 unsigned int update_crc32_80211(unsigned int crc, const unsigned char *data,
 								int len, unsigned int poly);
-void crc32_init_table_80211(unsigned int *crc32_table);
 unsigned int crc32_le_80211(unsigned int *crc32_table, const unsigned char *buf, 
 							int len);
 